@@ -0,0 +1,70 @@
+#ifndef ALLAN_DEVIATION_H
+#define ALLAN_DEVIATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ALLAN_MAX_LEVELS 48         // Octaves of tau0 tracked at most (2^47 samples)
+
+/**
+ * @brief One octave of the decimation cascade: the phase series taken every 2^k samples
+ * and the sums of consecutive blocks of 2^k samples.
+ */
+typedef struct {
+    __int128 block[2];              // Latest two block sums, newest first
+    __int128 held_block;            // Block of the even-indexed sample waiting for its partner
+    int64_t phase[2];               // Latest two decimated phases, newest first
+    int64_t held_phase;
+    uint64_t count;                 // Samples received at this octave
+    uint64_t terms;                 // Second differences in the sums
+    double phase_sum;               // Sum of squared second differences of phase
+    double block_sum;               // Sum of squared second differences of block sums
+} allan_level_t;
+
+/**
+ * @brief A phase sample kept back for the merge.
+ */
+typedef struct {
+    int64_t time_ns;
+    int64_t phase;
+} allan_sample_t;
+
+/**
+ * @brief Streaming stability accumulator of a phase (time error) series sampled at a
+ * roughly constant interval tau0. Each sample passes down a cascade of decimate-by-two
+ * stages, one per octave, so the whole ADEV/MDEV/TDEV curve at tau = 2^k * tau0 comes from
+ * one pass in memory logarithmic in the number of samples. Estimates are non-overlapping.
+ */
+typedef struct {
+    uint64_t samples;
+    int64_t first_ns;               // Times of the first and latest sample, for tau0
+    int64_t last_ns;
+    allan_level_t* levels;          // Octave k at index k, allocated as octaves fill
+    uint32_t level_count;
+    // Samples kept back in order instead of entering the cascade (only used with
+    // defer set): a later chunk's decimation phase depends on how many samples precede it
+    int defer;
+    allan_sample_t* series;
+    size_t series_count;
+    size_t series_capacity;
+} allan_accumulator_t;
+
+/**
+ * @brief Stability at one averaging time.
+ */
+typedef struct {
+    double tau_ns;
+    double adev;                    // Allan deviation (dimensionless)
+    double mdev;                    // Modified Allan deviation (dimensionless)
+    double tdev_ns;                 // Time deviation
+    uint64_t terms;                 // Second differences averaged
+} allan_point_t;
+
+/* Function Prototypes for the Stability Accumulator */
+void allan_init(allan_accumulator_t* accumulator, int defer);
+void allan_free(allan_accumulator_t* accumulator);
+int allan_add(allan_accumulator_t* accumulator, int64_t time_ns, int64_t phase);
+int allan_merge(allan_accumulator_t* dst, const allan_accumulator_t* src);
+int allan_point(const allan_accumulator_t* accumulator, uint32_t level, double phase_unit_ns, allan_point_t* point);
+
+#endif // ALLAN_DEVIATION_H
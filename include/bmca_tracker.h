@@ -0,0 +1,112 @@
+#ifndef BMCA_TRACKER_H
+#define BMCA_TRACKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hash_table.h"
+
+#define BMCA_DOMAIN_COUNT 256
+#define BMCA_ANNOUNCE_RECEIPT_TIMEOUT 3     // Announce intervals without an Announce before a foreign master is dropped
+#define BMCA_FOREIGN_MASTER_TIME_WINDOW 4   // Announce intervals in which two Announces qualify a foreign master
+
+/**
+ * @brief The fields of an Announce that the dataset comparison uses.
+ */
+typedef struct {
+    uint64_t grandmaster_id;
+    uint64_t sender_id;             // sourcePortIdentity of the Announce
+    uint16_t sender_port;
+    uint16_t steps_removed;
+    uint16_t offset_scaled_log_variance;
+    uint8_t priority1;
+    uint8_t clock_class;
+    uint8_t clock_accuracy;
+    uint8_t priority2;
+} bmca_dataset_t;
+
+/**
+ * @brief An Announce as recorded by the tracker.
+ */
+typedef struct {
+    int64_t capture_ns;
+    bmca_dataset_t dataset;
+    uint8_t domain;
+    int8_t log_interval;            // logMessageInterval of the Announce
+} bmca_announce_t;
+
+/**
+ * @brief A port that has sent Announces in a domain.
+ */
+typedef struct {
+    bmca_dataset_t dataset;         // From the latest Announce
+    int64_t last_announce_ns;
+    int64_t expires_ns;             // Announce receipt timeout
+    int64_t interval_ns;
+    uint64_t announces;
+    uint8_t domain;
+    uint8_t active;                 // Not timed out since its latest Announce
+    uint8_t qualified;              // Its latest two Announces fell within the foreign master time window
+} bmca_foreign_master_t;
+
+typedef enum {
+    BMCA_CHANGE_BETTER = 0,         // A better foreign master qualified or improved
+    BMCA_CHANGE_DEGRADED,           // The grandmaster's dataset got worse than another's
+    BMCA_CHANGE_TIMEOUT             // The grandmaster's Announces stopped
+} bmca_change_reason_t;
+
+/**
+ * @brief One change of a domain's elected grandmaster.
+ */
+typedef struct {
+    int64_t time_ns;                // Capture time of the Announce, or the timeout deadline
+    uint64_t previous_id;           // grandmasterIdentity before and after; 0 for none
+    uint64_t grandmaster_id;
+    uint8_t domain;
+    uint8_t reason;                 // bmca_change_reason_t
+} bmca_change_t;
+
+/**
+ * @brief Per-domain state of the election.
+ */
+typedef struct {
+    int64_t best;                   // Index of the elected foreign master, -1 for none
+    uint64_t grandmaster_id;
+    uint64_t changes;
+} bmca_domain_t;
+
+/**
+ * @brief Keeps the foreign-master table of every domain from Announces and elects each
+ * domain's grandmaster with the IEEE 1588 dataset comparison. An Announce only compares
+ * its sender with the current best; the domain is searched again only when the best
+ * degrades or times out. Timeouts follow capture time.
+ */
+typedef struct {
+    hash_table_t master_index;      // Mixed domain and sender port identity -> index into masters
+    bmca_foreign_master_t* masters;
+    size_t master_count;
+    size_t master_capacity;
+    bmca_domain_t domains[BMCA_DOMAIN_COUNT];
+    int64_t now_ns;                 // Latest capture time seen
+    int64_t next_expiry_ns;         // No active master expires before this
+    bmca_change_t* timeline;        // Grandmaster changes in order
+    size_t change_count;
+    size_t change_capacity;
+    // Keep Announces back for the merge instead of electing: set for chunk trackers,
+    // whose foreign-master tables continue the previous chunk's
+    int defer;
+    bmca_announce_t* pending;
+    size_t pending_count;
+    size_t pending_capacity;
+} bmca_tracker_t;
+
+/* Function Prototypes for the BMCA Tracker */
+int bmca_tracker_init(bmca_tracker_t* tracker);
+void bmca_tracker_free(bmca_tracker_t* tracker);
+int bmca_tracker_advance(bmca_tracker_t* tracker, int64_t capture_ns);
+int bmca_tracker_record(bmca_tracker_t* tracker, const bmca_announce_t* announce);
+int bmca_tracker_merge(bmca_tracker_t* dst, const bmca_tracker_t* src);
+int bmca_dataset_compare(const bmca_dataset_t* a, const bmca_dataset_t* b);
+const char* bmca_change_reason_name(bmca_change_reason_t reason);
+void bmca_tracker_print(const bmca_tracker_t* tracker);
+
+#endif // BMCA_TRACKER_H
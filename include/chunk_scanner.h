@@ -0,0 +1,24 @@
+#ifndef CHUNK_SCANNER_H
+#define CHUNK_SCANNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pcap.h"
+
+/*
+ * A mapped capture is split into byte ranges scanned by one thread each. Every range
+ * starts at the first record boundary found inside it, and the per-chunk clock, cycle and
+ * analyzer state is merged in range order, with gPTP cycles stitched across boundaries.
+ * Packets are numbered per chunk, so --chunks runs without per-packet output.
+ */
+#define CHUNK_SCANNER_MAX_CHUNKS 256        // Upper bound accepted for --chunks
+#define CHUNK_RESYNC_CHAIN_DEPTH 8          // Consecutive plausible records required to accept a boundary
+#define CHUNK_RESYNC_MAX_RECORD 262144      // Largest incl_len/orig_len considered plausible when snaplen is 0
+#define CHUNK_RESYNC_MAX_TS_SKEW 86400      // Largest timestamp jump (seconds) allowed inside a candidate chain
+
+/* Function Prototypes for the Chunk Scanner */
+int pcap_record_chain_plausible(const uint8_t* map, size_t map_size, size_t offset, const pcap_global_header_t* global_header, int swap_bytes, int depth);
+size_t pcap_find_record_boundary(const uint8_t* map, size_t map_size, size_t start, size_t limit, const pcap_global_header_t* global_header, int swap_bytes);
+int chunk_scan_file(const uint8_t* map, size_t map_size, const pcap_global_header_t* global_header, file_context_t* file_ctx, uint64_t* packet_count_out);
+
+#endif // CHUNK_SCANNER_H
@@ -20,13 +20,29 @@ typedef struct {
 
 typedef enum {
     ETHERTYPE_IPV4      = 0x0800, // IP Internet Protocol version 4 (IPv4)
+    ETHERTYPE_ARP       = 0x0806, // Address Resolution Protocol
     ETHERTYPE_VLAN      = 0x8100, // VLAN-tagged frame (IEEE 802.1Q)
     ETHERTYPE_IPV6      = 0x86DD,  // IP Internet Protocol version 6 (IPv6)
+    ETHERTYPE_LLDP      = 0x88CC, // Link Layer Discovery Protocol
     ETHERTYPE_PTP       = 0x88F7  // Precision Time Protocol
 } ethertype_t;
 
-void print_mac_address(const uint8_t* mac_address); //  6 byte array pointer
+#define FRAME_LAYER_ABSENT UINT32_MAX
+
+/* Offsets of the headers found in a frame, FRAME_LAYER_ABSENT when not present */
+typedef struct {
+    uint16_t ethertype;     // EtherType after any VLAN tag
+    uint32_t vlan;          // 802.1Q tag (TCI)
+    uint32_t ipv4;
+    uint32_t ipv6;
+    uint32_t udp;
+    uint32_t ptp;           // PTP common header, over Ethernet or UDP
+} frame_layers_t;
+
+void print_mac_address(output_t* out, const uint8_t* mac_address); //  6 byte array pointer
 void mac_address_to_string(char* buf, size_t buf_size, const uint8_t* mac_address);
 void process_ethernet_header(file_context_t* file_ctx, const unsigned char* packet_data, int data_length); 
+void locate_frame_layers(const uint8_t* frame, uint32_t length, frame_layers_t* layers);
+int frame_is_ptp(const uint8_t* frame, uint32_t length);
 
 #endif // ETHERNET_H
\ No newline at end of file
@@ -2,7 +2,10 @@
 #define GPTP_VALIDATOR_H
 
 #include <stdint.h>
-#include <time.h> 
+#include <stddef.h>
+#include "hash_table.h"
+#include "slab.h"
+#include "timing_wheel.h"
 
 // Enum to represent the state of a gPTP cycle
 typedef enum {
@@ -11,73 +14,148 @@ typedef enum {
     GPTP_CYCLE_STATE_FOLLOW_UP_RECEIVED,
     GPTP_CYCLE_STATE_PDELAY_REQ_RECEIVED,
     GPTP_CYCLE_STATE_PDELAY_RESP_RECEIVED,
+    GPTP_CYCLE_STATE_PDELAY_RESP_FOLLOW_UP_RECEIVED,
+    GPTP_CYCLE_STATE_DELAY_REQ_RECEIVED,
+    GPTP_CYCLE_STATE_DELAY_RESP_RECEIVED,
     GPTP_CYCLE_STATE_COMPLETE,
     GPTP_CYCLE_STATE_INVALID
 } gptp_cycle_state_t;
 
+// Endpoints recorded per cycle, indexing gptp_cycle_t.endpoints. Each destination follows its source.
+typedef enum {
+    GPTP_ENDPOINT_SYNC_SRC = 0,
+    GPTP_ENDPOINT_SYNC_DST,
+    GPTP_ENDPOINT_REQ_SRC,          // Sender of the Pdelay_Req or Delay_Req
+    GPTP_ENDPOINT_REQ_DST,
+    GPTP_ENDPOINT_RESP_SRC,         // Sender of the responses
+    GPTP_ENDPOINT_RESP_DST,
+    GPTP_ENDPOINT_COUNT
+} gptp_endpoint_role_t;
+
+// Message exchanges tracked as cycles
+typedef enum {
+    GPTP_CYCLE_SYNC = 0,    // Sync -> Follow_Up, keyed by the master's port
+    GPTP_CYCLE_PDELAY,      // Pdelay_Req -> Pdelay_Resp -> Pdelay_Resp_Follow_Up, keyed by the requester's port
+    GPTP_CYCLE_DELAY        // Delay_Req -> Delay_Resp (end-to-end), keyed by the requester's port
+} gptp_cycle_kind_t;
+
+/**
+ * @brief Identifies a cycle: the port identity its exchange is keyed by (see
+ * gptp_cycle_kind_t), its sequenceId and the exchange.
+ */
+typedef struct {
+    uint64_t clock_id;
+    uint16_t port_number;
+    uint16_t sequence_id;
+    uint8_t  kind;                  // gptp_cycle_kind_t
+} gptp_cycle_id_t;
+
+#define GPTP_CYCLE_MAX_MESSAGES 3   // Messages in the longest exchange
+
 /**
- * @brief Stores information about a gPTP cycle.
+ * @brief Stores information about a gPTP cycle, laid out as two cache lines.
+ * The first line holds everything the state machine reads or writes per message; the
+ * second holds the map bookkeeping. MAC addresses live in the map's endpoint table and
+ * are referenced by interned ID.
  */
 typedef struct gptp_cycle_s {
-    uint64_t master_id; 
-    uint64_t slave_id;  
-    uint16_t sequence_id; 
-
-    // Timestamps and correction fields for Sync message
-    uint64_t sync_ts_s;
-    uint32_t sync_ts_ns;
-    uint64_t sync_correction_field;
-    uint8_t  sync_mac_src[6];
-    uint8_t  sync_mac_dst[6];
-    
-    // Timestamps and correction fields for Follow_Up message
-    uint64_t follow_up_ts_s;
-    uint32_t follow_up_ts_ns;
-    uint64_t follow_up_correction_field;
-
-    // Timestamps and correction fields for Pdelay_Req message
-    uint64_t pdelay_req_ts_s;
-    uint32_t pdelay_req_ts_ns;
-    uint64_t pdelay_req_correction_field;
-    uint8_t  pdelay_req_mac_src[6];
-    uint8_t  pdelay_req_mac_dst[6];
-
-    // Timestamps and correction fields for Pdelay_Resp message
-    uint64_t pdelay_resp_ts_s;
-    uint32_t pdelay_resp_ts_ns;
-    uint64_t pdelay_resp_correction_field;
-    uint8_t  pdelay_resp_mac_src[6];
-    uint8_t  pdelay_resp_mac_dst[6];
-
-    gptp_cycle_state_t state; 
-    time_t last_update_time; 
-
-    struct gptp_cycle_s *next; // For linked list in hash map bucket
+    // Hot: capture times in nanoseconds since the epoch, by position of the message in its
+    // exchange (Sync, Follow_Up / Pdelay_Req, Pdelay_Resp, Pdelay_Resp_Follow_Up / Delay_Req, Delay_Resp)
+    int64_t  capture_ts_ns[GPTP_CYCLE_MAX_MESSAGES];
+    // Timestamps carried in the messages, in nanoseconds: preciseOriginTimestamp for Sync
+    // cycles; requestReceiptTimestamp and responseOriginTimestamp for Pdelay cycles;
+    // receiveTimestamp for Delay cycles
+    int64_t  message_ts_ns[2];
+    // Sum of the correctionFields of Sync and Follow_Up, or of Delay_Resp; for Pdelay cycles the
+    // Pdelay_Resp_Follow_Up's minus the Pdelay_Resp's, i.e. the correction to t3 - t2 (2^-16 ns)
+    int64_t  correction;
+    int64_t  last_update_ns;        // Capture time of the latest message recorded in this cycle
+    uint16_t sequence_id;
+    uint16_t port_number;           // Port number of the port identity the cycle is keyed by
+    uint16_t messages_seen;         // Bitmask of (1 << ptp_message_type_t) for every message recorded in this cycle
+    uint8_t  state;                 // gptp_cycle_state_t
+    uint8_t  kind;                  // gptp_cycle_kind_t
+
+    // Bookkeeping: clock identity of the key, expiry timer and endpoint IDs (0 when not seen)
+    uint64_t clock_id __attribute__((aligned(64)));
+    timer_node_t expiry;            // Fires when no message has completed the cycle within the map's timeout
+    uint32_t endpoints[GPTP_ENDPOINT_COUNT];
 } gptp_cycle_t;
 
 /**
- * @brief Entry in the gPTP cycle hash map.
+ * @brief Cold per-endpoint data, shared by every cycle the endpoint appears in.
  */
-typedef struct cycle_map_entry_s {
-    uint64_t key;               
-    gptp_cycle_t *cycle;        
-    struct cycle_map_entry_s *next;   
-} cycle_map_entry_t;
+typedef struct {
+    uint8_t mac[6];
+    uint16_t port_number;           // Port number of that message's sourcePortIdentity
+    uint64_t clock_id;              // Clock identity of the latest message sent from this MAC, 0 if none
+} gptp_endpoint_t;
+
+/**
+ * @brief Interns MAC addresses as dense endpoint IDs. ID 0 is reserved for "none".
+ */
+typedef struct {
+    hash_table_t index;             // MAC (as a 48-bit integer) -> endpoint ID
+    gptp_endpoint_t* endpoints;     // Indexed by endpoint ID
+    uint32_t count;
+    uint32_t capacity;
+} gptp_endpoint_table_t;
+
+#define CYCLE_SLAB_OBJECTS 1024 // Cycles carved from each slab
+#define GPTP_CYCLE_TIMEOUT_NS 1000000000LL // Capture time after the latest message before an incomplete cycle expires
+
+// Events reported while tracking gPTP cycles
+typedef enum {
+    GPTP_EVENT_TIMEOUT = 0,     // An incomplete cycle expired; it is removed once the callback returns
+    GPTP_EVENT_COMPLETE,        // Every message of the exchange arrived; the cycle is removed once the callback returns
+    GPTP_EVENT_OUT_OF_ORDER,    // A message arrived after one that follows it in the exchange; the cycle stays open
+    GPTP_EVENT_INVALID          // A message was repeated or came from a different responder; the cycle is removed
+} gptp_event_type_t;
+
+typedef void (*gptp_event_callback_t)(gptp_event_type_t event, const gptp_cycle_t *cycle, void *user);
 
 /**
- * @brief Hash map for tracking gPTP cycles.
+ * @brief Hash map for tracking gPTP cycles by gptp_cycle_id_t.
+ * The table is keyed by a 64-bit hash of the identity, and lookups compare the full identity.
+ * Values point to cycles owned by the map's slab allocator. Each map is only used by one
+ * thread at a time, so its slab doubles as that thread's free list of cycles.
+ * Every cycle is scheduled on a timing wheel driven by capture time and expires timeout_ns
+ * after its latest message, so memory stays bounded however many cycles are never completed.
  */
 typedef struct {
-    size_t size;                
-    cycle_map_entry_t **buckets; 
+    hash_table_t table;
+    slab_allocator_t cycles;
+    gptp_endpoint_table_t endpoints;
+    timing_wheel_t wheel;
+    int64_t timeout_ns;
+    uint64_t completed;     // Cycles removed on completion
+    uint64_t out_of_order;  // Out-of-order messages seen
+    uint64_t invalid;       // Cycles removed as invalid
+    uint64_t expired;       // Cycles removed by timeout
+    int64_t last_capture_ns; // Latest capture time the map was advanced to
+    // Keep cycles first seen within timeout_ns of the first advance instead of expiring them:
+    // set for chunk maps, whose cycles may continue a cycle from the previous chunk
+    int hold_boundary;
+    int64_t hold_until_ns;
 } gptp_cycle_map_t;
 
 /* Function Prototypes for gPTP Cycle Map */
 int gptp_cycle_map_init(gptp_cycle_map_t *map);
-uint64_t create_cycle_key(const uint8_t source_port_identity[10], uint16_t sequence_id, int swap_bytes);
-gptp_cycle_t* gptp_cycle_map_insert_or_get(gptp_cycle_map_t *map, uint64_t key);
-gptp_cycle_t* gptp_cycle_map_lookup(const gptp_cycle_map_t *map, uint64_t key);
-int gptp_cycle_map_remove(gptp_cycle_map_t *map, uint64_t key);
+gptp_cycle_id_t gptp_cycle_id(const uint8_t port_identity[10], uint16_t sequence_id, gptp_cycle_kind_t kind);
+gptp_cycle_t* gptp_cycle_map_insert_or_get(gptp_cycle_map_t *map, const gptp_cycle_id_t *id);
+gptp_cycle_t* gptp_cycle_map_lookup(const gptp_cycle_map_t *map, const gptp_cycle_id_t *id);
+int gptp_cycle_map_remove(gptp_cycle_map_t *map, const gptp_cycle_id_t *id);
+size_t gptp_cycle_map_size(const gptp_cycle_map_t *map);
+uint32_t gptp_cycle_map_intern_endpoint(gptp_cycle_map_t *map, const uint8_t mac[6]);
+const gptp_endpoint_t* gptp_cycle_map_endpoint(const gptp_cycle_map_t *map, uint32_t id);
+int64_t gptp_cycle_first_update(const gptp_cycle_t *cycle);
+void gptp_cycle_map_touch(gptp_cycle_map_t *map, gptp_cycle_t *cycle, int64_t capture_ts_ns);
+const char* gptp_event_type_name(gptp_event_type_t event);
+int gptp_cycle_map_record(gptp_cycle_map_t *map, uint8_t message_type, const uint8_t *cycle_port_identity, uint16_t sequence_id, int64_t capture_ts_ns, int64_t message_ts_ns,
+                          int64_t correction, const uint8_t *source_port_identity, const uint8_t *eth_src_mac, const uint8_t *eth_dst_mac, gptp_event_callback_t callback, void *user);
+void gptp_cycle_map_advance(gptp_cycle_map_t *map, int64_t capture_ts_ns, gptp_event_callback_t callback, void *user);
+int gptp_cycle_map_merge(gptp_cycle_map_t *dst, const gptp_cycle_map_t *src, gptp_event_callback_t callback, void *user);
 void gptp_cycle_map_free(gptp_cycle_map_t *map);
+void gptp_cycle_map_print(const gptp_cycle_map_t *map);
 
 #endif // GPTP_VALIDATOR_H
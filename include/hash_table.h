@@ -0,0 +1,67 @@
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HASH_TABLE_GROUP_SIZE 16        // Control bytes probed together (one SSE2 vector)
+#define HASH_TABLE_MIN_CAPACITY 64      // Smallest slot count allocated
+#define HASH_TABLE_MIGRATE_STEP 32      // Old slots moved to the new array per insert or remove while growing
+
+/**
+ * @brief A key/value slot. Values are opaque 64-bit words (integers or pointers).
+ */
+typedef struct {
+    uint64_t key;
+    uint64_t value;
+} hash_slot_t;
+
+/**
+ * @brief One open-addressing array: a control byte per slot (empty, deleted, or the low
+ * 7 bits of the key's hash) followed by the slots. Capacity is a power of two and a
+ * multiple of HASH_TABLE_GROUP_SIZE.
+ */
+typedef struct {
+    uint8_t* ctrl;
+    hash_slot_t* slots;
+    size_t capacity;
+    size_t size;            // Occupied slots
+    size_t growth_left;     // Inserts allowed before the array is over the maximum load
+} hash_array_t;
+
+/**
+ * @brief Resizable open-addressing hash table keyed by 64-bit integers. Keys are unique
+ * unless entries are added with hash_table_add() and found with a hash_key_match_t.
+ * Growing allocates a new array and moves the old entries over a few at a time on later
+ * inserts and removes, so no single insert pays for a full rehash. Lookups check both
+ * arrays while a migration is in progress.
+ */
+typedef struct {
+    hash_array_t current;
+    hash_array_t previous;  // Array being migrated from, capacity 0 when none
+    size_t migrate_pos;     // Next slot of previous to move
+} hash_table_t;
+
+/**
+ * @brief Full-key comparison for tables keyed by a hash of a longer key, such as a port
+ * identity and message type. Entries whose 64-bit keys are equal are told apart by
+ * calling equal with each entry's value; it returns nonzero for the entry looked for.
+ */
+typedef struct {
+    int (*equal)(const void* context, uint64_t value);
+    const void* context;
+} hash_key_match_t;
+
+/* Function Prototypes for the Hash Table */
+int hash_table_init(hash_table_t* table, size_t expected_size);
+void hash_table_free(hash_table_t* table);
+size_t hash_table_size(const hash_table_t* table);
+uint64_t* hash_table_find(const hash_table_t* table, uint64_t key);
+uint64_t* hash_table_insert(hash_table_t* table, uint64_t key, int* inserted);
+int hash_table_remove(hash_table_t* table, uint64_t key, uint64_t* value_out);
+uint64_t* hash_table_find_match(const hash_table_t* table, uint64_t key, const hash_key_match_t* match);
+uint64_t* hash_table_add(hash_table_t* table, uint64_t key, uint64_t value);
+int hash_table_remove_match(hash_table_t* table, uint64_t key, const hash_key_match_t* match, uint64_t* value_out);
+int hash_table_next(const hash_table_t* table, size_t* cursor, uint64_t* key_out, uint64_t* value_out);
+
+#endif // HASH_TABLE_H
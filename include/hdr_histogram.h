@@ -0,0 +1,38 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Log-linear buckets: magnitudes below 2^HDR_SUB_BUCKET_BITS are counted exactly, larger
+ * ones in buckets no wider than 1/2^(HDR_SUB_BUCKET_BITS - 1) of their value (under 1.6%),
+ * up to the full int64 range.
+ */
+#define HDR_SUB_BUCKET_BITS 7
+#define HDR_SUB_BUCKET_COUNT (1 << HDR_SUB_BUCKET_BITS)
+#define HDR_SUB_BUCKET_HALF (HDR_SUB_BUCKET_COUNT / 2)
+#define HDR_COUNTS_LENGTH ((64 - HDR_SUB_BUCKET_BITS + 2) * HDR_SUB_BUCKET_HALF)
+
+/**
+ * @brief Constant-memory histogram of signed 64-bit values. Percentiles report the middle
+ * of their bucket, so they are exact to half the bucket width; count, min and max are
+ * exact. Histograms merge by adding counts.
+ */
+typedef struct {
+    uint64_t total;
+    int64_t min;
+    int64_t max;
+    uint64_t* counts[2];    // By bucket of the magnitude: [0] values >= 0, [1] values < 0; allocated on first use
+} hdr_histogram_t;
+
+/* Function Prototypes for HDR Histograms */
+void hdr_histogram_init(hdr_histogram_t* histogram);
+void hdr_histogram_free(hdr_histogram_t* histogram);
+int hdr_histogram_record(hdr_histogram_t* histogram, int64_t value);
+int hdr_histogram_merge(hdr_histogram_t* dst, const hdr_histogram_t* src);
+int64_t hdr_histogram_percentile(const hdr_histogram_t* histogram, double percentile);
+int hdr_histogram_write(const hdr_histogram_t* histogram, FILE* file);
+int hdr_histogram_read(hdr_histogram_t* histogram, FILE* file);
+
+#endif // HDR_HISTOGRAM_H
@@ -0,0 +1,66 @@
+#ifndef HISTOGRAM_SET_H
+#define HISTOGRAM_SET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hash_table.h"
+#include "hdr_histogram.h"
+#include "ptp_offset.h"
+#include "pdelay_tracker.h"
+
+/*
+ * A histogram dump starts with the magic (u32), the version (u32) and the record count
+ * (u64), followed by that many records. All header fields are little-endian.
+ */
+#define HISTOGRAM_DUMP_MAGIC 0x54534850         // "PHST" as little-endian bytes
+#define HISTOGRAM_DUMP_VERSION 1
+
+// Quantities kept as histograms, all in scaled nanoseconds
+typedef enum {
+    HISTOGRAM_E2E_OFFSET = 0,   // offsetFromMaster per master (a) / slave (b) pair
+    HISTOGRAM_E2E_DELAY,        // meanPathDelay per master (a) / slave (b) pair
+    HISTOGRAM_SYNC_INTERVAL,    // Time between completed Syncs per master (a)
+    HISTOGRAM_LINK_DELAY,       // meanLinkDelay per requesting (a) / responding (b) port
+    HISTOGRAM_METRIC_COUNT
+} histogram_metric_t;
+
+/**
+ * @brief Identifies one histogram of a dump; followed by the hdr_histogram_write() encoding.
+ * Written in little-endian byte order as 24 bytes, reserved as zeros.
+ */
+typedef struct {
+    uint64_t id_a;              // Clock identities, as described by the metric; 0 if unused
+    uint64_t id_b;
+    uint16_t port_a;
+    uint16_t port_b;
+    uint8_t  metric;            // histogram_metric_t
+    uint8_t  reserved[3];
+} histogram_record_header_t;
+
+typedef struct {
+    histogram_record_header_t key;
+    hdr_histogram_t histogram;
+} histogram_entry_t;
+
+/**
+ * @brief Histograms of one or more runs, keyed by metric and clock identities, so results
+ * of separate runs can be combined.
+ */
+typedef struct {
+    hash_table_t index;             // Mixed key -> index into entries
+    histogram_entry_t* entries;     // In order of first appearance
+    size_t count;
+    size_t capacity;
+} histogram_set_t;
+
+/* Function Prototypes for Histogram Sets */
+int histogram_set_init(histogram_set_t* set);
+void histogram_set_free(histogram_set_t* set);
+hdr_histogram_t* histogram_set_get(histogram_set_t* set, const histogram_record_header_t* key);
+int histogram_set_collect(histogram_set_t* set, const ptp_offset_engine_t* offsets, const pdelay_tracker_t* links);
+int histogram_set_save(const histogram_set_t* set, const char* path);
+int histogram_set_load(histogram_set_t* set, const char* path);
+void histogram_set_print(const histogram_set_t* set);
+void histogram_print_percentiles(const char* label, const hdr_histogram_t* histogram);
+
+#endif // HISTOGRAM_SET_H
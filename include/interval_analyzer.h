@@ -0,0 +1,61 @@
+#ifndef INTERVAL_ANALYZER_H
+#define INTERVAL_ANALYZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hash_table.h"
+
+#define INTERVAL_TOLERANCE_PERCENT 30   // Intervals further than this from 2^logMessageInterval are out of tolerance
+#define INTERVAL_MAX_LOG 8              // logMessageInterval outside +-8 (0x7F: not applicable) is not checked
+
+/**
+ * @brief Interarrival statistics of one message type from one source port. Moments are
+ * kept as exact integer sums so that partial results of chunks merge without rounding.
+ */
+typedef struct {
+    uint64_t clock_id;
+    uint16_t port_number;
+    uint8_t message_type;
+    int8_t log_interval;            // logMessageInterval of the latest message
+    int8_t first_log_interval;      // logMessageInterval of the first message
+    uint8_t leading_closed;         // An interval that is not early has been seen
+    int64_t first_ns;               // Capture times of the first and latest message
+    int64_t last_ns;
+    uint64_t messages;
+    uint64_t intervals;             // Intervals checked against logMessageInterval
+    __int128 sum_ns;                // Sum and sum of squares of checked intervals
+    __int128 sum_squares;
+    int64_t min_ns;
+    int64_t max_ns;
+    uint64_t early;                 // Shorter than tolerance allows
+    uint64_t late;                  // Longer than tolerance allows
+    uint64_t bursts;                // Runs of consecutive early intervals
+    uint64_t longest_burst;         // Early intervals in the longest run
+    uint64_t run;                   // Early intervals in the run ending at the latest message
+    uint64_t leading_run;           // Early intervals before the first one that is not early
+} interval_source_t;
+
+/**
+ * @brief Checks the capture-time spacing of every (sourcePortIdentity, messageType) against
+ * the logMessageInterval its messages carry, in O(1) per message and constant memory per
+ * source.
+ */
+typedef struct {
+    hash_table_t source_index;      // Mixed port identity and message type -> index into sources
+    interval_source_t* sources;     // In order of first message
+    size_t source_count;
+    size_t source_capacity;
+} interval_analyzer_t;
+
+/* Function Prototypes for the Interval Analyzer */
+int interval_analyzer_init(interval_analyzer_t* analyzer);
+void interval_analyzer_free(interval_analyzer_t* analyzer);
+int interval_analyzer_record(interval_analyzer_t* analyzer, uint64_t clock_id, uint16_t port_number, uint8_t message_type,
+                             int8_t log_interval, int64_t capture_ns);
+int interval_analyzer_merge(interval_analyzer_t* dst, const interval_analyzer_t* src);
+int64_t interval_nominal_ns(int8_t log_interval);
+double interval_mean_ns(const interval_source_t* source);
+double interval_stddev_ns(const interval_source_t* source);
+void interval_analyzer_print(const interval_analyzer_t* analyzer);
+
+#endif // INTERVAL_ANALYZER_H
@@ -64,5 +64,6 @@ void process_udp_header(file_context_t* file_ctx, const uint8_t* packet_data, ui
 void parse_network_layer_header(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length, uint16_t ethertype, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac);
 void ipv4_to_string(uint32_t ip_raw, char* ip_str);
 void ipv6_to_string(const uint8_t* ip_raw, char* ip_str);
+void print_ipv6_address(output_t* out, const uint8_t* ip_raw);
 
 #endif // IP_H
\ No newline at end of file
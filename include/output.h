@@ -0,0 +1,44 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define OUTPUT_BUFFER_SIZE (1u << 16)       // Initial buffer of a writer; sink writers flush when it fills
+
+/* How much the tool prints */
+typedef enum {
+    OUTPUT_QUIET = 0,                       // File-level messages only
+    OUTPUT_SUMMARY,                         // File-level messages and summary statistics
+    OUTPUT_VERBOSE                          // Full per-packet decode (default)
+} output_verbosity_t;
+
+/**
+ * @brief Buffered text writer. Writers with a sink write the buffer out whenever it
+ * fills; writers without one keep everything in memory until the owner takes it.
+ */
+typedef struct output_s {
+    char* buffer;
+    size_t used;
+    size_t capacity;
+    FILE* sink;                             // Destination of flushes, or NULL to grow in memory
+    int failed;                             // A write or allocation failed; further output is dropped
+} output_t;
+
+/* Function Prototypes for the Output Writer */
+int output_init(output_t* out, FILE* sink, size_t capacity);
+int output_flush(output_t* out);
+void output_reset(output_t* out);
+void output_free(output_t* out);
+void output_write(output_t* out, const char* data, size_t length);
+void output_str(output_t* out, const char* text);
+void output_char(output_t* out, char c);
+void output_uint(output_t* out, uint64_t value);
+void output_int(output_t* out, int64_t value);
+void output_uint_padded(output_t* out, uint64_t value, int width);
+void output_hex(output_t* out, uint64_t value, int digits, int uppercase);
+void output_hex_bytes(output_t* out, const uint8_t* bytes, size_t count, char separator, int uppercase);
+void output_printf(output_t* out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif // OUTPUT_H
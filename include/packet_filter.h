@@ -0,0 +1,59 @@
+#ifndef PACKET_FILTER_H
+#define PACKET_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PACKET_FILTER_MAX_COMPARE 16    // Longest field a single instruction compares (an IPv6 address)
+
+/* Layer a compare instruction is relative to */
+typedef enum {
+    FILTER_BASE_FRAME = 0,              // Start of the Ethernet frame
+    FILTER_BASE_VLAN,                   // 802.1Q tag
+    FILTER_BASE_IPV4,
+    FILTER_BASE_IPV6,
+    FILTER_BASE_PTP,                    // PTP common header
+    FILTER_BASE_COUNT
+} filter_base_t;
+
+/* Filter instruction opcodes */
+typedef enum {
+    FILTER_OP_COMPARE = 0,              // Masked compare of length bytes at base + offset; jump jt if equal, jf otherwise
+    FILTER_OP_PRESENT,                  // Jump jt if the base layer is present, jf otherwise
+    FILTER_OP_RETURN                    // Stop with verdict value
+} filter_op_t;
+
+/**
+ * @brief One instruction of a compiled filter. Jumps are instruction indices and
+ * always point forward, so every program terminates.
+ */
+typedef struct {
+    uint8_t  op;
+    uint8_t  base;
+    uint8_t  length;
+    uint8_t  verdict;                   // FILTER_OP_RETURN: 1 accept, 0 reject
+    uint16_t offset;
+    uint16_t jt;
+    uint16_t jf;
+    uint8_t  value[PACKET_FILTER_MAX_COMPARE];
+    uint8_t  mask[PACKET_FILTER_MAX_COMPARE];
+} filter_insn_t;
+
+/**
+ * @brief A filter expression compiled to a straight-line decision program. Primitives
+ * match MAC and IPv4/IPv6 addresses, VLAN ID, PTP domain, message type and clockIdentity,
+ * and combine with and/or/not and parentheses (grammar in packet_filter.c).
+ */
+typedef struct packet_filter_s {
+    filter_insn_t* insns;
+    size_t count;
+    size_t capacity;
+    int needs_layers;                   // 0 if every compare is relative to the frame start
+} packet_filter_t;
+
+/* Function Prototypes for the Packet Filter */
+int packet_filter_compile(packet_filter_t* filter, const char* expression);
+int packet_filter_match(const packet_filter_t* filter, const uint8_t* frame, uint32_t length);
+void packet_filter_free(packet_filter_t* filter);
+
+#endif // PACKET_FILTER_H
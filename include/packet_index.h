@@ -0,0 +1,60 @@
+#ifndef PACKET_INDEX_H
+#define PACKET_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PACKET_INDEX_MAGIC 0x58444950          // "PIDX" in host byte order
+#define PACKET_INDEX_VERSION 2
+#define PACKET_INDEX_SUFFIX ".pidx"            // Appended to the capture path to name the sidecar file
+#define PACKET_INDEX_DEFAULT_STRIDE 1024       // Records between consecutive index entries
+#define PACKET_INDEX_NO_PTP_TYPE 0xFF          // ptp_message_type of entries that are not layer 2 PTP frames
+#define PACKET_INDEX_END_SLACK_NS 1000000000LL // Reading continues this far past --end to tolerate reordered captures
+
+/**
+ * @brief Header of a sidecar index file. The capture size and modification time
+ * identify the capture the index was built from; a mismatch marks the index stale.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t stride;
+    uint32_t reserved;
+    uint64_t capture_size;
+    int64_t  capture_mtime_ns;
+    uint64_t entry_count;
+} packet_index_header_t;
+
+/**
+ * @brief One sampled record of the capture.
+ */
+typedef struct {
+    int64_t  ts_ns;             // Capture time of the record
+    int64_t  prev_ts_ns;        // Capture time of the record before it, for the inter-packet delta
+    int64_t  max_prior_ts_ns;   // Latest capture time of any earlier record; non-decreasing, so it can be binary searched
+    uint64_t offset;            // File offset of the record header
+    uint64_t packet_number;     // 1-based position of the record in the file
+    uint16_t ethertype;         // EtherType after any VLAN tag
+    uint8_t  ptp_message_type;  // PTP messageType, or PACKET_INDEX_NO_PTP_TYPE
+    uint8_t  reserved[5];
+} packet_index_entry_t;
+
+/**
+ * @brief An index being built during a pass, or loaded from a sidecar file.
+ */
+typedef struct packet_index_s {
+    packet_index_header_t header;
+    packet_index_entry_t* entries;
+    size_t capacity;
+    int64_t max_ts_ns;          // Builder only: latest capture time seen so far
+} packet_index_t;
+
+/* Function Prototypes for the Packet Index */
+int packet_index_begin(packet_index_t* index, uint32_t stride, uint64_t capture_size, int64_t capture_mtime_ns);
+int packet_index_add(packet_index_t* index, uint64_t packet_number, int64_t ts_ns, int64_t prev_ts_ns, uint64_t offset, const uint8_t* data, uint32_t data_length);
+int packet_index_save(const packet_index_t* index, const char* index_path);
+int packet_index_load(packet_index_t* index, const char* index_path, uint64_t capture_size, int64_t capture_mtime_ns);
+const packet_index_entry_t* packet_index_seek(const packet_index_t* index, int64_t ts_ns);
+void packet_index_free(packet_index_t* index);
+
+#endif // PACKET_INDEX_H
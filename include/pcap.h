@@ -4,8 +4,17 @@
 
 /* Include Statements */
 #include <stdint.h>
+#include <stdio.h>
 #include "clock_map.h"      // Include clock_map.h
 #include "gptp_validator.h" // Include gptp_validator.h
+#include "ptp_offset.h"
+#include "pdelay_tracker.h"
+#include "sequence_tracker.h"
+#include "bmca_tracker.h"
+#include "interval_analyzer.h"
+#include "run_stats.h"
+#include "ptp_prefilter.h"
+#include "output.h"
 
 typedef struct pcap_global_header {
     uint32_t magic_number;   /* magic number to detect file format and byte ordering */
@@ -19,18 +28,119 @@ typedef struct pcap_global_header {
 
 typedef struct pcap_record_header {
     uint32_t ts_sec;         /* timestamp seconds */
-    uint32_t ts_usec;        /* timestamp microseconds */
+    uint32_t ts_usec;        /* timestamp microseconds (nanoseconds in nanosecond-resolution files) */
     uint32_t incl_len;       /* number of octets of packet saved in file */
     uint32_t orig_len;       /* actual length of packet */
 } pcap_record_header_t;
 
+/* pcapng block types, see https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-03.html */
+#define PCAPNG_BLOCK_TYPE_SHB 0x0A0D0D0A /* Section Header Block */
+#define PCAPNG_BLOCK_TYPE_IDB 0x00000001 /* Interface Description Block */
+#define PCAPNG_BLOCK_TYPE_SPB 0x00000003 /* Simple Packet Block */
+#define PCAPNG_BLOCK_TYPE_EPB 0x00000006 /* Enhanced Packet Block */
+
+/* pcapng option codes used by the reader */
+#define PCAPNG_OPT_ENDOFOPT   0
+#define PCAPNG_OPT_IF_TSRESOL 9
+#define PCAPNG_OPT_IF_TSOFFSET 14
+
+typedef struct pcapng_block_header {
+    uint32_t block_type;          /* block type code */
+    uint32_t block_total_length;  /* length of the whole block including both length fields */
+} pcapng_block_header_t;
+
+typedef struct pcapng_section_header {
+    uint32_t byte_order_magic;    /* 0x1A2B3C4D written in the section's byte order */
+    uint16_t version_major;
+    uint16_t version_minor;
+    int64_t  section_length;      /* -1 if not specified */
+} pcapng_section_header_t;
+
+typedef struct pcapng_interface_description {
+    uint16_t link_type;           /* data link type as defined by https://www.tcpdump.org/linktypes.html */
+    uint16_t reserved;
+    uint32_t snaplen;             /* max length of captured packets, 0 means no limit */
+} pcapng_interface_description_t;
+
+typedef struct pcapng_enhanced_packet {
+    uint32_t interface_id;        /* index of the interface in the current section */
+    uint32_t ts_high;             /* upper 32 bits of the timestamp */
+    uint32_t ts_low;              /* lower 32 bits of the timestamp */
+    uint32_t captured_len;        /* number of octets of packet saved in the block */
+    uint32_t original_len;        /* actual length of packet */
+} pcapng_enhanced_packet_t;
+
+/* Bytes of each record read before deciding whether its body is needed: enough for
+ * Ethernet + VLAN + IPv4 with options + UDP + the PTP common header */
+#define PCAP_PEEK_LEN 128
+
+struct pipeline_batch_s;
+struct packet_index_s;
+struct packet_filter_s;
+
 typedef struct{
     int swap_bytes; /* Flag to indicate if byte swapping is needed */
     int filter_ptp; /* Flag to indicate if PTP filtering is enabled */
+    const struct packet_filter_s* filter; /* Compiled --filter/--src/--dst expression, or NULL */
+    int use_stdio;  /* Flag to force the stdio reader instead of mapping the file */
+    int num_threads; /* Number of decode worker threads, 0 decodes on the reader thread */
+    int num_chunks;  /* Number of byte ranges scanned in parallel, 0 reads the file front to back */
+    int nanosecond_ts; /* Flag to indicate record header fractions are nanoseconds rather than microseconds */
+    int64_t packet_ts_ns; /* Capture time of the packet being decoded, in nanoseconds since the epoch */
+    int build_index;    /* Flag to write a sidecar packet index during the pass */
+    uint32_t index_stride; /* Records between index entries */
+    int has_window;     /* Flag to restrict decoding to [window_start_ns, window_end_ns] */
+    int64_t window_start_ns;
+    int64_t window_end_ns;
+    int verbosity;  /* output_verbosity_t: per-packet decode output is only produced at OUTPUT_VERBOSE */
+    output_t* out;  /* Writer receiving per-packet decode output */
+    run_stats_t* stats; /* Counters of the thread decoding with this context */
+    struct pipeline_batch_s* batch; /* Set on worker contexts: map updates are deferred into this batch */
     clock_map_t clock_map;      // Add clock map to file context
     gptp_cycle_map_t cycle_map; // Add gPTP cycle map to file context
+    ptp_offset_engine_t offsets; // Offsets and path delays of completed end-to-end exchanges
+    pdelay_tracker_t links;     // Link delays and rate ratios of completed peer-delay exchanges
+    sequence_tracker_t sequences; // Gaps, duplicates and reordering per source port and message type
+    bmca_tracker_t bmca;        // Foreign masters and grandmaster elections per domain
+    interval_analyzer_t intervals; // Message spacing against logMessageInterval per source port and message type
 } file_context_t;
 
+/* A capture record as handed from a reader to the packet decoders */
+typedef struct {
+    uint32_t incl_len;                  /* bytes of packet data captured */
+    uint32_t orig_len;                  /* length of the packet on the wire */
+    const uint8_t* data;                /* incl_len bytes of packet data */
+    int64_t ts_ns;                      /* capture time in nanoseconds since the epoch */
+    int64_t prev_ts_ns;                 /* capture time of the preceding record */
+    uint64_t packet_number;             /* 1-based position of the record in the file */
+    int valid;                          /* 0 if the record failed header validation */
+} packet_desc_t;
+
+/* Running state of a reader walking consecutive records */
+typedef struct {
+    uint64_t packet_count;
+    int64_t prev_ts_ns;
+    uint64_t window_count;          /* records decoded inside the time window */
+    struct packet_index_s* index;   /* index being built during this pass, or NULL */
+} reader_state_t;
+
+/* Consecutive records of a mapped capture, located ahead of decoding so they can be classified together */
+typedef struct {
+    size_t count;
+    size_t offsets[PTP_PREFILTER_BATCH];            /* file offset of each record header */
+    const uint8_t* frames[PTP_PREFILTER_BATCH];
+    uint32_t lengths[PTP_PREFILTER_BATCH];          /* included length of each record */
+    uint64_t is_ptp;                                /* prefilter result, valid when classified */
+    int classified;
+    int truncated;                                  /* the record after the batch runs past the end of the map */
+} record_batch_t;
+
+int file_context_init_maps(file_context_t* file_ctx);
+void file_context_free_maps(file_context_t* file_ctx);
 int process_pcap_file(const char* filepath, file_context_t* file_ctx);
+void begin_record(const pcap_record_header_t* record_header, int swap_bytes, int nanosecond_ts, reader_state_t* state, packet_desc_t* packet);
+void process_packet(file_context_t* file_ctx, const packet_desc_t* packet);
+int packet_passes_filter(const file_context_t* file_ctx, const uint8_t* data, uint32_t available, int is_ptp);
+size_t gather_record_batch(const file_context_t* file_ctx, const uint8_t* map, size_t map_size, size_t offset, size_t limit, record_batch_t* batch);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef PDELAY_TRACKER_H
+#define PDELAY_TRACKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hash_table.h"
+#include "hdr_histogram.h"
+
+/*
+ * Delays are scaled nanoseconds (2^-16 ns) like ptp_offset.h; rate ratios are fixed point
+ * with PDELAY_RATE_RATIO_SHIFT fractional bits (about 1e-12 resolution).
+ */
+#define PDELAY_RATE_RATIO_SHIFT 40
+#define PDELAY_RATE_RATIO_ONE ((int64_t)1 << PDELAY_RATE_RATIO_SHIFT)
+#define PDELAY_WINDOW 16            // Exchanges in each link's sliding window
+
+/**
+ * @brief Timestamps of one completed Pdelay_Req/Pdelay_Resp/Pdelay_Resp_Follow_Up exchange.
+ */
+typedef struct {
+    int64_t request_capture_ns;     // t1: capture time of the Pdelay_Req
+    int64_t request_receipt_ns;     // t2: requestReceiptTimestamp of the Pdelay_Resp
+    int64_t response_origin_ns;     // t3: responseOriginTimestamp of the Pdelay_Resp_Follow_Up
+    int64_t response_capture_ns;    // t4: capture time of the Pdelay_Resp
+    int64_t turnaround_correction;  // Correction to t3 - t2: correctionField of the follow-up minus the response's
+} pdelay_exchange_t;
+
+/**
+ * @brief One exchange in a link's sliding window.
+ */
+typedef struct {
+    int64_t response_origin_ns;
+    int64_t response_capture_ns;
+    int64_t link_delay;             // Scaled ns; only meaningful when has_delay is set
+    int has_delay;
+} pdelay_window_entry_t;
+
+/**
+ * @brief Peer-delay state of one link, from the requesting port to the responding port.
+ */
+typedef struct {
+    uint64_t requester_id;
+    uint64_t responder_id;
+    uint16_t requester_port;
+    uint16_t responder_port;
+    uint64_t exchanges;             // Exchanges pushed into the window, computed or not
+    uint64_t samples;               // Exchanges with a computed link delay
+    int64_t rate_ratio;             // Latest neighborRateRatio over the window
+    int64_t last_delay;             // Latest meanLinkDelay
+    int64_t min_delay;
+    int64_t max_delay;
+    __int128 delay_sum;
+    hdr_histogram_t delay_histogram;
+    pdelay_window_entry_t window[PDELAY_WINDOW]; // Exchange n sits in slot n % PDELAY_WINDOW
+    // Exchanges kept back uncomputed because the window did not reach the previous chunk
+    // (only used by trackers with defer_partial set)
+    uint32_t pending_count;
+    pdelay_exchange_t pending[PDELAY_WINDOW - 1];
+} pdelay_link_t;
+
+/**
+ * @brief Tracks meanLinkDelay and neighborRateRatio of every peer-to-peer link seen in a
+ * capture. neighborRateRatio is the responder's elapsed time over the requester's across
+ * the window; each exchange's meanLinkDelay is ((t4 - t1) * neighborRateRatio - (t3 - t2)) / 2.
+ * Integer arithmetic only; intermediates are 128-bit.
+ */
+typedef struct {
+    hash_table_t link_index;        // Mixed port identities -> index into links
+    pdelay_link_t* links;           // In order of first exchange
+    size_t link_count;
+    size_t link_capacity;
+    // Keep each link's exchanges back until its window holds only exchanges of this
+    // tracker: set for chunk trackers, whose windows continue the previous chunk's
+    int defer_partial;
+} pdelay_tracker_t;
+
+/* Function Prototypes for the Peer-Delay Tracker */
+int pdelay_tracker_init(pdelay_tracker_t* tracker);
+void pdelay_tracker_free(pdelay_tracker_t* tracker);
+int pdelay_tracker_record(pdelay_tracker_t* tracker, uint64_t requester_id, uint16_t requester_port, uint64_t responder_id,
+                          uint16_t responder_port, const pdelay_exchange_t* exchange, const pdelay_link_t** link_out);
+int pdelay_tracker_merge(pdelay_tracker_t* dst, const pdelay_tracker_t* src);
+int64_t pdelay_link_window_mean(const pdelay_link_t* link);
+int64_t pdelay_link_mean(const pdelay_link_t* link);
+int pdelay_rate_ratio_format(int64_t rate_ratio, char* buffer, size_t size);
+void pdelay_tracker_print(const pdelay_tracker_t* tracker);
+
+#endif // PDELAY_TRACKER_H
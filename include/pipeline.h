@@ -0,0 +1,90 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "pcap.h"
+#include "ptp.h"
+
+#define PIPELINE_BATCH_PACKETS 256          // Packet descriptors per batch
+#define PIPELINE_BATCH_STORAGE (1u << 20)   // Bytes of copied packet data per batch (stdio reader only)
+#define PIPELINE_BATCHES_PER_WORKER 4       // Batches in flight per worker thread
+#define PIPELINE_MAX_THREADS 256            // Upper bound accepted for -j
+
+/* Kinds of map updates deferred from a worker to the in-order commit stage */
+typedef enum {
+    PIPELINE_OP_CLOCK_MAPPING = 0,
+    PIPELINE_OP_GPTP_MESSAGE
+} pipeline_op_type_t;
+
+/**
+ * @brief A map update recorded by a worker, replayed in capture order at commit time.
+ */
+typedef struct {
+    pipeline_op_type_t type;
+    size_t out_offset;                  // Position in the batch output at which the update was made
+    uint64_t key;                       // PIPELINE_OP_CLOCK_MAPPING: grandmaster identity
+    uint64_t value;                     // PIPELINE_OP_CLOCK_MAPPING: source port identity
+    ptp_common_header_t common_header;  // PIPELINE_OP_GPTP_MESSAGE: decoded common header
+    int64_t capture_ts_ns;              // PIPELINE_OP_GPTP_MESSAGE: capture time of the packet
+    const uint8_t* packet_data;         // PIPELINE_OP_GPTP_MESSAGE: PTP message bytes
+    uint32_t data_length;
+    const uint8_t* eth_src_mac;
+    const uint8_t* eth_dst_mac;
+} pipeline_op_t;
+
+/**
+ * @brief A batch of packet descriptors moved between the reader, the workers and the commit stage.
+ */
+typedef struct pipeline_batch_s {
+    uint64_t sequence;                  // Position of the batch in capture order
+    size_t count;                       // Number of valid entries in packets
+    packet_desc_t packets[PIPELINE_BATCH_PACKETS];
+
+    uint8_t* storage;                   // Copies of packet data when the reader buffer is reused
+    size_t storage_used;
+    size_t storage_capacity;
+
+    output_t out;                       // Decode output of the batch, kept in memory and reused
+
+    pipeline_op_t* ops;                 // Deferred map updates in decode order
+    size_t op_count;
+    size_t op_capacity;
+} pipeline_batch_t;
+
+/**
+ * @brief Slot of the bounded MPMC ring.
+ */
+typedef struct {
+    atomic_size_t sequence;
+    pipeline_batch_t* batch;
+} work_queue_cell_t;
+
+/**
+ * @brief Bounded lock-free multi-producer/multi-consumer ring of batches.
+ */
+typedef struct {
+    work_queue_cell_t* cells;
+    size_t mask;
+    _Alignas(64) atomic_size_t enqueue_pos;
+    _Alignas(64) atomic_size_t dequeue_pos;
+} work_queue_t;
+
+typedef struct pipeline_s pipeline_t;
+
+/* Function Prototypes for the Work Queue */
+int work_queue_init(work_queue_t* queue, size_t capacity);
+int work_queue_push(work_queue_t* queue, pipeline_batch_t* batch);
+pipeline_batch_t* work_queue_pop(work_queue_t* queue);
+void work_queue_free(work_queue_t* queue);
+
+/* Function Prototypes for the Packet Pipeline */
+pipeline_t* pipeline_create(file_context_t* file_ctx, int num_workers);
+int pipeline_submit(pipeline_t* pipeline, const packet_desc_t* packet, int copy_data);
+void pipeline_finish(pipeline_t* pipeline);
+int pipeline_defer_clock_mapping(file_context_t* file_ctx, uint64_t grandmaster_id, uint64_t source_port_id);
+int pipeline_defer_gptp_message(file_context_t* file_ctx, const ptp_common_header_t* common_header, int64_t capture_ts_ns, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac);
+
+#endif // PIPELINE_H
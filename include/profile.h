@@ -0,0 +1,78 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PROFILE_PROBE_BUCKETS 16        // Probe lengths of 1..15 groups, and 16 or more
+
+/**
+ * @brief Pipeline stages timed by --profile. A stage's time excludes the stages it calls.
+ */
+typedef enum {
+    PROFILE_STAGE_READ = 0,     // Record framing and dispatch
+    PROFILE_STAGE_ETHERNET,
+    PROFILE_STAGE_IP,           // IPv4, IPv6 and UDP
+    PROFILE_STAGE_PTP,          // PTP common header and message bodies
+    PROFILE_STAGE_GPTP,         // gPTP validation, offsets, sequence, BMCA and interval tracking
+    PROFILE_STAGE_CLOCK_MAP,
+    PROFILE_STAGE_COMMIT,       // Pipeline output and replay in capture order
+    PROFILE_STAGE_MERGE,        // Merging chunk results
+    PROFILE_STAGE_COUNT
+} profile_stage_t;
+
+/**
+ * @brief A timed region on the stack of the thread that opened it. Scopes nest: the time of
+ * an inner scope is added to its parent's child_ticks so it is only counted once.
+ */
+typedef struct profile_scope {
+    struct profile_scope* parent;
+    uint64_t start;
+    uint64_t child_ticks;
+    profile_stage_t stage;
+    int active;                 // Profiling was enabled when the scope opened
+} profile_scope_t;
+
+// Set once by profile_enable() before any worker thread starts, read-only afterwards
+extern int profile_enabled;
+
+/* Function Prototypes for the Profiler */
+void profile_enable(void);
+void profile_set_input(uint64_t total_bytes);
+void profile_scope_enter(profile_scope_t* scope);
+void profile_scope_exit(profile_scope_t* scope);
+void profile_record_probe(size_t groups);
+void profile_record_progress(uint64_t bytes);
+void profile_report(void);
+
+static inline void profile_scope_begin(profile_scope_t* scope, profile_stage_t stage) {
+    scope->stage = stage;
+    scope->active = profile_enabled;
+    if (scope->active) {
+        profile_scope_enter(scope);
+    }
+}
+
+static inline void profile_scope_end(profile_scope_t* scope) {
+    if (scope->active) {
+        profile_scope_exit(scope);
+    }
+}
+
+/*
+ * Instrumentation points. Building with PROFILE=0 leaves PCAP_PROFILE undefined and removes
+ * them entirely; otherwise each costs one predictable branch while --profile is off.
+ */
+#ifdef PCAP_PROFILE
+#define PROFILE_SCOPE_BEGIN(name, stage) profile_scope_t name; profile_scope_begin(&name, stage)
+#define PROFILE_SCOPE_END(name) profile_scope_end(&name)
+#define PROFILE_PROBE_LENGTH(groups) do { if (profile_enabled) profile_record_probe(groups); } while (0)
+#define PROFILE_PROGRESS(bytes) do { if (profile_enabled) profile_record_progress(bytes); } while (0)
+#else
+#define PROFILE_SCOPE_BEGIN(name, stage) do { } while (0)
+#define PROFILE_SCOPE_END(name) do { } while (0)
+#define PROFILE_PROBE_LENGTH(groups) do { } while (0)
+#define PROFILE_PROGRESS(bytes) do { } while (0)
+#endif
+
+#endif // PROFILE_H
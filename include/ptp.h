@@ -18,6 +18,20 @@ typedef enum {
     PTP_MESSAGE_MANAGEMENT          = 0xD
 } ptp_message_type_t;
 
+// On-wire lengths of the common header and message bodies. The decoded structs below are
+// padded, so their sizeof is not a wire length.
+#define PTP_HEADER_WIRE_LENGTH 34                   // Common header
+#define PTP_TIMESTAMP_LENGTH 10                     // 48-bit seconds + 32-bit nanoseconds
+#define PTP_PORT_IDENTITY_LENGTH 10                 // ClockIdentity + portNumber
+#define PTP_SYNC_BODY_LENGTH PTP_TIMESTAMP_LENGTH
+#define PTP_FOLLOW_UP_BODY_LENGTH PTP_TIMESTAMP_LENGTH
+#define PTP_DELAY_REQ_BODY_LENGTH PTP_TIMESTAMP_LENGTH
+#define PTP_PDELAY_REQ_BODY_LENGTH PTP_TIMESTAMP_LENGTH   // Without the 10 reserved bytes
+#define PTP_DELAY_RESP_BODY_LENGTH (PTP_TIMESTAMP_LENGTH + PTP_PORT_IDENTITY_LENGTH)
+#define PTP_PDELAY_RESP_BODY_LENGTH (PTP_TIMESTAMP_LENGTH + PTP_PORT_IDENTITY_LENGTH)
+#define PTP_PDELAY_RESP_FOLLOW_UP_BODY_LENGTH (PTP_TIMESTAMP_LENGTH + PTP_PORT_IDENTITY_LENGTH)
+#define PTP_ANNOUNCE_BODY_LENGTH 30                 // Up to and including timeSource
+
 // PTP Common Header
 typedef struct {
     uint8_t  transportSpecific_messageType; // 4 bits transportSpecific, 4 bits messageType
@@ -103,7 +117,12 @@ typedef struct {
 
 // Processes PTP header and dispatches to specific message handlers.
 void process_ptp_header(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac);
-// Processes gPTP messages for cycle tracking.
-void process_gptp_message(file_context_t* file_ctx, const ptp_common_header_t* common_header, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac);
+// Records a grandmaster -> source port mapping in the clock map.
+void record_clock_mapping(file_context_t* file_ctx, uint64_t grandmaster_id, uint64_t source_port_id);
+// Returns the name of a PTP message type.
+const char* ptp_message_type_name(ptp_message_type_t messageType);
+// Processes gPTP messages for cycle tracking. capture_ts_ns is the capture time of the packet in nanoseconds.
+void process_gptp_message(file_context_t* file_ctx, const ptp_common_header_t* common_header, int64_t capture_ts_ns, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac);
+int merge_gptp_results(file_context_t* dst, const file_context_t* src);
 
 #endif // PTP_H
\ No newline at end of file
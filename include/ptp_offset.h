@@ -0,0 +1,95 @@
+#ifndef PTP_OFFSET_H
+#define PTP_OFFSET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hash_table.h"
+#include "hdr_histogram.h"
+#include "allan_deviation.h"
+
+/*
+ * Times below are scaled nanoseconds (2^-16 ns), the unit of correctionField, unless
+ * named *_ns. Results saturate at the int64 range (about +-39 hours).
+ */
+#define PTP_SCALED_NS_SHIFT 16
+#define PTP_OFFSET_PENDING_MAX 8    // Delay exchanges kept per master while waiting for its first Sync
+
+/**
+ * @brief Slave-side half of an end-to-end delay measurement.
+ */
+typedef struct {
+    uint64_t slave_id;
+    int64_t request_capture_ns;     // t3: capture time of the Delay_Req
+    int64_t receive_ns;             // t4: receiveTimestamp of the Delay_Resp
+    int64_t correction;             // correctionField of the Delay_Resp
+} ptp_delay_sample_t;
+
+/**
+ * @brief Latest two-step Sync of a master, waiting to be paired with delay measurements.
+ */
+typedef struct {
+    uint64_t clock_id;
+    int has_sync;
+    int64_t origin_ns;              // t1: preciseOriginTimestamp of the Follow_Up
+    int64_t capture_ns;             // t2: capture time of the Sync
+    int64_t correction;             // correctionFields of Sync and Follow_Up
+    int64_t first_capture_ns;       // Capture time of the first Sync recorded for this master
+    hdr_histogram_t sync_interval;  // Capture time between consecutive completed Syncs
+    uint32_t pending_count;
+    ptp_delay_sample_t pending[PTP_OFFSET_PENDING_MAX]; // Only used by engines with defer_unmatched set
+} ptp_offset_master_t;
+
+/**
+ * @brief Running offsetFromMaster and meanPathDelay statistics of one master/slave pair.
+ */
+typedef struct {
+    uint64_t master_id;
+    uint64_t slave_id;
+    uint64_t samples;
+    int64_t last_offset;
+    int64_t last_delay;
+    int64_t min_offset;
+    int64_t max_offset;
+    int64_t min_delay;
+    int64_t max_delay;
+    __int128 offset_sum;
+    __int128 delay_sum;
+    hdr_histogram_t offset_histogram;
+    hdr_histogram_t delay_histogram;
+    allan_accumulator_t stability;  // ADEV/MDEV/TDEV of the offset series
+} ptp_offset_pair_t;
+
+/**
+ * @brief Computes offsetFromMaster and meanPathDelay for every completed end-to-end
+ * exchange, pairing each Delay_Req/Delay_Resp with the latest Sync/Follow_Up of the
+ * responding master. Integer arithmetic only; intermediates are 128-bit.
+ */
+typedef struct {
+    hash_table_t master_index;      // Clock identity -> index into masters
+    ptp_offset_master_t* masters;
+    size_t master_count;
+    size_t master_capacity;
+    hash_table_t pair_index;        // Mixed master/slave identities -> index into pairs
+    ptp_offset_pair_t* pairs;       // In order of first result
+    size_t pair_count;
+    size_t pair_capacity;
+    uint64_t unmatched;             // Delay exchanges with no earlier Sync from their master
+    // Keep delay exchanges seen before a master's first Sync for the merge instead of
+    // counting them as unmatched: set for chunk engines, whose Sync may be in the previous chunk
+    int defer_unmatched;
+    // Keep each pair's offset series for the merge instead of accumulating its stability:
+    // set for chunk engines, whose decimation phase depends on the samples before them
+    int defer_stability;
+} ptp_offset_engine_t;
+
+/* Function Prototypes for the Offset Engine */
+int ptp_offset_init(ptp_offset_engine_t* engine);
+void ptp_offset_free(ptp_offset_engine_t* engine);
+int ptp_offset_record_sync(ptp_offset_engine_t* engine, uint64_t master_id, int64_t origin_ns, int64_t capture_ns, int64_t correction);
+int ptp_offset_record_delay(ptp_offset_engine_t* engine, uint64_t master_id, const ptp_delay_sample_t* sample, const ptp_offset_pair_t** pair_out);
+int ptp_offset_merge(ptp_offset_engine_t* dst, const ptp_offset_engine_t* src);
+int64_t ptp_offset_mean(const ptp_offset_pair_t* pair, int delay);
+int ptp_scaled_ns_format(int64_t scaled, char* buffer, size_t size);
+void ptp_offset_print(const ptp_offset_engine_t* engine);
+
+#endif // PTP_OFFSET_H
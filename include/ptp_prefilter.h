@@ -0,0 +1,23 @@
+#ifndef PTP_PREFILTER_H
+#define PTP_PREFILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PTP_PREFILTER_BATCH 64          // Frames classified per call, one bit each in the result
+#define PTP_PREFILTER_HEADER_BYTES 62   // Bytes of a frame the vector kernels read (VLAN + IPv6 + UDP ports)
+
+/* Implementations of the batch classifier */
+typedef enum {
+    PTP_PREFILTER_SCALAR = 0,           // frame_is_ptp() on each frame
+    PTP_PREFILTER_SSE42,                // 8 frames per vector
+    PTP_PREFILTER_AVX2                  // 16 frames per vector
+} ptp_prefilter_impl_t;
+
+/* Function Prototypes for the PTP Prefilter */
+ptp_prefilter_impl_t ptp_prefilter_best(void);
+const char* ptp_prefilter_name(ptp_prefilter_impl_t impl);
+uint64_t ptp_prefilter_batch_with(ptp_prefilter_impl_t impl, const uint8_t* const* frames, const uint32_t* lengths, size_t count);
+uint64_t ptp_prefilter_batch(const uint8_t* const* frames, const uint32_t* lengths, size_t count);
+
+#endif // PTP_PREFILTER_H
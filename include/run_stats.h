@@ -0,0 +1,66 @@
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RUN_STATS_CACHE_LINE 64
+#define RUN_STATS_DOMAIN_COUNT 256
+
+/* Number of values of the 4-bit PTP messageType field */
+#define PTP_MESSAGE_TYPE_COUNT 16
+
+/**
+ * @brief EtherTypes counted separately, after any VLAN tag.
+ */
+typedef enum {
+    RUN_STATS_ETHERTYPE_IPV4 = 0,
+    RUN_STATS_ETHERTYPE_IPV6,
+    RUN_STATS_ETHERTYPE_PTP,
+    RUN_STATS_ETHERTYPE_ARP,
+    RUN_STATS_ETHERTYPE_LLDP,
+    RUN_STATS_ETHERTYPE_OTHER,
+    RUN_STATS_ETHERTYPE_COUNT
+} run_stats_ethertype_t;
+
+/**
+ * @brief Reasons a record was not decoded completely.
+ */
+typedef enum {
+    RUN_STATS_BAD_RECORD = 0,       // Included length exceeds original length, or not an Ethernet link
+    RUN_STATS_SHORT_ETHERNET,
+    RUN_STATS_SHORT_VLAN,
+    RUN_STATS_BAD_IPV4,             // Truncated header or invalid header length
+    RUN_STATS_SHORT_IPV6,
+    RUN_STATS_SHORT_UDP,
+    RUN_STATS_SHORT_PTP_HEADER,
+    RUN_STATS_SHORT_PTP_MESSAGE,    // Common header complete, message body truncated
+    RUN_STATS_MALFORMED_COUNT
+} run_stats_malformed_t;
+
+/**
+ * @brief Counters of one decoding thread. Each thread increments its own block with plain
+ * stores; blocks are cache-line aligned so that threads never share a line, and are summed
+ * once the threads are done.
+ */
+typedef struct {
+    uint64_t packets;               // Records decoded
+    uint64_t bytes;                 // Captured bytes of the records decoded
+    uint64_t vlan_tagged;
+    uint64_t ethertypes[RUN_STATS_ETHERTYPE_COUNT];
+    uint64_t ptp_messages[PTP_MESSAGE_TYPE_COUNT];  // By messageType
+    uint64_t domains[RUN_STATS_DOMAIN_COUNT];       // PTP messages by domainNumber
+    uint64_t malformed[RUN_STATS_MALFORMED_COUNT];
+} __attribute__((aligned(RUN_STATS_CACHE_LINE))) run_stats_t;
+
+/* Function Prototypes for the Run Statistics */
+run_stats_t* run_stats_create(size_t count);
+void run_stats_destroy(run_stats_t* stats);
+void run_stats_add(run_stats_t* dst, const run_stats_t* src);
+void run_stats_count_ethertype(run_stats_t* stats, uint16_t ethertype);
+const char* run_stats_malformed_name(run_stats_malformed_t reason);
+const char* run_stats_ethertype_name(run_stats_ethertype_t ethertype);
+void run_stats_print(const run_stats_t* stats);
+void run_stats_print_ptp_messages(const run_stats_t* stats);
+
+#endif // RUN_STATS_H
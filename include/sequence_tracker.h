@@ -0,0 +1,78 @@
+#ifndef SEQUENCE_TRACKER_H
+#define SEQUENCE_TRACKER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hash_table.h"
+
+#define SEQUENCE_WINDOW 64          // sequenceIds remembered behind the highest one, one bit each
+#define SEQUENCE_RESYNC_GAP 1024    // A jump further than this either way restarts tracking
+
+/**
+ * @brief What one message's sequenceId says about its source's stream.
+ */
+typedef enum {
+    SEQUENCE_IN_ORDER = 0,      // Next after the highest so far, or the source's first message
+    SEQUENCE_GAP,               // Ahead of the highest, skipping sequenceIds
+    SEQUENCE_DUPLICATE,         // Already received
+    SEQUENCE_REORDERED,         // Behind the highest, filling a gap inside the window
+    SEQUENCE_LATE,              // Too far behind the highest to tell reordered from duplicate
+    SEQUENCE_RESYNC,            // Jumped more than SEQUENCE_RESYNC_GAP; tracking restarts here
+    SEQUENCE_DEFERRED           // Held back for the merge (trackers with defer_partial set)
+} sequence_event_t;
+
+/**
+ * @brief Loss accounting of one source.
+ */
+typedef struct {
+    uint64_t received;
+    uint64_t gaps;              // Messages that skipped sequenceIds
+    int64_t missing;            // sequenceIds skipped and not received since; negative
+                                // only in chunk trackers, for gaps opened in an earlier chunk
+    uint64_t duplicates;
+    uint64_t reordered;
+    uint64_t late;
+    uint64_t resyncs;
+} sequence_counts_t;
+
+/**
+ * @brief Sequence state of one message type from one source port.
+ */
+typedef struct {
+    uint64_t clock_id;
+    uint16_t port_number;
+    uint8_t message_type;
+    uint8_t depth;              // sequenceIds of window known since the first message or resync; 0 before any
+    uint16_t highest;           // Highest sequenceId received, in 16-bit wraparound order
+    uint64_t window;            // Bit i set: sequenceId highest - i was received
+    sequence_counts_t counts;
+    // sequenceIds kept back unclassified for the merge; the source's counts start once
+    // this is full (only used by trackers with defer_partial set)
+    uint32_t pending_count;
+    uint16_t pending[SEQUENCE_WINDOW];
+} sequence_source_t;
+
+/**
+ * @brief Detects gaps, duplicates and reordering in the sequenceIds of every
+ * (sourcePortIdentity, messageType) in O(1) per message and constant memory per source.
+ */
+typedef struct {
+    hash_table_t source_index;      // Mixed port identity and message type -> index into sources
+    sequence_source_t* sources;     // In order of first message
+    size_t source_count;
+    size_t source_capacity;
+    // Keep each source's first SEQUENCE_WINDOW sequenceIds back until the window no longer
+    // reaches the previous chunk: set for chunk trackers
+    int defer_partial;
+} sequence_tracker_t;
+
+/* Function Prototypes for the Sequence Tracker */
+int sequence_tracker_init(sequence_tracker_t* tracker);
+void sequence_tracker_free(sequence_tracker_t* tracker);
+int sequence_tracker_record(sequence_tracker_t* tracker, uint64_t clock_id, uint16_t port_number, uint8_t message_type,
+                            uint16_t sequence_id, const sequence_source_t** source_out, sequence_event_t* event_out);
+int sequence_tracker_merge(sequence_tracker_t* dst, const sequence_tracker_t* src);
+const char* sequence_event_name(sequence_event_t event);
+void sequence_tracker_print(const sequence_tracker_t* tracker);
+
+#endif // SEQUENCE_TRACKER_H
@@ -0,0 +1,37 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+
+#define SLAB_ALIGNMENT 64           // Slabs start on a cache line; object sizes are rounded to SLAB_OBJECT_ALIGNMENT
+#define SLAB_OBJECT_ALIGNMENT 16
+
+/**
+ * @brief Header at the start of every slab, linking the slabs for bulk release.
+ */
+typedef struct slab_s {
+    struct slab_s* next;
+} slab_t;
+
+/**
+ * @brief Fixed-size object allocator. Objects are carved from large slabs and released
+ * objects go onto an intrusive free list for reuse; slabs are only returned to the
+ * system all at once. Not thread-safe: each owner (one per thread) has its own.
+ */
+typedef struct {
+    size_t object_size;         // Bytes per object, rounded up to SLAB_OBJECT_ALIGNMENT
+    size_t objects_per_slab;
+    slab_t* slabs;              // Most recently allocated slab first
+    char* bump;                 // Next never-used object in the newest slab
+    char* bump_end;
+    void* free_list;            // Released objects, linked through their first word
+    size_t live;                // Objects currently allocated
+} slab_allocator_t;
+
+/* Function Prototypes for the Slab Allocator */
+void slab_init(slab_allocator_t* slab, size_t object_size, size_t objects_per_slab);
+void* slab_alloc(slab_allocator_t* slab);
+void slab_release(slab_allocator_t* slab, void* object);
+void slab_free_all(slab_allocator_t* slab);
+
+#endif // SLAB_H
@@ -0,0 +1,46 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TIMING_WHEEL_TICK_SHIFT 20      // One tick is 2^20 ns (~1.05 ms) of capture time
+#define TIMING_WHEEL_SLOT_BITS 6
+#define TIMING_WHEEL_SLOTS (1 << TIMING_WHEEL_SLOT_BITS)
+#define TIMING_WHEEL_LEVELS 4           // 64^4 ticks (~4.9 hours); later deadlines wait in the last level
+
+/**
+ * @brief Timer embedded in the object it expires.
+ */
+typedef struct timer_node_s {
+    struct timer_node_s* next;
+    struct timer_node_s** pprev;        // Link pointing at this node, NULL when not scheduled
+    int64_t expires_tick;
+    uint8_t level;
+    uint8_t slot;
+} timer_node_t;
+
+/**
+ * @brief Hierarchical timing wheel driven by capture time rather than the wall clock.
+ * Level 0 has one slot per tick; each higher level covers 64 slots of the level below.
+ * Timers cascade down a level when their slot comes up, so scheduling, cancelling and
+ * expiring are all O(1) amortized.
+ */
+typedef struct {
+    timer_node_t* slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];
+    uint64_t occupied[TIMING_WHEEL_LEVELS]; // Bit per non-empty slot, to skip idle stretches
+    int64_t now_tick;
+    size_t count;                           // Timers scheduled
+    int started;                            // now_tick is set by the first advance or schedule
+} timing_wheel_t;
+
+/* Called for each expired timer; the timer is already unscheduled and may be freed */
+typedef void (*timing_wheel_expire_fn)(timer_node_t* node, void* user);
+
+/* Function Prototypes for the Timing Wheel */
+void timing_wheel_init(timing_wheel_t* wheel);
+void timing_wheel_schedule(timing_wheel_t* wheel, timer_node_t* node, int64_t deadline_ns);
+void timing_wheel_cancel(timing_wheel_t* wheel, timer_node_t* node);
+void timing_wheel_advance(timing_wheel_t* wheel, int64_t now_ns, timing_wheel_expire_fn expire, void* user);
+
+#endif // TIMING_WHEEL_H
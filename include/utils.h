@@ -7,6 +7,10 @@
 
 #define PCAP_MAGIC_NUMBER 0xa1b2c3d4
 #define PCAP_SWAPPED_MAGIC_NUMBER 0xd4c3b2a1
+#define PCAP_NSEC_MAGIC_NUMBER 0xa1b23c4d          /* Record timestamps carry nanoseconds */
+#define PCAP_NSEC_SWAPPED_MAGIC_NUMBER 0x4d3cb2a1
+#define NSEC_PER_SEC 1000000000LL
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4d
 
 /* Macros to handle byte swapping based on file context */
 #define BYTES_TO_UINT16(data_ptr, swap_bytes_flag) ( (swap_bytes_flag) ? swap_uint16(*(uint16_t*)(data_ptr)) : *(uint16_t*)(data_ptr) )
@@ -22,6 +26,12 @@ uint16_t swap_uint16(uint16_t val);
 uint32_t swap_uint32(uint32_t val);
 uint64_t swap_uint64(uint64_t val);
 uint64_t bytes_to_uint48(const uint8_t* bytes, int swap_bytes);
+
+/* Functions to read network byte order fields from unaligned packet data */
+uint16_t read_be16(const uint8_t* bytes);
+uint32_t read_be32(const uint8_t* bytes);
+uint64_t read_be64(const uint8_t* bytes);
 int is_little_endian();
+int parse_timestamp_ns(const char* text, int64_t* ts_ns);
 
 #endif // UTILS_H
\ No newline at end of file
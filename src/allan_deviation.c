@@ -0,0 +1,182 @@
+#include "../include/allan_deviation.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALLAN_SERIES_INITIAL_SIZE 256
+
+/*
+ * Initializes an empty accumulator.
+ * @param accumulator The accumulator.
+ * @param defer Nonzero to keep samples back for allan_merge() instead of accumulating them.
+ */
+void allan_init(allan_accumulator_t* accumulator, int defer) {
+    memset(accumulator, 0, sizeof(*accumulator));
+    accumulator->defer = defer;
+}
+
+/*
+ * Frees the memory allocated by an accumulator and leaves it empty.
+ * @param accumulator The accumulator.
+ */
+void allan_free(allan_accumulator_t* accumulator) {
+    int defer = accumulator->defer;
+    free(accumulator->levels);
+    free(accumulator->series);
+    allan_init(accumulator, defer);
+}
+
+/*
+ * Grows an accumulator to hold at least count octaves; new octaves are empty.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int reserve_levels(allan_accumulator_t* accumulator, uint32_t count) {
+    if (count <= accumulator->level_count) {
+        return 0;
+    }
+    allan_level_t* grown = (allan_level_t*)realloc(accumulator->levels, count * sizeof(allan_level_t));
+    if (grown == NULL) {
+        perror("Failed to allocate memory for stability accumulator");
+        return -1;
+    }
+    memset(&grown[accumulator->level_count], 0, (count - accumulator->level_count) * sizeof(allan_level_t));
+    accumulator->levels = grown;
+    accumulator->level_count = count;
+    return 0;
+}
+
+/*
+ * Passes a sample down the cascade from octave k: each octave adds the second differences
+ * of its phase and block series, and every second sample sends the earlier phase and the
+ * sum of both blocks to the next octave.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int cascade(allan_accumulator_t* accumulator, uint32_t k, int64_t phase, __int128 block) {
+    for (; k < ALLAN_MAX_LEVELS; k++) {
+        if (reserve_levels(accumulator, k + 1) != 0) {
+            return -1;
+        }
+        allan_level_t* level = &accumulator->levels[k];
+        if (level->count >= 2) {
+            __int128 phase_difference = (__int128)phase - 2 * (__int128)level->phase[0] + level->phase[1];
+            __int128 block_difference = block - 2 * level->block[0] + level->block[1];
+            level->phase_sum += (double)phase_difference * (double)phase_difference;
+            level->block_sum += (double)block_difference * (double)block_difference;
+            level->terms++;
+        }
+        level->phase[1] = level->phase[0];
+        level->phase[0] = phase;
+        level->block[1] = level->block[0];
+        level->block[0] = block;
+        if (level->count++ % 2 == 0) {
+            level->held_phase = phase;
+            level->held_block = block;
+            return 0;
+        }
+        phase = level->held_phase;
+        block += level->held_block;
+    }
+    return 0;
+}
+
+/*
+ * Adds a phase sample.
+ * @param accumulator The accumulator.
+ * @param time_ns Time of the sample; samples must come in time order.
+ * @param phase The phase (time error) in any fixed unit.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int allan_add(allan_accumulator_t* accumulator, int64_t time_ns, int64_t phase) {
+    if (accumulator->defer) {
+        if (accumulator->series_count == accumulator->series_capacity) {
+            size_t grown_capacity = accumulator->series_capacity ? accumulator->series_capacity * 2 : ALLAN_SERIES_INITIAL_SIZE;
+            allan_sample_t* grown = (allan_sample_t*)realloc(accumulator->series, grown_capacity * sizeof(allan_sample_t));
+            if (grown == NULL) {
+                perror("Failed to allocate memory for stability samples");
+                return -1;
+            }
+            accumulator->series = grown;
+            accumulator->series_capacity = grown_capacity;
+        }
+        accumulator->series[accumulator->series_count].time_ns = time_ns;
+        accumulator->series[accumulator->series_count].phase = phase;
+        accumulator->series_count++;
+        return 0;
+    }
+    if (accumulator->samples == 0) {
+        accumulator->first_ns = time_ns;
+    }
+    accumulator->last_ns = time_ns;
+    accumulator->samples++;
+    return cascade(accumulator, 0, phase, phase);
+}
+
+/*
+ * Appends the samples of src to dst, which must hold the earlier samples. Samples src kept
+ * back are accumulated in order, giving the same result as a single pass. Accumulated
+ * samples are copied if dst is empty; otherwise their sums are added, losing the second
+ * differences that straddle the two.
+ * @param dst The accumulator receiving the samples.
+ * @param src The accumulator to merge from; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int allan_merge(allan_accumulator_t* dst, const allan_accumulator_t* src) {
+    if (src->samples != 0) {
+        if (reserve_levels(dst, src->level_count) != 0) {
+            return -1;
+        }
+        if (dst->samples == 0) {
+            memcpy(dst->levels, src->levels, src->level_count * sizeof(allan_level_t));
+            dst->samples = src->samples;
+            dst->first_ns = src->first_ns;
+            dst->last_ns = src->last_ns;
+        } else {
+            for (uint32_t k = 0; k < src->level_count; k++) {
+                dst->levels[k].phase_sum += src->levels[k].phase_sum;
+                dst->levels[k].block_sum += src->levels[k].block_sum;
+                dst->levels[k].terms += src->levels[k].terms;
+            }
+            dst->samples += src->samples;
+            dst->last_ns = src->last_ns;
+        }
+    }
+    for (size_t i = 0; i < src->series_count; i++) {
+        if (allan_add(dst, src->series[i].time_ns, src->series[i].phase) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Computes the stability at tau = 2^level * tau0, with tau0 the mean interval between
+ * samples:
+ *   AVAR(tau) = <(x[i+2m] - 2x[i+m] + x[i])^2> / (2 tau^2)
+ *   MVAR(tau) = <(X[j+2] - 2X[j+1] + X[j])^2> / (2 tau^2), X the means of blocks of m samples
+ *   TDEV(tau) = tau * sqrt(MVAR(tau) / 3)
+ * @param accumulator The accumulator.
+ * @param level The octave.
+ * @param phase_unit_ns Nanoseconds per unit of phase.
+ * @param point Set to the result.
+ * @return 0 on success, -1 if the octave has no second difference yet.
+ */
+int allan_point(const allan_accumulator_t* accumulator, uint32_t level, double phase_unit_ns, allan_point_t* point) {
+    if (level >= accumulator->level_count || accumulator->levels[level].terms == 0 ||
+        accumulator->last_ns <= accumulator->first_ns) {
+        return -1;
+    }
+    const allan_level_t* octave = &accumulator->levels[level];
+    double tau0_ns = (double)(accumulator->last_ns - accumulator->first_ns) / (double)(accumulator->samples - 1);
+    double m = ldexp(1.0, (int)level);
+    double tau_ns = tau0_ns * m;
+    double denominator = 2.0 * (double)octave->terms * tau_ns * tau_ns;
+    double avar = octave->phase_sum * phase_unit_ns * phase_unit_ns / denominator;
+    double mvar = octave->block_sum * phase_unit_ns * phase_unit_ns / (m * m) / denominator;
+    point->tau_ns = tau_ns;
+    point->adev = sqrt(avar);
+    point->mdev = sqrt(mvar);
+    point->tdev_ns = tau_ns * sqrt(mvar / 3.0);
+    point->terms = octave->terms;
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include "../include/bmca_tracker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MASTER_TABLE_INITIAL_SIZE 16
+#define BMCA_MAX_LOG_INTERVAL 8     // logMessageInterval beyond +-8 is treated as 0 (one second)
+#define BMCA_TIMELINE_LINES 32      // Grandmaster changes listed in the summary at most
+#define BMCA_RATE_WINDOW_NS 60000000000LL   // Window of the peak grandmaster change rate
+
+/*
+ * Initializes an empty tracker.
+ * @param tracker The tracker.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int bmca_tracker_init(bmca_tracker_t* tracker) {
+    memset(tracker, 0, sizeof(*tracker));
+    if (hash_table_init(&tracker->master_index, MASTER_TABLE_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize BMCA tracker.\n");
+        return -1;
+    }
+    for (int domain = 0; domain < BMCA_DOMAIN_COUNT; domain++) {
+        tracker->domains[domain].best = -1;
+    }
+    tracker->now_ns = INT64_MIN;
+    tracker->next_expiry_ns = INT64_MAX;
+    return 0;
+}
+
+/*
+ * Frees the memory allocated by a tracker.
+ * @param tracker The tracker.
+ */
+void bmca_tracker_free(bmca_tracker_t* tracker) {
+    hash_table_free(&tracker->master_index);
+    free(tracker->masters);
+    free(tracker->timeline);
+    free(tracker->pending);
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+/*
+ * Grows a record array to hold at least one more element.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int reserve_one(void** items, size_t* capacity, size_t count, size_t item_size) {
+    if (count < *capacity) {
+        return 0;
+    }
+    size_t grown_capacity = *capacity ? *capacity * 2 : MASTER_TABLE_INITIAL_SIZE;
+    void* grown = realloc(*items, grown_capacity * item_size);
+    if (grown == NULL) {
+        perror("Failed to allocate memory for BMCA tracker");
+        return -1;
+    }
+    *items = grown;
+    *capacity = grown_capacity;
+    return 0;
+}
+
+// A sending port of a domain looked up in the master index
+typedef struct {
+    const bmca_tracker_t* tracker;
+    uint64_t sender_id;
+    uint16_t sender_port;
+    uint8_t domain;
+} master_lookup_t;
+
+static int master_matches(const void* context, uint64_t value) {
+    const master_lookup_t* lookup = (const master_lookup_t*)context;
+    const bmca_foreign_master_t* master = &lookup->tracker->masters[value];
+    return master->domain == lookup->domain && master->dataset.sender_id == lookup->sender_id &&
+           master->dataset.sender_port == lookup->sender_port;
+}
+
+/*
+ * Finds the foreign master record of a sending port in a domain, adding an inactive one
+ * if the port is new. The index is keyed by a mix of the domain and port identity.
+ * @return Index of the record, or -1 on memory allocation failure.
+ */
+static int64_t get_master(bmca_tracker_t* tracker, uint8_t domain, uint64_t sender_id, uint16_t sender_port) {
+    uint64_t key = (sender_id * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)sender_port << 8) ^ domain;
+    master_lookup_t lookup = { tracker, sender_id, sender_port, domain };
+    hash_key_match_t match = { master_matches, &lookup };
+    const uint64_t* slot = hash_table_find_match(&tracker->master_index, key, &match);
+    if (slot != NULL) {
+        return (int64_t)*slot;
+    }
+
+    if (reserve_one((void**)&tracker->masters, &tracker->master_capacity, tracker->master_count, sizeof(bmca_foreign_master_t)) != 0 ||
+        hash_table_add(&tracker->master_index, key, tracker->master_count) == NULL) {
+        return -1;
+    }
+    bmca_foreign_master_t* master = &tracker->masters[tracker->master_count];
+    memset(master, 0, sizeof(*master));
+    master->domain = domain;
+    master->dataset.sender_id = sender_id;
+    master->dataset.sender_port = sender_port;
+    return (int64_t)tracker->master_count++;
+}
+
+#define COMPARE_FIELD(field) \
+    if (a->field != b->field) { \
+        return a->field < b->field ? -1 : 1; \
+    }
+
+/*
+ * Compares the grandmaster clock quality of two Announce datasets: priority1, clockClass,
+ * clockAccuracy, offsetScaledLogVariance and priority2. Lower values are better.
+ * @return Negative if a is better, positive if b is better, 0 if they are the same.
+ */
+static int compare_quality(const bmca_dataset_t* a, const bmca_dataset_t* b) {
+    COMPARE_FIELD(priority1);
+    COMPARE_FIELD(clock_class);
+    COMPARE_FIELD(clock_accuracy);
+    COMPARE_FIELD(offset_scaled_log_variance);
+    COMPARE_FIELD(priority2);
+    return 0;
+}
+
+/*
+ * Compares two Announce datasets as the IEEE 1588 dataset comparison does: by the
+ * grandmaster's quality and identity, then for the same grandmaster by stepsRemoved and
+ * the sender's port identity. Lower values are better throughout.
+ * @return Negative if a is better, positive if b is better, 0 if they are the same.
+ */
+int bmca_dataset_compare(const bmca_dataset_t* a, const bmca_dataset_t* b) {
+    if (a->grandmaster_id != b->grandmaster_id) {
+        int quality = compare_quality(a, b);
+        if (quality != 0) {
+            return quality;
+        }
+        return a->grandmaster_id < b->grandmaster_id ? -1 : 1;
+    }
+    COMPARE_FIELD(steps_removed);
+    COMPARE_FIELD(sender_id);
+    COMPARE_FIELD(sender_port);
+    return 0;
+}
+
+#undef COMPARE_FIELD
+
+/*
+ * Makes a foreign master the best of its domain, appending to the timeline if the
+ * domain's grandmaster identity changes.
+ * @param index Index of the new best, or -1 for none.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int set_best(bmca_tracker_t* tracker, uint8_t domain, int64_t index, int64_t time_ns, bmca_change_reason_t reason) {
+    bmca_domain_t* state = &tracker->domains[domain];
+    uint64_t grandmaster_id = index >= 0 ? tracker->masters[index].dataset.grandmaster_id : 0;
+    state->best = index;
+    if (grandmaster_id == state->grandmaster_id) {
+        return 0;
+    }
+    if (reserve_one((void**)&tracker->timeline, &tracker->change_capacity, tracker->change_count, sizeof(bmca_change_t)) != 0) {
+        return -1;
+    }
+    bmca_change_t* change = &tracker->timeline[tracker->change_count++];
+    change->time_ns = time_ns;
+    change->previous_id = state->grandmaster_id;
+    change->grandmaster_id = grandmaster_id;
+    change->domain = domain;
+    change->reason = (uint8_t)reason;
+    state->grandmaster_id = grandmaster_id;
+    state->changes++;
+    return 0;
+}
+
+/*
+ * Searches a domain's qualified foreign masters for the best one.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int elect(bmca_tracker_t* tracker, uint8_t domain, int64_t time_ns, bmca_change_reason_t reason) {
+    int64_t best = -1;
+    for (size_t i = 0; i < tracker->master_count; i++) {
+        const bmca_foreign_master_t* master = &tracker->masters[i];
+        if (master->domain == domain && master->active && master->qualified &&
+            (best < 0 || bmca_dataset_compare(&master->dataset, &tracker->masters[best].dataset) < 0)) {
+            best = (int64_t)i;
+        }
+    }
+    return set_best(tracker, domain, best, time_ns, reason);
+}
+
+/*
+ * @return Index of the active foreign master with the earliest timeout (the first one on
+ * ties), or -1 if none is active; its timeout is stored in expires_out.
+ */
+static int64_t earliest_expiry(const bmca_tracker_t* tracker, int64_t* expires_out) {
+    int64_t earliest = -1;
+    *expires_out = INT64_MAX;
+    for (size_t i = 0; i < tracker->master_count; i++) {
+        const bmca_foreign_master_t* master = &tracker->masters[i];
+        if (master->active && master->expires_ns < *expires_out) {
+            earliest = (int64_t)i;
+            *expires_out = master->expires_ns;
+        }
+    }
+    return earliest;
+}
+
+/*
+ * Moves capture time forward, dropping foreign masters whose Announce receipt timeout has
+ * passed in order of their deadlines. A dropped grandmaster is replaced by the best
+ * remaining foreign master of its domain, as of the deadline.
+ * @param tracker The tracker.
+ * @param capture_ns Capture time of the current packet.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int bmca_tracker_advance(bmca_tracker_t* tracker, int64_t capture_ns) {
+    if (capture_ns > tracker->now_ns) {
+        tracker->now_ns = capture_ns;
+    }
+    if (tracker->defer || tracker->now_ns < tracker->next_expiry_ns) {
+        return 0;
+    }
+    int64_t expires_ns;
+    int64_t index;
+    while ((index = earliest_expiry(tracker, &expires_ns)) >= 0 && expires_ns <= tracker->now_ns) {
+        bmca_foreign_master_t* master = &tracker->masters[index];
+        master->active = 0;
+        master->qualified = 0;
+        if (tracker->domains[master->domain].best == index &&
+            elect(tracker, master->domain, expires_ns, BMCA_CHANGE_TIMEOUT) != 0) {
+            return -1;
+        }
+    }
+    tracker->next_expiry_ns = expires_ns;
+    return 0;
+}
+
+/*
+ * @return The interval of a logMessageInterval in nanoseconds.
+ */
+static int64_t log_interval_ns(int8_t log_interval) {
+    if (log_interval > BMCA_MAX_LOG_INTERVAL || log_interval < -BMCA_MAX_LOG_INTERVAL) {
+        log_interval = 0;
+    }
+    return log_interval >= 0 ? 1000000000LL << log_interval : 1000000000LL >> -log_interval;
+}
+
+/*
+ * Records an Announce: updates its sender's foreign master record and compares it with
+ * the domain's best. The caller advances capture time first.
+ * @param tracker The tracker.
+ * @param announce The Announce.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int bmca_tracker_record(bmca_tracker_t* tracker, const bmca_announce_t* announce) {
+    if (tracker->defer) {
+        if (reserve_one((void**)&tracker->pending, &tracker->pending_capacity, tracker->pending_count, sizeof(bmca_announce_t)) != 0) {
+            return -1;
+        }
+        tracker->pending[tracker->pending_count++] = *announce;
+        return 0;
+    }
+    int64_t index = get_master(tracker, announce->domain, announce->dataset.sender_id, announce->dataset.sender_port);
+    if (index < 0) {
+        return -1;
+    }
+    bmca_foreign_master_t* master = &tracker->masters[index];
+    bmca_dataset_t previous = master->dataset;
+    int64_t interval_ns = log_interval_ns(announce->log_interval);
+    if (!master->active) {
+        master->active = 1;
+        master->qualified = 0;
+    } else {
+        // Qualified only while this and the previous Announce fall within the window
+        master->qualified = announce->capture_ns - master->last_announce_ns <= BMCA_FOREIGN_MASTER_TIME_WINDOW * interval_ns;
+    }
+    int was_best = tracker->domains[announce->domain].best == index;
+    master->dataset = announce->dataset;
+    master->last_announce_ns = announce->capture_ns;
+    master->interval_ns = interval_ns;
+    master->expires_ns = announce->capture_ns + BMCA_ANNOUNCE_RECEIPT_TIMEOUT * interval_ns;
+    master->announces++;
+    if (master->expires_ns < tracker->next_expiry_ns) {
+        tracker->next_expiry_ns = master->expires_ns;
+    }
+    if (!master->qualified) {
+        // A grandmaster whose Announces spread beyond the window no longer qualifies
+        return was_best ? elect(tracker, announce->domain, announce->capture_ns, BMCA_CHANGE_TIMEOUT) : 0;
+    }
+
+    const bmca_domain_t* state = &tracker->domains[announce->domain];
+    if (was_best) {
+        // The grandmaster's own Announce: search again only if it got worse
+        int quality = compare_quality(&master->dataset, &previous);
+        if (quality > 0 || (quality == 0 && bmca_dataset_compare(&master->dataset, &previous) > 0)) {
+            return elect(tracker, announce->domain, announce->capture_ns, BMCA_CHANGE_DEGRADED);
+        }
+        return set_best(tracker, announce->domain, index, announce->capture_ns, BMCA_CHANGE_BETTER);
+    }
+    if (state->best < 0 || bmca_dataset_compare(&master->dataset, &tracker->masters[state->best].dataset) < 0) {
+        return set_best(tracker, announce->domain, index, announce->capture_ns, BMCA_CHANGE_BETTER);
+    }
+    return 0;
+}
+
+/*
+ * Replays the Announces a chunk tracker kept back into dst, which holds the earlier part
+ * of the capture, and advances dst to the chunk's latest capture time. The result is the
+ * same as a single pass, as timeouts are dated by their deadlines.
+ * @param dst The tracker receiving the Announces.
+ * @param src The chunk tracker to merge from, which must defer; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int bmca_tracker_merge(bmca_tracker_t* dst, const bmca_tracker_t* src) {
+    for (size_t i = 0; i < src->pending_count; i++) {
+        if (bmca_tracker_advance(dst, src->pending[i].capture_ns) != 0 || bmca_tracker_record(dst, &src->pending[i]) != 0) {
+            return -1;
+        }
+    }
+    return bmca_tracker_advance(dst, src->now_ns);
+}
+
+/*
+ * @return A short description of why a grandmaster changed.
+ */
+const char* bmca_change_reason_name(bmca_change_reason_t reason) {
+    static const char* const names[] = {
+        [BMCA_CHANGE_BETTER] = "better master",
+        [BMCA_CHANGE_DEGRADED] = "grandmaster degraded",
+        [BMCA_CHANGE_TIMEOUT] = "announce timeout",
+    };
+    return (unsigned)reason < sizeof(names) / sizeof(names[0]) ? names[reason] : "unknown";
+}
+
+/*
+ * Prints the grandmaster of every domain that saw a change, the peak change rate and the
+ * first BMCA_TIMELINE_LINES grandmaster changes.
+ * @param tracker The tracker.
+ */
+void bmca_tracker_print(const bmca_tracker_t* tracker) {
+    printf("BMCA: %zu foreign masters, %zu grandmaster changes\n", tracker->master_count, tracker->change_count);
+    for (int domain = 0; domain < BMCA_DOMAIN_COUNT; domain++) {
+        const bmca_domain_t* state = &tracker->domains[domain];
+        if (state->changes == 0) {
+            continue;
+        }
+        if (state->best < 0) {
+            printf("    domain %d: no grandmaster, %llu changes\n", domain, (unsigned long long)state->changes);
+            continue;
+        }
+        const bmca_dataset_t* dataset = &tracker->masters[state->best].dataset;
+        printf("    domain %d: grandmaster 0x%016llx (priority1 %u, class %u, accuracy 0x%02x, variance 0x%04x, priority2 %u) "
+               "via 0x%016llx:%u, %u steps removed, %llu changes\n",
+               domain, (unsigned long long)dataset->grandmaster_id, dataset->priority1, dataset->clock_class,
+               dataset->clock_accuracy, dataset->offset_scaled_log_variance, dataset->priority2,
+               (unsigned long long)dataset->sender_id, dataset->sender_port, dataset->steps_removed,
+               (unsigned long long)state->changes);
+    }
+    // Busiest window of grandmaster changes; the timeline is in capture order
+    size_t peak = 0;
+    int64_t peak_start_ns = 0;
+    for (size_t first = 0, last = 0; last < tracker->change_count; last++) {
+        while (tracker->timeline[last].time_ns - tracker->timeline[first].time_ns >= BMCA_RATE_WINDOW_NS) {
+            first++;
+        }
+        if (last - first + 1 > peak) {
+            peak = last - first + 1;
+            peak_start_ns = tracker->timeline[first].time_ns;
+        }
+    }
+    if (peak != 0) {
+        printf("    peak change rate: %zu changes in %lld s from %lld.%09lld\n", peak, BMCA_RATE_WINDOW_NS / 1000000000LL,
+               (long long)(peak_start_ns / 1000000000LL), (long long)(peak_start_ns % 1000000000LL));
+    }
+    for (size_t i = 0; i < tracker->change_count && i < BMCA_TIMELINE_LINES; i++) {
+        const bmca_change_t* change = &tracker->timeline[i];
+        printf("    %lld.%09lld domain %u: 0x%016llx -> 0x%016llx (%s)\n",
+               (long long)(change->time_ns / 1000000000LL), (long long)(change->time_ns % 1000000000LL), change->domain,
+               (unsigned long long)change->previous_id, (unsigned long long)change->grandmaster_id,
+               bmca_change_reason_name((bmca_change_reason_t)change->reason));
+    }
+    if (tracker->change_count > BMCA_TIMELINE_LINES) {
+        printf("    ... and %zu more\n", tracker->change_count - BMCA_TIMELINE_LINES);
+    }
+}
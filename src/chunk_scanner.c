@@ -0,0 +1,364 @@
+/* The Plan */
+//
+// 1. Split the record area of a mapped classic pcap file into N byte ranges
+// 2. Each thread resynchronizes to the first record boundary inside its range by checking that a
+//    chain of record headers starting there is plausible (ts/incl_len/orig_len against snaplen)
+// 3. Each thread decodes the records that start inside its range into private maps and output
+// 4. Every boundary is verified against the offset the previous range actually ended on; a range
+//    that locked onto a false boundary is rescanned from the correct offset
+// 5. Partial maps are merged in range order, stitching gPTP cycles that straddle a boundary,
+//    and the range outputs are concatenated
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/chunk_scanner.h"
+#include "../include/ptp.h"
+#include "../include/utils.h"
+#include "../include/profile.h"
+
+#define CHUNK_SCANNER_MIN_CHUNK_BYTES (64 * 1024) // Smaller ranges are not worth a thread
+
+/* State of one byte range and the thread scanning it */
+typedef struct {
+    int index;
+    const uint8_t* map;
+    size_t map_size;
+    const pcap_global_header_t* global_header;
+    size_t range_start;     // First byte of the range
+    size_t range_end;       // One past the last byte of the range
+    size_t first_record;    // Offset the range is scanned from
+    size_t next_record;     // First record offset at or past range_end, where the next range must begin
+    uint64_t packet_count;
+    file_context_t ctx;     // Private maps and output
+    output_t out;           // Writer behind ctx.out, spilling to a scratch file
+} chunk_t;
+
+/*
+ * Checks that a chain of record headers starting at offset looks like real pcap records.
+ * @param map Start of the mapping.
+ * @param map_size Size of the mapping in bytes.
+ * @param offset Candidate record header offset.
+ * @param global_header The validated global header (host byte order).
+ * @param swap_bytes Non-zero if record headers need byte swapping.
+ * @param depth Number of consecutive records that must be plausible.
+ * @return 1 if the chain is plausible, 0 otherwise.
+ */
+int pcap_record_chain_plausible(const uint8_t* map, size_t map_size, size_t offset, const pcap_global_header_t* global_header, int swap_bytes, int depth) {
+    uint32_t max_incl_len = global_header->snaplen ? global_header->snaplen : CHUNK_RESYNC_MAX_RECORD;
+    uint32_t first_ts_sec = 0;
+    uint32_t fraction_limit = (global_header->magic_number == PCAP_NSEC_MAGIC_NUMBER ||
+                               global_header->magic_number == PCAP_NSEC_SWAPPED_MAGIC_NUMBER) ? NSEC_PER_SEC : 1000000;
+    pcap_record_header_t record_header;
+
+    for (int i = 0; i < depth; i++) {
+        if (offset == map_size) {
+            return i > 0; // A chain that ends exactly at end of file is complete
+        }
+        if (map_size - offset < sizeof(pcap_record_header_t)) {
+            return 0;
+        }
+        memcpy(&record_header, map + offset, sizeof(pcap_record_header_t));
+        if (swap_bytes) {
+            record_header.ts_sec = swap_uint32(record_header.ts_sec);
+            record_header.ts_usec = swap_uint32(record_header.ts_usec);
+            record_header.incl_len = swap_uint32(record_header.incl_len);
+            record_header.orig_len = swap_uint32(record_header.orig_len);
+        }
+
+        if (record_header.ts_usec >= fraction_limit ||
+            record_header.incl_len > record_header.orig_len ||
+            record_header.incl_len > max_incl_len ||
+            record_header.orig_len > CHUNK_RESYNC_MAX_RECORD) {
+            return 0;
+        }
+        if (i == 0) {
+            first_ts_sec = record_header.ts_sec;
+        } else {
+            uint32_t skew = record_header.ts_sec > first_ts_sec ? record_header.ts_sec - first_ts_sec : first_ts_sec - record_header.ts_sec;
+            if (skew > CHUNK_RESYNC_MAX_TS_SKEW) {
+                return 0;
+            }
+        }
+
+        offset += sizeof(pcap_record_header_t);
+        if (record_header.incl_len > map_size - offset) {
+            return 0;
+        }
+        offset += record_header.incl_len;
+    }
+    return 1;
+}
+
+/*
+ * Finds the first offset in [start, limit) at which a plausible record chain begins.
+ * @return The offset, or limit if no record boundary was found.
+ */
+size_t pcap_find_record_boundary(const uint8_t* map, size_t map_size, size_t start, size_t limit, const pcap_global_header_t* global_header, int swap_bytes) {
+    for (size_t offset = start; offset < limit; offset++) {
+        if (pcap_record_chain_plausible(map, map_size, offset, global_header, swap_bytes, CHUNK_RESYNC_CHAIN_DEPTH)) {
+            return offset;
+        }
+    }
+    return limit;
+}
+
+/*
+ * Decodes every record that starts inside the chunk's range, beginning at first_record.
+ * @param chunk The chunk.
+ */
+static void scan_chunk(chunk_t* chunk) {
+    reader_state_t state = {0};
+    pcap_record_header_t record_header;
+    packet_desc_t packet;
+    record_batch_t batch;
+    size_t offset = chunk->first_record;
+
+    do {
+        offset = gather_record_batch(&chunk->ctx, chunk->map, chunk->map_size, offset, chunk->range_end, &batch);
+        for (size_t i = 0; i < batch.count; i++) {
+            // Record headers are not guaranteed to be aligned within the file
+            memcpy(&record_header, chunk->map + batch.offsets[i], sizeof(pcap_record_header_t));
+            begin_record(&record_header, chunk->ctx.swap_bytes, chunk->ctx.nanosecond_ts, &state, &packet);
+            packet.data = batch.frames[i];
+
+            int is_ptp = batch.classified ? (int)((batch.is_ptp >> i) & 1) : -1;
+            if (packet_passes_filter(&chunk->ctx, packet.data, batch.lengths[i], is_ptp)) {
+                process_packet(&chunk->ctx, &packet);
+            }
+        }
+        if (batch.truncated) {
+            memcpy(&record_header, chunk->map + offset, sizeof(pcap_record_header_t));
+            begin_record(&record_header, chunk->ctx.swap_bytes, chunk->ctx.nanosecond_ts, &state, &packet);
+            fprintf(stderr, "Error reading packet data: record truncated at end of file\n");
+            offset = chunk->map_size;
+        }
+    } while (batch.count == PTP_PREFILTER_BATCH);
+
+    // Stopping short of the range end means the file ended; no later range owns any record
+    chunk->next_record = offset < chunk->range_end ? chunk->map_size : offset;
+    chunk->packet_count = state.packet_count;
+}
+
+/*
+ * Thread entry: resynchronizes to the first record of the range and scans it.
+ * @param arg The chunk.
+ * @return NULL.
+ */
+static void* chunk_main(void* arg) {
+    chunk_t* chunk = (chunk_t*)arg;
+    if (chunk->index > 0) {
+        chunk->first_record = pcap_find_record_boundary(chunk->map, chunk->map_size, chunk->range_start, chunk->range_end,
+                                                        chunk->global_header, chunk->ctx.swap_bytes);
+    }
+    PROFILE_SCOPE_BEGIN(read_scope, PROFILE_STAGE_READ);
+    scan_chunk(chunk);
+    PROFILE_SCOPE_END(read_scope);
+    return NULL;
+}
+
+/*
+ * Gives a chunk's context empty maps and analyzers, set to keep whatever depends on the
+ * part of the capture before the chunk for the merge.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int chunk_init_maps(chunk_t* chunk) {
+    if (file_context_init_maps(&chunk->ctx) != 0) {
+        fprintf(stderr, "Failed to initialize maps for chunk %d.\n", chunk->index);
+        return -1;
+    }
+    // Every chunk but the first sees the capture from the middle: its first cycles may
+    // continue one from the previous chunk, delay exchanges before a master's first Sync
+    // pair with a Sync from an earlier chunk, and peer-delay, sequenceId and stability
+    // windows continue the previous chunk's. Every chunk keeps its Announces for the merge,
+    // which elects in capture order from the first chunk on
+    int continues = chunk->index > 0;
+    chunk->ctx.cycle_map.hold_boundary = continues;
+    chunk->ctx.offsets.defer_unmatched = continues;
+    chunk->ctx.offsets.defer_stability = continues;
+    chunk->ctx.links.defer_partial = continues;
+    chunk->ctx.sequences.defer_partial = continues;
+    chunk->ctx.bmca.defer = 1;
+    return 0;
+}
+
+/*
+ * Sets up a chunk's private context: settings from the shared context, empty maps, the
+ * chunk thread's counters and a scratch output file.
+ * @return 0 on success, -1 on failure.
+ */
+static int chunk_init_context(chunk_t* chunk, const file_context_t* file_ctx, run_stats_t* stats) {
+    chunk->ctx = *file_ctx;
+    chunk->ctx.batch = NULL;
+    chunk->ctx.num_threads = 0;
+    chunk->ctx.num_chunks = 0;
+    chunk->ctx.stats = stats;
+    chunk->ctx.out = NULL;
+    if (chunk_init_maps(chunk) != 0) {
+        return -1;
+    }
+    FILE* scratch = tmpfile();
+    if (scratch == NULL) {
+        perror("Failed to create chunk output file");
+        return -1;
+    }
+    if (output_init(&chunk->out, scratch, OUTPUT_BUFFER_SIZE) != 0) {
+        fclose(scratch);
+        return -1;
+    }
+    chunk->ctx.out = &chunk->out;
+    return 0;
+}
+
+/*
+ * Frees a chunk's private maps and output file.
+ */
+static void chunk_free_context(chunk_t* chunk) {
+    file_context_free_maps(&chunk->ctx);
+    if (chunk->ctx.out != NULL) {
+        fclose(chunk->out.sink);
+        output_free(&chunk->out);
+        chunk->ctx.out = NULL;
+    }
+}
+
+/*
+ * Discards a chunk's results and scans it again from the given record offset.
+ * @return 0 on success, -1 on failure.
+ */
+static int rescan_chunk(chunk_t* chunk, size_t first_record) {
+    file_context_free_maps(&chunk->ctx);
+    if (chunk_init_maps(chunk) != 0) {
+        return -1;
+    }
+    memset(chunk->ctx.stats, 0, sizeof(*chunk->ctx.stats));
+    output_reset(&chunk->out);
+    rewind(chunk->out.sink);
+    if (ftruncate(fileno(chunk->out.sink), 0) != 0) {
+        perror("Failed to reset chunk output file");
+        return -1;
+    }
+    chunk->first_record = first_record;
+    PROFILE_SCOPE_BEGIN(read_scope, PROFILE_STAGE_READ);
+    scan_chunk(chunk);
+    PROFILE_SCOPE_END(read_scope);
+    return 0;
+}
+
+/*
+ * Appends a chunk's output to the shared writer.
+ */
+static void copy_chunk_output(chunk_t* chunk, output_t* out) {
+    char buffer[65536];
+    size_t n;
+    output_flush(&chunk->out);
+    fflush(chunk->out.sink);
+    rewind(chunk->out.sink);
+    while ((n = fread(buffer, 1, sizeof(buffer), chunk->out.sink)) > 0) {
+        output_write(out, buffer, n);
+    }
+}
+
+/*
+ * Scans a mapped classic pcap file as file_ctx->num_chunks byte ranges in parallel and
+ * merges the results into file_ctx.
+ * @param map Start of the mapping.
+ * @param map_size Size of the mapping in bytes.
+ * @param global_header The validated global header (host byte order).
+ * @param file_ctx The shared file context receiving the merged maps and output.
+ * @param packet_count_out Receives the total number of records processed.
+ * @return 0 on success, -1 on failure.
+ */
+int chunk_scan_file(const uint8_t* map, size_t map_size, const pcap_global_header_t* global_header, file_context_t* file_ctx, uint64_t* packet_count_out) {
+    size_t data_start = sizeof(pcap_global_header_t);
+    size_t data_size = map_size - data_start;
+
+    // Keep ranges large enough that resynchronization and thread startup stay negligible
+    size_t num_chunks = (size_t)file_ctx->num_chunks;
+    if (num_chunks > data_size / CHUNK_SCANNER_MIN_CHUNK_BYTES) {
+        num_chunks = data_size / CHUNK_SCANNER_MIN_CHUNK_BYTES;
+    }
+    if (num_chunks == 0) {
+        num_chunks = 1;
+    }
+    printf("Chunked scan: %zu range(s) of ~%zu bytes\n", num_chunks, data_size / num_chunks);
+
+    chunk_t* chunks = (chunk_t*)calloc(num_chunks, sizeof(chunk_t));
+    pthread_t* threads = (pthread_t*)calloc(num_chunks, sizeof(pthread_t));
+    run_stats_t* stats = run_stats_create(num_chunks);
+    if (chunks == NULL || threads == NULL || stats == NULL) {
+        perror("Failed to allocate memory for chunks");
+        free(chunks);
+        free(threads);
+        run_stats_destroy(stats);
+        return -1;
+    }
+
+    int result = 0;
+    size_t started = 0;
+    for (size_t i = 0; i < num_chunks; i++) {
+        chunk_t* chunk = &chunks[i];
+        chunk->index = (int)i;
+        chunk->map = map;
+        chunk->map_size = map_size;
+        chunk->global_header = global_header;
+        chunk->range_start = data_start + data_size * i / num_chunks;
+        chunk->range_end = data_start + data_size * (i + 1) / num_chunks;
+        chunk->first_record = chunk->range_start;
+        if (chunk_init_context(chunk, file_ctx, &stats[i]) != 0) {
+            result = -1;
+            break;
+        }
+        if (pthread_create(&threads[i], NULL, chunk_main, chunk) != 0) {
+            perror("Failed to start chunk thread");
+            result = -1;
+            break;
+        }
+        started++;
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (result == 0) {
+        /* Verify each boundary against where the previous range really ended */
+        size_t expected = data_start;
+        for (size_t i = 0; i < num_chunks && result == 0; i++) {
+            if (chunks[i].first_record != expected) {
+                fprintf(stderr, "Chunk %zu resynchronized at byte %zu but the previous range ends at byte %zu; rescanning.\n",
+                        i, chunks[i].first_record, expected);
+                result = rescan_chunk(&chunks[i], expected);
+            }
+            expected = chunks[i].next_record;
+        }
+    }
+
+    if (result == 0) {
+        /* Merge partial results in capture order */
+        PROFILE_SCOPE_BEGIN(merge_scope, PROFILE_STAGE_MERGE);
+        uint64_t total = 0;
+        for (size_t i = 0; i < num_chunks; i++) {
+            if (clock_map_merge(&file_ctx->clock_map, &chunks[i].ctx.clock_map) != 0 ||
+                merge_gptp_results(file_ctx, &chunks[i].ctx) != 0) {
+                fprintf(stderr, "Failed to merge results of chunk %zu.\n", i);
+                result = -1;
+                break;
+            }
+            run_stats_add(file_ctx->stats, chunks[i].ctx.stats);
+            copy_chunk_output(&chunks[i], file_ctx->out);
+            total += chunks[i].packet_count;
+        }
+        *packet_count_out = total;
+        PROFILE_SCOPE_END(merge_scope);
+    }
+
+    for (size_t i = 0; i < num_chunks; i++) {
+        chunk_free_context(&chunks[i]);
+    }
+    free(chunks);
+    free(threads);
+    run_stats_destroy(stats);
+    return result;
+}
@@ -2,7 +2,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-#define CLOCK_MAP_INITIAL_SIZE 1024 // Initial number of buckets for the hash map
+#define CLOCK_MAP_INITIAL_SIZE 64 // Entries allocated up front; the table grows as needed
 
 /*
  * Initializes a new clock hash map.
@@ -13,25 +13,13 @@ int clock_map_init(clock_map_t *map) {
     if (map == NULL) {
         return -1;
     }
-    map->size = CLOCK_MAP_INITIAL_SIZE;
-    map->buckets = (map_entry_t **)calloc(map->size, sizeof(map_entry_t *));
-    if (map->buckets == NULL) {
-        perror("Failed to allocate memory for clock map buckets");
+    if (hash_table_init(&map->table, CLOCK_MAP_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize clock map.\n");
         return -1;
     }
     return 0;
 }
 
-/*
- * Simple hash function for a 64-bit key.
- * @param map The hash map.
- * @param key The 64-bit key.
- * @return The hash index.
- */
-static size_t clock_map_hash(const clock_map_t *map, uint64_t key) {
-    return (size_t)(key % map->size);
-}
-
 /*
  * Inserts a key-value pair into the hash map. Updates value if key exists.
  * @param map The hash map.
@@ -44,26 +32,11 @@ int clock_map_insert(clock_map_t *map, uint64_t key, uint64_t value) {
         return -1;
     }
 
-    size_t index = clock_map_hash(map, key);
-    map_entry_t *current = map->buckets[index];
-
-    while (current != NULL) {
-        if (current->key == key) {
-            current->value = value;
-            return 0;
-        }
-        current = current->next;
-    }
-
-    map_entry_t *new_entry = (map_entry_t *)malloc(sizeof(map_entry_t));
-    if (new_entry == NULL) {
-        perror("Failed to allocate memory for map entry");
+    uint64_t *slot = hash_table_insert(&map->table, key, NULL);
+    if (slot == NULL) {
         return -1;
     }
-    new_entry->key = key;
-    new_entry->value = value;
-    new_entry->next = map->buckets[index];
-    map->buckets[index] = new_entry;
+    *slot = value;
     return 0;
 }
 
@@ -79,17 +52,43 @@ int clock_map_lookup(const clock_map_t *map, uint64_t key, uint64_t *value_out)
         return -1;
     }
 
-    size_t index = clock_map_hash(map, key);
-    map_entry_t *current = map->buckets[index];
+    const uint64_t *slot = hash_table_find(&map->table, key);
+    if (slot == NULL) {
+        return -1;
+    }
+    *value_out = *slot;
+    return 0;
+}
 
-    while (current != NULL) {
-        if (current->key == key) {
-            *value_out = current->value;
-            return 0;
+/*
+ * @param map The hash map.
+ * @return The number of grandmasters mapped.
+ */
+size_t clock_map_size(const clock_map_t *map) {
+    return hash_table_size(&map->table);
+}
+
+/*
+ * Merges every entry of src into dst. Entries already in dst are overwritten,
+ * so merging partial maps in capture order keeps the latest mapping.
+ * @param dst The map receiving the entries.
+ * @param src The map to merge from; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int clock_map_merge(clock_map_t *dst, const clock_map_t *src) {
+    if (dst == NULL || src == NULL) {
+        return -1;
+    }
+
+    size_t cursor = 0;
+    uint64_t key;
+    uint64_t value;
+    while (hash_table_next(&src->table, &cursor, &key, &value)) {
+        if (clock_map_insert(dst, key, value) != 0) {
+            return -1;
         }
-        current = current->next;
     }
-    return -1;
+    return 0;
 }
 
 /*
@@ -97,19 +96,8 @@ int clock_map_lookup(const clock_map_t *map, uint64_t key, uint64_t *value_out)
  * @param map The hash map to free.
  */
 void clock_map_free(clock_map_t *map) {
-    if (map == NULL || map->buckets == NULL) {
+    if (map == NULL) {
         return;
     }
-
-    for (size_t i = 0; i < map->size; i++) {
-        map_entry_t *current = map->buckets[i];
-        while (current != NULL) {
-            map_entry_t *to_free = current;
-            current = current->next;
-            free(to_free);
-        }
-    }
-    free(map->buckets);
-    map->buckets = NULL;
-    map->size = 0;
+    hash_table_free(&map->table);
 }
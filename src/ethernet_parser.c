@@ -11,14 +11,83 @@ void mac_address_to_string(char* buf, size_t buf_size, const uint8_t* mac_addres
         mac_address[3], mac_address[4], mac_address[5]);                                                                                                                                                                                                                      
 }                                                                
 
-void print_mac_address(const uint8_t* mac_address){
-    char mac_str[18]; //18 chars for address +1 null terminator
-    mac_address_to_string(mac_str, sizeof(mac_str), mac_address);
-    printf("%s", mac_str);
+void print_mac_address(output_t* out, const uint8_t* mac_address){
+    output_hex_bytes(out, mac_address, 6, ':', 1);
+}
+
+/*
+ * Locates the headers of a frame without decoding them: the VLAN tag, the IPv4/IPv6
+ * header, the UDP header and the PTP message (directly over Ethernet, or over UDP to
+ * ports 319/320). Layers that are absent or truncated are set to FRAME_LAYER_ABSENT.
+ * Only the first PCAP_PEEK_LEN bytes are ever inspected.
+ * @param frame The start of the Ethernet frame.
+ * @param length Number of bytes available at frame.
+ * @param layers Receives the offsets of the layers found.
+ */
+void locate_frame_layers(const uint8_t* frame, uint32_t length, frame_layers_t* layers) {
+    layers->ethertype = 0;
+    layers->vlan = layers->ipv4 = layers->ipv6 = layers->udp = layers->ptp = FRAME_LAYER_ABSENT;
+    if (length < ETHERNET_HEADER_LEN) {
+        return;
+    }
+    uint16_t ethertype = read_be16(frame + 12);
+    uint32_t offset = ETHERNET_HEADER_LEN;
+    if (ethertype == ETHERTYPE_VLAN && length >= offset + sizeof(vlan_header_t)) {
+        layers->vlan = offset;
+        ethertype = read_be16(frame + offset + 2);
+        offset += sizeof(vlan_header_t);
+    }
+    layers->ethertype = ethertype;
+
+    uint8_t protocol;
+    if (ethertype == ETHERTYPE_PTP) {
+        layers->ptp = offset;
+        return;
+    } else if (ethertype == ETHERTYPE_IPV4 && length >= offset + 20) {
+        uint32_t header_length = (frame[offset] & 0x0F) * 4u;
+        if (header_length < 20) {
+            return;
+        }
+        layers->ipv4 = offset;
+        // Only the first fragment carries the UDP header
+        if ((read_be16(frame + offset + 6) & 0x1FFF) != 0) {
+            return;
+        }
+        protocol = frame[offset + 9];
+        offset += header_length;
+    } else if (ethertype == ETHERTYPE_IPV6 && length >= offset + 40) {
+        layers->ipv6 = offset;
+        protocol = frame[offset + 6];
+        offset += 40;
+    } else {
+        return;
+    }
+
+    if (protocol != 17 || length < offset + sizeof(udp_header_t)) {
+        return;
+    }
+    layers->udp = offset;
+    uint16_t dst_port = read_be16(frame + offset + 2);
+    if (dst_port == PTP_EVENT_PORT || dst_port == PTP_GENERAL_PORT) {
+        layers->ptp = offset + sizeof(udp_header_t);
+    }
+}
+
+/*
+ * Checks from the headers alone whether a frame carries PTP.
+ * @param frame The start of the Ethernet frame.
+ * @param length Number of bytes available at frame.
+ * @return 1 if the frame is PTP, 0 otherwise.
+ */
+int frame_is_ptp(const uint8_t* frame, uint32_t length) {
+    frame_layers_t layers;
+    locate_frame_layers(frame, length, &layers);
+    return layers.ptp != FRAME_LAYER_ABSENT;
 }
 
 void process_ethernet_header(file_context_t* file_ctx, const unsigned char* packet_data, int data_length){
     if (data_length < (int)sizeof(ethernet_header_t)){
+        file_ctx->stats->malformed[RUN_STATS_SHORT_ETHERNET]++;
         fprintf(stderr, 
             "Error: Incomplete Ethernet header. Packet is too small (got %d bytes, requires at least %zu bytes).\n",
             data_length,
@@ -26,55 +95,54 @@ void process_ethernet_header(file_context_t* file_ctx, const unsigned char* pack
         return; //Stop processing of invalid packet
     }
 
-    /* Treat the first bytes of packet_data as an ethernet_header_t */
-    const ethernet_header_t* eth_header = (const ethernet_header_t*)packet_data;
+    /* Records sit at any offset of a mapped file, so fields are read bytewise rather than through a cast */
+    const uint8_t* dest_mac = packet_data;
+    const uint8_t* src_mac = packet_data + 6;
+    uint16_t ethertype = read_be16(packet_data + 12);
 
-    /* Use context-aware swap function if needed */
-    uint16_t ethertype = eth_header->ethertype;
-    if (is_little_endian()) {
-        ethertype = swap_uint16(ethertype);
+    /* Print Ethernet header data */
+    int verbose = file_ctx->verbosity == OUTPUT_VERBOSE;
+    output_t* out = file_ctx->out;
+    if (verbose) {
+        output_str(out, "Ethernet Header:\n Destination MAC: ");
+        print_mac_address(out, dest_mac);
+        output_str(out, "\n Source MAC: ");
+        print_mac_address(out, src_mac);
+        output_str(out, "EtherType: 0x");
+        output_hex(out, ethertype, 4, 1);
+        output_char(out, '\n');
     }
 
-    if (file_ctx->filter_ptp && ethertype != ETHERTYPE_PTP) {
-        return; // Skip non-PTP packets if filtering is enabled
-    }
-
-    /* Print Ethernet header data to Stdout */
-    printf("Ethernet Header:\n");
-    printf(" Destination MAC: ");
-    print_mac_address(eth_header->dest_mac);    
-    printf("\n Source MAC: ");
-    print_mac_address(eth_header->src_mac);
-    printf("EtherType: 0x%04X\n", ethertype);
-
     /* Define pointers for next layer */
     const uint8_t* network_layer_data = packet_data + sizeof(ethernet_header_t);
     uint32_t network_layer_length = data_length - sizeof(ethernet_header_t);
 
     if (ethertype == ETHERTYPE_VLAN) {
         if (network_layer_length < sizeof(vlan_header_t)) {
+            file_ctx->stats->malformed[RUN_STATS_SHORT_VLAN]++;
             fprintf(stderr, "Incomplete VLAN header\n");
             return;
         }
-        const vlan_header_t* vlan_header = (const vlan_header_t*)network_layer_data;
-        uint16_t tci = vlan_header->tci;
-        if (is_little_endian()) {
-            tci = swap_uint16(tci);
-        }
+        uint16_t tci = read_be16(network_layer_data);
         uint16_t vlan_id = tci & 0x0FFF;
         uint16_t vlan_pcp = tci >> 13; // Extract the 3-bit Priority Code Point
 
-        ethertype = vlan_header->ethertype;
-        if (is_little_endian()) {
-            ethertype = swap_uint16(ethertype);
+        ethertype = read_be16(network_layer_data + 2);
+        if (verbose) {
+            output_str(out, "VLAN ID: ");
+            output_uint(out, vlan_id);
+            output_str(out, "\nVLAN Priority: ");
+            output_uint(out, vlan_pcp);
+            output_str(out, "\nEncapsulated EtherType: 0x");
+            output_hex(out, ethertype, 4, 1);
+            output_char(out, '\n');
         }
-        printf("VLAN ID: %u\n", vlan_id);
-        printf("VLAN Priority: %u\n", vlan_pcp);
-        printf("Encapsulated EtherType: 0x%04X\n", ethertype);
         network_layer_data += sizeof(vlan_header_t);
         network_layer_length -= sizeof(vlan_header_t);
+        file_ctx->stats->vlan_tagged++;
     }
+    run_stats_count_ethertype(file_ctx->stats, ethertype);
 
     /* Hand off to network layer parser */
-    parse_network_layer_header(file_ctx, network_layer_data, network_layer_length, ethertype, eth_header->src_mac, eth_header->dest_mac);
+    parse_network_layer_header(file_ctx, network_layer_data, network_layer_length, ethertype, src_mac, dest_mac);
 }
\ No newline at end of file
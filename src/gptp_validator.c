@@ -1,21 +1,18 @@
 #include "../include/gptp_validator.h"
 #include "../include/ptp.h"
 #include "../include/utils.h"
+#include "../include/pipeline.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 
-#define CYCLE_MAP_INITIAL_SIZE 1024 // Initial number of buckets for the hash map
+#define CYCLE_MAP_INITIAL_SIZE 1024 // Cycles allocated up front; the table grows as needed
+#define ENDPOINT_TABLE_INITIAL_SIZE 64
 
-/*
- * Simple hash function for a 64-bit key.
- * @param map The hash map.
- * @param key The 64-bit key.
- * @return The hash index.
- */
-static size_t gptp_cycle_map_hash(const gptp_cycle_map_t *map, uint64_t key) {
-    return (size_t)(key % map->size);
-}
+// The state machine's fields must share the first cache line; cycles are slab-allocated at 64-byte alignment
+_Static_assert(offsetof(gptp_cycle_t, clock_id) == 64, "gptp_cycle_t hot fields must fit one cache line");
+_Static_assert(sizeof(gptp_cycle_t) == 128, "gptp_cycle_t must span exactly two cache lines");
 
 /*
  * Initializes a new gptp_cycle hash map.
@@ -26,173 +23,1013 @@ int gptp_cycle_map_init(gptp_cycle_map_t *map) {
     if (map == NULL) {
         return -1;
     }
-    map->size = CYCLE_MAP_INITIAL_SIZE;
-    map->buckets = (cycle_map_entry_t **)calloc(map->size, sizeof(cycle_map_entry_t *));
-    if (map->buckets == NULL) {
-        perror("Failed to allocate memory for gPTP cycle map buckets");
+    if (hash_table_init(&map->table, CYCLE_MAP_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize gPTP cycle map.\n");
         return -1;
     }
+    memset(&map->endpoints, 0, sizeof(map->endpoints));
+    if (hash_table_init(&map->endpoints.index, ENDPOINT_TABLE_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize gPTP endpoint table.\n");
+        hash_table_free(&map->table);
+        return -1;
+    }
+    slab_init(&map->cycles, sizeof(gptp_cycle_t), CYCLE_SLAB_OBJECTS);
+    timing_wheel_init(&map->wheel);
+    map->timeout_ns = GPTP_CYCLE_TIMEOUT_NS;
+    map->completed = 0;
+    map->out_of_order = 0;
+    map->invalid = 0;
+    map->expired = 0;
+    map->last_capture_ns = 0;
+    map->hold_boundary = 0;
+    map->hold_until_ns = 0;
     return 0;
 }
 
 /*
- * Creates a combined key from sourcePortIdentity (first 8 bytes) and sequenceId.
- * @param source_port_identity The 10-byte sourcePortIdentity.
+ * Builds the identity of a cycle.
+ * @param port_identity The 10-byte port identity the exchange is keyed by.
  * @param sequence_id The sequenceId.
- * @return The combined 64-bit key.
+ * @param kind The exchange.
+ * @return The identity.
  */
-uint64_t create_cycle_key(const uint8_t source_port_identity[10], uint16_t sequence_id, int swap_bytes) {
-    uint64_t clock_id = 0;
-    memcpy(&clock_id, source_port_identity, sizeof(uint64_t));
-    if (swap_bytes) {
-        clock_id = swap_uint64(clock_id);
-    }
-    // Combines clock_id and sequence_id into a single 64-bit key.
-    return (clock_id << 16) | sequence_id; 
+gptp_cycle_id_t gptp_cycle_id(const uint8_t port_identity[10], uint16_t sequence_id, gptp_cycle_kind_t kind) {
+    gptp_cycle_id_t id = { read_be64(port_identity), read_be16(port_identity + 8), sequence_id, (uint8_t)kind };
+    return id;
+}
+
+static gptp_cycle_id_t gptp_cycle_identity(const gptp_cycle_t *cycle) {
+    gptp_cycle_id_t id = { cycle->clock_id, cycle->port_number, cycle->sequence_id, cycle->kind };
+    return id;
 }
 
+/*
+ * @return The table key of a cycle. The port number, sequenceId and kind occupy disjoint
+ *         bits, so only cycles of different clocks can share it.
+ */
+static uint64_t gptp_cycle_hash(const gptp_cycle_id_t *id) {
+    return (id->clock_id * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)id->port_number << 32) ^ ((uint64_t)id->sequence_id << 8) ^ id->kind;
+}
+
+// Tells apart the cycles stored under one key; the context is the gptp_cycle_id_t looked up
+static int gptp_cycle_matches(const void *context, uint64_t value) {
+    const gptp_cycle_id_t *id = (const gptp_cycle_id_t *)context;
+    const gptp_cycle_t *cycle = (const gptp_cycle_t *)(uintptr_t)value;
+    return cycle->clock_id == id->clock_id && cycle->port_number == id->port_number &&
+           cycle->sequence_id == id->sequence_id && cycle->kind == id->kind;
+}
 
 /*
  * Inserts or updates a gptp_cycle_t in the hash map.
- * If the key exists, returns its associated cycle for update.
+ * If the cycle exists, returns it for update.
  * If not, creates a new cycle and returns it.
  * @param map The hash map.
- * @param key The 64-bit key for the cycle.
+ * @param id The identity of the cycle.
  * @return Pointer to the gptp_cycle_t, or NULL on memory allocation failure.
  */
-gptp_cycle_t* gptp_cycle_map_insert_or_get(gptp_cycle_map_t *map, uint64_t key) {
+gptp_cycle_t* gptp_cycle_map_insert_or_get(gptp_cycle_map_t *map, const gptp_cycle_id_t *id) {
     if (map == NULL) {
         return NULL;
     }
 
-    size_t index = gptp_cycle_map_hash(map, key);
-    cycle_map_entry_t *current = map->buckets[index];
-
-    while (current != NULL) {
-        if (current->key == key) {
-            return current->cycle; 
-        }
-        current = current->next;
+    uint64_t key = gptp_cycle_hash(id);
+    hash_key_match_t match = { gptp_cycle_matches, id };
+    const uint64_t *slot = hash_table_find_match(&map->table, key, &match);
+    if (slot != NULL) {
+        return (gptp_cycle_t *)(uintptr_t)*slot;
     }
 
-    cycle_map_entry_t *new_entry = (cycle_map_entry_t *)malloc(sizeof(cycle_map_entry_t));
-    if (new_entry == NULL) {
-        perror("Failed to allocate memory for cycle map entry");
+    gptp_cycle_t *new_cycle = (gptp_cycle_t *)slab_alloc(&map->cycles);
+    if (new_cycle == NULL) {
         return NULL;
     }
-    gptp_cycle_t *new_cycle = (gptp_cycle_t *)calloc(1, sizeof(gptp_cycle_t));
-    if (new_cycle == NULL) {
-        perror("Failed to allocate memory for gPTP cycle");
-        free(new_entry);
+    if (hash_table_add(&map->table, key, (uintptr_t)new_cycle) == NULL) {
+        slab_release(&map->cycles, new_cycle);
         return NULL;
     }
+    memset(new_cycle, 0, sizeof(*new_cycle));
 
-    new_entry->key = key;
-    new_entry->cycle = new_cycle;
-    new_entry->next = map->buckets[index]; 
-    map->buckets[index] = new_entry;
-    
     new_cycle->state = GPTP_CYCLE_STATE_INIT;
-    new_cycle->sequence_id = (uint16_t)(key & 0xFFFF);
-    new_cycle->last_update_time = time(NULL);
-
+    new_cycle->clock_id = id->clock_id;
+    new_cycle->port_number = id->port_number;
+    new_cycle->sequence_id = id->sequence_id;
+    new_cycle->kind = id->kind;
     return new_cycle;
 }
 
 /*
  * Looks up a gptp_cycle_t in the hash map.
  * @param map The hash map.
- * @param key The 64-bit key to look up.
+ * @param id The identity to look up.
  * @return Pointer to the gptp_cycle_t if found, otherwise NULL.
  */
-gptp_cycle_t* gptp_cycle_map_lookup(const gptp_cycle_map_t *map, uint64_t key) {
+gptp_cycle_t* gptp_cycle_map_lookup(const gptp_cycle_map_t *map, const gptp_cycle_id_t *id) {
     if (map == NULL) {
         return NULL;
     }
 
-    size_t index = gptp_cycle_map_hash(map, key);
-    cycle_map_entry_t *current = map->buckets[index];
+    hash_key_match_t match = { gptp_cycle_matches, id };
+    const uint64_t *slot = hash_table_find_match(&map->table, gptp_cycle_hash(id), &match);
+    return slot != NULL ? (gptp_cycle_t *)(uintptr_t)*slot : NULL;
+}
+
+/*
+ * Removes a gptp_cycle_t from the hash map and returns it to the map's slab for reuse.
+ * @param map The hash map.
+ * @param id The identity of the cycle to remove.
+ * @return 0 on success, -1 if the cycle is not found.
+ */
+int gptp_cycle_map_remove(gptp_cycle_map_t *map, const gptp_cycle_id_t *id) {
+    if (map == NULL) {
+        return -1;
+    }
+
+    hash_key_match_t match = { gptp_cycle_matches, id };
+    uint64_t value;
+    if (hash_table_remove_match(&map->table, gptp_cycle_hash(id), &match, &value) != 0) {
+        return -1;
+    }
+    gptp_cycle_t *cycle = (gptp_cycle_t *)(uintptr_t)value;
+    timing_wheel_cancel(&map->wheel, &cycle->expiry);
+    slab_release(&map->cycles, cycle);
+    return 0;
+}
+
+/*
+ * @param map The hash map.
+ * @return The number of cycles being tracked.
+ */
+size_t gptp_cycle_map_size(const gptp_cycle_map_t *map) {
+    return hash_table_size(&map->table);
+}
+
+/*
+ * Interns a MAC address in the map's endpoint table.
+ * @param map The hash map.
+ * @param mac The MAC address.
+ * @return The endpoint ID (never 0), or 0 on memory allocation failure.
+ */
+uint32_t gptp_cycle_map_intern_endpoint(gptp_cycle_map_t *map, const uint8_t mac[6]) {
+    gptp_endpoint_table_t *table = &map->endpoints;
+    uint64_t key = 0;
+    memcpy(&key, mac, 6);
+
+    int inserted;
+    uint64_t *slot = hash_table_insert(&table->index, key, &inserted);
+    if (slot == NULL) {
+        return 0;
+    }
+    if (!inserted) {
+        return (uint32_t)*slot;
+    }
 
-    while (current != NULL) {
-        if (current->key == key) {
-            return current->cycle;
+    // ID 0 means "none", so IDs start at 1
+    if (table->count + 1 >= table->capacity) {
+        uint32_t capacity = table->capacity ? table->capacity * 2 : ENDPOINT_TABLE_INITIAL_SIZE;
+        gptp_endpoint_t *grown = (gptp_endpoint_t *)realloc(table->endpoints, capacity * sizeof(gptp_endpoint_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for gPTP endpoints");
+            hash_table_remove(&table->index, key, NULL);
+            return 0;
         }
-        current = current->next;
+        table->endpoints = grown;
+        table->capacity = capacity;
     }
-    return NULL;
+    uint32_t id = ++table->count;
+    memcpy(table->endpoints[id].mac, mac, 6);
+    *slot = id;
+    return id;
 }
 
 /*
- * Removes a gptp_cycle_t from the hash map and frees its memory.
  * @param map The hash map.
- * @param key The 64-bit key of the cycle to remove.
- * @return 0 on success, -1 if key not found.
+ * @param id An endpoint ID returned by gptp_cycle_map_intern_endpoint().
+ * @return The endpoint, or NULL for ID 0.
  */
-int gptp_cycle_map_remove(gptp_cycle_map_t *map, uint64_t key) {
-    if (map == NULL) {
-        return -1;
+const gptp_endpoint_t* gptp_cycle_map_endpoint(const gptp_cycle_map_t *map, uint32_t id) {
+    if (id == 0 || id > map->endpoints.count) {
+        return NULL;
     }
+    return &map->endpoints.endpoints[id];
+}
 
-    size_t index = gptp_cycle_map_hash(map, key);
-    cycle_map_entry_t *current = map->buckets[index];
-    cycle_map_entry_t *prev = NULL;
+// Messages of each exchange in protocol order, indexing gptp_cycle_t.capture_ts_ns; -1 pads shorter exchanges
+static const int8_t gptp_exchange[][GPTP_CYCLE_MAX_MESSAGES] = {
+    [GPTP_CYCLE_SYNC]   = { PTP_MESSAGE_SYNC, PTP_MESSAGE_FOLLOW_UP, -1 },
+    [GPTP_CYCLE_PDELAY] = { PTP_MESSAGE_PDELAY_REQ, PTP_MESSAGE_PDELAY_RESP, PTP_MESSAGE_PDELAY_RESP_FOLLOW_UP },
+    [GPTP_CYCLE_DELAY]  = { PTP_MESSAGE_DELAY_REQ, PTP_MESSAGE_DELAY_RESP, -1 },
+};
 
-    while (current != NULL) {
-        if (current->key == key) {
-            if (prev == NULL) {
-                map->buckets[index] = current->next;
-            } else {
-                prev->next = current->next;
+/*
+ * @return The bitmask of (1 << ptp_message_type_t) of every message in an exchange.
+ */
+static uint16_t gptp_exchange_mask(gptp_cycle_kind_t kind) {
+    uint16_t mask = 0;
+    for (int i = 0; i < GPTP_CYCLE_MAX_MESSAGES && gptp_exchange[kind][i] >= 0; i++) {
+        mask |= (uint16_t)(1u << gptp_exchange[kind][i]);
+    }
+    return mask;
+}
+
+/*
+ * Finds the exchange a message belongs to and its position in it.
+ * @return The position, or -1 for messages not tracked as cycles.
+ */
+static int gptp_message_position(uint8_t message_type, gptp_cycle_kind_t *kind) {
+    for (int k = GPTP_CYCLE_SYNC; k <= GPTP_CYCLE_DELAY; k++) {
+        for (int i = 0; i < GPTP_CYCLE_MAX_MESSAGES; i++) {
+            if (gptp_exchange[k][i] == message_type) {
+                *kind = (gptp_cycle_kind_t)k;
+                return i;
             }
-            free(current->cycle);
-            free(current);
-            return 0;
         }
-        prev = current;
-        current = current->next;
     }
     return -1;
 }
 
 /*
- * Frees all memory allocated by the gptp_cycle hash map.
+ * @param cycle The cycle.
+ * @return Capture time of the earliest message recorded in the cycle, 0 if none.
+ */
+int64_t gptp_cycle_first_update(const gptp_cycle_t *cycle) {
+    int64_t first = 0;
+    for (int i = 0; i < GPTP_CYCLE_MAX_MESSAGES && gptp_exchange[cycle->kind][i] >= 0; i++) {
+        int64_t ts = cycle->capture_ts_ns[i];
+        if ((cycle->messages_seen & (1u << gptp_exchange[cycle->kind][i])) && (first == 0 || ts < first)) {
+            first = ts;
+        }
+    }
+    return first != 0 ? first : cycle->last_update_ns;
+}
+
+/*
+ * @return A printable name for an event.
+ */
+const char* gptp_event_type_name(gptp_event_type_t event) {
+    switch (event) {
+        case GPTP_EVENT_TIMEOUT:      return "timed out";
+        case GPTP_EVENT_COMPLETE:     return "complete";
+        case GPTP_EVENT_OUT_OF_ORDER: return "out of order";
+        case GPTP_EVENT_INVALID:      return "invalid";
+    }
+    return "unknown";
+}
+
+/*
+ * Records a message of a cycle at the given capture time and pushes its expiry back to
+ * timeout_ns after it.
+ * @param map The hash map holding the cycle.
+ * @param cycle The cycle.
+ * @param capture_ts_ns Capture time of the message.
+ */
+void gptp_cycle_map_touch(gptp_cycle_map_t *map, gptp_cycle_t *cycle, int64_t capture_ts_ns) {
+    if (capture_ts_ns > cycle->last_update_ns) {
+        cycle->last_update_ns = capture_ts_ns;
+    }
+    timing_wheel_schedule(&map->wheel, &cycle->expiry, cycle->last_update_ns + map->timeout_ns);
+}
+
+typedef struct {
+    gptp_cycle_map_t *map;
+    gptp_event_callback_t callback;
+    void *user;
+} gptp_expiry_context_t;
+
+/*
+ * Timing wheel callback: reports and removes an expired cycle, or keeps it for the
+ * merge if it may continue a cycle from before the map's first message.
+ */
+static void gptp_cycle_expire(timer_node_t *node, void *user) {
+    gptp_expiry_context_t *expiry = (gptp_expiry_context_t *)user;
+    gptp_cycle_t *cycle = (gptp_cycle_t *)((char *)node - offsetof(gptp_cycle_t, expiry));
+
+    if (expiry->map->hold_boundary && gptp_cycle_first_update(cycle) < expiry->map->hold_until_ns) {
+        return;
+    }
+    expiry->map->expired++;
+    if (expiry->callback != NULL) {
+        expiry->callback(GPTP_EVENT_TIMEOUT, cycle, expiry->user);
+    }
+    gptp_cycle_id_t id = gptp_cycle_identity(cycle);
+    gptp_cycle_map_remove(expiry->map, &id);
+}
+
+/*
+ * Advances the map's capture clock, removing every cycle that has gone timeout_ns
+ * without a message. Cost is proportional to the cycles expired, not the cycles tracked.
+ * @param map The hash map.
+ * @param capture_ts_ns Capture time of the current packet.
+ * @param callback Called with GPTP_EVENT_TIMEOUT before each expired cycle is removed; may be NULL.
+ * @param user Passed to callback.
+ */
+void gptp_cycle_map_advance(gptp_cycle_map_t *map, int64_t capture_ts_ns, gptp_event_callback_t callback, void *user) {
+    if (capture_ts_ns > map->last_capture_ns) {
+        map->last_capture_ns = capture_ts_ns;
+    }
+    if (map->hold_boundary && map->hold_until_ns == 0) {
+        map->hold_until_ns = capture_ts_ns + map->timeout_ns;
+    }
+    gptp_expiry_context_t expiry = { map, callback, user };
+    timing_wheel_advance(&map->wheel, capture_ts_ns, gptp_cycle_expire, &expiry);
+}
+
+/*
+ * Derives the cycle state from the set of messages recorded for it.
+ * @param kind The exchange the cycle tracks.
+ * @param messages_seen Bitmask of (1 << ptp_message_type_t).
+ * @return COMPLETE once every message is present, otherwise the state of the furthest
+ *         message in protocol order (earlier ones may still be missing).
+ */
+static gptp_cycle_state_t gptp_cycle_state_from_messages(gptp_cycle_kind_t kind, uint32_t messages_seen) {
+    if ((messages_seen & gptp_exchange_mask(kind)) == gptp_exchange_mask(kind)) {
+        return GPTP_CYCLE_STATE_COMPLETE;
+    }
+    if (messages_seen & (1u << PTP_MESSAGE_DELAY_RESP)) {
+        return GPTP_CYCLE_STATE_DELAY_RESP_RECEIVED;
+    }
+    if (messages_seen & (1u << PTP_MESSAGE_DELAY_REQ)) {
+        return GPTP_CYCLE_STATE_DELAY_REQ_RECEIVED;
+    }
+    if (messages_seen & (1u << PTP_MESSAGE_PDELAY_RESP_FOLLOW_UP)) {
+        return GPTP_CYCLE_STATE_PDELAY_RESP_FOLLOW_UP_RECEIVED;
+    }
+    if (messages_seen & (1u << PTP_MESSAGE_PDELAY_RESP)) {
+        return GPTP_CYCLE_STATE_PDELAY_RESP_RECEIVED;
+    }
+    if (messages_seen & (1u << PTP_MESSAGE_PDELAY_REQ)) {
+        return GPTP_CYCLE_STATE_PDELAY_REQ_RECEIVED;
+    }
+    if (messages_seen & (1u << PTP_MESSAGE_FOLLOW_UP)) {
+        return GPTP_CYCLE_STATE_FOLLOW_UP_RECEIVED;
+    }
+    if (messages_seen & (1u << PTP_MESSAGE_SYNC)) {
+        return GPTP_CYCLE_STATE_SYNC_RECEIVED;
+    }
+    return GPTP_CYCLE_STATE_INIT;
+}
+
+/*
+ * Copies the fields one message contributes to a cycle, except the correction.
+ * @param position Position of the message in the cycle's exchange.
+ */
+static void gptp_cycle_copy_message(gptp_cycle_t *dst, const gptp_cycle_t *src, uint8_t message_type, int position) {
+    dst->capture_ts_ns[position] = src->capture_ts_ns[position];
+    if (message_type == PTP_MESSAGE_FOLLOW_UP || message_type == PTP_MESSAGE_PDELAY_RESP || message_type == PTP_MESSAGE_DELAY_RESP) {
+        dst->message_ts_ns[0] = src->message_ts_ns[0];
+    } else if (message_type == PTP_MESSAGE_PDELAY_RESP_FOLLOW_UP) {
+        dst->message_ts_ns[1] = src->message_ts_ns[1];
+    }
+}
+
+/*
+ * Counts the messages of a later part of a cycle that arrived after a message following
+ * them in the exchange, i.e. the out-of-order events their arrival would have reported.
+ * @param kind The exchange.
+ * @param earlier Messages seen before the later part.
+ * @param later Messages of the later part.
+ */
+static uint64_t gptp_count_out_of_order(gptp_cycle_kind_t kind, uint32_t earlier, uint32_t later) {
+    uint64_t count = 0;
+    uint32_t following = 0;
+    for (int i = GPTP_CYCLE_MAX_MESSAGES - 1; i >= 0; i--) {
+        if (gptp_exchange[kind][i] < 0) {
+            continue;
+        }
+        uint32_t bit = 1u << gptp_exchange[kind][i];
+        if ((later & bit) && (earlier & following)) {
+            count++;
+        }
+        following |= bit;
+    }
+    return count;
+}
+
+/*
+ * Translates an endpoint ID of one map into the ID of the same MAC in another, carrying
+ * over the port identity src last saw from it.
+ * @return The ID in dst (0 for none), or -1 on memory allocation failure.
+ */
+static int64_t gptp_endpoint_translate(gptp_cycle_map_t *dst, const gptp_cycle_map_t *src, uint32_t id) {
+    const gptp_endpoint_t *endpoint = gptp_cycle_map_endpoint(src, id);
+    if (endpoint == NULL) {
+        return 0;
+    }
+    uint32_t translated = gptp_cycle_map_intern_endpoint(dst, endpoint->mac);
+    if (translated == 0) {
+        return -1;
+    }
+    if (endpoint->clock_id != 0) {
+        dst->endpoints.endpoints[translated].clock_id = endpoint->clock_id;
+        dst->endpoints.endpoints[translated].port_number = endpoint->port_number;
+    }
+    return translated;
+}
+
+/*
+ * Stitches the messages recorded in src into dst. Used to join halves of a cycle
+ * that were tracked separately, e.g. on both sides of a chunk boundary.
+ * Messages already recorded in dst are kept. The correction sum of src is added only
+ * when the two halves share no message.
+ * @param dst_map The map holding dst, whose endpoint IDs dst uses.
+ * @param dst The cycle receiving the messages.
+ * @param src_map The map holding src.
+ * @param src The cycle to take missing messages from.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int gptp_cycle_stitch(gptp_cycle_map_t *dst_map, gptp_cycle_t *dst, const gptp_cycle_map_t *src_map, const gptp_cycle_t *src) {
+    if (dst->messages_seen == 0) {
+        dst->kind = src->kind;
+    }
+    uint32_t missing = src->messages_seen & ~dst->messages_seen;
+    for (int i = 0; i < GPTP_CYCLE_MAX_MESSAGES && gptp_exchange[dst->kind][i] >= 0; i++) {
+        uint8_t message_type = (uint8_t)gptp_exchange[dst->kind][i];
+        if (missing & (1u << message_type)) {
+            gptp_cycle_copy_message(dst, src, message_type, i);
+        }
+    }
+    if (!(src->messages_seen & dst->messages_seen)) {
+        dst->correction += src->correction;
+    }
+    for (int role = 0; role < GPTP_ENDPOINT_COUNT; role++) {
+        if (dst->endpoints[role] == 0 && src->endpoints[role] != 0) {
+            int64_t id = gptp_endpoint_translate(dst_map, src_map, src->endpoints[role]);
+            if (id < 0) {
+                return -1;
+            }
+            dst->endpoints[role] = (uint32_t)id;
+        }
+    }
+
+    dst->messages_seen |= src->messages_seen;
+    dst->state = gptp_cycle_state_from_messages(dst->kind, dst->messages_seen);
+    if (src->last_update_ns > dst->last_update_ns) {
+        dst->last_update_ns = src->last_update_ns;
+    }
+    return 0;
+}
+
+/*
+ * Runs one message through the cycle state machine. O(1): one table lookup, and at
+ * most one removal and reinsertion.
+ * A message starts or extends the cycle of its exchange. A message the cycle already has,
+ * or a response from a different responder than the one already recorded, makes
+ * the cycle invalid; it is reported and removed, and the message starts a new cycle.
+ * A message arriving after one that follows it in the exchange is reported as out of
+ * order. Once every message of the exchange is present the cycle is reported as complete
+ * and removed, so only cycles still waiting for messages stay in the map.
+ * @param map The hash map.
+ * @param message_type The ptp_message_type_t; types not tracked as cycles are ignored.
+ * @param cycle_port_identity The 10-byte port identity the cycle is keyed by: the master's
+ *        (Sync, Follow_Up) or the requester's (Pdelay and Delay messages).
+ * @param sequence_id The message's sequenceId.
+ * @param capture_ts_ns Capture time of the message.
+ * @param message_ts_ns Timestamp carried in the message body, in nanoseconds (0 if none).
+ * @param correction The message's correctionField (2^-16 ns).
+ * @param source_port_identity The message's sourcePortIdentity (10 bytes), remembered for
+ *        its source endpoint.
+ * @param eth_src_mac Source MAC address.
+ * @param eth_dst_mac Destination MAC address.
+ * @param callback Called for each event; may be NULL.
+ * @param user Passed to callback.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int gptp_cycle_map_record(gptp_cycle_map_t *map, uint8_t message_type, const uint8_t *cycle_port_identity, uint16_t sequence_id, int64_t capture_ts_ns, int64_t message_ts_ns,
+                          int64_t correction, const uint8_t *source_port_identity, const uint8_t *eth_src_mac, const uint8_t *eth_dst_mac,
+                          gptp_event_callback_t callback, void *user) {
+    gptp_cycle_kind_t kind;
+    int position = gptp_message_position(message_type, &kind);
+    if (position < 0) {
+        return 0;
+    }
+    gptp_cycle_id_t id = gptp_cycle_id(cycle_port_identity, sequence_id, kind);
+    gptp_cycle_t *cycle = gptp_cycle_map_insert_or_get(map, &id);
+    if (cycle == NULL) {
+        return -1;
+    }
+
+    uint32_t bit = 1u << message_type;
+    uint32_t src_id = gptp_cycle_map_intern_endpoint(map, eth_src_mac);
+    uint32_t dst_id = gptp_cycle_map_intern_endpoint(map, eth_dst_mac);
+    if (src_id != 0) {
+        map->endpoints.endpoints[src_id].clock_id = read_be64(source_port_identity);
+        map->endpoints.endpoints[src_id].port_number = read_be16(source_port_identity + 8);
+    }
+    int is_response = kind != GPTP_CYCLE_SYNC && position > 0;
+    uint32_t responder = cycle->endpoints[GPTP_ENDPOINT_RESP_SRC];
+    if ((cycle->messages_seen & bit) || (is_response && responder != 0 && src_id != 0 && responder != src_id)) {
+        cycle->state = GPTP_CYCLE_STATE_INVALID;
+        map->invalid++;
+        if (callback != NULL) {
+            callback(GPTP_EVENT_INVALID, cycle, user);
+        }
+        gptp_cycle_map_remove(map, &id);
+        cycle = gptp_cycle_map_insert_or_get(map, &id);
+        if (cycle == NULL) {
+            return -1;
+        }
+    }
+
+    cycle->capture_ts_ns[position] = capture_ts_ns;
+    if (message_type == PTP_MESSAGE_FOLLOW_UP || message_type == PTP_MESSAGE_PDELAY_RESP || message_type == PTP_MESSAGE_DELAY_RESP) {
+        cycle->message_ts_ns[0] = message_ts_ns;
+    } else if (message_type == PTP_MESSAGE_PDELAY_RESP_FOLLOW_UP) {
+        cycle->message_ts_ns[1] = message_ts_ns;
+    }
+    if (message_type == PTP_MESSAGE_PDELAY_RESP) {
+        cycle->correction -= correction;
+    } else if (message_type != PTP_MESSAGE_PDELAY_REQ && message_type != PTP_MESSAGE_DELAY_REQ) {
+        cycle->correction += correction;
+    }
+
+    gptp_endpoint_role_t src_role = kind == GPTP_CYCLE_SYNC ? GPTP_ENDPOINT_SYNC_SRC
+                                  : is_response ? GPTP_ENDPOINT_RESP_SRC : GPTP_ENDPOINT_REQ_SRC;
+    if (cycle->endpoints[src_role] == 0) {
+        cycle->endpoints[src_role] = src_id;
+    }
+    // Each role's destination follows its source in gptp_endpoint_role_t
+    if (cycle->endpoints[src_role + 1] == 0) {
+        cycle->endpoints[src_role + 1] = dst_id;
+    }
+
+    // Messages that follow this one in the exchange and arrived before it
+    uint32_t later = 0;
+    for (int i = position + 1; i < GPTP_CYCLE_MAX_MESSAGES && gptp_exchange[kind][i] >= 0; i++) {
+        later |= 1u << gptp_exchange[kind][i];
+    }
+    int out_of_order = (cycle->messages_seen & later) != 0;
+    cycle->messages_seen |= (uint16_t)bit;
+    cycle->state = gptp_cycle_state_from_messages(kind, cycle->messages_seen);
+
+    if (out_of_order) {
+        map->out_of_order++;
+        if (callback != NULL) {
+            callback(GPTP_EVENT_OUT_OF_ORDER, cycle, user);
+        }
+    }
+    if (cycle->state == GPTP_CYCLE_STATE_COMPLETE) {
+        if (capture_ts_ns > cycle->last_update_ns) {
+            cycle->last_update_ns = capture_ts_ns;
+        }
+        map->completed++;
+        if (callback != NULL) {
+            callback(GPTP_EVENT_COMPLETE, cycle, user);
+        }
+        gptp_cycle_map_remove(map, &id);
+        return 0;
+    }
+    gptp_cycle_map_touch(map, cycle, capture_ts_ns);
+    return 0;
+}
+
+/*
+ * Merges every cycle of src into dst, stitching cycles present in both.
+ * Partial maps must be merged in capture order (dst holds the earlier part). Counts then
+ * match a sequential scan, except that a repeated message whose cycle src already
+ * completed leaves the earlier part to time out rather than be reported invalid.
+ * Only cycles completed by joining two halves are reported; no events are reported for
+ * cycles invalidated or expired by the merge.
+ * @param dst The map receiving the cycles.
+ * @param src The map to merge from; left unchanged.
+ * @param callback Called with GPTP_EVENT_COMPLETE for each cycle the merge completes; may be NULL.
+ * @param user Passed to callback.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int gptp_cycle_map_merge(gptp_cycle_map_t *dst, const gptp_cycle_map_t *src, gptp_event_callback_t callback, void *user) {
+    if (dst == NULL || src == NULL) {
+        return -1;
+    }
+
+    size_t cursor = 0;
+    uint64_t key;
+    uint64_t value;
+    while (hash_table_next(&src->table, &cursor, &key, &value)) {
+        const gptp_cycle_t *part = (const gptp_cycle_t *)(uintptr_t)value;
+        gptp_cycle_id_t id = gptp_cycle_identity(part);
+        gptp_cycle_t *cycle = gptp_cycle_map_insert_or_get(dst, &id);
+        if (cycle == NULL) {
+            return -1;
+        }
+        // Account for the later part's messages as a sequential scan would have on their arrival
+        int64_t responder = gptp_endpoint_translate(dst, src, part->endpoints[GPTP_ENDPOINT_RESP_SRC]);
+        if (responder < 0) {
+            return -1;
+        }
+        uint32_t earlier_responder = cycle->endpoints[GPTP_ENDPOINT_RESP_SRC];
+        if ((cycle->messages_seen & part->messages_seen) || (responder != 0 && earlier_responder != 0 && responder != earlier_responder)) {
+            dst->invalid++;
+            gptp_cycle_map_remove(dst, &id);
+            cycle = gptp_cycle_map_insert_or_get(dst, &id);
+            if (cycle == NULL) {
+                return -1;
+            }
+        } else {
+            dst->out_of_order += gptp_count_out_of_order(part->kind, cycle->messages_seen, part->messages_seen);
+        }
+        if (gptp_cycle_stitch(dst, cycle, src, part) != 0) {
+            return -1;
+        }
+        // Halves joined at a boundary may complete the cycle
+        if (cycle->state == GPTP_CYCLE_STATE_COMPLETE) {
+            dst->completed++;
+            if (callback != NULL) {
+                callback(GPTP_EVENT_COMPLETE, cycle, user);
+            }
+            gptp_cycle_map_remove(dst, &id);
+        } else {
+            timing_wheel_schedule(&dst->wheel, &cycle->expiry, cycle->last_update_ns + dst->timeout_ns);
+        }
+    }
+    dst->completed += src->completed;
+    dst->out_of_order += src->out_of_order;
+    dst->invalid += src->invalid;
+    dst->expired += src->expired;
+
+    // Cycles src held back for the merge expire here if src's capture time passed their deadline
+    if (src->last_capture_ns > dst->last_capture_ns) {
+        gptp_cycle_map_advance(dst, src->last_capture_ns, NULL, NULL);
+    }
+    return 0;
+}
+
+/*
+ * Frees all memory allocated by the gptp_cycle hash map: the table arrays, the endpoint
+ * table and the cycle slabs, without visiting individual cycles. Their timers live in the cycles.
  * @param map The hash map to free.
  */
 void gptp_cycle_map_free(gptp_cycle_map_t *map) {
-    if (map == NULL || map->buckets == NULL) {
+    if (map == NULL) {
         return;
     }
+    slab_free_all(&map->cycles);
+    hash_table_free(&map->table);
+    hash_table_free(&map->endpoints.index);
+    free(map->endpoints.endpoints);
+    memset(&map->endpoints, 0, sizeof(map->endpoints));
+}
+
+/*
+ * Reads a PTP timestamp (big-endian 48-bit seconds, 32-bit nanoseconds) as nanoseconds.
+ * Seconds beyond the int64 range saturate.
+ */
+static int64_t read_ptp_timestamp_ns(const uint8_t *bytes) {
+    uint64_t seconds = ((uint64_t)read_be16(bytes) << 32) | read_be32(bytes + 2);
+    uint32_t nanoseconds = read_be32(bytes + 6);
+    if (seconds > (uint64_t)(INT64_MAX / 1000000000LL) - 1) {
+        return INT64_MAX;
+    }
+    return (int64_t)seconds * 1000000000LL + nanoseconds;
+}
 
-    for (size_t i = 0; i < map->size; i++) {
-        cycle_map_entry_t *current = map->buckets[i];
-        while (current != NULL) {
-            cycle_map_entry_t *to_free = current;
-            current = current->next;
-            free(to_free->cycle);
-            free(to_free);
+/*
+ * @return The clock identity last seen from the endpoint in a role of a cycle, 0 if unknown.
+ */
+static uint64_t gptp_cycle_endpoint_clock(const gptp_cycle_map_t *map, const gptp_cycle_t *cycle, gptp_endpoint_role_t role) {
+    const gptp_endpoint_t *endpoint = gptp_cycle_map_endpoint(map, cycle->endpoints[role]);
+    return endpoint != NULL ? endpoint->clock_id : 0;
+}
+
+/*
+ * Feeds a completed cycle to the offset engine of a file context: a Sync cycle becomes
+ * its master's latest Sync (t1 from the Follow_Up, t2 its capture time) and a Delay cycle
+ * a delay measurement (t3 the Delay_Req's capture time, t4 from the Delay_Resp).
+ * Capture times stand in for the slave's timestamps, so results describe the capture
+ * point's view of the slave clock.
+ * @return The pair updated by a Delay cycle, or NULL.
+ */
+static const ptp_offset_pair_t* record_gptp_offsets(file_context_t *file_ctx, const gptp_cycle_t *cycle) {
+    const ptp_offset_pair_t *pair = NULL;
+    int result = 0;
+    if (cycle->kind == GPTP_CYCLE_SYNC) {
+        uint64_t master_id = gptp_cycle_endpoint_clock(&file_ctx->cycle_map, cycle, GPTP_ENDPOINT_SYNC_SRC);
+        if (master_id != 0) {
+            result = ptp_offset_record_sync(&file_ctx->offsets, master_id, cycle->message_ts_ns[0], cycle->capture_ts_ns[0], cycle->correction);
+        }
+    } else if (cycle->kind == GPTP_CYCLE_DELAY) {
+        uint64_t master_id = gptp_cycle_endpoint_clock(&file_ctx->cycle_map, cycle, GPTP_ENDPOINT_RESP_SRC);
+        ptp_delay_sample_t sample = {
+            .slave_id = gptp_cycle_endpoint_clock(&file_ctx->cycle_map, cycle, GPTP_ENDPOINT_REQ_SRC),
+            .request_capture_ns = cycle->capture_ts_ns[0],
+            .receive_ns = cycle->message_ts_ns[0],
+            .correction = cycle->correction,
+        };
+        if (master_id != 0 && sample.slave_id != 0) {
+            result = ptp_offset_record_delay(&file_ctx->offsets, master_id, &sample, &pair);
         }
     }
-    free(map->buckets);
-    map->buckets = NULL;
-    map->size = 0;
+    if (result != 0) {
+        fprintf(stderr, "Failed to record clock offset.\n");
+    }
+    return pair;
+}
+
+/*
+ * Feeds a completed Pdelay cycle to the peer-delay tracker of a file context, on the link
+ * from the requester's port to the responder's. The requester's port is the one the cycle
+ * is keyed by; the responder's is the one last seen from the MAC the responses came from.
+ * The capture times of the Pdelay_Req and Pdelay_Resp stand in for the requester's t1 and t4.
+ * @return The link updated, or NULL.
+ */
+static const pdelay_link_t* record_gptp_link_delay(file_context_t *file_ctx, const gptp_cycle_t *cycle) {
+    if (cycle->kind != GPTP_CYCLE_PDELAY) {
+        return NULL;
+    }
+    const gptp_endpoint_t *responder = gptp_cycle_map_endpoint(&file_ctx->cycle_map, cycle->endpoints[GPTP_ENDPOINT_RESP_SRC]);
+    if (cycle->clock_id == 0 || responder == NULL || responder->clock_id == 0) {
+        return NULL;
+    }
+    pdelay_exchange_t exchange = {
+        .request_capture_ns = cycle->capture_ts_ns[0],
+        .request_receipt_ns = cycle->message_ts_ns[0],
+        .response_origin_ns = cycle->message_ts_ns[1],
+        .response_capture_ns = cycle->capture_ts_ns[1],
+        .turnaround_correction = cycle->correction,
+    };
+    const pdelay_link_t *link = NULL;
+    if (pdelay_tracker_record(&file_ctx->links, cycle->clock_id, cycle->port_number, responder->clock_id,
+                              responder->port_number, &exchange, &link) != 0) {
+        fprintf(stderr, "Failed to record link delay.\n");
+    }
+    return link;
+}
+
+/*
+ * Reports gPTP cycle events in the output of the file context passed as user, feeding
+ * completed cycles to its offset engine and peer-delay tracker.
+ */
+static void report_gptp_event(gptp_event_type_t event, const gptp_cycle_t *cycle, void *user) {
+    file_context_t *file_ctx = (file_context_t *)user;
+    const ptp_offset_pair_t *pair = NULL;
+    const pdelay_link_t *link = NULL;
+    if (event == GPTP_EVENT_COMPLETE) {
+        pair = record_gptp_offsets(file_ctx, cycle);
+        link = record_gptp_link_delay(file_ctx, cycle);
+    }
+    if (file_ctx->verbosity != OUTPUT_VERBOSE) {
+        return;
+    }
+    static const char *const kind_names[] = {
+        [GPTP_CYCLE_SYNC] = "        gPTP Sync cycle ",
+        [GPTP_CYCLE_PDELAY] = "        gPTP Pdelay cycle ",
+        [GPTP_CYCLE_DELAY] = "        gPTP Delay cycle ",
+    };
+    output_str(file_ctx->out, kind_names[cycle->kind]);
+    output_str(file_ctx->out, gptp_event_type_name(event));
+    output_str(file_ctx->out, ": sequenceId ");
+    output_uint(file_ctx->out, cycle->sequence_id);
+    output_str(file_ctx->out, ", clock 0x");
+    output_hex(file_ctx->out, cycle->clock_id, 16, 0);
+    output_str(file_ctx->out, ":");
+    output_uint(file_ctx->out, cycle->port_number);
+    output_str(file_ctx->out, ", last message at ");
+    output_int(file_ctx->out, cycle->last_update_ns);
+    output_str(file_ctx->out, " ns\n");
+    if (pair != NULL) {
+        char offset[32];
+        char delay[32];
+        ptp_scaled_ns_format(pair->last_offset, offset, sizeof(offset));
+        ptp_scaled_ns_format(pair->last_delay, delay, sizeof(delay));
+        output_str(file_ctx->out, "        E2E offset from master 0x");
+        output_hex(file_ctx->out, pair->master_id, 16, 0);
+        output_str(file_ctx->out, ": ");
+        output_str(file_ctx->out, offset);
+        output_str(file_ctx->out, " ns, mean path delay ");
+        output_str(file_ctx->out, delay);
+        output_str(file_ctx->out, " ns\n");
+    }
+    if (link != NULL) {
+        char delay[32];
+        char window_mean[32];
+        char rate_ratio[32];
+        ptp_scaled_ns_format(link->last_delay, delay, sizeof(delay));
+        ptp_scaled_ns_format(pdelay_link_window_mean(link), window_mean, sizeof(window_mean));
+        pdelay_rate_ratio_format(link->rate_ratio, rate_ratio, sizeof(rate_ratio));
+        output_str(file_ctx->out, "        Pdelay link 0x");
+        output_hex(file_ctx->out, link->requester_id, 16, 0);
+        output_str(file_ctx->out, ":");
+        output_uint(file_ctx->out, link->requester_port);
+        output_str(file_ctx->out, " -> 0x");
+        output_hex(file_ctx->out, link->responder_id, 16, 0);
+        output_str(file_ctx->out, ":");
+        output_uint(file_ctx->out, link->responder_port);
+        output_str(file_ctx->out, ": meanLinkDelay ");
+        output_str(file_ctx->out, delay);
+        output_str(file_ctx->out, " ns (window mean ");
+        output_str(file_ctx->out, window_mean);
+        output_str(file_ctx->out, " ns), neighborRateRatio ");
+        output_str(file_ctx->out, rate_ratio);
+        output_str(file_ctx->out, "\n");
+    }
+}
+
+/*
+ * Cycle merge callback: feeds cycles completed at a chunk boundary to the offset engine
+ * and peer-delay tracker of the file context passed as user. Their events are not printed, as the output of
+ * both chunks has already been written.
+ */
+static void record_merged_gptp_event(gptp_event_type_t event, const gptp_cycle_t *cycle, void *user) {
+    if (event == GPTP_EVENT_COMPLETE) {
+        record_gptp_offsets((file_context_t *)user, cycle);
+        record_gptp_link_delay((file_context_t *)user, cycle);
+    }
+}
+
+/*
+ * Feeds a message's sequenceId to the sequence tracker and reports gaps, duplicates,
+ * reordering and resyncs in the output.
+ */
+static void record_sequence_id(file_context_t *file_ctx, const uint8_t *source_port_identity, ptp_message_type_t message_type, uint16_t sequence_id) {
+    const sequence_source_t *source;
+    sequence_event_t event;
+    if (sequence_tracker_record(&file_ctx->sequences, read_be64(source_port_identity), read_be16(source_port_identity + 8),
+                                (uint8_t)message_type, sequence_id, &source, &event) != 0) {
+        fprintf(stderr, "Failed to record sequenceId.\n");
+        return;
+    }
+    if (file_ctx->verbosity != OUTPUT_VERBOSE || event == SEQUENCE_IN_ORDER || event == SEQUENCE_DEFERRED) {
+        return;
+    }
+    output_str(file_ctx->out, "        Sequence ");
+    output_str(file_ctx->out, sequence_event_name(event));
+    output_str(file_ctx->out, ": ");
+    output_str(file_ctx->out, ptp_message_type_name(message_type));
+    output_str(file_ctx->out, " sequenceId ");
+    output_uint(file_ctx->out, sequence_id);
+    output_str(file_ctx->out, " from 0x");
+    output_hex(file_ctx->out, source->clock_id, 16, 0);
+    output_str(file_ctx->out, ":");
+    output_uint(file_ctx->out, source->port_number);
+    output_str(file_ctx->out, "\n");
+}
+
+/*
+ * Prints the grandmaster changes an Announce or timeout appended to the BMCA timeline.
+ */
+static void report_bmca_changes(file_context_t *file_ctx, size_t first_change) {
+    if (file_ctx->verbosity != OUTPUT_VERBOSE) {
+        return;
+    }
+    for (size_t i = first_change; i < file_ctx->bmca.change_count; i++) {
+        const bmca_change_t *change = &file_ctx->bmca.timeline[i];
+        output_str(file_ctx->out, "        BMCA domain ");
+        output_uint(file_ctx->out, change->domain);
+        output_str(file_ctx->out, ": grandmaster 0x");
+        output_hex(file_ctx->out, change->previous_id, 16, 0);
+        output_str(file_ctx->out, " -> 0x");
+        output_hex(file_ctx->out, change->grandmaster_id, 16, 0);
+        output_str(file_ctx->out, " (");
+        output_str(file_ctx->out, bmca_change_reason_name((bmca_change_reason_t)change->reason));
+        output_str(file_ctx->out, ")\n");
+    }
+}
+
+/*
+ * Feeds an Announce to the BMCA tracker. Fields are read at their on-wire offsets.
+ */
+static void record_announce(file_context_t *file_ctx, int64_t capture_ts_ns, const uint8_t *packet_data, uint32_t data_length) {
+    if (data_length < PTP_HEADER_WIRE_LENGTH + PTP_ANNOUNCE_BODY_LENGTH) {
+        return;
+    }
+    bmca_announce_t announce;
+    memset(&announce, 0, sizeof(announce));
+    announce.capture_ns = capture_ts_ns;
+    announce.domain = packet_data[4];
+    announce.log_interval = (int8_t)packet_data[33];
+    announce.dataset.sender_id = read_be64(packet_data + 20);
+    announce.dataset.sender_port = read_be16(packet_data + 28);
+    announce.dataset.priority1 = packet_data[47];
+    announce.dataset.clock_class = packet_data[48];
+    announce.dataset.clock_accuracy = packet_data[49];
+    announce.dataset.offset_scaled_log_variance = read_be16(packet_data + 50);
+    announce.dataset.priority2 = packet_data[52];
+    announce.dataset.grandmaster_id = read_be64(packet_data + 53);
+    announce.dataset.steps_removed = read_be16(packet_data + 61);
+
+    size_t first_change = file_ctx->bmca.change_count;
+    if (bmca_tracker_record(&file_ctx->bmca, &announce) != 0) {
+        fprintf(stderr, "Failed to record Announce.\n");
+        return;
+    }
+    report_bmca_changes(file_ctx, first_change);
+}
+
+/*
+ * Merges the gPTP cycle map, offset engine, peer-delay, sequence and BMCA trackers and interval analyzer of a chunk
+ * context into dst.
+ * Contexts must be merged in capture order.
+ * @param dst The context receiving the results.
+ * @param src The context to merge from; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int merge_gptp_results(file_context_t* dst, const file_context_t* src) {
+    if (gptp_cycle_map_merge(&dst->cycle_map, &src->cycle_map, record_merged_gptp_event, dst) != 0) {
+        return -1;
+    }
+    if (ptp_offset_merge(&dst->offsets, &src->offsets) != 0) {
+        return -1;
+    }
+    if (pdelay_tracker_merge(&dst->links, &src->links) != 0) {
+        return -1;
+    }
+    if (sequence_tracker_merge(&dst->sequences, &src->sequences) != 0) {
+        return -1;
+    }
+    if (interval_analyzer_merge(&dst->intervals, &src->intervals) != 0) {
+        return -1;
+    }
+    return bmca_tracker_merge(&dst->bmca, &src->bmca);
 }
 
 /*
  * Processes gPTP messages to track gPTP cycle states.
+ * Fields are read from the raw message in network byte order.
  * @param file_ctx The file context.
  * @param common_header The PTP common header.
+ * @param capture_ts_ns Capture time of the packet in nanoseconds.
  * @param packet_data Raw packet data.
  * @param data_length Length of the PTP message data.
  * @param eth_src_mac Source MAC address.
  * @param eth_dst_mac Destination MAC address.
  */
-void process_gptp_message(file_context_t* file_ctx, const ptp_common_header_t* common_header, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac) {
-    (void)packet_data; 
-    (void)data_length;
-    (void)eth_src_mac;
-    (void)eth_dst_mac;
+void process_gptp_message(file_context_t* file_ctx, const ptp_common_header_t* common_header, int64_t capture_ts_ns, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac) {
+    // Worker threads defer cycle tracking to the in-order commit stage
+    if (file_ctx->batch != NULL) {
+        if (pipeline_defer_gptp_message(file_ctx, common_header, capture_ts_ns, packet_data, data_length, eth_src_mac, eth_dst_mac) != 0) {
+            fprintf(stderr, "Failed to defer gPTP message.\n");
+        }
+        return;
+    }
+
+    // Capture time drives cycle expiry, so timeouts do not depend on how fast the file is read
+    gptp_cycle_map_advance(&file_ctx->cycle_map, capture_ts_ns, report_gptp_event, file_ctx);
+    size_t first_change = file_ctx->bmca.change_count;
+    if (bmca_tracker_advance(&file_ctx->bmca, capture_ts_ns) != 0) {
+        fprintf(stderr, "Failed to expire foreign masters.\n");
+    }
+    report_bmca_changes(file_ctx, first_change);
 
     ptp_message_type_t messageType = common_header->transportSpecific_messageType & 0x0F;
 
-    printf("        process_gptp_message called for message type: 0x%x\n", messageType);
+    uint16_t sequence_id = read_be16(packet_data + 30);
+    record_sequence_id(file_ctx, common_header->sourcePortIdentity, messageType, sequence_id);
+    if (interval_analyzer_record(&file_ctx->intervals, read_be64(common_header->sourcePortIdentity), read_be16(common_header->sourcePortIdentity + 8),
+                                 (uint8_t)messageType, (int8_t)packet_data[33], capture_ts_ns) != 0) {
+        fprintf(stderr, "Failed to record message interval.\n");
+    }
+    const uint8_t *port_identity = common_header->sourcePortIdentity;
+    const uint8_t *body = packet_data + PTP_HEADER_WIRE_LENGTH;
+    int64_t message_ts_ns = 0;
+    switch (messageType) {
+        case PTP_MESSAGE_SYNC:
+            break;
+        case PTP_MESSAGE_FOLLOW_UP:
+            if (data_length < PTP_HEADER_WIRE_LENGTH + PTP_TIMESTAMP_LENGTH) {
+                return;
+            }
+            message_ts_ns = read_ptp_timestamp_ns(body);
+            break;
+        case PTP_MESSAGE_PDELAY_REQ:
+        case PTP_MESSAGE_DELAY_REQ:
+            break;
+        case PTP_MESSAGE_PDELAY_RESP:
+        case PTP_MESSAGE_PDELAY_RESP_FOLLOW_UP:
+            // Responses are keyed by the requestingPortIdentity that follows the timestamp
+            if (data_length < PTP_HEADER_WIRE_LENGTH + PTP_TIMESTAMP_LENGTH + PTP_PORT_IDENTITY_LENGTH) {
+                return;
+            }
+            message_ts_ns = read_ptp_timestamp_ns(body);
+            port_identity = body + PTP_TIMESTAMP_LENGTH;
+            break;
+        case PTP_MESSAGE_DELAY_RESP:
+            // receiveTimestamp, then the requestingPortIdentity the cycle is keyed by
+            if (data_length < PTP_HEADER_WIRE_LENGTH + PTP_TIMESTAMP_LENGTH + PTP_PORT_IDENTITY_LENGTH) {
+                return;
+            }
+            message_ts_ns = read_ptp_timestamp_ns(body);
+            port_identity = body + PTP_TIMESTAMP_LENGTH;
+            break;
+        case PTP_MESSAGE_ANNOUNCE:
+            record_announce(file_ctx, capture_ts_ns, packet_data, data_length);
+            return;
+        default:
+            return;
+    }
+
+    int64_t correction = (int64_t)read_be64(packet_data + 8);
+    if (gptp_cycle_map_record(&file_ctx->cycle_map, (uint8_t)messageType, port_identity, sequence_id, capture_ts_ns, message_ts_ns, correction, common_header->sourcePortIdentity,
+                              eth_src_mac, eth_dst_mac, report_gptp_event, file_ctx) != 0) {
+        fprintf(stderr, "Failed to record gPTP message.\n");
+    }
+}
+
+/*
+ * Prints how many cycles completed, failed validation or timed out, and how many are
+ * still open.
+ * @param map The cycle map.
+ */
+void gptp_cycle_map_print(const gptp_cycle_map_t *map) {
+    printf("gPTP cycles completed: %llu\n", (unsigned long long)map->completed);
+    printf("gPTP cycles invalid: %llu\n", (unsigned long long)map->invalid);
+    printf("gPTP cycles timed out: %llu\n", (unsigned long long)map->expired);
+    printf("gPTP out-of-order messages: %llu\n", (unsigned long long)map->out_of_order);
+    printf("gPTP cycles still open: %zu\n", gptp_cycle_map_size(map));
 }
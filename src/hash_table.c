@@ -0,0 +1,444 @@
+// Open-addressing hash table in the style of SwissTable.
+//
+// Every slot has a control byte: CTRL_EMPTY, CTRL_DELETED, or the low 7 bits of the
+// key's hash (h2) when the slot is full. Slots are probed in aligned groups of 16: the
+// upper hash bits (h1) pick the first group, one vector compare finds the slots of the
+// group whose control byte equals h2, and only those keys are compared. A group that
+// still has an empty slot ends the probe. Groups are visited in triangular order, which
+// reaches every group of a power-of-two table.
+//
+// The maximum load is 7/8. Growing allocates the new array and leaves the old one in
+// place; each later insert or remove moves HASH_TABLE_MIGRATE_STEP old slots across,
+// so the cost of a resize is spread over the inserts that follow it.
+
+#include "../include/hash_table.h"
+#include "../include/profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define CTRL_EMPTY   ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xFE)
+#define SLOT_NOT_FOUND ((size_t)-1)
+
+/*
+ * Mixes a key into a well-distributed 64-bit hash (MurmurHash3 finalizer).
+ * Keys such as clock_id << 16 | sequence_id differ mostly in a few bits, so they
+ * cannot be used as table positions directly.
+ */
+static inline uint64_t hash_mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+/* Group probing: bit i of each result is set when control byte i of the group matches */
+#if defined(__SSE2__)
+static inline uint32_t group_match(const uint8_t* ctrl, uint8_t h2) {
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+// Empty and deleted are the only control bytes with the high bit set
+static inline uint32_t group_match_free(const uint8_t* ctrl) {
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+}
+#else
+static inline uint32_t group_match(const uint8_t* ctrl, uint8_t h2) {
+    uint32_t mask = 0;
+    for (int i = 0; i < HASH_TABLE_GROUP_SIZE; i++) {
+        mask |= (uint32_t)(ctrl[i] == h2) << i;
+    }
+    return mask;
+}
+
+static inline uint32_t group_match_free(const uint8_t* ctrl) {
+    uint32_t mask = 0;
+    for (int i = 0; i < HASH_TABLE_GROUP_SIZE; i++) {
+        mask |= (uint32_t)(ctrl[i] >> 7) << i;
+    }
+    return mask;
+}
+#endif
+
+static inline uint32_t group_match_empty(const uint8_t* ctrl) {
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+/*
+ * Allocates an array with every slot empty.
+ * @param array The array.
+ * @param capacity Number of slots, a power of two and at least HASH_TABLE_GROUP_SIZE.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int array_alloc(hash_array_t* array, size_t capacity) {
+    array->ctrl = (uint8_t*)malloc(capacity);
+    array->slots = (hash_slot_t*)malloc(capacity * sizeof(hash_slot_t));
+    if (array->ctrl == NULL || array->slots == NULL) {
+        perror("Failed to allocate memory for hash table");
+        free(array->ctrl);
+        free(array->slots);
+        memset(array, 0, sizeof(*array));
+        return -1;
+    }
+    memset(array->ctrl, CTRL_EMPTY, capacity);
+    array->capacity = capacity;
+    array->size = 0;
+    array->growth_left = capacity - capacity / 8;
+    return 0;
+}
+
+static void array_free(hash_array_t* array) {
+    free(array->ctrl);
+    free(array->slots);
+    memset(array, 0, sizeof(*array));
+}
+
+/*
+ * Finds the slot holding key, and for which match accepts the value if match is given.
+ * @return The slot index, or SLOT_NOT_FOUND.
+ */
+static size_t array_find(const hash_array_t* array, uint64_t key, uint64_t hash, const hash_key_match_t* match) {
+    if (array->capacity == 0) {
+        return SLOT_NOT_FOUND;
+    }
+    size_t group_mask = array->capacity / HASH_TABLE_GROUP_SIZE - 1;
+    size_t group = (size_t)(hash >> 7) & group_mask;
+    uint8_t h2 = (uint8_t)(hash & 0x7F);
+
+    for (size_t step = 0; step <= group_mask; step++) {
+        const uint8_t* ctrl = array->ctrl + group * HASH_TABLE_GROUP_SIZE;
+        for (uint32_t candidates = group_match(ctrl, h2); candidates != 0; candidates &= candidates - 1) {
+            size_t index = group * HASH_TABLE_GROUP_SIZE + (size_t)__builtin_ctz(candidates);
+            if (array->slots[index].key == key &&
+                (match == NULL || match->equal(match->context, array->slots[index].value))) {
+                PROFILE_PROBE_LENGTH(step + 1);
+                return index;
+            }
+        }
+        if (group_match_empty(ctrl) != 0) {
+            PROFILE_PROBE_LENGTH(step + 1);
+            return SLOT_NOT_FOUND;
+        }
+        group = (group + step + 1) & group_mask;
+    }
+    PROFILE_PROBE_LENGTH(group_mask + 1);
+    return SLOT_NOT_FOUND;
+}
+
+/*
+ * Stores a key known to be absent in the first empty or deleted slot of its probe sequence.
+ * The array must have growth_left > 0.
+ * @return Pointer to the stored value.
+ */
+static uint64_t* array_place(hash_array_t* array, uint64_t key, uint64_t value, uint64_t hash) {
+    size_t group_mask = array->capacity / HASH_TABLE_GROUP_SIZE - 1;
+    size_t group = (size_t)(hash >> 7) & group_mask;
+    uint32_t match;
+
+    for (size_t step = 0; (match = group_match_free(array->ctrl + group * HASH_TABLE_GROUP_SIZE)) == 0; step++) {
+        group = (group + step + 1) & group_mask;
+    }
+    size_t index = group * HASH_TABLE_GROUP_SIZE + (size_t)__builtin_ctz(match);
+    if (array->ctrl[index] == CTRL_EMPTY) {
+        array->growth_left--;
+    }
+    array->ctrl[index] = (uint8_t)(hash & 0x7F);
+    array->slots[index].key = key;
+    array->slots[index].value = value;
+    array->size++;
+    return &array->slots[index].value;
+}
+
+/*
+ * Empties a full slot. A slot can go back to empty if its group already has an empty
+ * slot, since no probe continues past such a group; otherwise it becomes a tombstone.
+ */
+static void array_erase(hash_array_t* array, size_t index) {
+    const uint8_t* group = array->ctrl + (index & ~(size_t)(HASH_TABLE_GROUP_SIZE - 1));
+    if (group_match_empty(group) != 0) {
+        array->ctrl[index] = CTRL_EMPTY;
+        array->growth_left++;
+    } else {
+        array->ctrl[index] = CTRL_DELETED;
+    }
+    array->size--;
+}
+
+/*
+ * Moves up to count slots of the previous array into the current one, freeing the
+ * previous array once it has been walked completely.
+ */
+static void migrate(hash_table_t* table, size_t count) {
+    hash_array_t* previous = &table->previous;
+    size_t end = table->migrate_pos + count;
+    if (end > previous->capacity) {
+        end = previous->capacity;
+    }
+    size_t i;
+    // A full current array stops the migration; the next insert then rehashes both
+    for (i = table->migrate_pos; i < end && table->current.growth_left > 0; i++) {
+        if (previous->ctrl[i] < CTRL_EMPTY) {
+            const hash_slot_t* slot = &previous->slots[i];
+            array_place(&table->current, slot->key, slot->value, hash_mix(slot->key));
+            array_erase(previous, i);
+        }
+    }
+    table->migrate_pos = i;
+    if (i == previous->capacity) {
+        array_free(previous);
+        table->migrate_pos = 0;
+    }
+}
+
+/*
+ * Makes room for at least one more insert into the current array.
+ * Normally the current array becomes the previous one and is migrated incrementally. If
+ * a migration is still running, both arrays are rehashed into a new one right away.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int grow(hash_table_t* table) {
+    size_t needed = (hash_table_size(table) + 1) * 2;
+    size_t capacity = table->current.capacity;
+    // Tables full of tombstones are rehashed at the same size
+    while (capacity - capacity / 8 < needed) {
+        capacity *= 2;
+    }
+
+    hash_array_t next;
+    if (array_alloc(&next, capacity) != 0) {
+        return -1;
+    }
+
+    if (table->previous.capacity == 0) {
+        table->previous = table->current;
+        table->current = next;
+        table->migrate_pos = 0;
+        return 0;
+    }
+
+    const hash_array_t* sources[2] = { &table->current, &table->previous };
+    for (int s = 0; s < 2; s++) {
+        for (size_t i = 0; i < sources[s]->capacity; i++) {
+            if (sources[s]->ctrl[i] < CTRL_EMPTY) {
+                const hash_slot_t* slot = &sources[s]->slots[i];
+                array_place(&next, slot->key, slot->value, hash_mix(slot->key));
+            }
+        }
+    }
+    array_free(&table->current);
+    array_free(&table->previous);
+    table->current = next;
+    table->migrate_pos = 0;
+    return 0;
+}
+
+/*
+ * Initializes an empty table.
+ * @param table The table.
+ * @param expected_size Number of entries to allocate room for up front (0 for the minimum).
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int hash_table_init(hash_table_t* table, size_t expected_size) {
+    if (table == NULL) {
+        return -1;
+    }
+    memset(table, 0, sizeof(*table));
+    size_t capacity = HASH_TABLE_MIN_CAPACITY;
+    while (capacity - capacity / 8 < expected_size) {
+        capacity *= 2;
+    }
+    return array_alloc(&table->current, capacity);
+}
+
+/*
+ * Frees the table's arrays. Values that point to memory are not freed.
+ * @param table The table.
+ */
+void hash_table_free(hash_table_t* table) {
+    if (table == NULL) {
+        return;
+    }
+    array_free(&table->current);
+    array_free(&table->previous);
+    table->migrate_pos = 0;
+}
+
+/*
+ * @param table The table.
+ * @return The number of entries.
+ */
+size_t hash_table_size(const hash_table_t* table) {
+    return table->current.size + table->previous.size;
+}
+
+/*
+ * Looks up a key.
+ * @param table The table.
+ * @param key The key.
+ * @return Pointer to the key's value, valid until the next insert or remove, or NULL if absent.
+ */
+uint64_t* hash_table_find(const hash_table_t* table, uint64_t key) {
+    return hash_table_find_match(table, key, NULL);
+}
+
+/*
+ * Looks up the entry of a key that match accepts.
+ * @param table The table.
+ * @param key The key, usually a hash of the full key.
+ * @param match Compares an entry's value with the full key; NULL accepts any entry.
+ * @return Pointer to the entry's value, valid until the next insert or remove, or NULL if absent.
+ */
+uint64_t* hash_table_find_match(const hash_table_t* table, uint64_t key, const hash_key_match_t* match) {
+    uint64_t hash = hash_mix(key);
+    size_t index = array_find(&table->current, key, hash, match);
+    if (index != SLOT_NOT_FOUND) {
+        return &table->current.slots[index].value;
+    }
+    index = array_find(&table->previous, key, hash, match);
+    if (index != SLOT_NOT_FOUND) {
+        return &table->previous.slots[index].value;
+    }
+    return NULL;
+}
+
+/*
+ * Finds a key, adding it with a zero value if it is absent.
+ * @param table The table.
+ * @param key The key.
+ * @param inserted Set to 1 if the key was added, 0 if it was already present. May be NULL.
+ * @return Pointer to the key's value, valid until the next insert or remove, or NULL on
+ *         memory allocation failure.
+ */
+uint64_t* hash_table_insert(hash_table_t* table, uint64_t key, int* inserted) {
+    uint64_t hash = hash_mix(key);
+    uint64_t value = 0;
+    int found = 0;
+
+    if (table->previous.capacity != 0) {
+        migrate(table, HASH_TABLE_MIGRATE_STEP);
+    }
+    size_t index = array_find(&table->current, key, hash, NULL);
+    if (index != SLOT_NOT_FOUND) {
+        if (inserted != NULL) {
+            *inserted = 0;
+        }
+        return &table->current.slots[index].value;
+    }
+    if (table->current.growth_left == 0) {
+        if (grow(table) != 0) {
+            return NULL;
+        }
+        // Growing during a migration rehashes the old array into the new one
+        index = array_find(&table->current, key, hash, NULL);
+        if (index != SLOT_NOT_FOUND) {
+            if (inserted != NULL) {
+                *inserted = 0;
+            }
+            return &table->current.slots[index].value;
+        }
+    }
+    // A key still in the old array moves over now so it only ever lives in one place
+    index = array_find(&table->previous, key, hash, NULL);
+    if (index != SLOT_NOT_FOUND) {
+        value = table->previous.slots[index].value;
+        array_erase(&table->previous, index);
+        found = 1;
+    }
+
+    if (inserted != NULL) {
+        *inserted = !found;
+    }
+    return array_place(&table->current, key, value, hash);
+}
+
+/*
+ * Adds an entry without looking for the key, which other entries may share. Such entries
+ * are found and removed with a hash_key_match_t.
+ * @param table The table.
+ * @param key The key, usually a hash of the full key.
+ * @param value The value.
+ * @return Pointer to the stored value, valid until the next insert or remove, or NULL on
+ *         memory allocation failure.
+ */
+uint64_t* hash_table_add(hash_table_t* table, uint64_t key, uint64_t value) {
+    if (table->previous.capacity != 0) {
+        migrate(table, HASH_TABLE_MIGRATE_STEP);
+    }
+    if (table->current.growth_left == 0 && grow(table) != 0) {
+        return NULL;
+    }
+    return array_place(&table->current, key, value, hash_mix(key));
+}
+
+/*
+ * Removes a key.
+ * @param table The table.
+ * @param key The key.
+ * @param value_out Receives the removed value. May be NULL.
+ * @return 0 on success, -1 if the key was not present.
+ */
+int hash_table_remove(hash_table_t* table, uint64_t key, uint64_t* value_out) {
+    return hash_table_remove_match(table, key, NULL, value_out);
+}
+
+/*
+ * Removes the entry of a key that match accepts.
+ * @param table The table.
+ * @param key The key, usually a hash of the full key.
+ * @param match Compares an entry's value with the full key; NULL accepts any entry.
+ * @param value_out Receives the removed value. May be NULL.
+ * @return 0 on success, -1 if no such entry was present.
+ */
+int hash_table_remove_match(hash_table_t* table, uint64_t key, const hash_key_match_t* match, uint64_t* value_out) {
+    uint64_t hash = hash_mix(key);
+    if (table->previous.capacity != 0) {
+        migrate(table, HASH_TABLE_MIGRATE_STEP);
+    }
+
+    hash_array_t* arrays[2] = { &table->current, &table->previous };
+    for (int a = 0; a < 2; a++) {
+        size_t index = array_find(arrays[a], key, hash, match);
+        if (index != SLOT_NOT_FOUND) {
+            if (value_out != NULL) {
+                *value_out = arrays[a]->slots[index].value;
+            }
+            array_erase(arrays[a], index);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Iterates over the entries in no particular order. The table must not be modified
+ * during the iteration.
+ * @param table The table.
+ * @param cursor Iteration state, set to 0 before the first call.
+ * @param key_out Receives the key of the next entry.
+ * @param value_out Receives the value of the next entry.
+ * @return 1 if an entry was returned, 0 when the iteration is complete.
+ */
+int hash_table_next(const hash_table_t* table, size_t* cursor, uint64_t* key_out, uint64_t* value_out) {
+    size_t total = table->current.capacity + table->previous.capacity;
+    while (*cursor < total) {
+        size_t position = (*cursor)++;
+        const hash_array_t* array = &table->current;
+        if (position >= array->capacity) {
+            position -= array->capacity;
+            array = &table->previous;
+        }
+        if (array->ctrl[position] < CTRL_EMPTY) {
+            *key_out = array->slots[position].key;
+            *value_out = array->slots[position].value;
+            return 1;
+        }
+    }
+    return 0;
+}
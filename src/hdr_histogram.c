@@ -0,0 +1,301 @@
+#include "../include/hdr_histogram.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Initializes an empty histogram. Counts are allocated by the first value recorded.
+ * @param histogram The histogram.
+ */
+void hdr_histogram_init(hdr_histogram_t* histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->min = INT64_MAX;
+    histogram->max = INT64_MIN;
+}
+
+/*
+ * Frees the counts of a histogram and leaves it empty.
+ * @param histogram The histogram.
+ */
+void hdr_histogram_free(hdr_histogram_t* histogram) {
+    free(histogram->counts[0]);
+    free(histogram->counts[1]);
+    hdr_histogram_init(histogram);
+}
+
+/*
+ * Maps a magnitude to its bucket: exact below HDR_SUB_BUCKET_COUNT, then
+ * HDR_SUB_BUCKET_HALF buckets per power of two.
+ */
+static size_t hdr_index(uint64_t magnitude) {
+    if (magnitude < HDR_SUB_BUCKET_COUNT) {
+        return (size_t)magnitude;
+    }
+    int shift = 63 - __builtin_clzll(magnitude) - HDR_SUB_BUCKET_BITS + 1;
+    return (size_t)shift * HDR_SUB_BUCKET_HALF + (size_t)(magnitude >> shift);
+}
+
+/*
+ * @return The smallest magnitude counted in a bucket.
+ */
+static uint64_t hdr_lowest(size_t index) {
+    if (index < HDR_SUB_BUCKET_COUNT) {
+        return index;
+    }
+    int shift = (int)(index / HDR_SUB_BUCKET_HALF) - 1;
+    return (uint64_t)(index - (size_t)shift * HDR_SUB_BUCKET_HALF) << shift;
+}
+
+/*
+ * @return The largest magnitude counted in a bucket.
+ */
+static uint64_t hdr_highest(size_t index) {
+    if (index < HDR_SUB_BUCKET_COUNT) {
+        return index;
+    }
+    int shift = (int)(index / HDR_SUB_BUCKET_HALF) - 1;
+    return hdr_lowest(index) + ((1ull << shift) - 1);
+}
+
+/*
+ * @return The magnitude halfway through a bucket, the value that stands for all of it.
+ */
+static uint64_t hdr_median(size_t index) {
+    uint64_t lowest = hdr_lowest(index);
+    return lowest + (hdr_highest(index) - lowest + 1) / 2;
+}
+
+/*
+ * @return The counts of one sign, allocating them if needed; NULL on memory allocation failure.
+ */
+static uint64_t* hdr_counts(hdr_histogram_t* histogram, int negative) {
+    if (histogram->counts[negative] == NULL) {
+        histogram->counts[negative] = (uint64_t*)calloc(HDR_COUNTS_LENGTH, sizeof(uint64_t));
+        if (histogram->counts[negative] == NULL) {
+            perror("Failed to allocate memory for histogram");
+        }
+    }
+    return histogram->counts[negative];
+}
+
+/*
+ * Records one value.
+ * @param histogram The histogram.
+ * @param value The value.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int hdr_histogram_record(hdr_histogram_t* histogram, int64_t value) {
+    int negative = value < 0;
+    uint64_t* counts = hdr_counts(histogram, negative);
+    if (counts == NULL) {
+        return -1;
+    }
+    uint64_t magnitude = negative ? -(uint64_t)value : (uint64_t)value;
+    counts[hdr_index(magnitude)]++;
+    histogram->total++;
+    if (value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    return 0;
+}
+
+/*
+ * Adds the counts of src to dst.
+ * @param dst The histogram receiving the counts.
+ * @param src The histogram to merge from; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int hdr_histogram_merge(hdr_histogram_t* dst, const hdr_histogram_t* src) {
+    for (int negative = 0; negative < 2; negative++) {
+        if (src->counts[negative] == NULL) {
+            continue;
+        }
+        uint64_t* counts = hdr_counts(dst, negative);
+        if (counts == NULL) {
+            return -1;
+        }
+        for (size_t i = 0; i < HDR_COUNTS_LENGTH; i++) {
+            counts[i] += src->counts[negative][i];
+        }
+    }
+    dst->total += src->total;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+    return 0;
+}
+
+/*
+ * Finds the bucket holding the value of a rank (1-based, in ascending order): negative
+ * values from the largest magnitude down, then the others from zero up.
+ * @return The middle value of that bucket.
+ */
+static int64_t hdr_value_at_rank(const hdr_histogram_t* histogram, uint64_t rank) {
+    uint64_t seen = 0;
+    const uint64_t* negatives = histogram->counts[1];
+    for (size_t i = HDR_COUNTS_LENGTH; negatives != NULL && i-- > 0;) {
+        seen += negatives[i];
+        if (seen >= rank) {
+            uint64_t median = hdr_median(i);
+            return median > (uint64_t)INT64_MAX ? INT64_MIN : -(int64_t)median;
+        }
+    }
+    const uint64_t* positives = histogram->counts[0];
+    for (size_t i = 0; positives != NULL && i < HDR_COUNTS_LENGTH; i++) {
+        seen += positives[i];
+        if (seen >= rank) {
+            uint64_t median = hdr_median(i);
+            return median > (uint64_t)INT64_MAX ? INT64_MAX : (int64_t)median;
+        }
+    }
+    return histogram->max;
+}
+
+/*
+ * Finds the value at a percentile, to half the bucket width and clamped to the recorded range.
+ * @param histogram The histogram.
+ * @param percentile Percentile in [0, 100]; 100 is the maximum.
+ * @return The value, or 0 for an empty histogram.
+ */
+int64_t hdr_histogram_percentile(const hdr_histogram_t* histogram, double percentile) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)histogram->total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank >= histogram->total) {
+        return histogram->max;
+    }
+    int64_t value = hdr_value_at_rank(histogram, rank);
+    if (value < histogram->min) {
+        return histogram->min;
+    }
+    return value > histogram->max ? histogram->max : value;
+}
+
+/*
+ * Writes an unsigned LEB128 varint.
+ */
+static int put_varint(FILE* file, uint64_t value) {
+    uint8_t bytes[10];
+    int length = 0;
+    do {
+        bytes[length] = (uint8_t)(value & 0x7F);
+        value >>= 7;
+        if (value != 0) {
+            bytes[length] |= 0x80;
+        }
+        length++;
+    } while (value != 0);
+    return fwrite(bytes, 1, (size_t)length, file) == (size_t)length ? 0 : -1;
+}
+
+/*
+ * Reads an unsigned LEB128 varint.
+ * @return 0 on success, -1 at end of file or on an overlong encoding.
+ */
+static int get_varint(FILE* file, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF) {
+            return -1;
+        }
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/*
+ * Writes a histogram compactly: total, min and max, then for each sign the number of
+ * non-empty buckets and each as (index delta, count), all as varints.
+ * @return 0 on success, -1 on write failure.
+ */
+int hdr_histogram_write(const hdr_histogram_t* histogram, FILE* file) {
+    if (put_varint(file, histogram->total) != 0 || put_varint(file, zigzag(histogram->min)) != 0 ||
+        put_varint(file, zigzag(histogram->max)) != 0) {
+        return -1;
+    }
+    for (int negative = 0; negative < 2; negative++) {
+        const uint64_t* counts = histogram->counts[negative];
+        uint64_t used = 0;
+        for (size_t i = 0; counts != NULL && i < HDR_COUNTS_LENGTH; i++) {
+            used += counts[i] != 0;
+        }
+        if (put_varint(file, used) != 0) {
+            return -1;
+        }
+        size_t previous = 0;
+        for (size_t i = 0; used != 0 && i < HDR_COUNTS_LENGTH; i++) {
+            if (counts[i] == 0) {
+                continue;
+            }
+            if (put_varint(file, i - previous) != 0 || put_varint(file, counts[i]) != 0) {
+                return -1;
+            }
+            previous = i;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Reads a histogram written by hdr_histogram_write() into an empty histogram.
+ * @return 0 on success, -1 on a truncated or malformed encoding or memory allocation failure.
+ */
+int hdr_histogram_read(hdr_histogram_t* histogram, FILE* file) {
+    uint64_t total, min, max;
+    if (get_varint(file, &total) != 0 || get_varint(file, &min) != 0 || get_varint(file, &max) != 0) {
+        return -1;
+    }
+    histogram->total = total;
+    histogram->min = unzigzag(min);
+    histogram->max = unzigzag(max);
+
+    uint64_t counted = 0;
+    for (int negative = 0; negative < 2; negative++) {
+        uint64_t used;
+        if (get_varint(file, &used) != 0 || used > HDR_COUNTS_LENGTH) {
+            return -1;
+        }
+        if (used == 0) {
+            continue;
+        }
+        uint64_t* counts = hdr_counts(histogram, negative);
+        if (counts == NULL) {
+            return -1;
+        }
+        uint64_t index = 0;
+        for (uint64_t n = 0; n < used; n++) {
+            uint64_t delta, count;
+            if (get_varint(file, &delta) != 0 || get_varint(file, &count) != 0) {
+                return -1;
+            }
+            index += delta;
+            if (index >= HDR_COUNTS_LENGTH) {
+                return -1;
+            }
+            counts[index] += count;
+            counted += count;
+        }
+    }
+    return counted == total ? 0 : -1;
+}
@@ -0,0 +1,309 @@
+#include "../include/histogram_set.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HISTOGRAM_SET_INITIAL_SIZE 16
+
+/*
+ * Initializes an empty set.
+ * @param set The set.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int histogram_set_init(histogram_set_t* set) {
+    memset(set, 0, sizeof(*set));
+    if (hash_table_init(&set->index, HISTOGRAM_SET_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize histogram set.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Frees a set and its histograms.
+ * @param set The set.
+ */
+void histogram_set_free(histogram_set_t* set) {
+    for (size_t i = 0; i < set->count; i++) {
+        hdr_histogram_free(&set->entries[i].histogram);
+    }
+    hash_table_free(&set->index);
+    free(set->entries);
+    memset(set, 0, sizeof(*set));
+}
+
+// A cleaned key looked up in the index
+typedef struct {
+    const histogram_set_t* set;
+    const histogram_record_header_t* key;
+} entry_lookup_t;
+
+static int entry_matches(const void* context, uint64_t value) {
+    const entry_lookup_t* lookup = (const entry_lookup_t*)context;
+    return memcmp(&lookup->set->entries[value].key, lookup->key, sizeof(*lookup->key)) == 0;
+}
+
+/*
+ * Finds the histogram of a key, adding an empty one if the key is new. The index is keyed
+ * by a mix of the key's fields and compares whole keys.
+ * @param set The set.
+ * @param key Metric, clock identities and ports; reserved bytes are ignored.
+ * @return The histogram, or NULL on memory allocation failure.
+ */
+hdr_histogram_t* histogram_set_get(histogram_set_t* set, const histogram_record_header_t* key) {
+    histogram_record_header_t clean = *key;
+    memset(clean.reserved, 0, sizeof(clean.reserved));
+    uint64_t mixed = ((clean.id_a * 0x9E3779B97F4A7C15ULL) ^ clean.port_a) * 0xC2B2AE3D27D4EB4FULL
+                   ^ clean.id_b ^ ((uint64_t)clean.port_b << 48) ^ ((uint64_t)clean.metric << 56);
+    entry_lookup_t lookup = { set, &clean };
+    hash_key_match_t match = { entry_matches, &lookup };
+    uint64_t* slot = hash_table_find_match(&set->index, mixed, &match);
+    if (slot != NULL) {
+        return &set->entries[*slot].histogram;
+    }
+
+    if (set->count == set->capacity) {
+        size_t grown_capacity = set->capacity ? set->capacity * 2 : HISTOGRAM_SET_INITIAL_SIZE;
+        histogram_entry_t* grown = (histogram_entry_t*)realloc(set->entries, grown_capacity * sizeof(histogram_entry_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for histogram set");
+            return NULL;
+        }
+        set->entries = grown;
+        set->capacity = grown_capacity;
+    }
+    if (hash_table_add(&set->index, mixed, set->count) == NULL) {
+        return NULL;
+    }
+    histogram_entry_t* entry = &set->entries[set->count++];
+    entry->key = clean;
+    hdr_histogram_init(&entry->histogram);
+    return &entry->histogram;
+}
+
+/*
+ * Merges one histogram into the set under the given key.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int collect_one(histogram_set_t* set, histogram_metric_t metric, uint64_t id_a, uint16_t port_a,
+                       uint64_t id_b, uint16_t port_b, const hdr_histogram_t* histogram) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    histogram_record_header_t key = { .id_a = id_a, .id_b = id_b, .port_a = port_a, .port_b = port_b, .metric = (uint8_t)metric };
+    hdr_histogram_t* target = histogram_set_get(set, &key);
+    if (target == NULL) {
+        return -1;
+    }
+    return hdr_histogram_merge(target, histogram);
+}
+
+/*
+ * Adds the histograms of a run's offset engine and peer-delay tracker to a set.
+ * @param set The set.
+ * @param offsets The offset engine.
+ * @param links The peer-delay tracker.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int histogram_set_collect(histogram_set_t* set, const ptp_offset_engine_t* offsets, const pdelay_tracker_t* links) {
+    for (size_t i = 0; i < offsets->pair_count; i++) {
+        const ptp_offset_pair_t* pair = &offsets->pairs[i];
+        if (collect_one(set, HISTOGRAM_E2E_OFFSET, pair->master_id, 0, pair->slave_id, 0, &pair->offset_histogram) != 0 ||
+            collect_one(set, HISTOGRAM_E2E_DELAY, pair->master_id, 0, pair->slave_id, 0, &pair->delay_histogram) != 0) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < offsets->master_count; i++) {
+        const ptp_offset_master_t* master = &offsets->masters[i];
+        if (collect_one(set, HISTOGRAM_SYNC_INTERVAL, master->clock_id, 0, 0, 0, &master->sync_interval) != 0) {
+            return -1;
+        }
+    }
+    for (size_t i = 0; i < links->link_count; i++) {
+        const pdelay_link_t* link = &links->links[i];
+        if (collect_one(set, HISTOGRAM_LINK_DELAY, link->requester_id, link->requester_port, link->responder_id,
+                        link->responder_port, &link->delay_histogram) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Writes the low size bytes of a value, least significant first.
+ * @return 0 on success, -1 on a write error.
+ */
+static int put_le(FILE* file, uint64_t value, size_t size) {
+    uint8_t bytes[8];
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+    return fwrite(bytes, 1, size, file) == size ? 0 : -1;
+}
+
+/*
+ * Reads a value of size bytes, least significant first.
+ * @return 0 on success, -1 on a short read.
+ */
+static int get_le(FILE* file, size_t size, uint64_t* value) {
+    uint8_t bytes[8];
+    if (fread(bytes, 1, size, file) != size) {
+        return -1;
+    }
+    *value = 0;
+    for (size_t i = 0; i < size; i++) {
+        *value |= (uint64_t)bytes[i] << (8 * i);
+    }
+    return 0;
+}
+
+static int write_record_header(FILE* file, const histogram_record_header_t* key) {
+    return put_le(file, key->id_a, 8) == 0 && put_le(file, key->id_b, 8) == 0 && put_le(file, key->port_a, 2) == 0 &&
+           put_le(file, key->port_b, 2) == 0 && put_le(file, key->metric, 1) == 0 && put_le(file, 0, 3) == 0 ? 0 : -1;
+}
+
+static int read_record_header(FILE* file, histogram_record_header_t* key) {
+    uint64_t id_a, id_b, port_a, port_b, metric, reserved;
+    if (get_le(file, 8, &id_a) != 0 || get_le(file, 8, &id_b) != 0 || get_le(file, 2, &port_a) != 0 ||
+        get_le(file, 2, &port_b) != 0 || get_le(file, 1, &metric) != 0 || get_le(file, 3, &reserved) != 0) {
+        return -1;
+    }
+    memset(key, 0, sizeof(*key));
+    key->id_a = id_a;
+    key->id_b = id_b;
+    key->port_a = (uint16_t)port_a;
+    key->port_b = (uint16_t)port_b;
+    key->metric = (uint8_t)metric;
+    return 0;
+}
+
+/*
+ * Writes a set to a dump file, replacing it atomically.
+ * @param set The set.
+ * @param path Path of the dump file.
+ * @return 0 on success, -1 on failure.
+ */
+int histogram_set_save(const histogram_set_t* set, const char* path) {
+    size_t path_length = strlen(path);
+    char* tmp_path = (char*)malloc(path_length + sizeof(".tmp"));
+    if (tmp_path == NULL) {
+        perror("Failed to allocate memory for histogram dump path");
+        return -1;
+    }
+    memcpy(tmp_path, path, path_length);
+    memcpy(tmp_path + path_length, ".tmp", sizeof(".tmp"));
+
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        perror("Error creating histogram dump");
+        free(tmp_path);
+        return -1;
+    }
+    int ok = put_le(file, HISTOGRAM_DUMP_MAGIC, 4) == 0 && put_le(file, HISTOGRAM_DUMP_VERSION, 4) == 0 &&
+             put_le(file, set->count, 8) == 0;
+    for (size_t i = 0; ok && i < set->count; i++) {
+        ok = write_record_header(file, &set->entries[i].key) == 0 &&
+             hdr_histogram_write(&set->entries[i].histogram, file) == 0;
+    }
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp_path, path) != 0) {
+        perror("Error writing histogram dump");
+        remove(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    free(tmp_path);
+    return 0;
+}
+
+/*
+ * Reads a dump file and merges its histograms into a set.
+ * @param set The set.
+ * @param path Path of the dump file.
+ * @return 0 on success, -1 if the file is unreadable or malformed.
+ */
+int histogram_set_load(histogram_set_t* set, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror("Error opening histogram dump");
+        return -1;
+    }
+    uint64_t magic, version, record_count;
+    if (get_le(file, 4, &magic) != 0 || get_le(file, 4, &version) != 0 || get_le(file, 8, &record_count) != 0 ||
+        magic != HISTOGRAM_DUMP_MAGIC || version != HISTOGRAM_DUMP_VERSION) {
+        fprintf(stderr, "Not a histogram dump: %s\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    int result = 0;
+    for (uint64_t i = 0; i < record_count && result == 0; i++) {
+        histogram_record_header_t key;
+        hdr_histogram_t histogram;
+        hdr_histogram_init(&histogram);
+        if (read_record_header(file, &key) != 0 || key.metric >= HISTOGRAM_METRIC_COUNT ||
+            hdr_histogram_read(&histogram, file) != 0) {
+            fprintf(stderr, "Truncated or corrupt histogram dump: %s\n", path);
+            result = -1;
+        } else {
+            hdr_histogram_t* target = histogram_set_get(set, &key);
+            if (target == NULL || hdr_histogram_merge(target, &histogram) != 0) {
+                result = -1;
+            }
+        }
+        hdr_histogram_free(&histogram);
+    }
+    fclose(file);
+    return result;
+}
+
+/*
+ * Prints a label followed by the p50, p99, p99.9 and maximum of a histogram of scaled
+ * nanoseconds.
+ * @param label Printed first, as is.
+ * @param histogram The histogram.
+ */
+void histogram_print_percentiles(const char* label, const hdr_histogram_t* histogram) {
+    static const double percentiles[] = { 50.0, 99.0, 99.9 };
+    static const char* const names[] = { "p50", "p99", "p99.9" };
+    char value[32];
+    printf("%s", label);
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        ptp_scaled_ns_format(hdr_histogram_percentile(histogram, percentiles[i]), value, sizeof(value));
+        printf("%s %s, ", names[i], value);
+    }
+    ptp_scaled_ns_format(histogram->max, value, sizeof(value));
+    printf("max %s ns\n", value);
+}
+
+/*
+ * Prints every histogram of a set with its percentiles, one line per key.
+ * @param set The set.
+ */
+void histogram_set_print(const histogram_set_t* set) {
+    static const char* const metric_names[] = {
+        [HISTOGRAM_E2E_OFFSET] = "E2E offset",
+        [HISTOGRAM_E2E_DELAY] = "E2E mean path delay",
+        [HISTOGRAM_SYNC_INTERVAL] = "Sync interval",
+        [HISTOGRAM_LINK_DELAY] = "Pdelay meanLinkDelay",
+    };
+    for (size_t i = 0; i < set->count; i++) {
+        const histogram_entry_t* entry = &set->entries[i];
+        char label[160];
+        if (entry->key.metric == HISTOGRAM_SYNC_INTERVAL) {
+            snprintf(label, sizeof(label), "%s 0x%016llx: %llu samples, ", metric_names[entry->key.metric],
+                     (unsigned long long)entry->key.id_a, (unsigned long long)entry->histogram.total);
+        } else if (entry->key.metric == HISTOGRAM_LINK_DELAY) {
+            snprintf(label, sizeof(label), "%s 0x%016llx:%u -> 0x%016llx:%u: %llu samples, ", metric_names[entry->key.metric],
+                     (unsigned long long)entry->key.id_a, entry->key.port_a, (unsigned long long)entry->key.id_b,
+                     entry->key.port_b, (unsigned long long)entry->histogram.total);
+        } else {
+            snprintf(label, sizeof(label), "%s 0x%016llx -> 0x%016llx: %llu samples, ", metric_names[entry->key.metric],
+                     (unsigned long long)entry->key.id_a, (unsigned long long)entry->key.id_b,
+                     (unsigned long long)entry->histogram.total);
+        }
+        histogram_print_percentiles(label, &entry->histogram);
+    }
+}
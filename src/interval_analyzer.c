@@ -0,0 +1,291 @@
+#include "../include/interval_analyzer.h"
+#include "../include/ptp.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOURCE_TABLE_INITIAL_SIZE 64
+#define INTERVAL_BURST_LENGTH 2     // Consecutive early intervals that make a burst
+
+/*
+ * Initializes an empty analyzer.
+ * @param analyzer The analyzer.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int interval_analyzer_init(interval_analyzer_t* analyzer) {
+    memset(analyzer, 0, sizeof(*analyzer));
+    if (hash_table_init(&analyzer->source_index, SOURCE_TABLE_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize interval analyzer.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Frees the memory allocated by an analyzer.
+ * @param analyzer The analyzer.
+ */
+void interval_analyzer_free(interval_analyzer_t* analyzer) {
+    hash_table_free(&analyzer->source_index);
+    free(analyzer->sources);
+    memset(analyzer, 0, sizeof(*analyzer));
+}
+
+// A (port identity, messageType) looked up in the source index
+typedef struct {
+    const interval_analyzer_t* analyzer;
+    uint64_t clock_id;
+    uint16_t port_number;
+    uint8_t message_type;
+} source_lookup_t;
+
+static int source_matches(const void* context, uint64_t value) {
+    const source_lookup_t* lookup = (const source_lookup_t*)context;
+    const interval_source_t* source = &lookup->analyzer->sources[value];
+    return source->clock_id == lookup->clock_id && source->port_number == lookup->port_number &&
+           source->message_type == lookup->message_type;
+}
+
+/*
+ * Finds the state of a source, adding an empty one if the source is new.
+ * @param inserted_out Set to 1 if the source is new, 0 otherwise.
+ * @return The source, or NULL on memory allocation failure.
+ */
+static interval_source_t* get_source(interval_analyzer_t* analyzer, uint64_t clock_id, uint16_t port_number, uint8_t message_type, int* inserted_out) {
+    uint64_t key = (clock_id * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)port_number << 8) ^ message_type;
+    source_lookup_t lookup = { analyzer, clock_id, port_number, message_type };
+    hash_key_match_t match = { source_matches, &lookup };
+    uint64_t* slot = hash_table_find_match(&analyzer->source_index, key, &match);
+    *inserted_out = slot == NULL;
+    if (slot != NULL) {
+        return &analyzer->sources[*slot];
+    }
+
+    if (analyzer->source_count == analyzer->source_capacity) {
+        size_t grown_capacity = analyzer->source_capacity ? analyzer->source_capacity * 2 : SOURCE_TABLE_INITIAL_SIZE;
+        interval_source_t* grown = (interval_source_t*)realloc(analyzer->sources, grown_capacity * sizeof(interval_source_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for interval sources");
+            return NULL;
+        }
+        analyzer->sources = grown;
+        analyzer->source_capacity = grown_capacity;
+    }
+    if (hash_table_add(&analyzer->source_index, key, analyzer->source_count) == NULL) {
+        return NULL;
+    }
+    interval_source_t* source = &analyzer->sources[analyzer->source_count++];
+    memset(source, 0, sizeof(*source));
+    source->clock_id = clock_id;
+    source->port_number = port_number;
+    source->message_type = message_type;
+    return source;
+}
+
+/*
+ * @return The interval a logMessageInterval announces in nanoseconds, or 0 if it is out of
+ * the checked range.
+ */
+int64_t interval_nominal_ns(int8_t log_interval) {
+    if (log_interval > INTERVAL_MAX_LOG || log_interval < -INTERVAL_MAX_LOG) {
+        return 0;
+    }
+    return log_interval >= 0 ? 1000000000LL << log_interval : 1000000000LL >> -log_interval;
+}
+
+/*
+ * Adds an interval to a source's moments and checks it against the interval announced by
+ * the message ending it.
+ */
+static void check_interval(interval_source_t* source, int64_t interval_ns, int8_t log_interval) {
+    int64_t nominal_ns = interval_nominal_ns(log_interval);
+    if (nominal_ns == 0) {
+        return;
+    }
+    if (source->intervals == 0 || interval_ns < source->min_ns) {
+        source->min_ns = interval_ns;
+    }
+    if (source->intervals == 0 || interval_ns > source->max_ns) {
+        source->max_ns = interval_ns;
+    }
+    source->intervals++;
+    source->sum_ns += interval_ns;
+    source->sum_squares += (__int128)interval_ns * interval_ns;
+
+    int64_t tolerance_ns = nominal_ns / 100 * INTERVAL_TOLERANCE_PERCENT;
+    if (interval_ns < nominal_ns - tolerance_ns) {
+        source->early++;
+        if (++source->run == INTERVAL_BURST_LENGTH) {
+            source->bursts++;
+        }
+        if (source->run > source->longest_burst) {
+            source->longest_burst = source->run;
+        }
+        if (!source->leading_closed) {
+            source->leading_run++;
+        }
+        return;
+    }
+    if (interval_ns > nominal_ns + tolerance_ns) {
+        source->late++;
+    }
+    source->run = 0;
+    source->leading_closed = 1;
+}
+
+/*
+ * Records a message and checks its interval since the source's previous message.
+ * @param analyzer The analyzer.
+ * @param clock_id clockIdentity of the sourcePortIdentity.
+ * @param port_number portNumber of the sourcePortIdentity.
+ * @param message_type messageType of the message.
+ * @param log_interval logMessageInterval of the message.
+ * @param capture_ns Capture time of the message.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int interval_analyzer_record(interval_analyzer_t* analyzer, uint64_t clock_id, uint16_t port_number, uint8_t message_type,
+                             int8_t log_interval, int64_t capture_ns) {
+    int inserted;
+    interval_source_t* source = get_source(analyzer, clock_id, port_number, message_type, &inserted);
+    if (source == NULL) {
+        return -1;
+    }
+    if (inserted) {
+        source->first_ns = capture_ns;
+        source->first_log_interval = log_interval;
+    } else {
+        check_interval(source, capture_ns - source->last_ns, log_interval);
+    }
+    source->last_ns = capture_ns;
+    source->log_interval = log_interval;
+    source->messages++;
+    return 0;
+}
+
+/*
+ * Appends a source's messages from a later part of the capture: checks the interval that
+ * spans the two parts, then joins the burst runs on either side of it.
+ */
+static void append_source(interval_source_t* dst, const interval_source_t* src) {
+    check_interval(dst, src->first_ns - dst->last_ns, src->first_log_interval);
+    if (src->intervals != 0) {
+        if (dst->intervals == 0 || src->min_ns < dst->min_ns) {
+            dst->min_ns = src->min_ns;
+        }
+        if (dst->intervals == 0 || src->max_ns > dst->max_ns) {
+            dst->max_ns = src->max_ns;
+        }
+    }
+    dst->intervals += src->intervals;
+    dst->sum_ns += src->sum_ns;
+    dst->sum_squares += src->sum_squares;
+    dst->early += src->early;
+    dst->late += src->late;
+
+    // src counted its leading run as if it started a burst; it continues dst's run instead
+    uint64_t joined_run = dst->run + src->leading_run;
+    dst->bursts += src->bursts;
+    if (src->leading_run >= INTERVAL_BURST_LENGTH) {
+        dst->bursts--;
+    }
+    if (dst->run < INTERVAL_BURST_LENGTH && joined_run >= INTERVAL_BURST_LENGTH) {
+        dst->bursts++;
+    }
+    if (src->longest_burst > dst->longest_burst) {
+        dst->longest_burst = src->longest_burst;
+    }
+    if (joined_run > dst->longest_burst) {
+        dst->longest_burst = joined_run;
+    }
+    if (!dst->leading_closed) {
+        dst->leading_run += src->leading_run;
+        dst->leading_closed = src->leading_closed;
+    }
+    dst->run = src->leading_closed ? src->run : joined_run;
+
+    dst->last_ns = src->last_ns;
+    dst->log_interval = src->log_interval;
+    dst->messages += src->messages;
+}
+
+/*
+ * Merges the sources of an analyzer that saw a later part of the capture into dst. The
+ * result is the same as a single pass over both parts.
+ * @param dst The analyzer receiving the sources.
+ * @param src The analyzer to merge from; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int interval_analyzer_merge(interval_analyzer_t* dst, const interval_analyzer_t* src) {
+    for (size_t i = 0; i < src->source_count; i++) {
+        const interval_source_t* from = &src->sources[i];
+        int inserted;
+        interval_source_t* source = get_source(dst, from->clock_id, from->port_number, from->message_type, &inserted);
+        if (source == NULL) {
+            return -1;
+        }
+        if (inserted) {
+            *source = *from;
+        } else {
+            append_source(source, from);
+        }
+    }
+    return 0;
+}
+
+/*
+ * @return The mean of a source's checked intervals in nanoseconds, 0 if there are none.
+ */
+double interval_mean_ns(const interval_source_t* source) {
+    return source->intervals != 0 ? (double)source->sum_ns / (double)source->intervals : 0.0;
+}
+
+/*
+ * Computes the sample standard deviation of a source's checked intervals. The sum of
+ * squared deviations, sum_squares - sum^2 / n, is formed in integers before rounding, so
+ * small jitter on long intervals does not cancel out.
+ * @return The standard deviation in nanoseconds, 0 with fewer than two intervals.
+ */
+double interval_stddev_ns(const interval_source_t* source) {
+    if (source->intervals < 2) {
+        return 0.0;
+    }
+    __int128 n = source->intervals;
+    __int128 square = source->sum_ns * source->sum_ns;
+    double deviations = (double)(source->sum_squares - square / n) - (double)(square % n) / (double)n;
+    if (deviations < 0.0) {
+        deviations = 0.0;
+    }
+    return sqrt(deviations / (double)(n - 1));
+}
+
+/*
+ * Prints the interval checks summed over every source, then the interval statistics of
+ * each source.
+ * @param analyzer The analyzer.
+ */
+void interval_analyzer_print(const interval_analyzer_t* analyzer) {
+    uint64_t checked = 0, early = 0, late = 0, bursts = 0;
+    for (size_t i = 0; i < analyzer->source_count; i++) {
+        checked += analyzer->sources[i].intervals;
+        early += analyzer->sources[i].early;
+        late += analyzer->sources[i].late;
+        bursts += analyzer->sources[i].bursts;
+    }
+    printf("Message intervals: %zu sources, %llu intervals checked, %llu early, %llu late (beyond %d%% of 2^logMessageInterval), %llu bursts\n",
+           analyzer->source_count, (unsigned long long)checked, (unsigned long long)early, (unsigned long long)late,
+           INTERVAL_TOLERANCE_PERCENT, (unsigned long long)bursts);
+    for (size_t i = 0; i < analyzer->source_count; i++) {
+        const interval_source_t* source = &analyzer->sources[i];
+        if (source->intervals == 0) {
+            continue;
+        }
+        printf("    %-22s 0x%016llx:%u: %llu intervals, nominal %lld ns, mean %.1f, stddev %.1f, min %lld, max %lld ns, "
+               "%llu early, %llu late, %llu bursts (longest %llu)\n",
+               ptp_message_type_name((ptp_message_type_t)source->message_type), (unsigned long long)source->clock_id,
+               source->port_number, (unsigned long long)source->intervals, (long long)interval_nominal_ns(source->log_interval),
+               interval_mean_ns(source), interval_stddev_ns(source), (long long)source->min_ns, (long long)source->max_ns,
+               (unsigned long long)source->early, (unsigned long long)source->late, (unsigned long long)source->bursts,
+               (unsigned long long)source->longest_burst);
+    }
+}
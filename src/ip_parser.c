@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h> // For offsetof
 #include "../include/ip.h"
 #include "../include/utils.h"
 #include "../include/ptp.h"
+#include "../include/profile.h"
 
 /**
  * @brief Converts a raw IPv4 address (uint32_t) to a human-readable string.
@@ -30,6 +32,20 @@ void ipv6_to_string(const uint8_t* ip_raw, char* ip_str){
         ip_raw[12], ip_raw[13], ip_raw[14], ip_raw[15]);
 }
 
+/**
+ * @brief Writes a raw IPv6 address in the format of ipv6_to_string().
+ * @param out The writer.
+ * @param ip_raw The raw IPv6 address.
+ */
+void print_ipv6_address(output_t* out, const uint8_t* ip_raw){
+    for (int group = 0; group < 8; group++) {
+        if (group > 0) {
+            output_char(out, ':');
+        }
+        output_hex_bytes(out, ip_raw + 2 * group, 2, '\0', 0);
+    }
+}
+
 /**
  * @brief Processes a UDP header and dispatches to PTP header processing if applicable.
  * @param file_ctx File context for byte swapping.
@@ -40,20 +56,22 @@ void ipv6_to_string(const uint8_t* ip_raw, char* ip_str){
  */
 void process_udp_header(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac) {
     if (data_length < sizeof(udp_header_t)) {
+        file_ctx->stats->malformed[RUN_STATS_SHORT_UDP]++;
         fprintf(stderr, "Incomplete UDP header\n");
         return;
     }
-    const udp_header_t* udp_header = (const udp_header_t*)packet_data;
-    uint16_t dst_port = udp_header->dst_port;
-    if (file_ctx->swap_bytes) { 
-        dst_port = swap_uint16(dst_port);
-    }
+    // Header fields are in network byte order, whatever the byte order of the capture file
+    uint16_t dst_port = read_be16(packet_data + offsetof(udp_header_t, dst_port));
 
     if (dst_port == PTP_EVENT_PORT || dst_port == PTP_GENERAL_PORT) {
-        printf("PTP packet found over UDP\n");
+        if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+            output_str(file_ctx->out, "PTP packet found over UDP\n");
+        }
         const uint8_t* ptp_data = packet_data + sizeof(udp_header_t);
         uint32_t ptp_length = data_length - sizeof(udp_header_t);
+        PROFILE_SCOPE_BEGIN(ptp_scope, PROFILE_STAGE_PTP);
         process_ptp_header(file_ctx, ptp_data, ptp_length, eth_src_mac, eth_dst_mac);
+        PROFILE_SCOPE_END(ptp_scope);
     }
 }
 
@@ -67,21 +85,31 @@ void process_udp_header(file_context_t* file_ctx, const uint8_t* packet_data, ui
  */
 void process_ipv4_header(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac){
     if (data_length < 20){ 
+        file_ctx->stats->malformed[RUN_STATS_BAD_IPV4]++;
         fprintf(stderr, "Error: Incomplete IPv4 header. Patcket is too small.\n");
         return; 
     }
     
     ipv4_header_t ip_header;
     memcpy(&ip_header, packet_data, sizeof(ipv4_header_t));
-    uint16_t total_length = ip_header.total_length;
-    if(file_ctx->swap_bytes){ 
-        total_length = swap_uint16(total_length);
+    uint16_t total_length = read_be16(packet_data + offsetof(ipv4_header_t, total_length));
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "    IPv4 Header len: ");
+        output_uint(file_ctx->out, total_length);
+        output_char(file_ctx->out, '\n');
+    }
+
+    // The header length includes any options
+    uint32_t header_length = (ip_header.version_ihl & 0x0F) * 4u;
+    if (header_length < sizeof(ipv4_header_t) || header_length > data_length) {
+        file_ctx->stats->malformed[RUN_STATS_BAD_IPV4]++;
+        fprintf(stderr, "Error: Invalid IPv4 header length.\n");
+        return;
     }
-    printf("    IPv4 Header len: %u\n", total_length);
 
     if (ip_header.protocol == 17) { 
-        const uint8_t* udp_data = packet_data + sizeof(ipv4_header_t);
-        uint32_t udp_length = data_length - sizeof(ipv4_header_t);
+        const uint8_t* udp_data = packet_data + header_length;
+        uint32_t udp_length = data_length - header_length;
         process_udp_header(file_ctx, udp_data, udp_length, eth_src_mac, eth_dst_mac);
     }
 }
@@ -96,40 +124,41 @@ void process_ipv4_header(file_context_t* file_ctx, const uint8_t* packet_data, u
  */
 void process_ipv6_header(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac){
     if (data_length < 40){ 
+        file_ctx->stats->malformed[RUN_STATS_SHORT_IPV6]++;
         fprintf(stderr, "Error: Incomplete IPv6 header. Patcket is too small.\n");
         return; 
     }
     ipv6_header_t ip_header;
     memcpy(&ip_header, packet_data, sizeof(ipv6_header_t));
 
-    uint32_t version_tc_flowlabel = ip_header.version_tc_flowlabel;
-    if (file_ctx->swap_bytes) { 
-        version_tc_flowlabel = swap_uint32(version_tc_flowlabel);
-    }
+    uint32_t version_tc_flowlabel = read_be32(packet_data + offsetof(ipv6_header_t, version_tc_flowlabel));
 
     uint8_t version = (version_tc_flowlabel >> 28) & 0x0F;
     uint8_t traffic_class = (version_tc_flowlabel >> 20) & 0xFF;
     uint32_t flow_label = version_tc_flowlabel & 0x000FFFFF;
 
-    uint16_t payload_length = ip_header.payload_length;
-    if (file_ctx->swap_bytes) { 
-        payload_length = swap_uint16(payload_length);
-    }
-
-    char src_ip_str[40];
-    char dst_ip_str[40];
-    ipv6_to_string(ip_header.src_ip, src_ip_str);
-    ipv6_to_string(ip_header.dst_ip, dst_ip_str);
+    uint16_t payload_length = read_be16(packet_data + offsetof(ipv6_header_t, payload_length));
 
-    printf("    IPv6 Header:\n");
-    printf("        Version: %u\n", version);
-    printf("        Traffic Class: %u\n", traffic_class);
-    printf("        Flow Label: %u\n", flow_label);
-    printf("        Payload Length: %u\n", payload_length);
-    printf("        Next Header: %u\n", ip_header.next_header);
-    printf("        Hop Limit: %u\n", ip_header.hop_limit);
-    printf("        Source IP: %s\n", src_ip_str);
-    printf("        Destination IP: %s\n", dst_ip_str);
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_t* out = file_ctx->out;
+        output_str(out, "    IPv6 Header:\n        Version: ");
+        output_uint(out, version);
+        output_str(out, "\n        Traffic Class: ");
+        output_uint(out, traffic_class);
+        output_str(out, "\n        Flow Label: ");
+        output_uint(out, flow_label);
+        output_str(out, "\n        Payload Length: ");
+        output_uint(out, payload_length);
+        output_str(out, "\n        Next Header: ");
+        output_uint(out, ip_header.next_header);
+        output_str(out, "\n        Hop Limit: ");
+        output_uint(out, ip_header.hop_limit);
+        output_str(out, "\n        Source IP: ");
+        print_ipv6_address(out, ip_header.src_ip);
+        output_str(out, "\n        Destination IP: ");
+        print_ipv6_address(out, ip_header.dst_ip);
+        output_char(out, '\n');
+    }
 
     if (ip_header.next_header == 17) { 
         const uint8_t* udp_data = packet_data + sizeof(ipv6_header_t);
@@ -149,17 +178,30 @@ void process_ipv6_header(file_context_t* file_ctx, const uint8_t* packet_data, u
  */
 void parse_network_layer_header(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length, uint16_t ethertype, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac) {
     switch (ethertype) {
-        case ETHERTYPE_IPV4:
+        case ETHERTYPE_IPV4: {
+            PROFILE_SCOPE_BEGIN(ip_scope, PROFILE_STAGE_IP);
             process_ipv4_header(file_ctx, packet_data, data_length, eth_src_mac, eth_dst_mac);
+            PROFILE_SCOPE_END(ip_scope);
             break;
-        case ETHERTYPE_IPV6:
+        }
+        case ETHERTYPE_IPV6: {
+            PROFILE_SCOPE_BEGIN(ip_scope, PROFILE_STAGE_IP);
             process_ipv6_header(file_ctx, packet_data, data_length, eth_src_mac, eth_dst_mac);
+            PROFILE_SCOPE_END(ip_scope);
             break;
-        case ETHERTYPE_PTP:
+        }
+        case ETHERTYPE_PTP: {
+            PROFILE_SCOPE_BEGIN(ptp_scope, PROFILE_STAGE_PTP);
             process_ptp_header(file_ctx, packet_data, data_length, eth_src_mac, eth_dst_mac);
+            PROFILE_SCOPE_END(ptp_scope);
             break;
+        }
         default:
-            printf("Unsupported network layer protocol: 0x%04X\n", ethertype);
+            if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+                output_str(file_ctx->out, "Unsupported network layer protocol: 0x");
+                output_hex(file_ctx->out, ethertype, 4, 1);
+                output_char(file_ctx->out, '\n');
+            }
             break;
     }
 }
\ No newline at end of file
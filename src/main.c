@@ -1,21 +1,77 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../include/pcap.h" 
 #include "../include/clock_map.h" 
 #include "../include/gptp_validator.h" 
+#include "../include/pipeline.h"
+#include "../include/chunk_scanner.h"
+#include "../include/packet_index.h"
+#include "../include/packet_filter.h"
+#include "../include/histogram_set.h"
+#include "../include/profile.h"
+#include "../include/utils.h"
+
+/*
+ * Combines the percentile histograms of this run with those of earlier runs: prints the
+ * combined percentiles if any --hist-load dumps were given, and writes the combination
+ * to the --hist-dump file if one was.
+ * @param file_ctx The file context; its histograms are used if a capture was processed.
+ * @param processed Whether a capture was processed.
+ * @param argc Argument count, to find the --hist-load options.
+ * @param argv Arguments.
+ * @param dump_path Path of the dump to write, or NULL.
+ * @return 0 on success, -1 on failure.
+ */
+static int combine_histograms(const file_context_t* file_ctx, int processed, int argc, char* argv[], const char* dump_path) {
+    histogram_set_t set;
+    if (histogram_set_init(&set) != 0) {
+        return -1;
+    }
+    int loaded = 0;
+    int result = 0;
+    if (processed && histogram_set_collect(&set, &file_ctx->offsets, &file_ctx->links) != 0) {
+        result = -1;
+    }
+    for (int i = 1; result == 0 && i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--hist-load") == 0) {
+            result = histogram_set_load(&set, argv[++i]);
+            loaded++;
+        }
+    }
+    if (result == 0 && loaded > 0) {
+        printf("Combined percentiles of %d dump%s%s:\n", loaded, loaded == 1 ? "" : "s", processed ? " and this capture" : "");
+        histogram_set_print(&set);
+    }
+    if (result == 0 && dump_path != NULL) {
+        result = histogram_set_save(&set, dump_path);
+    }
+    histogram_set_free(&set);
+    return result;
+}
 
 int main(int argc, char* argv[]) {
     const char* file_path = NULL;
+    const char* hist_dump_path = NULL;
+    int hist_load_count = 0;
+    int profile = 0;
+    const char* filter_expression = NULL;
+    const char* filter_src = NULL;
+    const char* filter_dst = NULL;
+    packet_filter_t filter = {0};
+    output_t out = {0};
     file_context_t file_ctx = {0}; // Initialize file context
+    run_stats_t run_stats = {0};   // Counters of this thread; pipeline and chunk threads keep their own
+    file_ctx.out = &out;
+    file_ctx.stats = &run_stats;
+    file_ctx.verbosity = OUTPUT_VERBOSE;
+    file_ctx.index_stride = PACKET_INDEX_DEFAULT_STRIDE;
+    file_ctx.window_start_ns = INT64_MIN;
+    file_ctx.window_end_ns = INT64_MAX;
 
-    // Initialize clock map and gPTP cycle map
-    if (clock_map_init(&file_ctx.clock_map) != 0) {
-        fprintf(stderr, "Failed to initialize clock map.\n");
-        return 1;
-    }
-    if (gptp_cycle_map_init(&file_ctx.cycle_map) != 0) {
-        fprintf(stderr, "Failed to initialize gPTP cycle map.\n");
-        clock_map_free(&file_ctx.clock_map); // Free clock map if cycle map init fails
+    // Initialize the clock map, the gPTP cycle map and the analyzers
+    if (file_context_init_maps(&file_ctx) != 0) {
+        fprintf(stderr, "Failed to initialize maps.\n");
         return 1;
     }
 
@@ -24,32 +80,171 @@ int main(int argc, char* argv[]) {
         if (strcmp(argv[i], "--filter-ptp") == 0) {
             file_ctx.filter_ptp = 1;
             printf("PTP/gPTP filtering enabled.\n");
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            file_ctx.verbosity = OUTPUT_QUIET;
+        } else if (strcmp(argv[i], "--summary") == 0) {
+            file_ctx.verbosity = OUTPUT_SUMMARY;
+        } else if (strcmp(argv[i], "--no-mmap") == 0) {
+            file_ctx.use_stdio = 1;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+#ifdef PCAP_PROFILE
+            profile = 1;
+#else
+            fprintf(stderr, "Warning: built with PROFILE=0; --profile has no effect.\n");
+#endif
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            file_ctx.num_threads = atoi(argv[++i]);
+            if (file_ctx.num_threads < 1 || file_ctx.num_threads > PIPELINE_MAX_THREADS) {
+                fprintf(stderr, "Invalid thread count for -j (expected 1-%d).\n", PIPELINE_MAX_THREADS);
+                file_context_free_maps(&file_ctx);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--chunks") == 0 && i + 1 < argc) {
+            file_ctx.num_chunks = atoi(argv[++i]);
+            if (file_ctx.num_chunks < 1 || file_ctx.num_chunks > CHUNK_SCANNER_MAX_CHUNKS) {
+                fprintf(stderr, "Invalid chunk count for --chunks (expected 1-%d).\n", CHUNK_SCANNER_MAX_CHUNKS);
+                file_context_free_maps(&file_ctx);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter_expression = argv[++i];
+        } else if (strcmp(argv[i], "--src") == 0 && i + 1 < argc) {
+            filter_src = argv[++i];
+        } else if (strcmp(argv[i], "--dst") == 0 && i + 1 < argc) {
+            filter_dst = argv[++i];
+        } else if (strcmp(argv[i], "--index") == 0) {
+            file_ctx.build_index = 1;
+        } else if (strcmp(argv[i], "--index-stride") == 0 && i + 1 < argc) {
+            int stride = atoi(argv[++i]);
+            if (stride < 1) {
+                fprintf(stderr, "Invalid stride for --index-stride (expected a positive record count).\n");
+                file_context_free_maps(&file_ctx);
+                return 1;
+            }
+            file_ctx.index_stride = (uint32_t)stride;
+        } else if ((strcmp(argv[i], "--start") == 0 || strcmp(argv[i], "--end") == 0) && i + 1 < argc) {
+            int64_t* bound = strcmp(argv[i], "--start") == 0 ? &file_ctx.window_start_ns : &file_ctx.window_end_ns;
+            if (parse_timestamp_ns(argv[i + 1], bound) != 0) {
+                fprintf(stderr, "Invalid time for %s (expected seconds since the epoch, e.g. 1700000000.25).\n", argv[i]);
+                file_context_free_maps(&file_ctx);
+                return 1;
+            }
+            file_ctx.has_window = 1;
+            i++;
+        } else if (strcmp(argv[i], "--hist-dump") == 0 && i + 1 < argc) {
+            hist_dump_path = argv[++i];
+        } else if (strcmp(argv[i], "--hist-load") == 0 && i + 1 < argc) {
+            hist_load_count++; // Read after processing, by combine_histograms()
+            i++;
         } else {
             file_path = argv[i];
         }
     }
 
+    if (file_ctx.num_threads > 0 && file_ctx.num_chunks > 0) {
+        fprintf(stderr, "-j and --chunks cannot be combined.\n");
+        file_context_free_maps(&file_ctx);
+        return 1;
+    }
+
+    if (file_ctx.num_chunks > 0 && (file_ctx.build_index || file_ctx.has_window)) {
+        fprintf(stderr, "--chunks cannot be combined with --index, --start or --end.\n");
+        file_context_free_maps(&file_ctx);
+        return 1;
+    }
+
+    // Each chunk numbers its packets from 1 and its analyzers start without the packets
+    // before its range, so per-packet output would not match a sequential run
+    if (file_ctx.num_chunks > 0 && file_ctx.verbosity == OUTPUT_VERBOSE) {
+        fprintf(stderr, "--chunks requires --quiet or --summary.\n");
+        file_context_free_maps(&file_ctx);
+        return 1;
+    }
+
+    if (file_ctx.window_start_ns > file_ctx.window_end_ns) {
+        fprintf(stderr, "--start must not be later than --end.\n");
+        file_context_free_maps(&file_ctx);
+        return 1;
+    }
+
+    // Without a capture, only combine histogram dumps
+    if (file_path == NULL && hist_load_count > 0) {
+        int combined = combine_histograms(&file_ctx, 0, argc, argv, hist_dump_path);
+        file_context_free_maps(&file_ctx);
+        return combined == 0 ? 0 : 1;
+    }
+
     // Print usage and exit if no file path is provided
     if (file_path == NULL) {
-        fprintf(stderr, "Usage: %s <file_path> [--filter-ptp]\n", argv[0]);
-        clock_map_free(&file_ctx.clock_map);
-        gptp_cycle_map_free(&file_ctx.cycle_map);
+        fprintf(stderr, "Usage: %s <file_path|-> [--quiet | --summary] [--filter-ptp] [--filter EXPR] [--src ADDR] [--dst ADDR] [--no-mmap] [--profile] [-j N | --chunks N] [--index] [--index-stride N] [--start T] [--end T] [--hist-dump FILE] [--hist-load FILE]...\n", argv[0]);
+        fprintf(stderr, "--chunks N requires --quiet or --summary.\n");
+        file_context_free_maps(&file_ctx);
+        return 1;
+    }
+
+    // Compile --filter, --src and --dst into a single filter program
+    if (filter_expression != NULL || filter_src != NULL || filter_dst != NULL) {
+        size_t length = 64 + (filter_expression ? strlen(filter_expression) : 0) +
+                        (filter_src ? strlen(filter_src) : 0) + (filter_dst ? strlen(filter_dst) : 0);
+        char* combined = (char*)malloc(length);
+        if (combined == NULL) {
+            perror("Failed to allocate memory for filter expression");
+            file_context_free_maps(&file_ctx);
+            return 1;
+        }
+        int used = 0;
+        if (filter_expression != NULL) {
+            used += snprintf(combined + used, length - (size_t)used, "(%s)", filter_expression);
+        }
+        if (filter_src != NULL) {
+            used += snprintf(combined + used, length - (size_t)used, "%ssrc %s", used ? " and " : "", filter_src);
+        }
+        if (filter_dst != NULL) {
+            snprintf(combined + used, length - (size_t)used, "%sdst %s", used ? " and " : "", filter_dst);
+        }
+        int compiled = packet_filter_compile(&filter, combined);
+        free(combined);
+        if (compiled != 0) {
+            file_context_free_maps(&file_ctx);
+            return 1;
+        }
+        file_ctx.filter = &filter;
+    }
+
+    // Per-packet output is formatted into a large buffer and written to stdout in blocks
+    if (output_init(&out, stdout, OUTPUT_BUFFER_SIZE) != 0) {
+        packet_filter_free(&filter);
+        file_context_free_maps(&file_ctx);
         return 1;
     }
 
     printf("PCAP Parser - Main application (under development)\n");
 
     // Process the PCAP file
-    if (process_pcap_file(file_path, &file_ctx) != 0) {
+    if (profile) {
+        profile_enable();
+    }
+    int processed = process_pcap_file(file_path, &file_ctx);
+    profile_report();
+    if (processed != 0) {
         fprintf(stderr, "Failed to process PCAP file: %s\n", file_path);
-        clock_map_free(&file_ctx.clock_map);
-        gptp_cycle_map_free(&file_ctx.cycle_map);
+        output_free(&out);
+        packet_filter_free(&filter);
+        file_context_free_maps(&file_ctx);
         return 1;
     }
 
-    // Free all allocated maps
-    clock_map_free(&file_ctx.clock_map);
-    gptp_cycle_map_free(&file_ctx.cycle_map);
+    // Combine this run's percentiles with earlier runs' and write them out
+    int status = 0;
+    if ((hist_dump_path != NULL || hist_load_count > 0) &&
+        combine_histograms(&file_ctx, 1, argc, argv, hist_dump_path) != 0) {
+        status = 1;
+    }
+
+    // Free the writer, the filter and all allocated maps
+    output_free(&out);
+    packet_filter_free(&filter);
+    file_context_free_maps(&file_ctx);
 
-    return 0;
+    return status;
 }
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include "../include/output.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Initializes a writer.
+ * @param out The writer.
+ * @param sink Stream the buffer is flushed to, or NULL to keep all output in memory.
+ * @param capacity Initial buffer size in bytes.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int output_init(output_t* out, FILE* sink, size_t capacity) {
+    memset(out, 0, sizeof(*out));
+    out->buffer = (char*)malloc(capacity);
+    if (out->buffer == NULL) {
+        perror("Failed to allocate memory for output buffer");
+        return -1;
+    }
+    out->capacity = capacity;
+    out->sink = sink;
+    return 0;
+}
+
+/*
+ * Writes the buffered output to the sink. Writers without a sink keep their contents.
+ * @param out The writer.
+ * @return 0 on success, -1 if the sink could not be written.
+ */
+int output_flush(output_t* out) {
+    if (out->sink == NULL || out->used == 0) {
+        return out->failed ? -1 : 0;
+    }
+    if (fwrite(out->buffer, 1, out->used, out->sink) != out->used) {
+        out->failed = 1;
+    }
+    out->used = 0;
+    return out->failed ? -1 : 0;
+}
+
+/*
+ * Discards the buffered output, keeping the buffer for reuse.
+ * @param out The writer.
+ */
+void output_reset(output_t* out) {
+    out->used = 0;
+    out->failed = 0;
+}
+
+/*
+ * Frees the buffer of a writer without flushing it.
+ * @param out The writer.
+ */
+void output_free(output_t* out) {
+    free(out->buffer);
+    out->buffer = NULL;
+    out->used = 0;
+    out->capacity = 0;
+}
+
+/*
+ * Makes room for length more bytes, flushing to the sink or growing the buffer.
+ * @return Pointer to the free space, or NULL if output is being dropped.
+ */
+static char* output_reserve(output_t* out, size_t length) {
+    if (out->capacity - out->used >= length) {
+        return out->buffer + out->used;
+    }
+    if (out->failed) {
+        return NULL;
+    }
+    if (out->sink != NULL) {
+        output_flush(out);
+        if (out->capacity >= length) {
+            return out->buffer;
+        }
+    }
+
+    size_t capacity = out->capacity ? out->capacity : OUTPUT_BUFFER_SIZE;
+    while (capacity - out->used < length) {
+        capacity *= 2;
+    }
+    char* grown = (char*)realloc(out->buffer, capacity);
+    if (grown == NULL) {
+        perror("Failed to allocate memory for output buffer");
+        out->failed = 1;
+        return NULL;
+    }
+    out->buffer = grown;
+    out->capacity = capacity;
+    return out->buffer + out->used;
+}
+
+/*
+ * Appends raw bytes.
+ */
+void output_write(output_t* out, const char* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    char* dest = output_reserve(out, length);
+    if (dest != NULL) {
+        memcpy(dest, data, length);
+        out->used += length;
+    }
+}
+
+/*
+ * Appends a NUL-terminated string.
+ */
+void output_str(output_t* out, const char* text) {
+    output_write(out, text, strlen(text));
+}
+
+/*
+ * Appends one character.
+ */
+void output_char(output_t* out, char c) {
+    char* dest = output_reserve(out, 1);
+    if (dest != NULL) {
+        *dest = c;
+        out->used++;
+    }
+}
+
+/*
+ * Appends an unsigned decimal number, zero-padded to at least width digits (as "%0*llu").
+ */
+void output_uint_padded(output_t* out, uint64_t value, int width) {
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    if (width > (int)sizeof(digits)) {
+        width = (int)sizeof(digits);
+    }
+
+    int length = count > width ? count : width;
+    char* dest = output_reserve(out, (size_t)length);
+    if (dest == NULL) {
+        return;
+    }
+    for (int i = 0; i < length - count; i++) {
+        *dest++ = '0';
+    }
+    while (count > 0) {
+        *dest++ = digits[--count];
+    }
+    out->used += (size_t)length;
+}
+
+/*
+ * Appends an unsigned decimal number (as "%llu").
+ */
+void output_uint(output_t* out, uint64_t value) {
+    output_uint_padded(out, value, 0);
+}
+
+/*
+ * Appends a signed decimal number (as "%lld").
+ */
+void output_int(output_t* out, int64_t value) {
+    if (value < 0) {
+        output_char(out, '-');
+        output_uint(out, -(uint64_t)value);
+    } else {
+        output_uint(out, (uint64_t)value);
+    }
+}
+
+/*
+ * Appends a hexadecimal number without prefix, zero-padded to at least digits digits
+ * (as "%0*llx", or "%0*llX" when uppercase).
+ */
+void output_hex(output_t* out, uint64_t value, int digits, int uppercase) {
+    const char* alphabet = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+    int count = 1;
+    while (count < 16 && (value >> (4 * count)) != 0) {
+        count++;
+    }
+    if (digits > 16) {
+        digits = 16;
+    }
+    if (count < digits) {
+        count = digits;
+    }
+
+    char* dest = output_reserve(out, (size_t)count);
+    if (dest == NULL) {
+        return;
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        dest[i] = alphabet[value & 0x0F];
+        value >>= 4;
+    }
+    out->used += (size_t)count;
+}
+
+/*
+ * Appends bytes as two hex digits each, with an optional separator between bytes
+ * (e.g. a MAC address as "00:1B:21:..."). A separator of '\0' writes none.
+ */
+void output_hex_bytes(output_t* out, const uint8_t* bytes, size_t count, char separator, int uppercase) {
+    const char* alphabet = uppercase ? "0123456789ABCDEF" : "0123456789abcdef";
+    if (count == 0) {
+        return;
+    }
+    size_t length = count * 2 + (separator ? count - 1 : 0);
+    char* dest = output_reserve(out, length);
+    if (dest == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (separator && i > 0) {
+            *dest++ = separator;
+        }
+        *dest++ = alphabet[bytes[i] >> 4];
+        *dest++ = alphabet[bytes[i] & 0x0F];
+    }
+    out->used += length;
+}
+
+/*
+ * Appends formatted text. Meant for rare messages; per-packet output uses the
+ * formatters above.
+ */
+void output_printf(output_t* out, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    char* dest = output_reserve(out, 256);
+    if (dest == NULL) {
+        va_end(args);
+        return;
+    }
+    va_list retry;
+    va_copy(retry, args);
+    size_t available = out->capacity - out->used;
+    int length = vsnprintf(dest, available, format, args);
+    if (length >= 0 && (size_t)length >= available) {
+        dest = output_reserve(out, (size_t)length + 1);
+        length = dest != NULL ? vsnprintf(dest, (size_t)length + 1, format, retry) : -1;
+    }
+    if (length > 0) {
+        out->used += (size_t)length;
+    }
+    va_end(retry);
+    va_end(args);
+}
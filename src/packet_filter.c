@@ -0,0 +1,558 @@
+// Compiles filter expressions into a small decision program that runs on raw frame bytes.
+//
+// Grammar:
+//   expr      := term ( "or" term )*
+//   term      := factor ( "and" factor )*
+//   factor    := "not" factor | "(" expr ")" | primitive
+//   primitive := "ptp" | "gptp" | "vlan" [ID] | "domain" N | "msgtype" NAME|N | "clock" CLOCKID
+//              | [ "src" | "dst" ] [ "mac" | "ip" | "ip6" ] [ "host" ] ADDRESS | "ip" | "ip6"
+// "&&", "||" and "!" are accepted for "and", "or" and "not". ADDRESS is a MAC, IPv4 or
+// IPv6 address; without "src"/"dst" either side matches. A bare "ip" or "ip6" matches
+// frames carrying that header. CLOCKID is 16 hex digits,
+// optionally separated by ':', '-' or '.'.
+//
+// Each primitive becomes one or two masked compares against a layer located once per
+// frame, and "and"/"or"/"not" become jump targets, as in a BPF program. The deepest field
+// (a clockIdentity behind VLAN, IPv4 with options and UDP) ends within PCAP_PEEK_LEN bytes,
+// so filters run on the header peek before a record body is read.
+
+#include "../include/packet_filter.h"
+#include "../include/ethernet.h"
+#include "../include/ptp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <arpa/inet.h>
+
+#define FILTER_TOKEN_MAX 64         // Longest token accepted in an expression
+#define FILTER_MAX_INSNS 16384      // Label ids and jump targets must fit in 16 bits
+
+/* A jump target while the program is being built: an instruction, or another label */
+typedef struct {
+    int insn;
+    int alias;
+} filter_label_t;
+
+/* Parser and code generator state */
+typedef struct {
+    const char* expression;
+    const char* cursor;
+    char token[FILTER_TOKEN_MAX];
+    int has_token;
+    packet_filter_t* filter;
+    filter_label_t* labels;
+    size_t label_count;
+    size_t label_capacity;
+    int failed;
+} filter_compiler_t;
+
+/* PTP message type names accepted by "msgtype" */
+static const struct {
+    const char* name;
+    ptp_message_type_t type;
+} filter_message_types[] = {
+    { "sync", PTP_MESSAGE_SYNC },
+    { "delay_req", PTP_MESSAGE_DELAY_REQ },
+    { "pdelay_req", PTP_MESSAGE_PDELAY_REQ },
+    { "pdelay_resp", PTP_MESSAGE_PDELAY_RESP },
+    { "follow_up", PTP_MESSAGE_FOLLOW_UP },
+    { "delay_resp", PTP_MESSAGE_DELAY_RESP },
+    { "pdelay_resp_follow_up", PTP_MESSAGE_PDELAY_RESP_FOLLOW_UP },
+    { "announce", PTP_MESSAGE_ANNOUNCE },
+    { "signaling", PTP_MESSAGE_SIGNALING },
+    { "management", PTP_MESSAGE_MANAGEMENT },
+};
+
+/* Reports a compile error once, pointing at the current token */
+static void filter_error(filter_compiler_t* c, const char* message) {
+    if (!c->failed) {
+        fprintf(stderr, "Filter error: %s near '%s' in \"%s\"\n", message, c->has_token ? c->token : "<end>", c->expression);
+        c->failed = 1;
+    }
+}
+
+/* Reads the next token into c->token; parentheses and '!' are single-character tokens */
+static void filter_next_token(filter_compiler_t* c) {
+    const char* p = c->cursor;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    c->has_token = *p != '\0';
+    if (!c->has_token) {
+        c->token[0] = '\0';
+        c->cursor = p;
+        return;
+    }
+
+    size_t length = 0;
+    if (*p == '(' || *p == ')' || *p == '!') {
+        length = 1;
+    } else {
+        while (p[length] != '\0' && p[length] != ' ' && p[length] != '\t' && p[length] != '(' && p[length] != ')') {
+            length++;
+        }
+    }
+    if (length >= FILTER_TOKEN_MAX) {
+        length = FILTER_TOKEN_MAX - 1;
+        filter_error(c, "token too long");
+    }
+    memcpy(c->token, p, length);
+    c->token[length] = '\0';
+    c->cursor = p + length;
+}
+
+/* Consumes the current token if it matches word (case-insensitively) */
+static int filter_accept(filter_compiler_t* c, const char* word) {
+    if (c->has_token && strcasecmp(c->token, word) == 0) {
+        filter_next_token(c);
+        return 1;
+    }
+    return 0;
+}
+
+/* Creates an unbound label */
+static int filter_new_label(filter_compiler_t* c) {
+    if (c->label_count == c->label_capacity) {
+        size_t capacity = c->label_capacity ? c->label_capacity * 2 : 16;
+        filter_label_t* grown = (filter_label_t*)realloc(c->labels, capacity * sizeof(filter_label_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for filter labels");
+            c->failed = 1;
+            return 0;
+        }
+        c->labels = grown;
+        c->label_capacity = capacity;
+    }
+    c->labels[c->label_count].insn = -1;
+    c->labels[c->label_count].alias = -1;
+    return (int)c->label_count++;
+}
+
+/* Binds a label to the next instruction to be emitted */
+static void filter_bind_label(filter_compiler_t* c, int label) {
+    if (!c->failed) {
+        c->labels[label].insn = (int)c->filter->count;
+    }
+}
+
+/* Makes a label jump wherever target jumps */
+static void filter_alias_label(filter_compiler_t* c, int label, int target) {
+    if (!c->failed) {
+        c->labels[label].alias = target;
+    }
+}
+
+/* Appends an instruction whose jt/jf hold label ids until the program is linked */
+static filter_insn_t* filter_emit(filter_compiler_t* c, filter_op_t op, filter_base_t base, int jt, int jf) {
+    packet_filter_t* filter = c->filter;
+    if (c->failed) {
+        return NULL;
+    }
+    if (filter->count >= FILTER_MAX_INSNS) {
+        filter_error(c, "expression too long");
+        return NULL;
+    }
+    if (filter->count == filter->capacity) {
+        size_t capacity = filter->capacity ? filter->capacity * 2 : 16;
+        filter_insn_t* grown = (filter_insn_t*)realloc(filter->insns, capacity * sizeof(filter_insn_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for filter program");
+            c->failed = 1;
+            return NULL;
+        }
+        filter->insns = grown;
+        filter->capacity = capacity;
+    }
+    filter_insn_t* insn = &filter->insns[filter->count++];
+    memset(insn, 0, sizeof(*insn));
+    insn->op = (uint8_t)op;
+    insn->base = (uint8_t)base;
+    insn->jt = (uint16_t)jt;
+    insn->jf = (uint16_t)jf;
+    if (base != FILTER_BASE_FRAME) {
+        filter->needs_layers = 1;
+    }
+    return insn;
+}
+
+/* Emits a masked compare of length bytes; a NULL mask compares every bit */
+static void filter_emit_compare(filter_compiler_t* c, filter_base_t base, uint16_t offset, const uint8_t* value, const uint8_t* mask, uint8_t length, int jt, int jf) {
+    filter_insn_t* insn = filter_emit(c, FILTER_OP_COMPARE, base, jt, jf);
+    if (insn == NULL) {
+        return;
+    }
+    insn->offset = offset;
+    insn->length = length;
+    for (uint8_t i = 0; i < length; i++) {
+        insn->mask[i] = mask ? mask[i] : 0xFF;
+        insn->value[i] = value[i] & insn->mask[i];
+    }
+}
+
+/* Emits a compare of the same field at two offsets, matching if either side matches */
+static void filter_emit_either(filter_compiler_t* c, filter_base_t base, uint16_t first, uint16_t second, const uint8_t* value, uint8_t length, int jt, int jf) {
+    int next = filter_new_label(c);
+    filter_emit_compare(c, base, first, value, NULL, length, jt, next);
+    filter_bind_label(c, next);
+    filter_emit_compare(c, base, second, value, NULL, length, jt, jf);
+}
+
+/* Returns the value of a hex digit, or -1 */
+static int filter_hex_digit(char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'f') {
+        return (ch | 0x20) - 'a' + 10;
+    }
+    return -1;
+}
+
+/* Parses count bytes of hex digits, optionally separated by ':', '-' or '.' */
+static int filter_parse_hex_bytes(const char* text, uint8_t* out, size_t count) {
+    size_t n = 0;
+    const char* p = text;
+    while (*p != '\0') {
+        if (*p == ':' || *p == '-' || *p == '.') {
+            p++;
+            continue;
+        }
+        int high = filter_hex_digit(p[0]);
+        if (high < 0 || n == count) {
+            return -1;
+        }
+        int low = filter_hex_digit(p[1]);
+        if (low >= 0) {
+            out[n++] = (uint8_t)((high << 4) | low);
+            p += 2;
+        } else {
+            out[n++] = (uint8_t)high; // Single-digit group, e.g. "0:1b:..."
+            p += 1;
+        }
+    }
+    return n == count ? 0 : -1;
+}
+
+/* Parses an unsigned decimal number no larger than max */
+static int filter_parse_number(const char* text, unsigned long max, unsigned long* out) {
+    char* end;
+    if (text[0] < '0' || text[0] > '9') {
+        return -1;
+    }
+    unsigned long value = strtoul(text, &end, 0);
+    if (*end != '\0' || value > max) {
+        return -1;
+    }
+    *out = value;
+    return 0;
+}
+
+/* Address kinds understood by the address primitives */
+typedef enum {
+    FILTER_ADDRESS_NONE = 0,
+    FILTER_ADDRESS_MAC,
+    FILTER_ADDRESS_IPV4,
+    FILTER_ADDRESS_IPV6
+} filter_address_t;
+
+/* Classifies and parses an address token */
+static filter_address_t filter_parse_address(const char* text, uint8_t out[16]) {
+    // "::" only appears in IPv6 addresses
+    if ((strchr(text, ':') != NULL || strchr(text, '-') != NULL) && strstr(text, "::") == NULL) {
+        if (strlen(text) <= 17 && filter_parse_hex_bytes(text, out, 6) == 0) {
+            return FILTER_ADDRESS_MAC;
+        }
+    }
+    if (inet_pton(AF_INET, text, out) == 1) {
+        return FILTER_ADDRESS_IPV4;
+    }
+    if (inet_pton(AF_INET6, text, out) == 1) {
+        return FILTER_ADDRESS_IPV6;
+    }
+    return FILTER_ADDRESS_NONE;
+}
+
+/* Compiles [src|dst] [mac|ip|ip6] [host] ADDRESS, or a bare "ip"/"ip6" presence test;
+ * side is 0 for either, 1 for src, 2 for dst */
+static void filter_address_primitive(filter_compiler_t* c, int side, int jt, int jf) {
+    filter_address_t want = FILTER_ADDRESS_NONE;
+    if (filter_accept(c, "mac") || filter_accept(c, "ether")) {
+        want = FILTER_ADDRESS_MAC;
+    } else if (filter_accept(c, "ip")) {
+        want = FILTER_ADDRESS_IPV4;
+    } else if (filter_accept(c, "ip6")) {
+        want = FILTER_ADDRESS_IPV6;
+    }
+    int host = filter_accept(c, "host");
+
+    uint8_t address[16];
+    filter_address_t kind = c->has_token ? filter_parse_address(c->token, address) : FILTER_ADDRESS_NONE;
+    if (kind == FILTER_ADDRESS_NONE && side == 0 && !host &&
+        (want == FILTER_ADDRESS_IPV4 || want == FILTER_ADDRESS_IPV6)) {
+        filter_emit(c, FILTER_OP_PRESENT, want == FILTER_ADDRESS_IPV4 ? FILTER_BASE_IPV4 : FILTER_BASE_IPV6, jt, jf);
+        return;
+    }
+    if (!c->has_token) {
+        filter_error(c, "expected an address");
+        return;
+    }
+    if (kind == FILTER_ADDRESS_NONE || (want != FILTER_ADDRESS_NONE && kind != want) ||
+        (host && kind == FILTER_ADDRESS_MAC)) {
+        filter_error(c, "invalid address");
+        return;
+    }
+    filter_next_token(c);
+
+    /* Field offsets of the source and destination addresses in each header */
+    filter_base_t base;
+    uint16_t src_offset, dst_offset;
+    uint8_t length;
+    if (kind == FILTER_ADDRESS_MAC) {
+        base = FILTER_BASE_FRAME; dst_offset = 0; src_offset = 6; length = 6;
+    } else if (kind == FILTER_ADDRESS_IPV4) {
+        base = FILTER_BASE_IPV4; src_offset = 12; dst_offset = 16; length = 4;
+    } else {
+        base = FILTER_BASE_IPV6; src_offset = 8; dst_offset = 24; length = 16;
+    }
+
+    if (side == 1) {
+        filter_emit_compare(c, base, src_offset, address, NULL, length, jt, jf);
+    } else if (side == 2) {
+        filter_emit_compare(c, base, dst_offset, address, NULL, length, jt, jf);
+    } else {
+        filter_emit_either(c, base, src_offset, dst_offset, address, length, jt, jf);
+    }
+}
+
+/* Compiles a single primitive */
+static void filter_primitive(filter_compiler_t* c, int jt, int jf) {
+    unsigned long number;
+    uint8_t value[8];
+
+    if (filter_accept(c, "ptp")) {
+        filter_emit(c, FILTER_OP_PRESENT, FILTER_BASE_PTP, jt, jf);
+    } else if (filter_accept(c, "gptp")) {
+        // gPTP (802.1AS) uses transportSpecific (majorSdoId) 1
+        uint8_t sdo = 0x10, sdo_mask = 0xF0;
+        filter_emit_compare(c, FILTER_BASE_PTP, 0, &sdo, &sdo_mask, 1, jt, jf);
+    } else if (filter_accept(c, "vlan")) {
+        if (c->has_token && filter_parse_number(c->token, 4095, &number) == 0) {
+            filter_next_token(c);
+            uint8_t tci[2] = { (uint8_t)(number >> 8), (uint8_t)number };
+            uint8_t tci_mask[2] = { 0x0F, 0xFF };
+            filter_emit_compare(c, FILTER_BASE_VLAN, 0, tci, tci_mask, 2, jt, jf);
+        } else {
+            filter_emit(c, FILTER_OP_PRESENT, FILTER_BASE_VLAN, jt, jf);
+        }
+    } else if (filter_accept(c, "domain")) {
+        if (!c->has_token || filter_parse_number(c->token, 255, &number) != 0) {
+            filter_error(c, "expected a domain number (0-255)");
+            return;
+        }
+        filter_next_token(c);
+        value[0] = (uint8_t)number;
+        filter_emit_compare(c, FILTER_BASE_PTP, 4, value, NULL, 1, jt, jf);
+    } else if (filter_accept(c, "msgtype")) {
+        int found = 0;
+        for (size_t i = 0; i < sizeof(filter_message_types) / sizeof(filter_message_types[0]); i++) {
+            if (c->has_token && strcasecmp(c->token, filter_message_types[i].name) == 0) {
+                value[0] = (uint8_t)filter_message_types[i].type;
+                found = 1;
+            }
+        }
+        if (!found && c->has_token && filter_parse_number(c->token, 15, &number) == 0) {
+            value[0] = (uint8_t)number;
+            found = 1;
+        }
+        if (!found) {
+            filter_error(c, "expected a PTP message type");
+            return;
+        }
+        filter_next_token(c);
+        uint8_t type_mask = 0x0F;
+        filter_emit_compare(c, FILTER_BASE_PTP, 0, value, &type_mask, 1, jt, jf);
+    } else if (filter_accept(c, "clock")) {
+        if (!c->has_token || filter_parse_hex_bytes(c->token, value, 8) != 0) {
+            filter_error(c, "expected a clockIdentity (16 hex digits)");
+            return;
+        }
+        filter_next_token(c);
+        // clockIdentity is the first 8 bytes of sourcePortIdentity
+        filter_emit_compare(c, FILTER_BASE_PTP, 20, value, NULL, 8, jt, jf);
+    } else if (filter_accept(c, "src")) {
+        filter_address_primitive(c, 1, jt, jf);
+    } else if (filter_accept(c, "dst")) {
+        filter_address_primitive(c, 2, jt, jf);
+    } else if (c->has_token) {
+        filter_address_primitive(c, 0, jt, jf);
+    } else {
+        filter_error(c, "unexpected end of expression");
+    }
+}
+
+static void filter_expression(filter_compiler_t* c, int jt, int jf);
+
+/* factor := "not" factor | "(" expr ")" | primitive */
+static void filter_factor(filter_compiler_t* c, int jt, int jf) {
+    if (filter_accept(c, "not") || filter_accept(c, "!")) {
+        filter_factor(c, jf, jt);
+    } else if (filter_accept(c, "(")) {
+        filter_expression(c, jt, jf);
+        if (!filter_accept(c, ")")) {
+            filter_error(c, "expected ')'");
+        }
+    } else if (c->has_token && strcmp(c->token, ")") == 0) {
+        filter_error(c, "unexpected ')'");
+    } else {
+        filter_primitive(c, jt, jf);
+    }
+}
+
+/* term := factor ( "and" factor )* */
+static void filter_term(filter_compiler_t* c, int jt, int jf) {
+    for (;;) {
+        int next = filter_new_label(c);
+        filter_factor(c, next, jf);
+        if (c->failed) {
+            return;
+        }
+        if (filter_accept(c, "and") || filter_accept(c, "&&")) {
+            filter_bind_label(c, next);
+            continue;
+        }
+        filter_alias_label(c, next, jt);
+        return;
+    }
+}
+
+/* expr := term ( "or" term )* */
+static void filter_expression(filter_compiler_t* c, int jt, int jf) {
+    for (;;) {
+        int next = filter_new_label(c);
+        filter_term(c, jt, next);
+        if (c->failed) {
+            return;
+        }
+        if (filter_accept(c, "or") || filter_accept(c, "||")) {
+            filter_bind_label(c, next);
+            continue;
+        }
+        filter_alias_label(c, next, jf);
+        return;
+    }
+}
+
+/* Follows label aliases to the instruction a label finally refers to */
+static int filter_resolve_label(const filter_compiler_t* c, int label) {
+    while (c->labels[label].alias >= 0) {
+        label = c->labels[label].alias;
+    }
+    return c->labels[label].insn;
+}
+
+/*
+ * Compiles a filter expression into a decision program.
+ * @param filter The filter to fill.
+ * @param expression The expression text.
+ * @return 0 on success, -1 on a syntax error or memory allocation failure.
+ */
+int packet_filter_compile(packet_filter_t* filter, const char* expression) {
+    filter_compiler_t c;
+    memset(filter, 0, sizeof(*filter));
+    memset(&c, 0, sizeof(c));
+    c.expression = expression;
+    c.cursor = expression;
+    c.filter = filter;
+
+    int accept = filter_new_label(&c);
+    int reject = filter_new_label(&c);
+    filter_next_token(&c);
+    if (!c.has_token) {
+        filter_error(&c, "empty expression");
+    }
+    filter_expression(&c, accept, reject);
+    if (!c.failed && c.has_token) {
+        filter_error(&c, "unexpected token");
+    }
+
+    /* The two verdicts close the program */
+    filter_bind_label(&c, accept);
+    filter_insn_t* insn = filter_emit(&c, FILTER_OP_RETURN, FILTER_BASE_FRAME, 0, 0);
+    if (insn != NULL) {
+        insn->verdict = 1;
+    }
+    filter_bind_label(&c, reject);
+    filter_emit(&c, FILTER_OP_RETURN, FILTER_BASE_FRAME, 0, 0);
+
+    if (c.failed) {
+        free(c.labels);
+        packet_filter_free(filter);
+        return -1;
+    }
+
+    /* Link: replace label ids with instruction indices */
+    for (size_t i = 0; i < filter->count; i++) {
+        if (filter->insns[i].op != FILTER_OP_RETURN) {
+            filter->insns[i].jt = (uint16_t)filter_resolve_label(&c, filter->insns[i].jt);
+            filter->insns[i].jf = (uint16_t)filter_resolve_label(&c, filter->insns[i].jf);
+        }
+    }
+    free(c.labels);
+    return 0;
+}
+
+/*
+ * Runs a compiled filter against the first bytes of a frame.
+ * @param filter The compiled filter.
+ * @param frame The start of the Ethernet frame.
+ * @param length Number of bytes available at frame; fields beyond it do not match.
+ * @return 1 if the frame is accepted, 0 otherwise.
+ */
+int packet_filter_match(const packet_filter_t* filter, const uint8_t* frame, uint32_t length) {
+    uint32_t base[FILTER_BASE_COUNT];
+    base[FILTER_BASE_FRAME] = 0;
+    if (filter->needs_layers) {
+        frame_layers_t layers;
+        locate_frame_layers(frame, length, &layers);
+        base[FILTER_BASE_VLAN] = layers.vlan;
+        base[FILTER_BASE_IPV4] = layers.ipv4;
+        base[FILTER_BASE_IPV6] = layers.ipv6;
+        base[FILTER_BASE_PTP] = layers.ptp;
+    } else {
+        base[FILTER_BASE_VLAN] = base[FILTER_BASE_IPV4] = base[FILTER_BASE_IPV6] = base[FILTER_BASE_PTP] = FRAME_LAYER_ABSENT;
+    }
+
+    size_t pc = 0;
+    for (;;) {
+        const filter_insn_t* insn = &filter->insns[pc];
+        if (insn->op == FILTER_OP_RETURN) {
+            return insn->verdict;
+        }
+
+        uint32_t start = base[insn->base];
+        int match = start != FRAME_LAYER_ABSENT;
+        if (insn->op == FILTER_OP_COMPARE && match) {
+            start += insn->offset;
+            match = start <= length && insn->length <= length - start;
+            for (uint8_t i = 0; match && i < insn->length; i++) {
+                match = (frame[start + i] & insn->mask[i]) == insn->value[i];
+            }
+        }
+        pc = match ? insn->jt : insn->jf;
+    }
+}
+
+/*
+ * Frees a compiled filter.
+ * @param filter The filter.
+ */
+void packet_filter_free(packet_filter_t* filter) {
+    if (filter == NULL) {
+        return;
+    }
+    free(filter->insns);
+    filter->insns = NULL;
+    filter->count = 0;
+    filter->capacity = 0;
+}
@@ -0,0 +1,197 @@
+#include "../include/packet_index.h"
+#include "../include/ethernet.h"
+#include "../include/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Starts building an index for a capture.
+ * @param index The index to initialize.
+ * @param stride Number of records between consecutive entries.
+ * @param capture_size Size of the capture file in bytes.
+ * @param capture_mtime_ns Modification time of the capture file.
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int packet_index_begin(packet_index_t* index, uint32_t stride, uint64_t capture_size, int64_t capture_mtime_ns) {
+    if (index == NULL || stride == 0) {
+        return -1;
+    }
+    memset(index, 0, sizeof(*index));
+    index->header.magic = PACKET_INDEX_MAGIC;
+    index->header.version = PACKET_INDEX_VERSION;
+    index->header.stride = stride;
+    index->header.capture_size = capture_size;
+    index->header.capture_mtime_ns = capture_mtime_ns;
+    index->max_ts_ns = INT64_MIN;
+    return 0;
+}
+
+/*
+ * Accounts for one record of the capture, sampling it into the index every stride records.
+ * Must be called for every record in file order.
+ * @param index The index being built.
+ * @param packet_number 1-based position of the record in the file.
+ * @param ts_ns Capture time of the record.
+ * @param prev_ts_ns Capture time of the preceding record.
+ * @param offset File offset of the record header.
+ * @param data The packet data, used to classify the sampled record.
+ * @param data_length Number of bytes available at data.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int packet_index_add(packet_index_t* index, uint64_t packet_number, int64_t ts_ns, int64_t prev_ts_ns, uint64_t offset, const uint8_t* data, uint32_t data_length) {
+    if ((packet_number - 1) % index->header.stride == 0) {
+        if (index->header.entry_count == index->capacity) {
+            size_t capacity = index->capacity ? index->capacity * 2 : 1024;
+            packet_index_entry_t* grown = (packet_index_entry_t*)realloc(index->entries, capacity * sizeof(packet_index_entry_t));
+            if (grown == NULL) {
+                perror("Failed to allocate memory for packet index");
+                return -1;
+            }
+            index->entries = grown;
+            index->capacity = capacity;
+        }
+
+        packet_index_entry_t* entry = &index->entries[index->header.entry_count++];
+        memset(entry, 0, sizeof(*entry));
+        entry->ts_ns = ts_ns;
+        entry->prev_ts_ns = prev_ts_ns;
+        entry->max_prior_ts_ns = index->max_ts_ns;
+        entry->offset = offset;
+        entry->packet_number = packet_number;
+        entry->ptp_message_type = PACKET_INDEX_NO_PTP_TYPE;
+
+        /* Classify the record by EtherType (after a VLAN tag) and PTP message type */
+        uint32_t payload = ETHERNET_HEADER_LEN;
+        if (data_length >= ETHERNET_HEADER_LEN) {
+            entry->ethertype = (uint16_t)((data[12] << 8) | data[13]);
+            if (entry->ethertype == ETHERTYPE_VLAN && data_length >= ETHERNET_HEADER_LEN + sizeof(vlan_header_t)) {
+                entry->ethertype = (uint16_t)((data[16] << 8) | data[17]);
+                payload += sizeof(vlan_header_t);
+            }
+            if (entry->ethertype == ETHERTYPE_PTP && data_length > payload) {
+                entry->ptp_message_type = data[payload] & 0x0F;
+            }
+        }
+    }
+
+    if (ts_ns > index->max_ts_ns) {
+        index->max_ts_ns = ts_ns;
+    }
+    return 0;
+}
+
+/*
+ * Writes an index to its sidecar file. The file is written under a temporary name
+ * and renamed into place so readers never see a partial index.
+ * @param index The index.
+ * @param index_path Path of the sidecar file.
+ * @return 0 on success, -1 on error.
+ */
+int packet_index_save(const packet_index_t* index, const char* index_path) {
+    size_t path_length = strlen(index_path);
+    char* tmp_path = (char*)malloc(path_length + sizeof(".tmp"));
+    if (tmp_path == NULL) {
+        perror("Failed to allocate memory for packet index path");
+        return -1;
+    }
+    memcpy(tmp_path, index_path, path_length);
+    memcpy(tmp_path + path_length, ".tmp", sizeof(".tmp"));
+
+    FILE* file = fopen(tmp_path, "wb");
+    if (file == NULL) {
+        perror("Error creating packet index");
+        free(tmp_path);
+        return -1;
+    }
+    size_t count = (size_t)index->header.entry_count;
+    int ok = fwrite(&index->header, sizeof(index->header), 1, file) == 1 &&
+             (count == 0 || fwrite(index->entries, sizeof(packet_index_entry_t), count, file) == count);
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp_path, index_path) != 0) {
+        perror("Error writing packet index");
+        remove(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    free(tmp_path);
+    return 0;
+}
+
+/*
+ * Loads a sidecar index if it exists and matches the capture.
+ * @param index The index to fill.
+ * @param index_path Path of the sidecar file.
+ * @param capture_size Size of the capture file in bytes.
+ * @param capture_mtime_ns Modification time of the capture file.
+ * @return 0 if a valid index was loaded, -1 if it is missing, stale or unreadable.
+ */
+int packet_index_load(packet_index_t* index, const char* index_path, uint64_t capture_size, int64_t capture_mtime_ns) {
+    memset(index, 0, sizeof(*index));
+    FILE* file = fopen(index_path, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+
+    packet_index_header_t header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != PACKET_INDEX_MAGIC || header.version != PACKET_INDEX_VERSION ||
+        header.capture_size != capture_size || header.capture_mtime_ns != capture_mtime_ns ||
+        header.entry_count == 0 || header.entry_count > capture_size) {
+        fclose(file);
+        return -1;
+    }
+
+    size_t count = (size_t)header.entry_count;
+    packet_index_entry_t* entries = (packet_index_entry_t*)malloc(count * sizeof(packet_index_entry_t));
+    if (entries == NULL || fread(entries, sizeof(packet_index_entry_t), count, file) != count) {
+        free(entries);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    index->header = header;
+    index->entries = entries;
+    index->capacity = count;
+    return 0;
+}
+
+/*
+ * Finds the entry to start reading from so that no record at or after ts_ns is missed:
+ * the last entry whose earlier records are all older than ts_ns.
+ * @param index A loaded index.
+ * @param ts_ns The start of the time window.
+ * @return The entry, never NULL for a loaded index.
+ */
+const packet_index_entry_t* packet_index_seek(const packet_index_t* index, int64_t ts_ns) {
+    size_t low = 0;
+    size_t high = (size_t)index->header.entry_count;
+
+    // max_prior_ts_ns is non-decreasing, and the first entry has no earlier records
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (index->entries[mid].max_prior_ts_ns < ts_ns) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return &index->entries[low];
+}
+
+/*
+ * Frees the entries of an index.
+ * @param index The index.
+ */
+void packet_index_free(packet_index_t* index) {
+    if (index == NULL) {
+        return;
+    }
+    free(index->entries);
+    index->entries = NULL;
+    index->capacity = 0;
+    index->header.entry_count = 0;
+}
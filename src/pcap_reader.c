@@ -6,159 +6,1173 @@
 // 4. Process each packet data as needed
 // 5. Handle end-of-file and cleanup
 // 6. Return success or error codes
+//
+// Regular files are memory-mapped and walked in place so packet bodies are handed
+// to the parsers without any allocation or copy. Non-seekable inputs (pipes, stdin)
+// fall back to the buffered stdio reader.
+//
+// A sidecar packet index (capture path + ".pidx") can be written during a pass over a
+// classic pcap file; later runs with --start/--end binary-search it and jump straight
+// to the time window instead of scanning from the first record.
+//
+// Both classic pcap and pcapng are accepted. pcapng blocks are walked one by one and
+// Enhanced/Simple Packet Blocks are fed to the same decode path as classic records.
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../include/pcap.h"
 #include "../include/ip.h"
 #include "../include/utils.h"
 #include "../include/ethernet.h"
+#include "../include/pipeline.h"
+#include "../include/chunk_scanner.h"
+#include "../include/packet_index.h"
+#include "../include/packet_filter.h"
+#include "../include/profile.h"
 
-/* Function to read and process a pcap file */
-int process_pcap_file(const char* filepath, file_context_t* file_ctx){
-    // Open the PCAP file in binary read mode
-    FILE* file = fopen(filepath, "rb"); 
-    if (file == NULL) {
-        perror("Error opening file");
-        return -1; 
-    }
+#define PCAPNG_MIN_BLOCK_LENGTH 12            // Block type, total length and trailing length
+#define PCAPNG_DEFAULT_TS_UNITS 1000000ULL    // Timestamp resolution when if_tsresol is absent
+#define RECORD_PREFETCH_DISTANCE 2048         // Bytes ahead of the record walk to prefetch in mapped captures
 
-    printf("File opened successfully: %s\n", filepath);
+/* Per-interface state from an Interface Description Block */
+typedef struct {
+    uint16_t link_type;
+    uint32_t snaplen;
+    uint64_t ts_units_per_sec;  /* from if_tsresol */
+    int64_t  ts_offset_sec;     /* from if_tsoffset */
+    int      warned;            /* set once a packet on an unsupported link type was reported */
+} pcapng_interface_t;
 
-    /* Read global header */
-    pcap_global_header_t global_header;
-    // Read the global header from the file, populating the global_header structure
-    size_t bytes_read = fread(&global_header, sizeof(pcap_global_header_t), 1, file);
-    if (bytes_read != 1) {
-        perror("Error reading global header");
-        fclose(file);
-        return -1; 
-    }
-    printf("PCAP Global Header read successfully.\n");
+/* Reader state for the current pcapng section */
+typedef struct {
+    int swap_bytes;                     /* byte order of the current section */
+    pcapng_interface_t* interfaces;     /* interfaces described so far in the current section */
+    size_t interface_count;
+    size_t interface_capacity;
+} pcapng_reader_t;
 
+/*
+ * Validates the global header and sets up byte swapping in the file context.
+ * @param global_header The global header as read from the file; swapped in place if required.
+ * @param file_ctx The file context.
+ * @return 0 if the header is valid, -1 otherwise.
+ */
+static int validate_global_header(pcap_global_header_t* global_header, file_context_t* file_ctx) {
     /* Check magic number to determine endianness */
     file_ctx->swap_bytes = 0; // Initialize to no swapping
-    if (global_header.magic_number == 0xa1b2c3d4) {
+    file_ctx->nanosecond_ts = 0;
+    if (global_header->magic_number == PCAP_MAGIC_NUMBER) {
         printf("PCAP file is in native byte order (no byte swapping needed)\n");
-    } else if (global_header.magic_number == 0xd4c3b2a1) {
+    } else if (global_header->magic_number == PCAP_SWAPPED_MAGIC_NUMBER) {
         printf("PCAP file is in swapped byte order (byte swapping needed)\n");
         file_ctx->swap_bytes = 1;
+    } else if (global_header->magic_number == PCAP_NSEC_MAGIC_NUMBER) {
+        printf("PCAP file is in native byte order with nanosecond timestamps\n");
+        file_ctx->nanosecond_ts = 1;
+    } else if (global_header->magic_number == PCAP_NSEC_SWAPPED_MAGIC_NUMBER) {
+        printf("PCAP file is in swapped byte order with nanosecond timestamps (byte swapping needed)\n");
+        file_ctx->swap_bytes = 1;
+        file_ctx->nanosecond_ts = 1;
     } else {
         fprintf(stderr, "Error: Not a valid PCAP file (invalid magic number).\n");
-        fclose(file);
         return -1;
     }
 
     /* If byte swapping is needed, swap the fields in the global header */
     if (file_ctx->swap_bytes) {
-        global_header.version_major = swap_uint16(global_header.version_major);
-        global_header.version_minor = swap_uint16(global_header.version_minor);
-        global_header.thiszone = swap_uint32(global_header.thiszone);
-        global_header.sigfigs = swap_uint32(global_header.sigfigs);
-        global_header.snaplen = swap_uint32(global_header.snaplen);
-        global_header.network = swap_uint32(global_header.network);
+        global_header->version_major = swap_uint16(global_header->version_major);
+        global_header->version_minor = swap_uint16(global_header->version_minor);
+        global_header->thiszone = swap_uint32(global_header->thiszone);
+        global_header->sigfigs = swap_uint32(global_header->sigfigs);
+        global_header->snaplen = swap_uint32(global_header->snaplen);
+        global_header->network = swap_uint32(global_header->network);
     }
 
     // Print the global header information
-    printf("PCAP Version: %u.%u\n", global_header.version_major, global_header.version_minor);
-    printf("Snapshot Length: %u\n", global_header.snaplen);
-    printf("Link-Layer Header Type: %u\n", global_header.network);
+    printf("PCAP Version: %u.%u\n", global_header->version_major, global_header->version_minor);
+    printf("Snapshot Length: %u\n", global_header->snaplen);
+    printf("Link-Layer Header Type: %u\n", global_header->network);
 
     /* Verify PCAP Version is at least 2. this will allow verification that PCAP standard from 1998 is met before we process the data. */
-    if (global_header.version_major == 2) {
+    if (global_header->version_major == 2) {
         printf("PCAP version is valid (>= 2.0)\n");
     } else {
-        fprintf(stderr, "Error: Unsupported PCAP version %u.%u. Minimum required is 2.0.\n", global_header.version_major, global_header.version_minor);
-        fclose(file);
+        fprintf(stderr, "Error: Unsupported PCAP version %u.%u. Minimum required is 2.0.\n", global_header->version_major, global_header->version_minor);
         return -1;
     }
 
     /* Verify snapshot length, should be 0 by default */
-    if (global_header.snaplen == 0) {
+    if (global_header->snaplen == 0) {
         printf("Snapshot length is valid (0 means no limit)\n");
     }
     else {
-        printf("Warning: Snapshot length is set to %u. This may limit packet capture size.\n", global_header.snaplen);
+        printf("Warning: Snapshot length is set to %u. This may limit packet capture size.\n", global_header->snaplen);
     }
 
     /* Verify network type */
-    if (global_header.network == 1) { // 1 indicates Ethernet
+    if (global_header->network == 1) { // 1 indicates Ethernet
         printf("Link-layer header type is Ethernet (1)\n");
     } else {
-        printf("Warning: Unsupported link-layer header type %u. Only Ethernet (1) is fully supported.\n", global_header.network);
-        fclose(file);
+        printf("Warning: Unsupported link-layer header type %u. Only Ethernet (1) is fully supported.\n", global_header->network);
         return -1;
     }
+    return 0;
+}
 
+/*
+ * Validates a record and fills in a packet descriptor for it.
+ * @param incl_len Bytes of packet data captured.
+ * @param orig_len Length of the packet on the wire.
+ * @param ts_ns Capture time in nanoseconds since the epoch.
+ * @param state The reader state, updated with the packet count and timestamp.
+ * @param packet The descriptor to fill; its data pointer is left for the caller.
+ */
+static void begin_packet(uint32_t incl_len, uint32_t orig_len, int64_t ts_ns, reader_state_t* state, packet_desc_t* packet) {
+    state->packet_count++;
+    packet->packet_number = state->packet_count;
+    PROFILE_PROGRESS(sizeof(pcap_record_header_t) + incl_len);
+    packet->incl_len = incl_len;
+    packet->orig_len = orig_len;
+    packet->data = NULL;
+    packet->valid = 1;
 
-    /* After all checks pass, loop through all packets in the file */
+    /* Check included length vs original length */
+    if (incl_len > orig_len) {
+        fprintf(stderr, "Error: Included length (%u) exceeds original length (%u) in packet %llu. Skipping packet.\n", incl_len, orig_len, (unsigned long long)state->packet_count);
+        packet->valid = 0;
+        return;
+    }
+
+    /* Remember the previous packet's capture time for the delta */
+    packet->ts_ns = ts_ns;
+    packet->prev_ts_ns = state->prev_ts_ns;
+    state->prev_ts_ns = ts_ns;
+}
+
+/*
+ * Byte swaps a pcap record header and fills in a packet descriptor for it.
+ * @param record_header The record header as read from the file.
+ * @param swap_bytes Non-zero if the record header is in swapped byte order.
+ * @param nanosecond_ts Non-zero if ts_usec holds nanoseconds.
+ * @param state The reader state, updated with the packet count and timestamp.
+ * @param packet The descriptor to fill; its data pointer is left for the caller.
+ */
+void begin_record(const pcap_record_header_t* record_header, int swap_bytes, int nanosecond_ts, reader_state_t* state, packet_desc_t* packet) {
+    uint32_t ts_sec = record_header->ts_sec;
+    uint32_t fraction = record_header->ts_usec;
+    uint32_t incl_len = record_header->incl_len;
+    uint32_t orig_len = record_header->orig_len;
+
+    // If byte swapping is needed, swap the fields in the record header
+    if (swap_bytes) {
+        ts_sec = swap_uint32(ts_sec);
+        fraction = swap_uint32(fraction);
+        incl_len = swap_uint32(incl_len);
+        orig_len = swap_uint32(orig_len);
+    }
+    int64_t ts_ns = (int64_t)ts_sec * NSEC_PER_SEC + (nanosecond_ts ? fraction : (int64_t)fraction * 1000);
+    begin_packet(incl_len, orig_len, ts_ns, state, packet);
+}
+
+/*
+ * Prints a record header and decodes its packet data.
+ * @param file_ctx The file context.
+ * @param packet The packet descriptor.
+ */
+void process_packet(file_context_t* file_ctx, const packet_desc_t* packet) {
+    output_t* out = file_ctx->out;
+    int verbose = file_ctx->verbosity == OUTPUT_VERBOSE;
+
+    if (verbose) {
+        output_str(out, "\n--- Packet ");
+        output_uint(out, packet->packet_number);
+        output_str(out, " ---\n");
+    }
+    if (!packet->valid) {
+        file_ctx->stats->malformed[RUN_STATS_BAD_RECORD]++;
+        return;
+    }
+    file_ctx->stats->packets++;
+    file_ctx->stats->bytes += packet->incl_len;
+
+    // Print the record header information
+    if (verbose) {
+        output_str(out, "Timestamp (Seconds): ");
+        output_int(out, packet->ts_ns / NSEC_PER_SEC);
+        output_str(out, "\nTimestamp (Nanoseconds): ");
+        int64_t fraction = packet->ts_ns % NSEC_PER_SEC;
+        if (fraction < 0) {
+            output_char(out, '-');
+        }
+        output_uint_padded(out, fraction < 0 ? -(uint64_t)fraction : (uint64_t)fraction, fraction < 0 ? 8 : 9);
+        output_str(out, "\nIncluded Length: ");
+        output_uint(out, packet->incl_len);
+        output_str(out, "\nOriginal Length: ");
+        output_uint(out, packet->orig_len);
+        output_char(out, '\n');
+
+        /* Calculate and print time delta between packets if not the first packet */
+        if (packet->packet_number > 1) {
+            int64_t time_delta = packet->ts_ns - packet->prev_ts_ns;
+            uint64_t magnitude = time_delta < 0 ? -(uint64_t)time_delta : (uint64_t)time_delta;
+            output_str(out, time_delta < 0 ? "Time since last packet: -" : "Time since last packet: ");
+            output_uint(out, magnitude / NSEC_PER_SEC);
+            output_char(out, '.');
+            output_uint_padded(out, magnitude % NSEC_PER_SEC, 9);
+            output_str(out, " seconds\n");
+        }
+    }
+
+    // The capture time travels with the packet into the PTP layer
+    file_ctx->packet_ts_ns = packet->ts_ns;
+
+    // Process the packet data (e.g., parse Ethernet, IP, TCP/UDP headers)
+    PROFILE_SCOPE_BEGIN(ethernet_scope, PROFILE_STAGE_ETHERNET);
+    process_ethernet_header(file_ctx, packet->data, packet->incl_len);
+    PROFILE_SCOPE_END(ethernet_scope);
+    if (verbose) {
+        output_str(out, "Packet data read successfully (");
+        output_uint(out, packet->incl_len);
+        output_str(out, " bytes).\n");
+    }
+}
+
+/*
+ * Hands a packet to the worker pipeline if one is running, otherwise decodes it in place.
+ * @param file_ctx The file context.
+ * @param pipeline The worker pipeline, or NULL.
+ * @param packet The packet descriptor.
+ * @param copy_data Non-zero if packet->data will not outlive this call.
+ * @return 0 on success, -1 if the pipeline could not accept the packet.
+ */
+static int dispatch_packet(file_context_t* file_ctx, pipeline_t* pipeline, const packet_desc_t* packet, int copy_data) {
+    if (pipeline != NULL) {
+        return pipeline_submit(pipeline, packet, copy_data);
+    }
+    process_packet(file_ctx, packet);
+    return 0;
+}
+
+/*
+ * Decides from the first bytes of a packet whether it passes the capture filters,
+ * so readers can skip the body of rejected packets without reading it.
+ * @param file_ctx The file context.
+ * @param data The start of the packet.
+ * @param available Number of bytes available at data (at most PCAP_PEEK_LEN are inspected).
+ * @param is_ptp Result of the batch prefilter for this packet, or -1 if it was not classified.
+ * @return 1 if the packet should be decoded, 0 otherwise.
+ */
+int packet_passes_filter(const file_context_t* file_ctx, const uint8_t* data, uint32_t available, int is_ptp) {
+    if (file_ctx->filter_ptp && !(is_ptp >= 0 ? is_ptp : frame_is_ptp(data, available))) {
+        return 0;
+    }
+    if (file_ctx->filter != NULL && !packet_filter_match(file_ctx->filter, data, available)) {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Samples a record into the index being built and checks it against the time window
+ * and the capture filters.
+ * @param file_ctx The file context.
+ * @param state The reader state.
+ * @param packet The packet descriptor, with its data.
+ * @param available Number of bytes of packet data read so far.
+ * @param record_offset File offset of the record header.
+ * @param is_ptp Result of the batch prefilter for this record, or -1 if it was not classified.
+ * @return 1 to decode the record, 0 to skip it, -1 to stop reading.
+ */
+static int admit_record(file_context_t* file_ctx, reader_state_t* state, const packet_desc_t* packet, uint32_t available, uint64_t record_offset, int is_ptp) {
+    if (state->index != NULL && packet->valid &&
+        packet_index_add(state->index, packet->packet_number, packet->ts_ns, packet->prev_ts_ns,
+                         record_offset, packet->data, available) != 0) {
+        fprintf(stderr, "Warning: Packet index abandoned.\n");
+        packet_index_free(state->index);
+        state->index = NULL;
+    }
+
+    if (file_ctx->has_window) {
+        if (!packet->valid || packet->ts_ns < file_ctx->window_start_ns) {
+            return 0;
+        }
+        if (packet->ts_ns > file_ctx->window_end_ns) {
+            // Keep reading while building an index; otherwise stop once clearly past the window
+            if (state->index == NULL && packet->ts_ns - file_ctx->window_end_ns > PACKET_INDEX_END_SLACK_NS) {
+                return -1;
+            }
+            return 0;
+        }
+    }
+    if (!packet_passes_filter(file_ctx, packet->data, available, is_ptp)) {
+        return 0;
+    }
+    if (file_ctx->has_window) {
+        state->window_count++;
+    }
+    return 1;
+}
+
+/*
+ * Advances a stream past bytes that are not needed, seeking when the stream allows it.
+ * @param file The stream.
+ * @param count Number of bytes to skip.
+ * @return 0 on success, -1 on a short read.
+ */
+static int skip_stream_bytes(FILE* file, uint64_t count) {
+    if (count == 0 || fseeko(file, (off_t)count, SEEK_CUR) == 0) {
+        return 0;
+    }
+    // Pipes cannot seek; read and discard instead
+    uint8_t scratch[4096];
+    while (count > 0) {
+        size_t chunk = count < sizeof(scratch) ? (size_t)count : sizeof(scratch);
+        if (fread(scratch, 1, chunk, file) != chunk) {
+            return -1;
+        }
+        count -= chunk;
+    }
+    return 0;
+}
+
+/*
+ * Locates up to PTP_PREFILTER_BATCH consecutive records of a mapped capture starting
+ * before limit and, when only PTP frames are wanted, classifies them in one prefilter pass.
+ * @param file_ctx The file context.
+ * @param map Start of the mapping.
+ * @param map_size Size of the mapping in bytes.
+ * @param offset Offset of the first record header.
+ * @param limit No record starting at or after this offset is gathered.
+ * @param batch Receives the records.
+ * @return The offset just past the last gathered record.
+ */
+size_t gather_record_batch(const file_context_t* file_ctx, const uint8_t* map, size_t map_size, size_t offset, size_t limit, record_batch_t* batch) {
+    size_t count = 0;
+    int truncated = 0;
+    while (count < PTP_PREFILTER_BATCH && offset < limit && map_size - offset >= sizeof(pcap_record_header_t)) {
+        // Each header's address depends on the previous one; fetch ahead so the walk does not stall on every miss
+        __builtin_prefetch(map + offset + RECORD_PREFETCH_DISTANCE);
+        uint32_t incl_len;
+        memcpy(&incl_len, map + offset + offsetof(pcap_record_header_t, incl_len), sizeof(incl_len));
+        if (file_ctx->swap_bytes) {
+            incl_len = swap_uint32(incl_len);
+        }
+        if (incl_len > map_size - offset - sizeof(pcap_record_header_t)) {
+            truncated = 1;
+            break;
+        }
+        batch->offsets[count] = offset;
+        batch->frames[count] = map + offset + sizeof(pcap_record_header_t);
+        batch->lengths[count] = incl_len;
+        count++;
+        offset += sizeof(pcap_record_header_t) + incl_len;
+    }
+    batch->count = count;
+    batch->truncated = truncated;
+
+    batch->classified = file_ctx->filter_ptp;
+    batch->is_ptp = batch->classified ? ptp_prefilter_batch(batch->frames, batch->lengths, batch->count) : 0;
+    return offset;
+}
+
+/*
+ * Walks a memory-mapped capture, handing packet bodies to the parsers in place.
+ * Records are located a batch at a time so --filter-ptp can classify them together.
+ * @param map Start of the mapping.
+ * @param map_size Size of the mapping in bytes.
+ * @param offset Offset of the first record header to read.
+ * @param file_ctx The file context.
+ * @param state The reader state.
+ * @param pipeline The worker pipeline, or NULL to decode on this thread.
+ */
+static void read_records_mmap(const uint8_t* map, size_t map_size, size_t offset, file_context_t* file_ctx, reader_state_t* state, pipeline_t* pipeline) {
     pcap_record_header_t record_header;
-    int packet_count = 0;
-    uint32_t prev_ts_sec = 0;
-    uint32_t prev_ts_usec = 0;
+    packet_desc_t packet;
+    record_batch_t batch;
+
+    for (;;) {
+        offset = gather_record_batch(file_ctx, map, map_size, offset, map_size, &batch);
+        for (size_t i = 0; i < batch.count; i++) {
+            // Record headers are not guaranteed to be aligned within the file
+            memcpy(&record_header, map + batch.offsets[i], sizeof(pcap_record_header_t));
+            begin_record(&record_header, file_ctx->swap_bytes, file_ctx->nanosecond_ts, state, &packet);
+            packet.data = batch.frames[i];
+
+            int is_ptp = batch.classified ? (int)((batch.is_ptp >> i) & 1) : -1;
+            int admit = admit_record(file_ctx, state, &packet, batch.lengths[i], batch.offsets[i], is_ptp);
+            if (admit < 0) {
+                return;
+            }
+            if (admit > 0 && dispatch_packet(file_ctx, pipeline, &packet, 0) != 0) {
+                return;
+            }
+        }
+        if (batch.truncated) {
+            memcpy(&record_header, map + offset, sizeof(pcap_record_header_t));
+            begin_record(&record_header, file_ctx->swap_bytes, file_ctx->nanosecond_ts, state, &packet);
+            fprintf(stderr, "Error reading packet data: record truncated at end of file\n");
+            return;
+        }
+        if (batch.count < PTP_PREFILTER_BATCH) {
+            return;
+        }
+    }
+}
+
+/*
+ * Reads records through stdio for inputs that cannot be mapped.
+ * Only the first PCAP_PEEK_LEN bytes of each record are read before the record is
+ * admitted; bodies of rejected records are skipped without being read where possible.
+ * A single buffer is grown to the largest admitted packet and reused for every record.
+ * @param file The open file, positioned at the first record header to read.
+ * @param offset File offset of that record header.
+ * @param file_ctx The file context.
+ * @param state The reader state.
+ * @param pipeline The worker pipeline, or NULL to decode on this thread.
+ */
+static void read_records_stdio(FILE* file, uint64_t offset, file_context_t* file_ctx, reader_state_t* state, pipeline_t* pipeline) {
+    pcap_record_header_t record_header;
+    packet_desc_t packet;
+    size_t packet_capacity = PCAP_PEEK_LEN;
+    unsigned char* packet_data = (unsigned char*)malloc(packet_capacity);
+    if (packet_data == NULL) {
+        perror("Failed to allocate memory for packet data");
+        return;
+    }
+
     // Read packet records until the end of the file
     while(fread(&record_header, sizeof(pcap_record_header_t), 1, file) == 1) {
-        packet_count++;
-        printf("\n--- Packet %d ---\n", packet_count);
+        begin_record(&record_header, file_ctx->swap_bytes, file_ctx->nanosecond_ts, state, &packet);
+        uint32_t incl_len = packet.incl_len;
 
-        // If byte swapping is needed, swap the fields in the record header
-        if (file_ctx->swap_bytes) {
-            record_header.ts_sec = swap_uint32(record_header.ts_sec);
-            record_header.ts_usec = swap_uint32(record_header.ts_usec);
-            record_header.incl_len = swap_uint32(record_header.incl_len);
-            record_header.orig_len = swap_uint32(record_header.orig_len);
+        // Peek at the headers first
+        uint32_t peek_len = incl_len < PCAP_PEEK_LEN ? incl_len : PCAP_PEEK_LEN;
+        if (fread(packet_data, 1, peek_len, file) != peek_len) {
+            perror("Error reading packet data");
+            break;
         }
-
-        /* Check included length vs original length */
-        if (record_header.incl_len > record_header.orig_len){
-            fprintf(stderr, "Error: Included length (%u) exceeds original length (%u) in packet %d. Skipping packet.\n", record_header.incl_len, record_header.orig_len, packet_count);
+        packet.data = packet_data;
+        int admit = admit_record(file_ctx, state, &packet, peek_len, offset, -1);
+        offset += sizeof(pcap_record_header_t) + incl_len;
+        if (admit < 0) {
+            break;
+        }
+        if (admit == 0) {
+            if (skip_stream_bytes(file, incl_len - peek_len) != 0) {
+                perror("Error reading packet data");
+                break;
+            }
             continue;
         }
 
-        // Print the record header information
-        printf("Timestamp (Seconds): %u\n", record_header.ts_sec);
-        printf("Timestamp (Microseconds): %u\n", record_header.ts_usec);
-        printf("Included Length: %u\n", record_header.incl_len);
-        printf("Original Length: %u\n", record_header.orig_len);
+        // Grow the packet buffer if this record is larger than any seen so far
+        if (incl_len > packet_capacity) {
+            unsigned char* grown = (unsigned char*)realloc(packet_data, incl_len);
+            if (grown == NULL) {
+                perror("Failed to allocate memory for packet data");
+                break; // Exit the loop if memory allocation fails
+            }
+            packet_data = grown;
+            packet_capacity = incl_len;
+        }
 
-        /* Calculate and print time delta between packets if not the first packet */
-        if (packet_count > 1) {
-            double time_delta = (double)(record_header.ts_sec - prev_ts_sec) + 
-                                (double)(record_header.ts_usec - prev_ts_usec) / 1000000.0;
-            printf("Time since last packet: %.6f seconds\n", time_delta);
+        // Read the rest of the packet data from the file
+        size_t data_bytes_read = fread(packet_data + peek_len, 1, incl_len - peek_len, file);
+        if (data_bytes_read != incl_len - peek_len) {
+            perror("Error reading packet data");
+            break; // Exit the loop if the packet data cannot be fully read
+        }
+
+        // The buffer is reused for the next record, so the pipeline must take a copy
+        packet.data = packet_data;
+        if (dispatch_packet(file_ctx, pipeline, &packet, 1) != 0) {
+            break;
         }
+    }
+    free(packet_data);
+}
+
+/* Reads a 16-bit field of a pcapng block in the section's byte order */
+static uint16_t pcapng_read_u16(const uint8_t* data, int swap_bytes) {
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return swap_bytes ? swap_uint16(value) : value;
+}
+
+/* Reads a 32-bit field of a pcapng block in the section's byte order */
+static uint32_t pcapng_read_u32(const uint8_t* data, int swap_bytes) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return swap_bytes ? swap_uint32(value) : value;
+}
 
-        /* Store current packet's timestamp for the next iteration */
-        prev_ts_sec = record_header.ts_sec;
-        prev_ts_usec = record_header.ts_usec;
+/*
+ * Determines the total length of the block starting at block. A Section Header Block
+ * switches the reader to the byte order announced by its byte-order magic.
+ * @param ng The pcapng reader state.
+ * @param block The first 12 bytes of the block.
+ * @param file_ctx The file context, whose swap flag follows the current section.
+ * @return The block total length in host byte order, or 0 if the block header is invalid.
+ */
+static uint32_t pcapng_block_total_length(pcapng_reader_t* ng, const uint8_t* block, file_context_t* file_ctx) {
+    uint32_t block_type;
+    memcpy(&block_type, block, sizeof(block_type)); // The SHB type code reads the same in both byte orders
 
-        // Allocate memory for the packet data based on the included length
-        unsigned char* packet_data = (unsigned char*)malloc(record_header.incl_len);
-        if (packet_data == NULL) {
-            perror("Failed to allocate memory for packet data");
-            break; // Exit the loop if memory allocation fails
+    if (block_type == PCAPNG_BLOCK_TYPE_SHB) {
+        uint32_t byte_order_magic;
+        memcpy(&byte_order_magic, block + sizeof(pcapng_block_header_t), sizeof(byte_order_magic));
+        if (byte_order_magic == PCAPNG_BYTE_ORDER_MAGIC) {
+            ng->swap_bytes = 0;
+        } else if (byte_order_magic == swap_uint32(PCAPNG_BYTE_ORDER_MAGIC)) {
+            ng->swap_bytes = 1;
+        } else {
+            fprintf(stderr, "Error: Not a valid PCAPNG section (invalid byte-order magic).\n");
+            return 0;
         }
+        file_ctx->swap_bytes = ng->swap_bytes;
+    }
+
+    uint32_t total_length = pcapng_read_u32(block + 4, ng->swap_bytes);
+    if (total_length < PCAPNG_MIN_BLOCK_LENGTH || total_length % 4 != 0) {
+        fprintf(stderr, "Error: Invalid PCAPNG block length %u.\n", total_length);
+        return 0;
+    }
+    return total_length;
+}
+
+/*
+ * Starts a new section: interfaces from the previous section no longer apply.
+ * @return 0 on success, -1 if the section cannot be read.
+ */
+static int pcapng_begin_section(pcapng_reader_t* ng, const uint8_t* body, uint32_t body_length) {
+    if (body_length < sizeof(pcapng_section_header_t)) {
+        fprintf(stderr, "Error: Truncated PCAPNG Section Header Block.\n");
+        return -1;
+    }
+    uint16_t version_major = pcapng_read_u16(body + 4, ng->swap_bytes);
+    uint16_t version_minor = pcapng_read_u16(body + 6, ng->swap_bytes);
+    printf("PCAPNG Section: version %u.%u, %s byte order\n", version_major, version_minor, ng->swap_bytes ? "swapped" : "native");
+    if (version_major != 1) {
+        fprintf(stderr, "Error: Unsupported PCAPNG version %u.%u.\n", version_major, version_minor);
+        return -1;
+    }
+    ng->interface_count = 0;
+    return 0;
+}
+
+/*
+ * Adds an interface from an Interface Description Block, including its timestamp options.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int pcapng_add_interface(pcapng_reader_t* ng, const uint8_t* body, uint32_t body_length) {
+    if (body_length < sizeof(pcapng_interface_description_t)) {
+        fprintf(stderr, "Error: Truncated PCAPNG Interface Description Block. Skipping block.\n");
+        return 0;
+    }
+    if (ng->interface_count == ng->interface_capacity) {
+        size_t capacity = ng->interface_capacity ? ng->interface_capacity * 2 : 4;
+        pcapng_interface_t* grown = (pcapng_interface_t*)realloc(ng->interfaces, capacity * sizeof(pcapng_interface_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for PCAPNG interfaces");
+            return -1;
+        }
+        ng->interfaces = grown;
+        ng->interface_capacity = capacity;
+    }
+
+    pcapng_interface_t* iface = &ng->interfaces[ng->interface_count];
+    iface->link_type = pcapng_read_u16(body, ng->swap_bytes);
+    iface->snaplen = pcapng_read_u32(body + 4, ng->swap_bytes);
+    iface->ts_units_per_sec = PCAPNG_DEFAULT_TS_UNITS;
+    iface->ts_offset_sec = 0;
+    iface->warned = 0;
+
+    /* Walk the options: code and length, then the value padded to 32 bits */
+    uint32_t offset = sizeof(pcapng_interface_description_t);
+    while (body_length - offset >= 4) {
+        uint16_t code = pcapng_read_u16(body + offset, ng->swap_bytes);
+        uint16_t length = pcapng_read_u16(body + offset + 2, ng->swap_bytes);
+        offset += 4;
+        if (code == PCAPNG_OPT_ENDOFOPT || length > body_length - offset) {
+            break;
+        }
+        if (code == PCAPNG_OPT_IF_TSRESOL && length >= 1) {
+            uint8_t tsresol = body[offset];
+            uint8_t exponent = tsresol & 0x7F;
+            uint64_t units = 1;
+            if (tsresol & 0x80) {
+                units = exponent < 64 ? (1ULL << exponent) : 0;
+            } else {
+                for (uint8_t i = 0; i < exponent && units != 0; i++) {
+                    units = units > UINT64_MAX / 10 ? 0 : units * 10;
+                }
+            }
+            if (units == 0) {
+                fprintf(stderr, "Warning: Unsupported if_tsresol 0x%02x, assuming microseconds.\n", tsresol);
+            } else {
+                iface->ts_units_per_sec = units;
+            }
+        } else if (code == PCAPNG_OPT_IF_TSOFFSET && length >= 8) {
+            uint64_t ts_offset;
+            memcpy(&ts_offset, body + offset, sizeof(ts_offset));
+            iface->ts_offset_sec = (int64_t)(ng->swap_bytes ? swap_uint64(ts_offset) : ts_offset);
+        }
+        offset += (length + 3u) & ~3u;
+        if (offset > body_length) {
+            break;
+        }
+    }
+
+    printf("PCAPNG Interface %zu: link type %u, snaplen %u, %llu timestamp units/s\n",
+           ng->interface_count, iface->link_type, iface->snaplen, (unsigned long long)iface->ts_units_per_sec);
+    if (iface->link_type != 1) {
+        printf("Warning: Unsupported link-layer header type %u on interface %zu. Only Ethernet (1) is fully supported.\n",
+               iface->link_type, ng->interface_count);
+    }
+    ng->interface_count++;
+    return 0;
+}
+
+/*
+ * Converts an interface timestamp to nanoseconds since the epoch, adding the interface's
+ * if_tsoffset. Units finer than a nanosecond are rounded to the nearest one, and times
+ * beyond the int64 range saturate.
+ */
+static int64_t pcapng_timestamp_ns(const pcapng_interface_t* iface, uint64_t timestamp) {
+    uint64_t units = iface->ts_units_per_sec;
+    __int128 ns = ((__int128)(timestamp / units) + iface->ts_offset_sec) * NSEC_PER_SEC +
+                  ((unsigned __int128)(timestamp % units) * NSEC_PER_SEC + units / 2) / units;
+    if (ns > INT64_MAX) {
+        return INT64_MAX;
+    }
+    if (ns < INT64_MIN) {
+        return INT64_MIN;
+    }
+    return (int64_t)ns;
+}
+
+/*
+ * Turns an Enhanced or Simple Packet Block into a packet descriptor and dispatches it.
+ * @return 0 on success, -1 if the pipeline could not accept the packet.
+ */
+static int pcapng_dispatch_packet(pcapng_interface_t* iface, uint32_t incl_len, uint32_t orig_len, int64_t ts_ns, const uint8_t* data,
+                                  file_context_t* file_ctx, reader_state_t* state, pipeline_t* pipeline, int copy_data) {
+    packet_desc_t packet;
+    begin_packet(incl_len, orig_len, ts_ns, state, &packet);
+    if (iface->link_type != 1) {
+        if (!iface->warned) {
+            fprintf(stderr, "Warning: Skipping packets on non-Ethernet interface (link type %u).\n", iface->link_type);
+            iface->warned = 1;
+        }
+        packet.valid = 0;
+    }
+    packet.data = data;
+    int admit = admit_record(file_ctx, state, &packet, incl_len, 0, -1);
+    if (admit <= 0) {
+        return admit;
+    }
+    return dispatch_packet(file_ctx, pipeline, &packet, copy_data);
+}
+
+/*
+ * Processes one pcapng block. Blocks that carry no packets (statistics, name resolution, ...) are skipped.
+ * @param ng The pcapng reader state.
+ * @param block The whole block.
+ * @param total_length The block total length in host byte order.
+ * @param file_ctx The file context.
+ * @param state The reader state.
+ * @param pipeline The worker pipeline, or NULL to decode on this thread.
+ * @param copy_data Non-zero if the block memory will not outlive this call.
+ * @return 0 on success, -1 if reading must stop.
+ */
+static int pcapng_process_block(pcapng_reader_t* ng, const uint8_t* block, uint32_t total_length,
+                                file_context_t* file_ctx, reader_state_t* state, pipeline_t* pipeline, int copy_data) {
+    uint32_t block_type = pcapng_read_u32(block, ng->swap_bytes);
+    const uint8_t* body = block + sizeof(pcapng_block_header_t);
+    uint32_t body_length = total_length - PCAPNG_MIN_BLOCK_LENGTH;
+    uint32_t incl_len;
+    uint32_t orig_len;
 
-        // Read the packet data from the file
-        size_t data_bytes_read = fread(packet_data, 1, record_header.incl_len, file);
-        if (data_bytes_read != record_header.incl_len) {
+    // Section and interface messages go straight to stdout; on this thread, emit the
+    // packets decoded so far first so the messages land between the right packets
+    if ((block_type == PCAPNG_BLOCK_TYPE_SHB || block_type == PCAPNG_BLOCK_TYPE_IDB) && pipeline == NULL) {
+        output_flush(file_ctx->out);
+    }
+
+    switch (block_type) {
+        case PCAPNG_BLOCK_TYPE_SHB:
+            return pcapng_begin_section(ng, body, body_length);
+
+        case PCAPNG_BLOCK_TYPE_IDB:
+            return pcapng_add_interface(ng, body, body_length);
+
+        case PCAPNG_BLOCK_TYPE_EPB: {
+            if (body_length < sizeof(pcapng_enhanced_packet_t)) {
+                fprintf(stderr, "Error: Truncated PCAPNG Enhanced Packet Block. Skipping block.\n");
+                return 0;
+            }
+            uint32_t interface_id = pcapng_read_u32(body, ng->swap_bytes);
+            uint64_t timestamp = ((uint64_t)pcapng_read_u32(body + 4, ng->swap_bytes) << 32) | pcapng_read_u32(body + 8, ng->swap_bytes);
+            incl_len = pcapng_read_u32(body + 12, ng->swap_bytes);
+            orig_len = pcapng_read_u32(body + 16, ng->swap_bytes);
+            if (interface_id >= ng->interface_count) {
+                fprintf(stderr, "Error: Enhanced Packet Block references undefined interface %u. Skipping block.\n", interface_id);
+                return 0;
+            }
+            if (incl_len > body_length - sizeof(pcapng_enhanced_packet_t)) {
+                fprintf(stderr, "Error: Enhanced Packet Block captured length (%u) exceeds block size. Skipping block.\n", incl_len);
+                return 0;
+            }
+            pcapng_interface_t* iface = &ng->interfaces[interface_id];
+            return pcapng_dispatch_packet(iface, incl_len, orig_len, pcapng_timestamp_ns(iface, timestamp), body + sizeof(pcapng_enhanced_packet_t), file_ctx, state, pipeline, copy_data);
+        }
+
+        case PCAPNG_BLOCK_TYPE_SPB: {
+            if (body_length < 4 || ng->interface_count == 0) {
+                fprintf(stderr, "Error: Invalid PCAPNG Simple Packet Block. Skipping block.\n");
+                return 0;
+            }
+            // Simple Packet Blocks belong to the first interface and carry no timestamp
+            pcapng_interface_t* iface = &ng->interfaces[0];
+            orig_len = pcapng_read_u32(body, ng->swap_bytes);
+            incl_len = orig_len;
+            if (iface->snaplen != 0 && incl_len > iface->snaplen) {
+                incl_len = iface->snaplen;
+            }
+            if (incl_len > body_length - 4) {
+                incl_len = body_length - 4;
+            }
+            return pcapng_dispatch_packet(iface, incl_len, orig_len, state->prev_ts_ns, body + 4, file_ctx, state, pipeline, copy_data);
+        }
+
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Walks the blocks of a memory-mapped pcapng file, handing packet data to the parsers in place.
+ */
+static void read_blocks_mmap(const uint8_t* map, size_t map_size, pcapng_reader_t* ng, file_context_t* file_ctx, reader_state_t* state, pipeline_t* pipeline) {
+    size_t offset = 0;
+    while (map_size - offset >= PCAPNG_MIN_BLOCK_LENGTH) {
+        uint32_t total_length = pcapng_block_total_length(ng, map + offset, file_ctx);
+        if (total_length == 0) {
+            break;
+        }
+        if (total_length > map_size - offset) {
+            fprintf(stderr, "Error reading packet data: block truncated at end of file\n");
+            break;
+        }
+        if (pcapng_process_block(ng, map + offset, total_length, file_ctx, state, pipeline, 0) != 0) {
+            break;
+        }
+        offset += total_length;
+    }
+}
+
+/*
+ * Reads pcapng blocks through stdio into a single reused buffer.
+ * @param file The open file, positioned after the first 4 bytes.
+ * @param first_word The first 4 bytes of the file (the SHB type code).
+ */
+static void read_blocks_stdio(FILE* file, const uint8_t first_word[4], pcapng_reader_t* ng, file_context_t* file_ctx, reader_state_t* state, pipeline_t* pipeline) {
+    uint8_t* block = (uint8_t*)malloc(PCAPNG_MIN_BLOCK_LENGTH);
+    size_t block_capacity = PCAPNG_MIN_BLOCK_LENGTH;
+    size_t have = 4;
+    if (block == NULL) {
+        perror("Failed to allocate memory for PCAPNG block");
+        return;
+    }
+    memcpy(block, first_word, 4);
+
+    for (;;) {
+        if (fread(block + have, 1, PCAPNG_MIN_BLOCK_LENGTH - have, file) != PCAPNG_MIN_BLOCK_LENGTH - have) {
+            break; // End of file
+        }
+        have = 0;
+        uint32_t total_length = pcapng_block_total_length(ng, block, file_ctx);
+        if (total_length == 0) {
+            break;
+        }
+        if (total_length > block_capacity) {
+            uint8_t* grown = (uint8_t*)realloc(block, total_length);
+            if (grown == NULL) {
+                perror("Failed to allocate memory for PCAPNG block");
+                break;
+            }
+            block = grown;
+            block_capacity = total_length;
+        }
+        if (fread(block + PCAPNG_MIN_BLOCK_LENGTH, 1, total_length - PCAPNG_MIN_BLOCK_LENGTH, file) != total_length - PCAPNG_MIN_BLOCK_LENGTH) {
             perror("Error reading packet data");
-            free(packet_data);
-            break; // Exit the loop if the packet data cannot be fully read
+            break;
+        }
+        // The buffer is reused for the next block, so the pipeline must take a copy
+        if (pcapng_process_block(ng, block, total_length, file_ctx, state, pipeline, 1) != 0) {
+            break;
         }
+    }
+    free(block);
+}
+
+/*
+ * Checks whether the first 4 bytes of a file identify it as pcapng.
+ */
+static int is_pcapng(const uint8_t first_word[4]) {
+    uint32_t block_type;
+    memcpy(&block_type, first_word, sizeof(block_type));
+    return block_type == PCAPNG_BLOCK_TYPE_SHB;
+}
+
+/*
+ * Starts the worker pipeline if one was requested.
+ * @return 0 on success, -1 if the pipeline could not be created.
+ */
+static int start_pipeline(file_context_t* file_ctx, pipeline_t** pipeline) {
+    *pipeline = NULL;
+    if (file_ctx->num_threads > 0 && (*pipeline = pipeline_create(file_ctx, file_ctx->num_threads)) == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Looks up where to start reading for the time window, and primes the reader state
+ * as if every record before that point had been read.
+ * @param seek_index A loaded sidecar index.
+ * @param file_ctx The file context.
+ * @param state The reader state.
+ * @param capture_size Size of the capture file in bytes.
+ * @return File offset of the first record header to read.
+ */
+static uint64_t seek_window_start(const packet_index_t* seek_index, const file_context_t* file_ctx, reader_state_t* state, uint64_t capture_size) {
+    const packet_index_entry_t* entry = packet_index_seek(seek_index, file_ctx->window_start_ns);
+    if (entry->offset < sizeof(pcap_global_header_t) || entry->offset >= capture_size) {
+        fprintf(stderr, "Warning: Packet index entry out of range, reading from the first record.\n");
+        return sizeof(pcap_global_header_t);
+    }
+    state->packet_count = entry->packet_number - 1;
+    state->prev_ts_ns = entry->prev_ts_ns;
+    printf("Packet index: starting at packet %llu (offset %llu)\n", (unsigned long long)entry->packet_number, (unsigned long long)entry->offset);
+    return entry->offset;
+}
 
-        // Process the packet data (e.g., parse Ethernet, IP, TCP/UDP headers)
-        process_ethernet_header(file_ctx, packet_data, record_header.incl_len);
-        printf("Packet data read successfully (%zu bytes).\n", data_bytes_read);
-        // Free the allocated memory for the packet data
-        free(packet_data);
+/*
+ * Drops an index being built when the capture turns out to be pcapng; offsets into
+ * pcapng blocks cannot be resumed without the section and interface blocks before them.
+ */
+static void skip_pcapng_index(reader_state_t* state) {
+    if (state->index != NULL) {
+        printf("Warning: the packet index supports classic pcap only; no index written.\n");
+        packet_index_free(state->index);
+        state->index = NULL;
     }
+}
 
-    printf("\nTotal packets processed: %d\n", packet_count);
+/*
+ * Processes a capture that has been mapped into memory.
+ * @param seek_index A sidecar index used to jump to the time window, or NULL.
+ * @return 0 on success, -1 on error.
+ */
+static int process_mapped_capture(const uint8_t* map, size_t map_size, const packet_index_t* seek_index, file_context_t* file_ctx, reader_state_t* state) {
+    pipeline_t* pipeline = NULL;
 
-    // Close the file
-    fclose(file);
+    if (map_size >= PCAPNG_MIN_BLOCK_LENGTH && is_pcapng(map)) {
+        printf("PCAPNG file detected.\n");
+        skip_pcapng_index(state);
+        if (file_ctx->num_chunks > 0) {
+            printf("Warning: chunked scanning only supports classic pcap; reading sequentially.\n");
+        }
+        pcapng_reader_t ng = {0};
+        // Settle the first section's byte order before workers copy the file context
+        if (pcapng_block_total_length(&ng, map, file_ctx) == 0 || start_pipeline(file_ctx, &pipeline) != 0) {
+            return -1;
+        }
+        PROFILE_SCOPE_BEGIN(read_scope, PROFILE_STAGE_READ);
+        read_blocks_mmap(map, map_size, &ng, file_ctx, state, pipeline);
+        PROFILE_SCOPE_END(read_scope);
+        // Workers hold pointers into the mapping until the pipeline has drained
+        if (pipeline != NULL) {
+            pipeline_finish(pipeline);
+        }
+        free(ng.interfaces);
+        return 0;
+    }
+
+    /* Read global header */
+    if (map_size < sizeof(pcap_global_header_t)) {
+        fprintf(stderr, "Error reading global header: file too small\n");
+        return -1;
+    }
+    pcap_global_header_t global_header;
+    memcpy(&global_header, map, sizeof(pcap_global_header_t));
+    printf("PCAP Global Header read successfully.\n");
+
+    if (validate_global_header(&global_header, file_ctx) != 0) {
+        return -1;
+    }
+
+    /* Split the file into byte ranges scanned in parallel if requested */
+    if (file_ctx->num_chunks > 0) {
+        return chunk_scan_file(map, map_size, &global_header, file_ctx, &state->packet_count);
+    }
+
+    /* After all checks pass, loop through all packets in the file */
+    if (start_pipeline(file_ctx, &pipeline) != 0) {
+        return -1;
+    }
+    size_t offset = sizeof(pcap_global_header_t);
+    if (seek_index != NULL) {
+        offset = (size_t)seek_window_start(seek_index, file_ctx, state, map_size);
+    }
+    PROFILE_SCOPE_BEGIN(read_scope, PROFILE_STAGE_READ);
+    read_records_mmap(map, map_size, offset, file_ctx, state, pipeline);
+    PROFILE_SCOPE_END(read_scope);
+    // Workers hold pointers into the mapping until the pipeline has drained
+    if (pipeline != NULL) {
+        pipeline_finish(pipeline);
+    }
+    return 0;
+}
+
+/*
+ * Processes a capture read sequentially through stdio.
+ * @param seek_index A sidecar index used to jump to the time window, or NULL.
+ * @param capture_size Size of the capture file in bytes (regular files only).
+ * @return 0 on success, -1 on error.
+ */
+static int process_stream_capture(FILE* file, const packet_index_t* seek_index, uint64_t capture_size, file_context_t* file_ctx, reader_state_t* state) {
+    pipeline_t* pipeline = NULL;
+    if (file_ctx->num_chunks > 0) {
+        printf("Warning: chunked scanning needs a regular, mappable file; reading sequentially.\n");
+    }
+
+    /* Read the first word to tell classic pcap from pcapng */
+    pcap_global_header_t global_header;
+    uint8_t* header_bytes = (uint8_t*)&global_header;
+    if (fread(header_bytes, 1, 4, file) != 4) {
+        perror("Error reading global header");
+        return -1;
+    }
+
+    if (is_pcapng(header_bytes)) {
+        printf("PCAPNG file detected.\n");
+        skip_pcapng_index(state);
+        pcapng_reader_t ng = {0};
+        if (start_pipeline(file_ctx, &pipeline) != 0) {
+            return -1;
+        }
+        PROFILE_SCOPE_BEGIN(read_scope, PROFILE_STAGE_READ);
+        read_blocks_stdio(file, header_bytes, &ng, file_ctx, state, pipeline);
+        PROFILE_SCOPE_END(read_scope);
+        if (pipeline != NULL) {
+            pipeline_finish(pipeline);
+        }
+        free(ng.interfaces);
+        return 0;
+    }
+
+    // Read the rest of the global header from the file, populating the global_header structure
+    size_t bytes_read = fread(header_bytes + 4, sizeof(pcap_global_header_t) - 4, 1, file);
+    if (bytes_read != 1) {
+        perror("Error reading global header");
+        return -1; 
+    }
+    printf("PCAP Global Header read successfully.\n");
+
+    if (validate_global_header(&global_header, file_ctx) != 0) {
+        return -1;
+    }
+
+    /* After all checks pass, loop through all packets in the file */
+    if (start_pipeline(file_ctx, &pipeline) != 0) {
+        return -1;
+    }
+    uint64_t offset = sizeof(pcap_global_header_t);
+    if (seek_index != NULL) {
+        uint64_t start = seek_window_start(seek_index, file_ctx, state, capture_size);
+        if (fseeko(file, (off_t)start, SEEK_SET) == 0) {
+            offset = start;
+        } else {
+            perror("Warning: Cannot seek to the time window, reading from the first record");
+            state->packet_count = 0;
+            state->prev_ts_ns = 0;
+        }
+    }
+    PROFILE_SCOPE_BEGIN(read_scope, PROFILE_STAGE_READ);
+    read_records_stdio(file, offset, file_ctx, state, pipeline);
+    PROFILE_SCOPE_END(read_scope);
+    if (pipeline != NULL) {
+        pipeline_finish(pipeline);
+    }
+    return 0;
+}
+
+/*
+ * Prints the number of PTP messages seen, in total and by message type, and the report of
+ * every gPTP analyzer.
+ * @param file_ctx The file context.
+ */
+static void print_ptp_summary(const file_context_t* file_ctx) {
+    run_stats_print_ptp_messages(file_ctx->stats);
+    gptp_cycle_map_print(&file_ctx->cycle_map);
+    ptp_offset_print(&file_ctx->offsets);
+    pdelay_tracker_print(&file_ctx->links);
+    sequence_tracker_print(&file_ctx->sequences);
+    interval_analyzer_print(&file_ctx->intervals);
+    bmca_tracker_print(&file_ctx->bmca);
+}
+
+/*
+ * Initializes the clock map, the gPTP cycle map and every analyzer of a file context.
+ * Any maps the context held before are overwritten, not freed.
+ * @param file_ctx The file context.
+ * @return 0 on success, -1 on memory allocation failure; nothing stays allocated then.
+ */
+int file_context_init_maps(file_context_t* file_ctx) {
+    memset(&file_ctx->clock_map, 0, sizeof(file_ctx->clock_map));
+    memset(&file_ctx->cycle_map, 0, sizeof(file_ctx->cycle_map));
+    memset(&file_ctx->offsets, 0, sizeof(file_ctx->offsets));
+    memset(&file_ctx->links, 0, sizeof(file_ctx->links));
+    memset(&file_ctx->sequences, 0, sizeof(file_ctx->sequences));
+    memset(&file_ctx->bmca, 0, sizeof(file_ctx->bmca));
+    memset(&file_ctx->intervals, 0, sizeof(file_ctx->intervals));
+
+    if (clock_map_init(&file_ctx->clock_map) != 0 || gptp_cycle_map_init(&file_ctx->cycle_map) != 0 ||
+        ptp_offset_init(&file_ctx->offsets) != 0 || pdelay_tracker_init(&file_ctx->links) != 0 ||
+        sequence_tracker_init(&file_ctx->sequences) != 0 || bmca_tracker_init(&file_ctx->bmca) != 0 ||
+        interval_analyzer_init(&file_ctx->intervals) != 0) {
+        // Maps that were never initialized are still zeroed, which every free function accepts
+        file_context_free_maps(file_ctx);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Frees the maps allocated by file_context_init_maps().
+ * @param file_ctx The file context.
+ */
+void file_context_free_maps(file_context_t* file_ctx) {
+    clock_map_free(&file_ctx->clock_map);
+    gptp_cycle_map_free(&file_ctx->cycle_map);
+    ptp_offset_free(&file_ctx->offsets);
+    pdelay_tracker_free(&file_ctx->links);
+    sequence_tracker_free(&file_ctx->sequences);
+    bmca_tracker_free(&file_ctx->bmca);
+    interval_analyzer_free(&file_ctx->intervals);
+}
+
+/* Function to read and process a pcap or pcapng file */
+int process_pcap_file(const char* filepath, file_context_t* file_ctx){
+    // "-" reads the capture from stdin, which can only be consumed through stdio
+    int fd = (strcmp(filepath, "-") == 0) ? dup(STDIN_FILENO) : open(filepath, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening file");
+        return -1; 
+    }
+
+    printf("File opened successfully: %s\n", filepath);
+
+    /* Map the file if it is a regular, non-empty file and mmap is not disabled */
+    struct stat file_stat;
+    int is_regular = fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+    const uint8_t* map = NULL;
+    size_t map_size = 0;
+    if (!file_ctx->use_stdio && is_regular && file_stat.st_size > 0) {
+        map_size = (size_t)file_stat.st_size;
+        void* mapping = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            perror("Warning: mmap failed, falling back to stdio reader");
+        } else {
+            map = (const uint8_t*)mapping;
+            // Records are consumed front to back exactly once
+            madvise(mapping, map_size, MADV_SEQUENTIAL);
+        }
+    }
+
+    reader_state_t state = {0};
+    int result;
+    if (profile_enabled) {
+        profile_set_input(is_regular ? (uint64_t)file_stat.st_size : 0);
+    }
+
+    /* Load the sidecar index to jump to the time window, or build one during this pass */
+    packet_index_t seek_index = {0};
+    packet_index_t built_index = {0};
+    const packet_index_t* seek = NULL;
+    char* index_path = NULL;
+    if ((file_ctx->build_index || file_ctx->has_window) && is_regular) {
+        uint64_t capture_size = (uint64_t)file_stat.st_size;
+        int64_t capture_mtime_ns = (int64_t)file_stat.st_mtim.tv_sec * NSEC_PER_SEC + file_stat.st_mtim.tv_nsec;
+        index_path = (char*)malloc(strlen(filepath) + sizeof(PACKET_INDEX_SUFFIX));
+        if (index_path == NULL) {
+            perror("Failed to allocate memory for packet index path");
+        } else {
+            strcpy(index_path, filepath);
+            strcat(index_path, PACKET_INDEX_SUFFIX);
+            if (file_ctx->has_window && packet_index_load(&seek_index, index_path, capture_size, capture_mtime_ns) == 0) {
+                printf("Packet index loaded: %s (%llu entries)\n", index_path, (unsigned long long)seek_index.header.entry_count);
+                seek = &seek_index;
+            } else if (file_ctx->build_index && packet_index_begin(&built_index, file_ctx->index_stride, capture_size, capture_mtime_ns) == 0) {
+                state.index = &built_index;
+            }
+        }
+    } else if (file_ctx->build_index) {
+        printf("Warning: the packet index needs a regular file; no index written.\n");
+    }
+
+    if (map != NULL) {
+        close(fd);
+        printf("Reader mode: mmap\n");
+        result = process_mapped_capture(map, map_size, seek, file_ctx, &state);
+        munmap((void*)map, map_size);
+    } else {
+        // Open the PCAP file in binary read mode
+        FILE* file = fdopen(fd, "rb");
+        if (file == NULL) {
+            perror("Error opening file");
+            close(fd);
+            return -1;
+        }
+        printf("Reader mode: stdio\n");
+        result = process_stream_capture(file, seek, is_regular ? (uint64_t)file_stat.st_size : 0, file_ctx, &state);
+
+        // Close the file
+        fclose(file);
+    }
+
+    // Emit whatever was decoded, even if reading stopped early
+    output_flush(file_ctx->out);
+
+    // The index is only complete if the whole capture was read
+    if (result == 0 && state.index != NULL) {
+        if (packet_index_save(state.index, index_path) == 0) {
+            printf("Packet index written: %s (%llu entries)\n", index_path, (unsigned long long)state.index->header.entry_count);
+        }
+    }
+    packet_index_free(&built_index);
+    packet_index_free(&seek_index);
+    free(index_path);
+
+    if (result != 0) {
+        return -1;
+    }
+    printf("\nTotal packets processed: %llu\n", (unsigned long long)state.packet_count);
+    if (file_ctx->has_window) {
+        printf("Packets in time window: %llu\n", (unsigned long long)state.window_count);
+    }
+    if (file_ctx->verbosity == OUTPUT_SUMMARY) {
+        run_stats_print(file_ctx->stats);
+        print_ptp_summary(file_ctx);
+    }
     return 0; //File processed successfully
-}
\ No newline at end of file
+}
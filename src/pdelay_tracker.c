@@ -0,0 +1,320 @@
+#include "../include/pdelay_tracker.h"
+#include "../include/ptp_offset.h"
+#include "../include/histogram_set.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LINK_TABLE_INITIAL_SIZE 16
+
+/*
+ * Initializes an empty tracker.
+ * @param tracker The tracker.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int pdelay_tracker_init(pdelay_tracker_t* tracker) {
+    memset(tracker, 0, sizeof(*tracker));
+    if (hash_table_init(&tracker->link_index, LINK_TABLE_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize peer-delay tracker.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Frees the memory allocated by a tracker.
+ * @param tracker The tracker.
+ */
+void pdelay_tracker_free(pdelay_tracker_t* tracker) {
+    for (size_t i = 0; i < tracker->link_count; i++) {
+        hdr_histogram_free(&tracker->links[i].delay_histogram);
+    }
+    hash_table_free(&tracker->link_index);
+    free(tracker->links);
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+// The ports of a link looked up in the link index
+typedef struct {
+    const pdelay_tracker_t* tracker;
+    uint64_t requester_id;
+    uint64_t responder_id;
+    uint16_t requester_port;
+    uint16_t responder_port;
+} link_lookup_t;
+
+static int link_matches(const void* context, uint64_t value) {
+    const link_lookup_t* lookup = (const link_lookup_t*)context;
+    const pdelay_link_t* link = &lookup->tracker->links[value];
+    return link->requester_id == lookup->requester_id && link->requester_port == lookup->requester_port &&
+           link->responder_id == lookup->responder_id && link->responder_port == lookup->responder_port;
+}
+
+/*
+ * Finds the state of a link, adding an empty one if the link is new.
+ * The link index is keyed by a mix of both port identities, and entries sharing a key
+ * are told apart by link_matches().
+ * @return The link, or NULL on memory allocation failure.
+ */
+static pdelay_link_t* get_link(pdelay_tracker_t* tracker, uint64_t requester_id, uint16_t requester_port,
+                               uint64_t responder_id, uint16_t responder_port) {
+    uint64_t key = ((requester_id * 0x9E3779B97F4A7C15ULL) ^ requester_port) * 0xC2B2AE3D27D4EB4FULL
+                 ^ responder_id ^ ((uint64_t)responder_port << 48);
+    link_lookup_t lookup = { tracker, requester_id, responder_id, requester_port, responder_port };
+    hash_key_match_t match = { link_matches, &lookup };
+    uint64_t* slot = hash_table_find_match(&tracker->link_index, key, &match);
+    if (slot != NULL) {
+        return &tracker->links[*slot];
+    }
+
+    if (tracker->link_count == tracker->link_capacity) {
+        size_t grown_capacity = tracker->link_capacity ? tracker->link_capacity * 2 : LINK_TABLE_INITIAL_SIZE;
+        pdelay_link_t* grown = (pdelay_link_t*)realloc(tracker->links, grown_capacity * sizeof(pdelay_link_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for peer-delay links");
+            return NULL;
+        }
+        tracker->links = grown;
+        tracker->link_capacity = grown_capacity;
+    }
+    if (hash_table_add(&tracker->link_index, key, tracker->link_count) == NULL) {
+        return NULL;
+    }
+    pdelay_link_t* link = &tracker->links[tracker->link_count++];
+    memset(link, 0, sizeof(*link));
+    link->requester_id = requester_id;
+    link->requester_port = requester_port;
+    link->responder_id = responder_id;
+    link->responder_port = responder_port;
+    link->rate_ratio = PDELAY_RATE_RATIO_ONE;
+    link->min_delay = INT64_MAX;
+    link->max_delay = INT64_MIN;
+    hdr_histogram_init(&link->delay_histogram);
+    return link;
+}
+
+/*
+ * Narrows a 128-bit fixed-point value to int64, saturating.
+ */
+static int64_t saturate(__int128 value) {
+    if (value > INT64_MAX) {
+        return INT64_MAX;
+    }
+    if (value < INT64_MIN) {
+        return INT64_MIN;
+    }
+    return (int64_t)value;
+}
+
+/*
+ * Pushes an exchange into a link's window and updates neighborRateRatio from the oldest
+ * and newest exchanges in it. The ratio is kept when the window spans no time.
+ * @return The window slot of the exchange.
+ */
+static pdelay_window_entry_t* window_push(pdelay_link_t* link, const pdelay_exchange_t* exchange) {
+    pdelay_window_entry_t* entry = &link->window[link->exchanges % PDELAY_WINDOW];
+    entry->response_origin_ns = exchange->response_origin_ns;
+    entry->response_capture_ns = exchange->response_capture_ns;
+    entry->link_delay = 0;
+    entry->has_delay = 0;
+    link->exchanges++;
+
+    if (link->exchanges >= 2) {
+        uint64_t oldest = link->exchanges > PDELAY_WINDOW ? link->exchanges - PDELAY_WINDOW : 0;
+        const pdelay_window_entry_t* first = &link->window[oldest % PDELAY_WINDOW];
+        __int128 responder_elapsed = (__int128)entry->response_origin_ns - first->response_origin_ns;
+        __int128 requester_elapsed = (__int128)entry->response_capture_ns - first->response_capture_ns;
+        if (responder_elapsed > 0 && requester_elapsed > 0) {
+            link->rate_ratio = saturate(responder_elapsed * PDELAY_RATE_RATIO_ONE / requester_elapsed);
+        }
+    }
+    return entry;
+}
+
+/*
+ * Computes meanLinkDelay of an exchange with the link's current neighborRateRatio and
+ * accumulates it:
+ *   meanLinkDelay = ((t4 - t1) * neighborRateRatio - (t3 - t2)) / 2
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int apply_delay(pdelay_link_t* link, pdelay_window_entry_t* entry, const pdelay_exchange_t* exchange) {
+    const __int128 scale = (__int128)1 << PTP_SCALED_NS_SHIFT;
+    __int128 round_trip = ((__int128)exchange->response_capture_ns - exchange->request_capture_ns) * link->rate_ratio
+                        / ((__int128)1 << (PDELAY_RATE_RATIO_SHIFT - PTP_SCALED_NS_SHIFT));
+    __int128 turnaround = ((__int128)exchange->response_origin_ns - exchange->request_receipt_ns) * scale
+                        + exchange->turnaround_correction;
+    int64_t delay = saturate((round_trip - turnaround) / 2);
+    if (hdr_histogram_record(&link->delay_histogram, delay) != 0) {
+        return -1;
+    }
+
+    entry->link_delay = delay;
+    entry->has_delay = 1;
+    link->samples++;
+    link->last_delay = delay;
+    link->delay_sum += delay;
+    if (delay < link->min_delay) {
+        link->min_delay = delay;
+    }
+    if (delay > link->max_delay) {
+        link->max_delay = delay;
+    }
+    return 0;
+}
+
+/*
+ * Records a completed Pdelay exchange on the link between two ports.
+ * @param tracker The tracker.
+ * @param requester_id Clock identity of the port that sent the Pdelay_Req.
+ * @param requester_port Its port number.
+ * @param responder_id Clock identity of the port that sent the responses.
+ * @param responder_port Its port number.
+ * @param exchange The exchange's timestamps.
+ * @param link_out Set to the link when a delay was computed, else NULL; may be NULL.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int pdelay_tracker_record(pdelay_tracker_t* tracker, uint64_t requester_id, uint16_t requester_port, uint64_t responder_id,
+                          uint16_t responder_port, const pdelay_exchange_t* exchange, const pdelay_link_t** link_out) {
+    if (link_out != NULL) {
+        *link_out = NULL;
+    }
+    pdelay_link_t* link = get_link(tracker, requester_id, requester_port, responder_id, responder_port);
+    if (link == NULL) {
+        return -1;
+    }
+    if (tracker->defer_partial && link->exchanges < PDELAY_WINDOW - 1) {
+        link->pending[link->pending_count++] = *exchange;
+        window_push(link, exchange);
+        return 0;
+    }
+    if (apply_delay(link, window_push(link, exchange), exchange) != 0) {
+        return -1;
+    }
+    if (link_out != NULL) {
+        *link_out = link;
+    }
+    return 0;
+}
+
+/*
+ * Merges the links of src into dst. Trackers must be merged in capture order (dst holds
+ * the earlier part): the exchanges src kept back are computed against dst's window, after
+ * which src's window, which then holds only src's exchanges, replaces dst's.
+ * @param dst The tracker receiving the links.
+ * @param src The tracker to merge from; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int pdelay_tracker_merge(pdelay_tracker_t* dst, const pdelay_tracker_t* src) {
+    for (size_t i = 0; i < src->link_count; i++) {
+        const pdelay_link_t* part = &src->links[i];
+        pdelay_link_t* link = get_link(dst, part->requester_id, part->requester_port, part->responder_id, part->responder_port);
+        if (link == NULL) {
+            return -1;
+        }
+        uint64_t base = link->exchanges;
+        for (uint32_t p = 0; p < part->pending_count; p++) {
+            if (apply_delay(link, window_push(link, &part->pending[p]), &part->pending[p]) != 0) {
+                return -1;
+            }
+        }
+        if (hdr_histogram_merge(&link->delay_histogram, &part->delay_histogram) != 0) {
+            return -1;
+        }
+        if (part->exchanges == part->pending_count) {
+            continue;
+        }
+
+        // Take src's window, with the delays of the exchanges it kept back from the replay above
+        pdelay_window_entry_t window[PDELAY_WINDOW];
+        memcpy(window, link->window, sizeof(window));
+        uint64_t first = part->exchanges > PDELAY_WINDOW ? part->exchanges - PDELAY_WINDOW : 0;
+        for (uint64_t n = first; n < part->exchanges; n++) {
+            pdelay_window_entry_t entry = part->window[n % PDELAY_WINDOW];
+            if (n < part->pending_count) {
+                entry = link->window[(base + n) % PDELAY_WINDOW];
+            }
+            window[(base + n) % PDELAY_WINDOW] = entry;
+        }
+        memcpy(link->window, window, sizeof(window));
+        link->exchanges = base + part->exchanges;
+        link->rate_ratio = part->rate_ratio;
+
+        if (part->samples != 0) {
+            link->samples += part->samples;
+            link->last_delay = part->last_delay;
+            link->delay_sum += part->delay_sum;
+            if (part->min_delay < link->min_delay) {
+                link->min_delay = part->min_delay;
+            }
+            if (part->max_delay > link->max_delay) {
+                link->max_delay = part->max_delay;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * @param link The link.
+ * @return Mean of the link delays in the link's window in scaled nanoseconds, 0 if none.
+ */
+int64_t pdelay_link_window_mean(const pdelay_link_t* link) {
+    __int128 sum = 0;
+    int count = 0;
+    uint64_t first = link->exchanges > PDELAY_WINDOW ? link->exchanges - PDELAY_WINDOW : 0;
+    for (uint64_t n = first; n < link->exchanges; n++) {
+        const pdelay_window_entry_t* entry = &link->window[n % PDELAY_WINDOW];
+        if (entry->has_delay) {
+            sum += entry->link_delay;
+            count++;
+        }
+    }
+    return count != 0 ? saturate(sum / count) : 0;
+}
+
+/*
+ * @param link The link.
+ * @return Mean of every link delay of the link in scaled nanoseconds, 0 if none.
+ */
+int64_t pdelay_link_mean(const pdelay_link_t* link) {
+    if (link->samples == 0) {
+        return 0;
+    }
+    return saturate(link->delay_sum / (__int128)link->samples);
+}
+
+/*
+ * Formats a fixed-point rate ratio as a decimal with nine fractional digits (truncated),
+ * e.g. "1.000000123".
+ * @return The number of characters written, as snprintf.
+ */
+int pdelay_rate_ratio_format(int64_t rate_ratio, char* buffer, size_t size) {
+    uint64_t magnitude = rate_ratio < 0 ? -(uint64_t)rate_ratio : (uint64_t)rate_ratio;
+    uint64_t whole = magnitude >> PDELAY_RATE_RATIO_SHIFT;
+    uint64_t fraction = (uint64_t)(((unsigned __int128)(magnitude & (PDELAY_RATE_RATIO_ONE - 1)) * 1000000000u) >> PDELAY_RATE_RATIO_SHIFT);
+    return snprintf(buffer, size, "%s%llu.%09llu", rate_ratio < 0 ? "-" : "", (unsigned long long)whole, (unsigned long long)fraction);
+}
+
+/*
+ * Prints the link delay and neighborRateRatio of every link.
+ * @param tracker The tracker.
+ */
+void pdelay_tracker_print(const pdelay_tracker_t* tracker) {
+    for (size_t i = 0; i < tracker->link_count; i++) {
+        const pdelay_link_t* link = &tracker->links[i];
+        char window_mean[32], mean[32], min_delay[32], max_delay[32], rate_ratio[32];
+        ptp_scaled_ns_format(pdelay_link_window_mean(link), window_mean, sizeof(window_mean));
+        ptp_scaled_ns_format(pdelay_link_mean(link), mean, sizeof(mean));
+        ptp_scaled_ns_format(link->min_delay, min_delay, sizeof(min_delay));
+        ptp_scaled_ns_format(link->max_delay, max_delay, sizeof(max_delay));
+        pdelay_rate_ratio_format(link->rate_ratio, rate_ratio, sizeof(rate_ratio));
+        printf("Pdelay link 0x%016llx:%u -> 0x%016llx:%u: %llu exchanges, %llu link delays computed\n",
+               (unsigned long long)link->requester_id, link->requester_port,
+               (unsigned long long)link->responder_id, link->responder_port,
+               (unsigned long long)link->exchanges, (unsigned long long)link->samples);
+        printf("    meanLinkDelay ns:  last %d exchanges %s, overall %s, min %s, max %s\n",
+               PDELAY_WINDOW, window_mean, mean, min_delay, max_delay);
+        histogram_print_percentiles("    meanLinkDelay:     ", &link->delay_histogram);
+        printf("    neighborRateRatio: %s\n", rate_ratio);
+    }
+}
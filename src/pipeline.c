@@ -0,0 +1,486 @@
+/* The Plan */
+//
+// 1. The reader thread fills batches of packet descriptors
+// 2. Full batches are pushed onto a bounded lock-free MPMC ring
+// 3. Worker threads pop batches and run the Ethernet/IP/PTP decode into a per-batch output stream,
+//    deferring every clock map / gPTP cycle map update instead of applying it
+// 4. Decoded batches are committed strictly in capture order: output is written and deferred
+//    updates are replayed against the shared maps, so results match a single-threaded run
+// 5. Committed batches are recycled to the reader through a second ring
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "../include/pipeline.h"
+#include "../include/ptp.h"
+#include "../include/profile.h"
+
+struct pipeline_s {
+    file_context_t* file_ctx;           // Shared context owning the maps and the final output
+    int num_workers;
+    pthread_t* workers;
+    run_stats_t* worker_stats;          // One counter block per worker, summed into file_ctx when done
+    atomic_int next_worker_stats;       // Next block to hand to a starting worker
+
+    size_t num_batches;
+    pipeline_batch_t* batches;
+    work_queue_t work_queue;            // Filled batches waiting for a worker
+    work_queue_t free_queue;            // Committed batches waiting for the reader
+
+    pipeline_batch_t* filling;          // Batch currently being filled by the reader
+    uint64_t next_sequence;
+
+    _Atomic(pipeline_batch_t*)* reorder;   // Decoded batches indexed by sequence % num_batches
+    pthread_mutex_t commit_lock;
+    uint64_t next_commit;               // Sequence of the next batch to commit (under commit_lock)
+
+    atomic_int done;                    // Set once the reader has pushed its last batch
+};
+
+/*
+ * Waits progressively longer while a ring is empty or full.
+ * @param spins Number of consecutive failed attempts so far.
+ */
+static void backoff(unsigned* spins) {
+    (*spins)++;
+    if (*spins < 64) {
+        return;
+    }
+    if (*spins < 128) {
+        sched_yield();
+        return;
+    }
+    struct timespec pause = {0, 50000}; // 50 us
+    nanosleep(&pause, NULL);
+}
+
+/*
+ * Initializes a ring with room for at least capacity batches.
+ * @param queue The queue.
+ * @param capacity Minimum number of slots, rounded up to a power of two.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int work_queue_init(work_queue_t* queue, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    queue->cells = (work_queue_cell_t*)calloc(size, sizeof(work_queue_cell_t));
+    if (queue->cells == NULL) {
+        perror("Failed to allocate memory for work queue");
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+    queue->mask = size - 1;
+    atomic_init(&queue->enqueue_pos, 0);
+    atomic_init(&queue->dequeue_pos, 0);
+    return 0;
+}
+
+/*
+ * Pushes a batch onto the ring without blocking.
+ * @param queue The queue.
+ * @param batch The batch to push.
+ * @return 1 on success, 0 if the ring is full.
+ */
+int work_queue_push(work_queue_t* queue, pipeline_batch_t* batch) {
+    size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+    work_queue_cell_t* cell;
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->batch = batch;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return 1;
+}
+
+/*
+ * Pops a batch from the ring without blocking.
+ * @param queue The queue.
+ * @return The batch, or NULL if the ring is empty.
+ */
+pipeline_batch_t* work_queue_pop(work_queue_t* queue) {
+    size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+    work_queue_cell_t* cell;
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+        }
+    }
+    pipeline_batch_t* batch = cell->batch;
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+    return batch;
+}
+
+/*
+ * Frees the ring's slots. Batches referenced by the ring are not freed.
+ * @param queue The queue.
+ */
+void work_queue_free(work_queue_t* queue) {
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+/*
+ * Appends a deferred update to the batch of a worker context.
+ * @param file_ctx The worker context.
+ * @return Pointer to the new operation, or NULL on memory allocation failure.
+ */
+static pipeline_op_t* append_op(file_context_t* file_ctx) {
+    pipeline_batch_t* batch = file_ctx->batch;
+    if (batch->op_count == batch->op_capacity) {
+        size_t capacity = batch->op_capacity ? batch->op_capacity * 2 : 64;
+        pipeline_op_t* grown = (pipeline_op_t*)realloc(batch->ops, capacity * sizeof(pipeline_op_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for deferred pipeline operation");
+            return NULL;
+        }
+        batch->ops = grown;
+        batch->op_capacity = capacity;
+    }
+    pipeline_op_t* op = &batch->ops[batch->op_count++];
+    op->out_offset = batch->out.used;
+    return op;
+}
+
+/*
+ * Defers a grandmaster -> source port clock map insertion until the batch is committed.
+ * @param file_ctx The worker context.
+ * @param grandmaster_id The grandmaster identity.
+ * @param source_port_id The source port identity.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int pipeline_defer_clock_mapping(file_context_t* file_ctx, uint64_t grandmaster_id, uint64_t source_port_id) {
+    pipeline_op_t* op = append_op(file_ctx);
+    if (op == NULL) {
+        return -1;
+    }
+    op->type = PIPELINE_OP_CLOCK_MAPPING;
+    op->key = grandmaster_id;
+    op->value = source_port_id;
+    return 0;
+}
+
+/*
+ * Defers a gPTP cycle update until the batch is committed.
+ * The packet data stays valid until then because the batch owns or pins it.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int pipeline_defer_gptp_message(file_context_t* file_ctx, const ptp_common_header_t* common_header, int64_t capture_ts_ns, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac) {
+    pipeline_op_t* op = append_op(file_ctx);
+    if (op == NULL) {
+        return -1;
+    }
+    op->type = PIPELINE_OP_GPTP_MESSAGE;
+    op->common_header = *common_header;
+    op->capture_ts_ns = capture_ts_ns;
+    op->packet_data = packet_data;
+    op->data_length = data_length;
+    op->eth_src_mac = eth_src_mac;
+    op->eth_dst_mac = eth_dst_mac;
+    return 0;
+}
+
+/*
+ * Writes a decoded batch to the shared output and replays its deferred updates in order.
+ * Must be called with commit_lock held.
+ * @param pipeline The pipeline.
+ * @param batch The batch to commit.
+ */
+static void commit_batch(pipeline_t* pipeline, pipeline_batch_t* batch) {
+    file_context_t* file_ctx = pipeline->file_ctx;
+    size_t written = 0;
+
+    for (size_t i = 0; i < batch->op_count; i++) {
+        const pipeline_op_t* op = &batch->ops[i];
+        // Emit the output that preceded the update so anything it prints lands in the same place
+        output_write(file_ctx->out, batch->out.buffer + written, op->out_offset - written);
+        written = op->out_offset;
+
+        switch (op->type) {
+            case PIPELINE_OP_CLOCK_MAPPING:
+                record_clock_mapping(file_ctx, op->key, op->value);
+                break;
+            case PIPELINE_OP_GPTP_MESSAGE: {
+                PROFILE_SCOPE_BEGIN(gptp_scope, PROFILE_STAGE_GPTP);
+                process_gptp_message(file_ctx, &op->common_header, op->capture_ts_ns, op->packet_data, op->data_length, op->eth_src_mac, op->eth_dst_mac);
+                PROFILE_SCOPE_END(gptp_scope);
+                break;
+            }
+        }
+    }
+    output_write(file_ctx->out, batch->out.buffer + written, batch->out.used - written);
+
+    output_reset(&batch->out);
+    batch->count = 0;
+    batch->storage_used = 0;
+    batch->op_count = 0;
+}
+
+/*
+ * Publishes a decoded batch to the reorder stage and commits every batch that is now in order.
+ * Whichever worker holds the commit lock drains on behalf of the others.
+ * @param pipeline The pipeline.
+ * @param batch The decoded batch, or NULL to only drain.
+ */
+static void publish_batch(pipeline_t* pipeline, pipeline_batch_t* batch) {
+    if (batch != NULL) {
+        atomic_store(&pipeline->reorder[batch->sequence % pipeline->num_batches], batch);
+    }
+
+    for (;;) {
+        if (pthread_mutex_trylock(&pipeline->commit_lock) != 0) {
+            return; // The current holder re-checks the next slot after unlocking
+        }
+        pipeline_batch_t* next;
+        while ((next = atomic_load(&pipeline->reorder[pipeline->next_commit % pipeline->num_batches])) != NULL
+               && next->sequence == pipeline->next_commit) {
+            atomic_store(&pipeline->reorder[pipeline->next_commit % pipeline->num_batches], NULL);
+            PROFILE_SCOPE_BEGIN(commit_scope, PROFILE_STAGE_COMMIT);
+            commit_batch(pipeline, next);
+            PROFILE_SCOPE_END(commit_scope);
+            pipeline->next_commit++;
+            work_queue_push(&pipeline->free_queue, next);
+        }
+        uint64_t next_commit = pipeline->next_commit;
+        pthread_mutex_unlock(&pipeline->commit_lock);
+
+        // A batch published while we held the lock would otherwise be left behind
+        next = atomic_load(&pipeline->reorder[next_commit % pipeline->num_batches]);
+        if (next == NULL || next->sequence != next_commit) {
+            return;
+        }
+    }
+}
+
+/*
+ * Worker thread: decodes batches into their own output buffer with map updates deferred.
+ * @param arg The pipeline.
+ * @return NULL.
+ */
+static void* worker_main(void* arg) {
+    pipeline_t* pipeline = (pipeline_t*)arg;
+
+    // Settings are shared; the maps are only touched by the commit stage
+    file_context_t worker_ctx = *pipeline->file_ctx;
+    memset(&worker_ctx.clock_map, 0, sizeof(worker_ctx.clock_map));
+    memset(&worker_ctx.cycle_map, 0, sizeof(worker_ctx.cycle_map));
+    worker_ctx.stats = &pipeline->worker_stats[atomic_fetch_add(&pipeline->next_worker_stats, 1)];
+
+    unsigned spins = 0;
+    for (;;) {
+        pipeline_batch_t* batch = work_queue_pop(&pipeline->work_queue);
+        if (batch == NULL) {
+            // The reader sets done only after its last push, so one more pop settles the race
+            if (atomic_load(&pipeline->done) && (batch = work_queue_pop(&pipeline->work_queue)) == NULL) {
+                break;
+            }
+            if (batch == NULL) {
+                backoff(&spins);
+                continue;
+            }
+        }
+        spins = 0;
+
+        worker_ctx.out = &batch->out;
+        worker_ctx.batch = batch;
+        for (size_t i = 0; i < batch->count; i++) {
+            process_packet(&worker_ctx, &batch->packets[i]);
+        }
+
+        publish_batch(pipeline, batch);
+    }
+    return NULL;
+}
+
+/*
+ * Frees every batch and ring owned by the pipeline.
+ * @param pipeline The pipeline.
+ */
+static void pipeline_free(pipeline_t* pipeline) {
+    if (pipeline->batches != NULL) {
+        for (size_t i = 0; i < pipeline->num_batches; i++) {
+            free(pipeline->batches[i].storage);
+            free(pipeline->batches[i].ops);
+            output_free(&pipeline->batches[i].out);
+        }
+    }
+    free(pipeline->batches);
+    free((void*)pipeline->reorder);
+    free(pipeline->workers);
+    run_stats_destroy(pipeline->worker_stats);
+    work_queue_free(&pipeline->work_queue);
+    work_queue_free(&pipeline->free_queue);
+    pthread_mutex_destroy(&pipeline->commit_lock);
+    free(pipeline);
+}
+
+/*
+ * Creates the pipeline and starts its worker threads.
+ * Must be called after the global header has been validated so workers see the final settings.
+ * @param file_ctx The shared file context.
+ * @param num_workers Number of decode threads.
+ * @return The pipeline, or NULL on failure.
+ */
+pipeline_t* pipeline_create(file_context_t* file_ctx, int num_workers) {
+    // The work queues' positions sit on their own cache lines, so the pipeline keeps their alignment
+    size_t bytes = (sizeof(pipeline_t) + _Alignof(pipeline_t) - 1) / _Alignof(pipeline_t) * _Alignof(pipeline_t);
+    pipeline_t* pipeline = (pipeline_t*)aligned_alloc(_Alignof(pipeline_t), bytes);
+    if (pipeline == NULL) {
+        perror("Failed to allocate memory for pipeline");
+        return NULL;
+    }
+    memset(pipeline, 0, sizeof(*pipeline));
+    pthread_mutex_init(&pipeline->commit_lock, NULL);
+    pipeline->file_ctx = file_ctx;
+    pipeline->num_batches = (size_t)num_workers * PIPELINE_BATCHES_PER_WORKER;
+    pipeline->batches = (pipeline_batch_t*)calloc(pipeline->num_batches, sizeof(pipeline_batch_t));
+    pipeline->reorder = calloc(pipeline->num_batches, sizeof(*pipeline->reorder));
+    pipeline->workers = (pthread_t*)calloc((size_t)num_workers, sizeof(pthread_t));
+    pipeline->worker_stats = run_stats_create((size_t)num_workers);
+    if (pipeline->batches == NULL || pipeline->reorder == NULL || pipeline->workers == NULL || pipeline->worker_stats == NULL) {
+        perror("Failed to allocate memory for pipeline batches");
+        pipeline_free(pipeline);
+        return NULL;
+    }
+    if (work_queue_init(&pipeline->work_queue, pipeline->num_batches) != 0 ||
+        work_queue_init(&pipeline->free_queue, pipeline->num_batches) != 0) {
+        pipeline_free(pipeline);
+        return NULL;
+    }
+    for (size_t i = 0; i < pipeline->num_batches; i++) {
+        work_queue_push(&pipeline->free_queue, &pipeline->batches[i]);
+    }
+    atomic_init(&pipeline->done, 0);
+    atomic_init(&pipeline->next_worker_stats, 0);
+
+    for (int i = 0; i < num_workers; i++) {
+        if (pthread_create(&pipeline->workers[i], NULL, worker_main, pipeline) != 0) {
+            perror("Failed to start pipeline worker thread");
+            // Let the workers that did start drain and exit before tearing down
+            atomic_store(&pipeline->done, 1);
+            for (int j = 0; j < i; j++) {
+                pthread_join(pipeline->workers[j], NULL);
+            }
+            pipeline_free(pipeline);
+            return NULL;
+        }
+        pipeline->num_workers++;
+    }
+    printf("Decode pipeline started with %d worker thread(s).\n", num_workers);
+    return pipeline;
+}
+
+/*
+ * Pushes the batch being filled to the workers.
+ * @param pipeline The pipeline.
+ */
+static void flush_filling(pipeline_t* pipeline) {
+    pipeline_batch_t* batch = pipeline->filling;
+    if (batch == NULL || batch->count == 0) {
+        return;
+    }
+    batch->sequence = pipeline->next_sequence++;
+    unsigned spins = 0;
+    while (!work_queue_push(&pipeline->work_queue, batch)) {
+        backoff(&spins);
+    }
+    pipeline->filling = NULL;
+}
+
+/*
+ * Adds a packet to the current batch, handing the batch to the workers once it is full.
+ * @param pipeline The pipeline.
+ * @param packet The packet descriptor.
+ * @param copy_data Non-zero if packet->data must be copied into the batch.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int pipeline_submit(pipeline_t* pipeline, const packet_desc_t* packet, int copy_data) {
+    uint32_t length = packet->valid ? packet->incl_len : 0;
+
+    // Data copied into a batch must fit its storage; start a new batch rather than grow a used one
+    if (copy_data && pipeline->filling != NULL &&
+        pipeline->filling->storage_used + length > pipeline->filling->storage_capacity) {
+        flush_filling(pipeline);
+    }
+
+    if (pipeline->filling == NULL) {
+        unsigned spins = 0;
+        while ((pipeline->filling = work_queue_pop(&pipeline->free_queue)) == NULL) {
+            backoff(&spins);
+        }
+    }
+    pipeline_batch_t* batch = pipeline->filling;
+
+    packet_desc_t* slot = &batch->packets[batch->count];
+    *slot = *packet;
+    if (copy_data) {
+        if (batch->storage_used + length > batch->storage_capacity) {
+            // Only reached with an empty batch, so growing cannot invalidate earlier descriptors
+            size_t capacity = length > PIPELINE_BATCH_STORAGE ? length : PIPELINE_BATCH_STORAGE;
+            uint8_t* grown = (uint8_t*)realloc(batch->storage, capacity);
+            if (grown == NULL) {
+                perror("Failed to allocate memory for batch storage");
+                return -1;
+            }
+            batch->storage = grown;
+            batch->storage_capacity = capacity;
+        }
+        if (length > 0) {
+            memcpy(batch->storage + batch->storage_used, packet->data, length);
+        }
+        slot->data = batch->storage + batch->storage_used;
+        batch->storage_used += length;
+    }
+    batch->count++;
+
+    if (batch->count == PIPELINE_BATCH_PACKETS) {
+        flush_filling(pipeline);
+    }
+    return 0;
+}
+
+/*
+ * Flushes the last partial batch, waits for every batch to be committed and stops the workers.
+ * The pipeline is freed and must not be used afterwards.
+ * @param pipeline The pipeline.
+ */
+void pipeline_finish(pipeline_t* pipeline) {
+    flush_filling(pipeline);
+    atomic_store(&pipeline->done, 1);
+    for (int i = 0; i < pipeline->num_workers; i++) {
+        pthread_join(pipeline->workers[i], NULL);
+    }
+    publish_batch(pipeline, NULL);
+    output_flush(pipeline->file_ctx->out);
+    for (int i = 0; i < pipeline->num_workers; i++) {
+        run_stats_add(pipeline->file_ctx->stats, &pipeline->worker_stats[i]);
+    }
+    pipeline_free(pipeline);
+}
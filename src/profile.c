@@ -0,0 +1,274 @@
+// Hot-path profiler behind --profile.
+//
+// Scopes read a cycle counter (the TSC on x86, CLOCK_MONOTONIC elsewhere) on entry and exit.
+// Every thread accumulates into its own cache-line aligned block, registered on first use,
+// so timing never contends between threads; the blocks are summed by profile_report() after
+// all threads have been joined. Ticks are converted to nanoseconds by calibrating the
+// counter against CLOCK_MONOTONIC over the whole run.
+//
+// Progress is counted per thread as well and folded into two shared atomics every
+// PROFILE_PROGRESS_BATCH records; the thread that finds the report deadline passed prints
+// the throughput line.
+
+#include "../include/profile.h"
+#include "../include/utils.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define PROFILE_CACHE_LINE 64
+#define PROFILE_PROGRESS_BATCH 256              // Records counted locally before a shared update
+#define PROFILE_PROGRESS_INTERVAL_NS NSEC_PER_SEC
+
+/**
+ * @brief Timings of one thread. Written only by its thread, read once the threads are joined.
+ */
+typedef struct profile_thread {
+    uint64_t ticks[PROFILE_STAGE_COUNT];        // Self time of each stage
+    uint64_t calls[PROFILE_STAGE_COUNT];
+    uint64_t probes[PROFILE_PROBE_BUCKETS];     // Hash table lookups by groups probed
+    uint64_t pending_bytes;                     // Progress not yet added to the shared totals
+    uint64_t pending_records;
+    struct profile_thread* next;
+} __attribute__((aligned(PROFILE_CACHE_LINE))) profile_thread_t;
+
+int profile_enabled = 0;
+
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static profile_thread_t* threads = NULL;       // Every registered block
+static __thread profile_thread_t* this_thread = NULL;
+static __thread profile_scope_t* open_scope = NULL;    // Innermost open scope of this thread
+
+static uint64_t input_bytes = 0;                // Size of the capture, 0 if unknown
+static int64_t start_ns = 0;
+static uint64_t start_ticks = 0;
+static atomic_uint_fast64_t progress_bytes;
+static atomic_uint_fast64_t progress_records;
+static _Atomic int64_t next_progress_ns;
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline uint64_t read_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)monotonic_ns();
+#endif
+}
+
+/*
+ * @return The calling thread's block, registering a new one on first use, or NULL on
+ * memory allocation failure.
+ */
+static profile_thread_t* get_thread(void) {
+    if (this_thread != NULL) {
+        return this_thread;
+    }
+    profile_thread_t* block = (profile_thread_t*)aligned_alloc(PROFILE_CACHE_LINE, sizeof(profile_thread_t));
+    if (block == NULL) {
+        return NULL;
+    }
+    memset(block, 0, sizeof(*block));
+    pthread_mutex_lock(&thread_lock);
+    block->next = threads;
+    threads = block;
+    pthread_mutex_unlock(&thread_lock);
+    this_thread = block;
+    return block;
+}
+
+/*
+ * Turns profiling on. Must be called before any capture processing starts.
+ */
+void profile_enable(void) {
+    profile_enabled = 1;
+    start_ns = monotonic_ns();
+    start_ticks = read_ticks();
+    atomic_init(&progress_bytes, 0);
+    atomic_init(&progress_records, 0);
+    atomic_init(&next_progress_ns, start_ns + PROFILE_PROGRESS_INTERVAL_NS);
+}
+
+/*
+ * Sets the size of the capture so progress lines can show a percentage and an ETA.
+ * @param total_bytes Size of the capture in bytes, 0 if unknown (e.g. stdin).
+ */
+void profile_set_input(uint64_t total_bytes) {
+    input_bytes = total_bytes;
+}
+
+/*
+ * Opens a scope on the calling thread. Use PROFILE_SCOPE_BEGIN.
+ * @param scope The scope, on the caller's stack.
+ */
+void profile_scope_enter(profile_scope_t* scope) {
+    scope->parent = open_scope;
+    scope->child_ticks = 0;
+    open_scope = scope;
+    scope->start = read_ticks();
+}
+
+/*
+ * Closes the innermost scope, charging its time less its children's to its stage.
+ * @param scope The scope.
+ */
+void profile_scope_exit(profile_scope_t* scope) {
+    uint64_t elapsed = read_ticks() - scope->start;
+    open_scope = scope->parent;
+    if (scope->parent != NULL) {
+        scope->parent->child_ticks += elapsed;
+    }
+    profile_thread_t* block = get_thread();
+    if (block != NULL) {
+        block->ticks[scope->stage] += elapsed - scope->child_ticks;
+        block->calls[scope->stage]++;
+    }
+}
+
+/*
+ * Counts one hash table lookup.
+ * @param groups Number of groups the lookup probed.
+ */
+void profile_record_probe(size_t groups) {
+    profile_thread_t* block = get_thread();
+    if (block != NULL) {
+        block->probes[(groups < PROFILE_PROBE_BUCKETS ? groups : PROFILE_PROBE_BUCKETS) - 1]++;
+    }
+}
+
+static void print_progress(int64_t now_ns, uint64_t bytes, uint64_t records) {
+    double seconds = (double)(now_ns - start_ns) / NSEC_PER_SEC;
+    double bytes_per_second = (double)bytes / seconds;
+    fprintf(stderr, "Progress: ");
+    if (input_bytes > 0) {
+        fprintf(stderr, "%.1f%%, ", 100.0 * (double)bytes / (double)input_bytes);
+    }
+    fprintf(stderr, "%llu packets, %.0f packets/s, %.1f MB/s", (unsigned long long)records, (double)records / seconds, bytes_per_second / 1e6);
+    if (input_bytes > bytes && bytes_per_second > 0.0) {
+        fprintf(stderr, ", ETA %.1f s", (double)(input_bytes - bytes) / bytes_per_second);
+    }
+    fputc('\n', stderr);
+}
+
+/*
+ * Counts one record read from the capture and prints a progress line once per interval.
+ * @param bytes Bytes of the capture the record occupies.
+ */
+void profile_record_progress(uint64_t bytes) {
+    profile_thread_t* block = get_thread();
+    if (block == NULL) {
+        return;
+    }
+    block->pending_bytes += bytes;
+    if (++block->pending_records < PROFILE_PROGRESS_BATCH) {
+        return;
+    }
+    uint64_t total_bytes = atomic_fetch_add(&progress_bytes, block->pending_bytes) + block->pending_bytes;
+    uint64_t total_records = atomic_fetch_add(&progress_records, block->pending_records) + block->pending_records;
+    block->pending_bytes = 0;
+    block->pending_records = 0;
+
+    // One thread wins each deadline; the others carry on without printing
+    int64_t now_ns = monotonic_ns();
+    int64_t deadline = atomic_load(&next_progress_ns);
+    if (now_ns < deadline || !atomic_compare_exchange_strong(&next_progress_ns, &deadline, now_ns + PROFILE_PROGRESS_INTERVAL_NS)) {
+        return;
+    }
+    print_progress(now_ns, total_bytes, total_records);
+}
+
+static const char* stage_name(profile_stage_t stage) {
+    static const char* const names[] = {
+        [PROFILE_STAGE_READ] = "read",
+        [PROFILE_STAGE_ETHERNET] = "ethernet",
+        [PROFILE_STAGE_IP] = "ip/udp",
+        [PROFILE_STAGE_PTP] = "ptp",
+        [PROFILE_STAGE_GPTP] = "gptp",
+        [PROFILE_STAGE_CLOCK_MAP] = "clock map",
+        [PROFILE_STAGE_COMMIT] = "commit",
+        [PROFILE_STAGE_MERGE] = "merge",
+    };
+    return (unsigned)stage < PROFILE_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+/*
+ * Prints the stage breakdown and probe-length histogram to stderr and frees the thread
+ * blocks. Call after every thread that was profiled has been joined.
+ */
+void profile_report(void) {
+    if (!profile_enabled) {
+        return;
+    }
+    int64_t wall_ns = monotonic_ns() - start_ns;
+    uint64_t wall_ticks = read_ticks() - start_ticks;
+    double ns_per_tick = wall_ticks > 0 ? (double)wall_ns / (double)wall_ticks : 1.0;
+
+    // Sum the blocks of every thread, including progress not yet folded into the totals
+    profile_thread_t total = {0};
+    uint64_t bytes = atomic_load(&progress_bytes);
+    uint64_t records = atomic_load(&progress_records);
+    int thread_count = 0;
+    for (profile_thread_t* block = threads; block != NULL; block = block->next) {
+        for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+            total.ticks[i] += block->ticks[i];
+            total.calls[i] += block->calls[i];
+        }
+        for (int i = 0; i < PROFILE_PROBE_BUCKETS; i++) {
+            total.probes[i] += block->probes[i];
+        }
+        bytes += block->pending_bytes;
+        records += block->pending_records;
+        thread_count++;
+    }
+
+    double seconds = wall_ns > 0 ? (double)wall_ns / NSEC_PER_SEC : 1e-9;
+    fprintf(stderr, "\nProfile: %.3f s wall, %llu packets, %.0f packets/s, %.1f MB/s\n",
+            (double)wall_ns / NSEC_PER_SEC, (unsigned long long)records, (double)records / seconds, (double)bytes / seconds / 1e6);
+
+    uint64_t busy_ticks = 0;
+    for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        busy_ticks += total.ticks[i];
+    }
+    fprintf(stderr, "Stage self times, summed over %d thread%s:\n", thread_count, thread_count == 1 ? "" : "s");
+    fprintf(stderr, "    %-10s %12s %12s %7s %10s\n", "stage", "calls", "ms", "share", "ns/call");
+    for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+        if (total.calls[i] == 0) {
+            continue;
+        }
+        double stage_ns = (double)total.ticks[i] * ns_per_tick;
+        fprintf(stderr, "    %-10s %12llu %12.3f %6.1f%% %10.1f\n", stage_name((profile_stage_t)i), (unsigned long long)total.calls[i],
+                stage_ns / 1e6, busy_ticks > 0 ? 100.0 * (double)total.ticks[i] / (double)busy_ticks : 0.0, stage_ns / (double)total.calls[i]);
+    }
+
+    uint64_t lookups = 0;
+    for (int i = 0; i < PROFILE_PROBE_BUCKETS; i++) {
+        lookups += total.probes[i];
+    }
+    if (lookups > 0) {
+        fprintf(stderr, "Hash table probe lengths: %llu lookups\n", (unsigned long long)lookups);
+        for (int i = 0; i < PROFILE_PROBE_BUCKETS; i++) {
+            if (total.probes[i] == 0) {
+                continue;
+            }
+            fprintf(stderr, "    %2d%s group%s %12llu %6.2f%%\n", i + 1, i + 1 == PROFILE_PROBE_BUCKETS ? "+" : " ", i == 0 ? " " : "s",
+                    (unsigned long long)total.probes[i], 100.0 * (double)total.probes[i] / (double)lookups);
+        }
+    }
+
+    while (threads != NULL) {
+        profile_thread_t* next = threads->next;
+        free(threads);
+        threads = next;
+    }
+    this_thread = NULL;
+}
@@ -0,0 +1,396 @@
+#include "../include/ptp_offset.h"
+#include "../include/histogram_set.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OFFSET_TABLE_INITIAL_SIZE 16
+
+/*
+ * Initializes an empty engine.
+ * @param engine The engine.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int ptp_offset_init(ptp_offset_engine_t* engine) {
+    memset(engine, 0, sizeof(*engine));
+    if (hash_table_init(&engine->master_index, OFFSET_TABLE_INITIAL_SIZE) != 0 ||
+        hash_table_init(&engine->pair_index, OFFSET_TABLE_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize offset engine.\n");
+        hash_table_free(&engine->master_index);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Frees the memory allocated by an engine.
+ * @param engine The engine.
+ */
+void ptp_offset_free(ptp_offset_engine_t* engine) {
+    for (size_t i = 0; i < engine->master_count; i++) {
+        hdr_histogram_free(&engine->masters[i].sync_interval);
+    }
+    for (size_t i = 0; i < engine->pair_count; i++) {
+        hdr_histogram_free(&engine->pairs[i].offset_histogram);
+        hdr_histogram_free(&engine->pairs[i].delay_histogram);
+        allan_free(&engine->pairs[i].stability);
+    }
+    hash_table_free(&engine->master_index);
+    hash_table_free(&engine->pair_index);
+    free(engine->masters);
+    free(engine->pairs);
+    memset(engine, 0, sizeof(*engine));
+}
+
+/*
+ * Grows a record array to hold at least one more element.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int reserve_one(void** items, size_t* capacity, size_t count, size_t item_size) {
+    if (count < *capacity) {
+        return 0;
+    }
+    size_t grown_capacity = *capacity ? *capacity * 2 : OFFSET_TABLE_INITIAL_SIZE;
+    void* grown = realloc(*items, grown_capacity * item_size);
+    if (grown == NULL) {
+        perror("Failed to allocate memory for offset engine");
+        return -1;
+    }
+    *items = grown;
+    *capacity = grown_capacity;
+    return 0;
+}
+
+/*
+ * Finds the state of a master, adding an empty one if it is new.
+ * @return The master, or NULL on memory allocation failure.
+ */
+static ptp_offset_master_t* get_master(ptp_offset_engine_t* engine, uint64_t master_id) {
+    int inserted;
+    uint64_t* slot = hash_table_insert(&engine->master_index, master_id, &inserted);
+    if (slot == NULL) {
+        return NULL;
+    }
+    if (!inserted) {
+        return &engine->masters[*slot];
+    }
+    if (reserve_one((void**)&engine->masters, &engine->master_capacity, engine->master_count, sizeof(ptp_offset_master_t)) != 0) {
+        hash_table_remove(&engine->master_index, master_id, NULL);
+        return NULL;
+    }
+    ptp_offset_master_t* master = &engine->masters[engine->master_count];
+    memset(master, 0, sizeof(*master));
+    master->clock_id = master_id;
+    hdr_histogram_init(&master->sync_interval);
+    *slot = engine->master_count++;
+    return master;
+}
+
+// A master/slave pair looked up in the pair index
+typedef struct {
+    const ptp_offset_engine_t* engine;
+    uint64_t master_id;
+    uint64_t slave_id;
+} pair_lookup_t;
+
+static int pair_matches(const void* context, uint64_t value) {
+    const pair_lookup_t* lookup = (const pair_lookup_t*)context;
+    const ptp_offset_pair_t* pair = &lookup->engine->pairs[value];
+    return pair->master_id == lookup->master_id && pair->slave_id == lookup->slave_id;
+}
+
+/*
+ * Finds the statistics of a master/slave pair, adding empty ones if the pair is new.
+ * The pair index is keyed by a mix of both identities and compares them in full.
+ * @return The pair, or NULL on memory allocation failure.
+ */
+static ptp_offset_pair_t* get_pair(ptp_offset_engine_t* engine, uint64_t master_id, uint64_t slave_id) {
+    uint64_t key = master_id * 0x9E3779B97F4A7C15ULL ^ slave_id;
+    pair_lookup_t lookup = { engine, master_id, slave_id };
+    hash_key_match_t match = { pair_matches, &lookup };
+    uint64_t* slot = hash_table_find_match(&engine->pair_index, key, &match);
+    if (slot != NULL) {
+        return &engine->pairs[*slot];
+    }
+
+    if (reserve_one((void**)&engine->pairs, &engine->pair_capacity, engine->pair_count, sizeof(ptp_offset_pair_t)) != 0 ||
+        hash_table_add(&engine->pair_index, key, engine->pair_count) == NULL) {
+        return NULL;
+    }
+    ptp_offset_pair_t* pair = &engine->pairs[engine->pair_count++];
+    memset(pair, 0, sizeof(*pair));
+    pair->master_id = master_id;
+    pair->slave_id = slave_id;
+    pair->min_offset = pair->min_delay = INT64_MAX;
+    pair->max_offset = pair->max_delay = INT64_MIN;
+    hdr_histogram_init(&pair->offset_histogram);
+    hdr_histogram_init(&pair->delay_histogram);
+    allan_init(&pair->stability, engine->defer_stability);
+    return pair;
+}
+
+/*
+ * Narrows a 128-bit scaled time to int64, saturating.
+ */
+static int64_t saturate(__int128 value) {
+    if (value > INT64_MAX) {
+        return INT64_MAX;
+    }
+    if (value < INT64_MIN) {
+        return INT64_MIN;
+    }
+    return (int64_t)value;
+}
+
+/*
+ * Pairs a delay measurement with a master's Sync and accumulates the result:
+ *   master-to-slave  = (t2 - t1) - correction(Sync, Follow_Up)
+ *   slave-to-master  = (t4 - t3) - correction(Delay_Resp)
+ *   meanPathDelay    = (master-to-slave + slave-to-master) / 2
+ *   offsetFromMaster = (master-to-slave - slave-to-master) / 2
+ * @return The updated pair, or NULL on memory allocation failure.
+ */
+static ptp_offset_pair_t* apply_sample(ptp_offset_engine_t* engine, const ptp_offset_master_t* master, const ptp_delay_sample_t* sample) {
+    ptp_offset_pair_t* pair = get_pair(engine, master->clock_id, sample->slave_id);
+    if (pair == NULL) {
+        return NULL;
+    }
+
+    const __int128 scale = (__int128)1 << PTP_SCALED_NS_SHIFT;
+    __int128 master_to_slave = ((__int128)master->capture_ns - master->origin_ns) * scale - master->correction;
+    __int128 slave_to_master = ((__int128)sample->receive_ns - sample->request_capture_ns) * scale - sample->correction;
+    int64_t delay = saturate((master_to_slave + slave_to_master) / 2);
+    int64_t offset = saturate((master_to_slave - slave_to_master) / 2);
+    if (hdr_histogram_record(&pair->offset_histogram, offset) != 0 || hdr_histogram_record(&pair->delay_histogram, delay) != 0 ||
+        allan_add(&pair->stability, sample->request_capture_ns, offset) != 0) {
+        return NULL;
+    }
+
+    pair->samples++;
+    pair->last_offset = offset;
+    pair->last_delay = delay;
+    pair->offset_sum += offset;
+    pair->delay_sum += delay;
+    if (offset < pair->min_offset) {
+        pair->min_offset = offset;
+    }
+    if (offset > pair->max_offset) {
+        pair->max_offset = offset;
+    }
+    if (delay < pair->min_delay) {
+        pair->min_delay = delay;
+    }
+    if (delay > pair->max_delay) {
+        pair->max_delay = delay;
+    }
+    return pair;
+}
+
+/*
+ * Records the capture time between two completed Syncs of a master, in scaled nanoseconds.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+static int record_sync_interval(ptp_offset_master_t* master, int64_t capture_ns) {
+    __int128 interval = ((__int128)capture_ns - master->capture_ns) * ((__int128)1 << PTP_SCALED_NS_SHIFT);
+    return hdr_histogram_record(&master->sync_interval, saturate(interval));
+}
+
+/*
+ * Records a completed two-step Sync/Follow_Up exchange as the master's latest.
+ * @param engine The engine.
+ * @param master_id Clock identity of the master.
+ * @param origin_ns preciseOriginTimestamp of the Follow_Up (t1).
+ * @param capture_ns Capture time of the Sync (t2).
+ * @param correction Sum of the Sync and Follow_Up correctionFields.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int ptp_offset_record_sync(ptp_offset_engine_t* engine, uint64_t master_id, int64_t origin_ns, int64_t capture_ns, int64_t correction) {
+    ptp_offset_master_t* master = get_master(engine, master_id);
+    if (master == NULL) {
+        return -1;
+    }
+    if (!master->has_sync) {
+        master->first_capture_ns = capture_ns;
+    } else if (record_sync_interval(master, capture_ns) != 0) {
+        return -1;
+    }
+    master->has_sync = 1;
+    master->origin_ns = origin_ns;
+    master->capture_ns = capture_ns;
+    master->correction = correction;
+    return 0;
+}
+
+/*
+ * Records a completed Delay_Req/Delay_Resp exchange and computes its offset and mean
+ * path delay against the responding master's latest Sync.
+ * @param engine The engine.
+ * @param master_id Clock identity of the master that sent the Delay_Resp.
+ * @param sample The slave's delay measurement.
+ * @param pair_out Set to the pair's statistics when a result was computed, else NULL; may be NULL.
+ * @return 0 on success (including when no Sync was available), -1 on memory allocation failure.
+ */
+int ptp_offset_record_delay(ptp_offset_engine_t* engine, uint64_t master_id, const ptp_delay_sample_t* sample, const ptp_offset_pair_t** pair_out) {
+    if (pair_out != NULL) {
+        *pair_out = NULL;
+    }
+    ptp_offset_master_t* master = get_master(engine, master_id);
+    if (master == NULL) {
+        return -1;
+    }
+    if (!master->has_sync) {
+        if (engine->defer_unmatched && master->pending_count < PTP_OFFSET_PENDING_MAX) {
+            master->pending[master->pending_count++] = *sample;
+        } else {
+            engine->unmatched++;
+        }
+        return 0;
+    }
+
+    const ptp_offset_pair_t* pair = apply_sample(engine, master, sample);
+    if (pair == NULL) {
+        return -1;
+    }
+    if (pair_out != NULL) {
+        *pair_out = pair;
+    }
+    return 0;
+}
+
+/*
+ * Merges the results of src into dst. Engines must be merged in capture order (dst
+ * holds the earlier part): delay exchanges src kept back are paired with dst's latest
+ * Sync of their master, the interval from that Sync to src's first is recorded,
+ * src's latest Syncs replace dst's, and src's offset series continue dst's.
+ * @param dst The engine receiving the results.
+ * @param src The engine to merge from; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int ptp_offset_merge(ptp_offset_engine_t* dst, const ptp_offset_engine_t* src) {
+    for (size_t i = 0; i < src->master_count; i++) {
+        const ptp_offset_master_t* part = &src->masters[i];
+        ptp_offset_master_t* master = get_master(dst, part->clock_id);
+        if (master == NULL) {
+            return -1;
+        }
+        for (uint32_t p = 0; p < part->pending_count; p++) {
+            if (ptp_offset_record_delay(dst, part->clock_id, &part->pending[p], NULL) != 0) {
+                return -1;
+            }
+        }
+        if (hdr_histogram_merge(&master->sync_interval, &part->sync_interval) != 0) {
+            return -1;
+        }
+        if (part->has_sync) {
+            if (!master->has_sync) {
+                master->first_capture_ns = part->first_capture_ns;
+            } else if (record_sync_interval(master, part->first_capture_ns) != 0) {
+                return -1;
+            }
+            master->has_sync = 1;
+            master->origin_ns = part->origin_ns;
+            master->capture_ns = part->capture_ns;
+            master->correction = part->correction;
+        }
+    }
+
+    for (size_t i = 0; i < src->pair_count; i++) {
+        const ptp_offset_pair_t* part = &src->pairs[i];
+        ptp_offset_pair_t* pair = get_pair(dst, part->master_id, part->slave_id);
+        if (pair == NULL) {
+            return -1;
+        }
+        pair->samples += part->samples;
+        pair->last_offset = part->last_offset;
+        pair->last_delay = part->last_delay;
+        pair->offset_sum += part->offset_sum;
+        pair->delay_sum += part->delay_sum;
+        if (hdr_histogram_merge(&pair->offset_histogram, &part->offset_histogram) != 0 ||
+            hdr_histogram_merge(&pair->delay_histogram, &part->delay_histogram) != 0 ||
+            allan_merge(&pair->stability, &part->stability) != 0) {
+            return -1;
+        }
+        if (part->min_offset < pair->min_offset) {
+            pair->min_offset = part->min_offset;
+        }
+        if (part->max_offset > pair->max_offset) {
+            pair->max_offset = part->max_offset;
+        }
+        if (part->min_delay < pair->min_delay) {
+            pair->min_delay = part->min_delay;
+        }
+        if (part->max_delay > pair->max_delay) {
+            pair->max_delay = part->max_delay;
+        }
+    }
+    dst->unmatched += src->unmatched;
+    return 0;
+}
+
+/*
+ * @param pair The pair.
+ * @param delay Nonzero for the mean path delay, zero for the mean offset.
+ * @return The mean in scaled nanoseconds, 0 without samples.
+ */
+int64_t ptp_offset_mean(const ptp_offset_pair_t* pair, int delay) {
+    if (pair->samples == 0) {
+        return 0;
+    }
+    return saturate((delay ? pair->delay_sum : pair->offset_sum) / (__int128)pair->samples);
+}
+
+/*
+ * Formats scaled nanoseconds as decimal nanoseconds with three fractional digits
+ * (truncated toward zero), e.g. "-12.500".
+ * @return The number of characters written, as snprintf.
+ */
+int ptp_scaled_ns_format(int64_t scaled, char* buffer, size_t size) {
+    uint64_t magnitude = scaled < 0 ? -(uint64_t)scaled : (uint64_t)scaled;
+    uint64_t whole = magnitude >> PTP_SCALED_NS_SHIFT;
+    uint64_t millis = ((magnitude & ((1u << PTP_SCALED_NS_SHIFT) - 1)) * 1000) >> PTP_SCALED_NS_SHIFT;
+    return snprintf(buffer, size, "%s%llu.%03llu", scaled < 0 ? "-" : "", (unsigned long long)whole, (unsigned long long)millis);
+}
+
+/*
+ * Prints the offset, path delay and stability of every master -> slave pair, the Sync
+ * interval of every master and the delay exchanges that had no Sync to pair with.
+ * @param engine The engine.
+ */
+void ptp_offset_print(const ptp_offset_engine_t* engine) {
+    for (size_t i = 0; i < engine->pair_count; i++) {
+        const ptp_offset_pair_t* pair = &engine->pairs[i];
+        char mean_offset[32], min_offset[32], max_offset[32], mean_delay[32], min_delay[32], max_delay[32];
+        ptp_scaled_ns_format(ptp_offset_mean(pair, 0), mean_offset, sizeof(mean_offset));
+        ptp_scaled_ns_format(pair->min_offset, min_offset, sizeof(min_offset));
+        ptp_scaled_ns_format(pair->max_offset, max_offset, sizeof(max_offset));
+        ptp_scaled_ns_format(ptp_offset_mean(pair, 1), mean_delay, sizeof(mean_delay));
+        ptp_scaled_ns_format(pair->min_delay, min_delay, sizeof(min_delay));
+        ptp_scaled_ns_format(pair->max_delay, max_delay, sizeof(max_delay));
+        printf("E2E master 0x%016llx -> slave 0x%016llx: %llu samples\n",
+               (unsigned long long)pair->master_id, (unsigned long long)pair->slave_id, (unsigned long long)pair->samples);
+        printf("    offset from master ns: mean %s, min %s, max %s\n", mean_offset, min_offset, max_offset);
+        printf("    mean path delay ns:    mean %s, min %s, max %s\n", mean_delay, min_delay, max_delay);
+        histogram_print_percentiles("    offset from master:    ", &pair->offset_histogram);
+        histogram_print_percentiles("    mean path delay:       ", &pair->delay_histogram);
+        allan_point_t point;
+        for (uint32_t level = 0; allan_point(&pair->stability, level, 1.0 / (1 << PTP_SCALED_NS_SHIFT), &point) == 0; level++) {
+            if (level == 0) {
+                printf("    offset stability:      tau s, ADEV, MDEV, TDEV ns\n");
+            }
+            printf("        tau %14.6f  ADEV %.3e  MDEV %.3e  TDEV %12.3f  (%llu terms)\n",
+                   point.tau_ns / 1e9, point.adev, point.mdev, point.tdev_ns, (unsigned long long)point.terms);
+        }
+    }
+    for (size_t i = 0; i < engine->master_count; i++) {
+        const ptp_offset_master_t* master = &engine->masters[i];
+        if (master->sync_interval.total != 0) {
+            char label[96];
+            snprintf(label, sizeof(label), "Sync interval from master 0x%016llx: %llu intervals, ",
+                     (unsigned long long)master->clock_id, (unsigned long long)master->sync_interval.total);
+            histogram_print_percentiles(label, &master->sync_interval);
+        }
+    }
+    if (engine->unmatched != 0) {
+        printf("E2E delay exchanges without a preceding Sync: %llu\n", (unsigned long long)engine->unmatched);
+    }
+}
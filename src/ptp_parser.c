@@ -2,312 +2,324 @@
 #include "../include/utils.h"
 #include "../include/clock_map.h" 
 #include "../include/gptp_validator.h" 
+#include "../include/pipeline.h"
+#include "../include/profile.h"
 #include <stdio.h>
 #include <string.h> // For memcpy
 
+// Returns the name of a PTP message type, or "Unknown".
+const char* ptp_message_type_name(ptp_message_type_t messageType) {
+    switch (messageType) {
+        case PTP_MESSAGE_SYNC: return "Sync";
+        case PTP_MESSAGE_DELAY_REQ: return "Delay_Req";
+        case PTP_MESSAGE_PDELAY_REQ: return "Pdelay_Req";
+        case PTP_MESSAGE_PDELAY_RESP: return "Pdelay_Resp";
+        case PTP_MESSAGE_FOLLOW_UP: return "Follow_Up";
+        case PTP_MESSAGE_DELAY_RESP: return "Delay_Resp";
+        case PTP_MESSAGE_PDELAY_RESP_FOLLOW_UP: return "Pdelay_Resp_Follow_Up";
+        case PTP_MESSAGE_ANNOUNCE: return "Announce";
+        case PTP_MESSAGE_SIGNALING: return "Signaling";
+        case PTP_MESSAGE_MANAGEMENT: return "Management";
+        default: return "Unknown";
+    }
+}
+
+// Writes a port identity as the clock identity in hex, a colon and the port number in hex.
+static void print_port_identity(output_t* out, const uint8_t* port_identity) {
+    output_hex_bytes(out, port_identity, 8, '\0', 0);
+    output_char(out, ':');
+    output_hex(out, ((uint16_t)port_identity[8] << 8) | port_identity[9], 4, 0);
+}
+
+// Writes a "(seconds)" and "(nanoseconds)" line pair for a PTP timestamp field.
+static void print_timestamp(output_t* out, const char* name, uint64_t seconds, uint32_t nanoseconds) {
+    output_str(out, "            ");
+    output_str(out, name);
+    output_str(out, " (seconds): ");
+    output_uint(out, seconds);
+    output_str(out, "\n            ");
+    output_str(out, name);
+    output_str(out, " (nanoseconds): ");
+    output_uint(out, nanoseconds);
+    output_char(out, '\n');
+}
+
 // Prints common PTP header information.
-static void print_common_ptp_header_info(const ptp_common_header_t* header) {
+static void print_common_ptp_header_info(output_t* out, const ptp_common_header_t* header) {
     uint8_t transportSpecific = (header->transportSpecific_messageType >> 4) & 0x0F;
     ptp_message_type_t messageType = header->transportSpecific_messageType & 0x0F;
     uint8_t versionPTP = (header->versionPTP_reserved >> 4) & 0x0F;
 
-    char port_identity_str[22]; 
-    snprintf(port_identity_str, sizeof(port_identity_str), "%02x%02x%02x%02x%02x%02x%02x%02x:%04x",
-             header->sourcePortIdentity[0], header->sourcePortIdentity[1],
-             header->sourcePortIdentity[2], header->sourcePortIdentity[3],
-             header->sourcePortIdentity[4], header->sourcePortIdentity[5],
-             header->sourcePortIdentity[6], header->sourcePortIdentity[7],
-             (header->sourcePortIdentity[8] << 8) | header->sourcePortIdentity[9]);
-
-
-    printf("        PTP Common Header:\n");
-    printf("            Transport Specific: 0x%x\n", transportSpecific);
-    printf("            Message Type: 0x%x (%s)\n", messageType,
-           messageType == PTP_MESSAGE_SYNC ? "Sync" :
-           messageType == PTP_MESSAGE_DELAY_REQ ? "Delay_Req" :
-           messageType == PTP_MESSAGE_PDELAY_REQ ? "Pdelay_Req" :
-           messageType == PTP_MESSAGE_PDELAY_RESP ? "Pdelay_Resp" :
-           messageType == PTP_MESSAGE_FOLLOW_UP ? "Follow_Up" :
-           messageType == PTP_MESSAGE_DELAY_RESP ? "Delay_Resp" :
-           messageType == PTP_MESSAGE_PDELAY_RESP_FOLLOW_UP ? "Pdelay_Resp_Follow_Up" :
-           messageType == PTP_MESSAGE_ANNOUNCE ? "Announce" :
-           messageType == PTP_MESSAGE_SIGNALING ? "Signaling" :
-           messageType == PTP_MESSAGE_MANAGEMENT ? "Management" : "Unknown");
-    printf("            Version PTP: %d\n", versionPTP);
-    printf("            Message Length: %u\n", header->messageLength);
-    printf("            Domain Number: %d\n", header->domainNumber);
-    printf("            Flags: 0x%04x\n", header->flags);
-    printf("            Correction Field: %llu\n", (unsigned long long)header->correctionField);
-    printf("            Source Port Identity: %s\n", port_identity_str);
-    printf("            Sequence ID: %u\n", header->sequenceId);
-    printf("            Control Field: %d\n", header->controlField);
-    printf("            Log Message Interval: %d\n", header->logMessageInterval);
+    output_str(out, "        PTP Common Header:\n            Transport Specific: 0x");
+    output_hex(out, transportSpecific, 1, 0);
+    output_str(out, "\n            Message Type: 0x");
+    output_hex(out, messageType, 1, 0);
+    output_str(out, " (");
+    output_str(out, ptp_message_type_name(messageType));
+    output_str(out, ")\n            Version PTP: ");
+    output_uint(out, versionPTP);
+    output_str(out, "\n            Message Length: ");
+    output_uint(out, header->messageLength);
+    output_str(out, "\n            Domain Number: ");
+    output_uint(out, header->domainNumber);
+    output_str(out, "\n            Flags: 0x");
+    output_hex(out, header->flags, 4, 0);
+    output_str(out, "\n            Correction Field: ");
+    output_uint(out, header->correctionField);
+    output_str(out, "\n            Source Port Identity: ");
+    print_port_identity(out, header->sourcePortIdentity);
+    output_str(out, "\n            Sequence ID: ");
+    output_uint(out, header->sequenceId);
+    output_str(out, "\n            Control Field: ");
+    output_uint(out, header->controlField);
+    output_str(out, "\n            Log Message Interval: ");
+    output_int(out, header->logMessageInterval);
+    output_char(out, '\n');
+}
+
+// Decodes a PTP timestamp (48-bit seconds, 32-bit nanoseconds, network byte order).
+static void read_timestamp(const uint8_t* bytes, uint64_t* seconds, uint32_t* nanoseconds) {
+    *seconds = ((uint64_t)read_be16(bytes) << 32) | read_be32(bytes + 2);
+    *nanoseconds = read_be32(bytes + 6);
+}
+
+// Counts and reports a message too short for its body. Returns 1 if it was.
+static int check_body_length(file_context_t* file_ctx, uint32_t data_length, uint32_t body_length, const char* name) {
+    if (data_length >= PTP_HEADER_WIRE_LENGTH + body_length) {
+        return 0;
+    }
+    file_ctx->stats->malformed[RUN_STATS_SHORT_PTP_MESSAGE]++;
+    fprintf(stderr, "Truncated PTP %s message\n", name);
+    return 1;
 }
 
 // Processes PTP Sync messages.
 static void process_sync_message(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length) {
-    if (data_length < sizeof(ptp_common_header_t) + 10) { 
-        fprintf(stderr, "Truncated PTP Sync message\n");
+    if (check_body_length(file_ctx, data_length, PTP_SYNC_BODY_LENGTH, "Sync")) {
         return;
     }
 
     ptp_sync_message_t sync_message;
-    memcpy(&sync_message.header, packet_data, sizeof(ptp_common_header_t));
+    read_timestamp(packet_data + PTP_HEADER_WIRE_LENGTH, &sync_message.originTimestamp_seconds, &sync_message.originTimestamp_nanoseconds);
 
-    uint32_t offset = sizeof(ptp_common_header_t);
-    sync_message.originTimestamp_seconds = bytes_to_uint48(packet_data + offset, file_ctx->swap_bytes);
-    offset += 6; 
-    sync_message.originTimestamp_nanoseconds = BYTES_TO_UINT32(packet_data + offset, file_ctx->swap_bytes);
-
-    printf("        PTP Sync Message:\n");
-    printf("            Origin Timestamp (seconds): %llu\n", (unsigned long long)sync_message.originTimestamp_seconds);
-    printf("            Origin Timestamp (nanoseconds): %u\n", sync_message.originTimestamp_nanoseconds);
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "        PTP Sync Message:\n");
+        print_timestamp(file_ctx->out, "Origin Timestamp", sync_message.originTimestamp_seconds, sync_message.originTimestamp_nanoseconds);
+    }
 }
 
 
 // Processes PTP Follow_Up messages.
 static void process_follow_up_message(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length) {
-    if (data_length < sizeof(ptp_common_header_t) + 10) { 
-        fprintf(stderr, "Truncated PTP Follow_Up message\n");
+    if (check_body_length(file_ctx, data_length, PTP_FOLLOW_UP_BODY_LENGTH, "Follow_Up")) {
         return;
     }
 
     ptp_follow_up_message_t follow_up_message;
-    memcpy(&follow_up_message.header, packet_data, sizeof(ptp_common_header_t));
+    read_timestamp(packet_data + PTP_HEADER_WIRE_LENGTH, &follow_up_message.preciseOriginTimestamp_seconds,
+                   &follow_up_message.preciseOriginTimestamp_nanoseconds);
 
-    uint32_t offset = sizeof(ptp_common_header_t);
-    follow_up_message.preciseOriginTimestamp_seconds = bytes_to_uint48(packet_data + offset, file_ctx->swap_bytes);
-    offset += 6; 
-    follow_up_message.preciseOriginTimestamp_nanoseconds = BYTES_TO_UINT32(packet_data + offset, file_ctx->swap_bytes);
-
-    printf("        PTP Follow_Up Message:\n");
-    printf("            Precise Origin Timestamp (seconds): %llu\n", (unsigned long long)follow_up_message.preciseOriginTimestamp_seconds);
-    printf("            Precise Origin Timestamp (nanoseconds): %u\n", follow_up_message.preciseOriginTimestamp_nanoseconds);
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "        PTP Follow_Up Message:\n");
+        print_timestamp(file_ctx->out, "Precise Origin Timestamp", follow_up_message.preciseOriginTimestamp_seconds, follow_up_message.preciseOriginTimestamp_nanoseconds);
+    }
 }
 
 // Processes PTP Pdelay_Req messages.
 static void process_pdelay_req_message(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length) {
-    if (data_length < sizeof(ptp_common_header_t) + 10) { 
-        fprintf(stderr, "Truncated PTP Pdelay_Req message\n");
+    if (check_body_length(file_ctx, data_length, PTP_PDELAY_REQ_BODY_LENGTH, "Pdelay_Req")) {
         return;
     }
 
     ptp_pdelay_req_message_t pdelay_req_message;
-    memcpy(&pdelay_req_message.header, packet_data, sizeof(ptp_common_header_t));
+    read_timestamp(packet_data + PTP_HEADER_WIRE_LENGTH, &pdelay_req_message.originTimestamp_seconds, &pdelay_req_message.originTimestamp_nanoseconds);
 
-    uint32_t offset = sizeof(ptp_common_header_t);
-    pdelay_req_message.originTimestamp_seconds = bytes_to_uint48(packet_data + offset, file_ctx->swap_bytes);
-    offset += 6; 
-    pdelay_req_message.originTimestamp_nanoseconds = BYTES_TO_UINT32(packet_data + offset, file_ctx->swap_bytes);
-
-    printf("        PTP Pdelay_Req Message:\n");
-    printf("            Origin Timestamp (seconds): %llu\n", (unsigned long long)pdelay_req_message.originTimestamp_seconds);
-    printf("            Origin Timestamp (nanoseconds): %u\n", pdelay_req_message.originTimestamp_nanoseconds);
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "        PTP Pdelay_Req Message:\n");
+        print_timestamp(file_ctx->out, "Origin Timestamp", pdelay_req_message.originTimestamp_seconds, pdelay_req_message.originTimestamp_nanoseconds);
+    }
 }
 
 // Processes PTP Pdelay_Resp messages.
 static void process_pdelay_resp_message(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length) {
-    if (data_length < sizeof(ptp_common_header_t) + 20) { 
-        fprintf(stderr, "Truncated PTP Pdelay_Resp message\n");
+    if (check_body_length(file_ctx, data_length, PTP_PDELAY_RESP_BODY_LENGTH, "Pdelay_Resp")) {
         return;
     }
 
     ptp_pdelay_resp_message_t pdelay_resp_message;
-    memcpy(&pdelay_resp_message.header, packet_data, sizeof(ptp_common_header_t));
-
-    uint32_t offset = sizeof(ptp_common_header_t);
-    pdelay_resp_message.requestReceiptTimestamp_seconds = bytes_to_uint48(packet_data + offset, file_ctx->swap_bytes);
-    offset += 6; 
-    pdelay_resp_message.requestReceiptTimestamp_nanoseconds = BYTES_TO_UINT32(packet_data + offset, file_ctx->swap_bytes);
-    offset += 4; 
-
-    memcpy(pdelay_resp_message.requestingPortIdentity, packet_data + offset, 10);
-
-    char requesting_port_identity_str[22]; 
-    snprintf(requesting_port_identity_str, sizeof(requesting_port_identity_str), "%02x%02x%02x%02x%02x%02x%02x%02x:%04x",
-             pdelay_resp_message.requestingPortIdentity[0], pdelay_resp_message.requestingPortIdentity[1],
-             pdelay_resp_message.requestingPortIdentity[2], pdelay_resp_message.requestingPortIdentity[3],
-             pdelay_resp_message.requestingPortIdentity[4], pdelay_resp_message.requestingPortIdentity[5],
-             pdelay_resp_message.requestingPortIdentity[6], pdelay_resp_message.requestingPortIdentity[7],
-             (pdelay_resp_message.requestingPortIdentity[8] << 8) | pdelay_resp_message.requestingPortIdentity[9]);
-
-    printf("        PTP Pdelay_Resp Message:\n");
-    printf("            Request Receipt Timestamp (seconds): %llu\n", (unsigned long long)pdelay_resp_message.requestReceiptTimestamp_seconds);
-    printf("            Request Receipt Timestamp (nanoseconds): %u\n", pdelay_resp_message.requestReceiptTimestamp_nanoseconds);
-    printf("            Requesting Port Identity: %s\n", requesting_port_identity_str);
+    const uint8_t* body = packet_data + PTP_HEADER_WIRE_LENGTH;
+    read_timestamp(body, &pdelay_resp_message.requestReceiptTimestamp_seconds, &pdelay_resp_message.requestReceiptTimestamp_nanoseconds);
+    memcpy(pdelay_resp_message.requestingPortIdentity, body + PTP_TIMESTAMP_LENGTH, PTP_PORT_IDENTITY_LENGTH);
+
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "        PTP Pdelay_Resp Message:\n");
+        print_timestamp(file_ctx->out, "Request Receipt Timestamp", pdelay_resp_message.requestReceiptTimestamp_seconds, pdelay_resp_message.requestReceiptTimestamp_nanoseconds);
+        output_str(file_ctx->out, "            Requesting Port Identity: ");
+        print_port_identity(file_ctx->out, pdelay_resp_message.requestingPortIdentity);
+        output_char(file_ctx->out, '\n');
+    }
 }
 
 
 // Processes PTP Pdelay_Resp_Follow_Up messages.
 static void process_pdelay_resp_follow_up_message(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length) {
-    if (data_length < sizeof(ptp_common_header_t) + 20) { 
-        fprintf(stderr, "Truncated PTP Pdelay_Resp_Follow_Up message\n");
+    if (check_body_length(file_ctx, data_length, PTP_PDELAY_RESP_FOLLOW_UP_BODY_LENGTH, "Pdelay_Resp_Follow_Up")) {
         return;
     }
 
     ptp_pdelay_resp_follow_up_message_t pdelay_resp_follow_up_message;
-    memcpy(&pdelay_resp_follow_up_message.header, packet_data, sizeof(ptp_common_header_t));
-
-    uint32_t offset = sizeof(ptp_common_header_t);
-    pdelay_resp_follow_up_message.responseOriginTimestamp_seconds = bytes_to_uint48(packet_data + offset, file_ctx->swap_bytes);
-    offset += 6; 
-    pdelay_resp_follow_up_message.responseOriginTimestamp_nanoseconds = BYTES_TO_UINT32(packet_data + offset, file_ctx->swap_bytes);
-    offset += 4; 
-
-    memcpy(pdelay_resp_follow_up_message.requestingPortIdentity, packet_data + offset, 10);
-
-    char requesting_port_identity_str[22]; 
-    snprintf(requesting_port_identity_str, sizeof(requesting_port_identity_str), "%02x%02x%02x%02x%02x%02x%02x%02x:%04x",
-             pdelay_resp_follow_up_message.requestingPortIdentity[0], pdelay_resp_follow_up_message.requestingPortIdentity[1],
-             pdelay_resp_follow_up_message.requestingPortIdentity[2], pdelay_resp_follow_up_message.requestingPortIdentity[3],
-             pdelay_resp_follow_up_message.requestingPortIdentity[4], pdelay_resp_follow_up_message.requestingPortIdentity[5],
-             pdelay_resp_follow_up_message.requestingPortIdentity[6], pdelay_resp_follow_up_message.requestingPortIdentity[7],
-             (pdelay_resp_follow_up_message.requestingPortIdentity[8] << 8) | pdelay_resp_follow_up_message.requestingPortIdentity[9]);
-
-    printf("        PTP Pdelay_Resp_Follow_Up Message:\n");
-    printf("            Response Origin Timestamp (seconds): %llu\n", (unsigned long long)pdelay_resp_follow_up_message.responseOriginTimestamp_seconds);
-    printf("            Response Origin Timestamp (nanoseconds): %u\n", pdelay_resp_follow_up_message.responseOriginTimestamp_nanoseconds);
-    printf("            Requesting Port Identity: %s\n", requesting_port_identity_str);
+    const uint8_t* body = packet_data + PTP_HEADER_WIRE_LENGTH;
+    read_timestamp(body, &pdelay_resp_follow_up_message.responseOriginTimestamp_seconds,
+                   &pdelay_resp_follow_up_message.responseOriginTimestamp_nanoseconds);
+    memcpy(pdelay_resp_follow_up_message.requestingPortIdentity, body + PTP_TIMESTAMP_LENGTH, PTP_PORT_IDENTITY_LENGTH);
+
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "        PTP Pdelay_Resp_Follow_Up Message:\n");
+        print_timestamp(file_ctx->out, "Response Origin Timestamp", pdelay_resp_follow_up_message.responseOriginTimestamp_seconds, pdelay_resp_follow_up_message.responseOriginTimestamp_nanoseconds);
+        output_str(file_ctx->out, "            Requesting Port Identity: ");
+        print_port_identity(file_ctx->out, pdelay_resp_follow_up_message.requestingPortIdentity);
+        output_char(file_ctx->out, '\n');
+    }
 }
 
 // Processes PTP Delay_Req messages.
 static void process_delay_req_message(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length) {
-    if (data_length < sizeof(ptp_common_header_t) + 10) { 
-        fprintf(stderr, "Truncated PTP Delay_Req message\n");
+    if (check_body_length(file_ctx, data_length, PTP_DELAY_REQ_BODY_LENGTH, "Delay_Req")) {
         return;
     }
 
     ptp_delay_req_message_t delay_req_message;
-    memcpy(&delay_req_message.header, packet_data, sizeof(ptp_common_header_t));
-
-    uint32_t offset = sizeof(ptp_common_header_t);
-    delay_req_message.originTimestamp_seconds = bytes_to_uint48(packet_data + offset, file_ctx->swap_bytes);
-    offset += 6; 
-    delay_req_message.originTimestamp_nanoseconds = BYTES_TO_UINT32(packet_data + offset, file_ctx->swap_bytes);
+    read_timestamp(packet_data + PTP_HEADER_WIRE_LENGTH, &delay_req_message.originTimestamp_seconds, &delay_req_message.originTimestamp_nanoseconds);
 
-    printf("        PTP Delay_Req Message:\n");
-    printf("            Origin Timestamp (seconds): %llu\n", (unsigned long long)delay_req_message.originTimestamp_seconds);
-    printf("            Origin Timestamp (nanoseconds): %u\n", delay_req_message.originTimestamp_nanoseconds);
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "        PTP Delay_Req Message:\n");
+        print_timestamp(file_ctx->out, "Origin Timestamp", delay_req_message.originTimestamp_seconds, delay_req_message.originTimestamp_nanoseconds);
+    }
 }
 
 // Processes PTP Delay_Resp messages.
 static void process_delay_resp_message(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length) {
-    if (data_length < sizeof(ptp_common_header_t) + 20) { 
-        fprintf(stderr, "Truncated PTP Delay_Resp message\n");
+    if (check_body_length(file_ctx, data_length, PTP_DELAY_RESP_BODY_LENGTH, "Delay_Resp")) {
         return;
     }
 
     ptp_delay_resp_message_t delay_resp_message;
-    memcpy(&delay_resp_message.header, packet_data, sizeof(ptp_common_header_t));
-
-    uint32_t offset = sizeof(ptp_common_header_t);
-    delay_resp_message.receiveTimestamp_seconds = bytes_to_uint48(packet_data + offset, file_ctx->swap_bytes);
-    offset += 6; 
-    delay_resp_message.receiveTimestamp_nanoseconds = BYTES_TO_UINT32(packet_data + offset, file_ctx->swap_bytes);
-    offset += 4; 
-
-    memcpy(delay_resp_message.requestingPortIdentity, packet_data + offset, 10);
-
-    char requesting_port_identity_str[22]; 
-    snprintf(requesting_port_identity_str, sizeof(requesting_port_identity_str), "%02x%02x%02x%02x%02x%02x%02x%02x:%04x",
-             delay_resp_message.requestingPortIdentity[0], delay_resp_message.requestingPortIdentity[1],
-             delay_resp_message.requestingPortIdentity[2], delay_resp_message.requestingPortIdentity[3],
-             delay_resp_message.requestingPortIdentity[4], delay_resp_message.requestingPortIdentity[5],
-             delay_resp_message.requestingPortIdentity[6], delay_resp_message.requestingPortIdentity[7],
-             (delay_resp_message.requestingPortIdentity[8] << 8) | delay_resp_message.requestingPortIdentity[9]);
-
-    printf("        PTP Delay_Resp Message:\n");
-    printf("            Receive Timestamp (seconds): %llu\n", (unsigned long long)delay_resp_message.receiveTimestamp_seconds);
-    printf("            Receive Timestamp (nanoseconds): %u\n", delay_resp_message.receiveTimestamp_nanoseconds);
-    printf("            Requesting Port Identity: %s\n", requesting_port_identity_str);
+    const uint8_t* body = packet_data + PTP_HEADER_WIRE_LENGTH;
+    read_timestamp(body, &delay_resp_message.receiveTimestamp_seconds, &delay_resp_message.receiveTimestamp_nanoseconds);
+    memcpy(delay_resp_message.requestingPortIdentity, body + PTP_TIMESTAMP_LENGTH, PTP_PORT_IDENTITY_LENGTH);
+
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "        PTP Delay_Resp Message:\n");
+        print_timestamp(file_ctx->out, "Receive Timestamp", delay_resp_message.receiveTimestamp_seconds, delay_resp_message.receiveTimestamp_nanoseconds);
+        output_str(file_ctx->out, "            Requesting Port Identity: ");
+        print_port_identity(file_ctx->out, delay_resp_message.requestingPortIdentity);
+        output_char(file_ctx->out, '\n');
+    }
 }
 
-// Processes PTP Announce messages.
+// Processes PTP Announce messages. Body fields are read at their on-wire offsets.
 static void process_announce_message(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length) {
-    if (data_length < sizeof(ptp_common_header_t) + 30) { 
-        fprintf(stderr, "Truncated PTP Announce message\n");
+    if (check_body_length(file_ctx, data_length, PTP_ANNOUNCE_BODY_LENGTH, "Announce")) {
         return;
     }
 
     ptp_announce_message_t announce_message;
-    memcpy(&announce_message.header, packet_data, sizeof(ptp_common_header_t));
-
-    uint32_t offset = sizeof(ptp_common_header_t);
-    announce_message.originTimestamp_seconds = bytes_to_uint48(packet_data + offset, file_ctx->swap_bytes);
-    offset += 6;
-    announce_message.originTimestamp_nanoseconds = BYTES_TO_UINT32(packet_data + offset, file_ctx->swap_bytes);
-    offset += 4;
-    announce_message.currentUtcOffset = BYTES_TO_UINT16(packet_data + offset, file_ctx->swap_bytes);
-    offset += 2;
-    offset += 1; 
-    announce_message.grandmasterPriority1 = packet_data[offset++];
-    memcpy(announce_message.grandmasterClockQuality, packet_data + offset, 4);
-    offset += 4;
-    announce_message.grandmasterPriority2 = packet_data[offset++];
-    memcpy(announce_message.grandmasterIdentity, packet_data + offset, 8);
-    offset += 8;
-    announce_message.stepsRemoved = BYTES_TO_UINT16(packet_data + offset, file_ctx->swap_bytes);
-    announce_message.timeSource = packet_data[offset];
-
-    char grandmaster_identity_str[24];
-    snprintf(grandmaster_identity_str, sizeof(grandmaster_identity_str), "%02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x",
-        announce_message.grandmasterIdentity[0], announce_message.grandmasterIdentity[1],
-        announce_message.grandmasterIdentity[2], announce_message.grandmasterIdentity[3],
-        announce_message.grandmasterIdentity[4], announce_message.grandmasterIdentity[5],
-        announce_message.grandmasterIdentity[6], announce_message.grandmasterIdentity[7]);
-
-    printf("        PTP Announce Message:\n");
-    printf("            Origin Timestamp (seconds): %llu\n", (unsigned long long)announce_message.originTimestamp_seconds);
-    printf("            Origin Timestamp (nanoseconds): %u\n", announce_message.originTimestamp_nanoseconds);
-    printf("            Current UTC Offset: %d\n", announce_message.currentUtcOffset);
-    printf("            Grandmaster Priority 1: %u\n", announce_message.grandmasterPriority1);
-    printf("            Grandmaster Clock Quality: 0x%02x%02x%02x%02x\n",
-        announce_message.grandmasterClockQuality[0], announce_message.grandmasterClockQuality[1],
-        announce_message.grandmasterClockQuality[2], announce_message.grandmasterClockQuality[3]);
-    printf("            Grandmaster Priority 2: %u\n", announce_message.grandmasterPriority2);
-    printf("            Grandmaster Identity: %s\n", grandmaster_identity_str);
-    printf("            Steps Removed: %u\n", announce_message.stepsRemoved);
-    printf("            Time Source: 0x%x\n", announce_message.timeSource);
-
-    uint64_t grandmaster_id = 0;
-    uint64_t source_port_id = 0;
-    memcpy(&grandmaster_id, announce_message.grandmasterIdentity, sizeof(uint64_t));
-    memcpy(&source_port_id, announce_message.header.sourcePortIdentity, sizeof(uint64_t));
-
-    if (file_ctx->swap_bytes) {
-        grandmaster_id = swap_uint64(grandmaster_id);
-        source_port_id = swap_uint64(source_port_id);
+    const uint8_t* body = packet_data + PTP_HEADER_WIRE_LENGTH;
+    read_timestamp(body, &announce_message.originTimestamp_seconds, &announce_message.originTimestamp_nanoseconds);
+    announce_message.currentUtcOffset = read_be16(body + 10);
+    announce_message.grandmasterPriority1 = body[13];
+    memcpy(announce_message.grandmasterClockQuality, body + 14, 4);
+    announce_message.grandmasterPriority2 = body[18];
+    memcpy(announce_message.grandmasterIdentity, body + 19, 8);
+    announce_message.stepsRemoved = read_be16(body + 27);
+    announce_message.timeSource = body[29];
+
+    if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_t* out = file_ctx->out;
+        output_str(out, "        PTP Announce Message:\n");
+        print_timestamp(out, "Origin Timestamp", announce_message.originTimestamp_seconds, announce_message.originTimestamp_nanoseconds);
+        output_str(out, "            Current UTC Offset: ");
+        output_uint(out, announce_message.currentUtcOffset);
+        output_str(out, "\n            Grandmaster Priority 1: ");
+        output_uint(out, announce_message.grandmasterPriority1);
+        output_str(out, "\n            Grandmaster Clock Quality: 0x");
+        output_hex_bytes(out, announce_message.grandmasterClockQuality, 4, '\0', 0);
+        output_str(out, "\n            Grandmaster Priority 2: ");
+        output_uint(out, announce_message.grandmasterPriority2);
+        output_str(out, "\n            Grandmaster Identity: ");
+        output_hex_bytes(out, announce_message.grandmasterIdentity, 8, ':', 0);
+        output_str(out, "\n            Steps Removed: ");
+        output_uint(out, announce_message.stepsRemoved);
+        output_str(out, "\n            Time Source: 0x");
+        output_hex(out, announce_message.timeSource, 1, 0);
+        output_char(out, '\n');
     }
-    
-    if (clock_map_insert(&file_ctx->clock_map, grandmaster_id, source_port_id) != 0) {
+
+    record_clock_mapping(file_ctx, read_be64(announce_message.grandmasterIdentity), read_be64(packet_data + 20));
+}
+
+// Records a grandmaster -> source port mapping in the clock map.
+// Worker contexts defer the insertion so it is applied in capture order.
+void record_clock_mapping(file_context_t* file_ctx, uint64_t grandmaster_id, uint64_t source_port_id) {
+    if (file_ctx->batch != NULL) {
+        if (pipeline_defer_clock_mapping(file_ctx, grandmaster_id, source_port_id) != 0) {
+            fprintf(stderr, "Failed to defer clock map insertion.\n");
+        }
+        return;
+    }
+
+    PROFILE_SCOPE_BEGIN(clock_map_scope, PROFILE_STAGE_CLOCK_MAP);
+    int inserted = clock_map_insert(&file_ctx->clock_map, grandmaster_id, source_port_id);
+    PROFILE_SCOPE_END(clock_map_scope);
+    if (inserted != 0) {
         fprintf(stderr, "Failed to insert into clock map.\n");
-    } else {
-        printf("            Clock Map: Added Grandmaster ID %016llx -> Source Port ID %016llx\n", 
-               (unsigned long long)grandmaster_id, (unsigned long long)source_port_id);
+    } else if (file_ctx->verbosity == OUTPUT_VERBOSE) {
+        output_str(file_ctx->out, "            Clock Map: Added Grandmaster ID ");
+        output_hex(file_ctx->out, grandmaster_id, 16, 0);
+        output_str(file_ctx->out, " -> Source Port ID ");
+        output_hex(file_ctx->out, source_port_id, 16, 0);
+        output_char(file_ctx->out, '\n');
     }
 }
 
 
+// Decodes the common header from its on-wire offsets; multi-byte fields are in network byte order.
+static void read_common_header(const uint8_t* packet_data, ptp_common_header_t* header) {
+    memset(header, 0, sizeof(*header));
+    header->transportSpecific_messageType = packet_data[0];
+    header->versionPTP_reserved = packet_data[1];
+    header->messageLength = read_be16(packet_data + 2);
+    header->domainNumber = packet_data[4];
+    header->flags = read_be16(packet_data + 6);
+    header->correctionField = read_be64(packet_data + 8);
+    memcpy(header->sourcePortIdentity, packet_data + 20, PTP_PORT_IDENTITY_LENGTH);
+    header->sequenceId = read_be16(packet_data + 30);
+    header->controlField = packet_data[32];
+    header->logMessageInterval = (int8_t)packet_data[33];
+}
+
 // Processes PTP header and dispatches to specific message handlers.
 void process_ptp_header(file_context_t* file_ctx, const uint8_t* packet_data, uint32_t data_length, const uint8_t* eth_src_mac, const uint8_t* eth_dst_mac) {
-    if (data_length < sizeof(ptp_common_header_t)) {
+    if (data_length < PTP_HEADER_WIRE_LENGTH) {
+        file_ctx->stats->malformed[RUN_STATS_SHORT_PTP_HEADER]++;
         fprintf(stderr, "Truncated PTP common header\n");
         return;
     }
 
     ptp_common_header_t common_header;
-    memcpy(&common_header, packet_data, sizeof(ptp_common_header_t));
+    read_common_header(packet_data, &common_header);
 
-    if (file_ctx->swap_bytes) {
-        common_header.messageLength = swap_uint16(common_header.messageLength);
-        common_header.flags = swap_uint16(common_header.flags);
-        common_header.correctionField = swap_uint64(common_header.correctionField);
-        common_header.sequenceId = swap_uint16(common_header.sequenceId);
-    }
+    file_ctx->stats->ptp_messages[common_header.transportSpecific_messageType & 0x0F]++;
+    file_ctx->stats->domains[common_header.domainNumber]++;
 
-    print_common_ptp_header_info(&common_header);
+    int verbose = file_ctx->verbosity == OUTPUT_VERBOSE;
+    if (verbose) {
+        print_common_ptp_header_info(file_ctx->out, &common_header);
+    }
 
-    process_gptp_message(file_ctx, &common_header, packet_data, data_length, eth_src_mac, eth_dst_mac);
+    PROFILE_SCOPE_BEGIN(gptp_scope, PROFILE_STAGE_GPTP);
+    process_gptp_message(file_ctx, &common_header, file_ctx->packet_ts_ns, packet_data, data_length, eth_src_mac, eth_dst_mac);
+    PROFILE_SCOPE_END(gptp_scope);
 
     ptp_message_type_t messageType = common_header.transportSpecific_messageType & 0x0F;
 
@@ -338,10 +350,18 @@ void process_ptp_header(file_context_t* file_ctx, const uint8_t* packet_data, ui
             break;
         case PTP_MESSAGE_SIGNALING:
         case PTP_MESSAGE_MANAGEMENT:
-            printf("        PTP Message Type 0x%x parsing not yet implemented.\n", messageType);
+            if (verbose) {
+                output_str(file_ctx->out, "        PTP Message Type 0x");
+                output_hex(file_ctx->out, messageType, 1, 0);
+                output_str(file_ctx->out, " parsing not yet implemented.\n");
+            }
             break;
         default:
-            printf("        Unknown PTP Message Type 0x%x\n", messageType);
+            if (verbose) {
+                output_str(file_ctx->out, "        Unknown PTP Message Type 0x");
+                output_hex(file_ctx->out, messageType, 1, 0);
+                output_char(file_ctx->out, '\n');
+            }
             break;
     }
 }
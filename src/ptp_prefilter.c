@@ -0,0 +1,270 @@
+// Classifies batches of frames as PTP or not, several frames per instruction.
+//
+// The 16-bit header words the decision depends on (EtherType, the IPv4/IPv6 fields and
+// the UDP destination port) are gathered from each frame into one array per word, so
+// that lane i of every vector belongs to frame i. A VLAN tag shifts every later field by
+// four bytes; the gather applies that shift per frame, so the kernels evaluate the rules
+// of locate_frame_layers() for a single layout with compares instead of branches. IPv4
+// headers with options move the UDP header, so those lanes are flagged and resolved by
+// the scalar path; the result is always identical to frame_is_ptp() on each frame.
+
+#include "../include/ptp_prefilter.h"
+#include "../include/ethernet.h"
+#include "../include/ip.h"
+#include "../include/utils.h"
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PTP_PREFILTER_X86 1
+#include <immintrin.h>
+#endif
+
+/* Header words of a batch, one array per field, padded to a whole AVX2 vector */
+typedef struct {
+    _Alignas(32) uint16_t length[PTP_PREFILTER_BATCH];      // Captured length after the VLAN tag, saturated to 16 bits
+    _Alignas(32) uint16_t ethertype[PTP_PREFILTER_BATCH];   // EtherType, behind the VLAN tag if any (offset 12)
+    _Alignas(32) uint16_t version_ihl[PTP_PREFILTER_BATCH]; // IPv4 version/IHL and TOS (offset 14)
+    _Alignas(32) uint16_t fragment[PTP_PREFILTER_BATCH];    // IPv4 flags/fragment offset, IPv6 next header/hop limit (offset 20)
+    _Alignas(32) uint16_t protocol[PTP_PREFILTER_BATCH];    // IPv4 TTL/protocol (offset 22)
+    _Alignas(32) uint16_t port4[PTP_PREFILTER_BATCH];       // UDP destination port over IPv4 without options (offset 36)
+    _Alignas(32) uint16_t port6[PTP_PREFILTER_BATCH];       // UDP destination port over IPv6 (offset 56)
+} prefilter_words_t;
+
+/* Reads a big-endian 16-bit word */
+static inline uint16_t prefilter_word(const uint8_t* bytes) {
+    uint16_t word;
+    memcpy(&word, bytes, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap16(word);
+#else
+    return is_little_endian() ? __builtin_bswap16(word) : word;
+#endif
+}
+
+/*
+ * Gathers the header words of count frames, with offsets given for an untagged frame and
+ * moved past the VLAN tag of tagged ones. A word past the end of a frame is read from its
+ * last two bytes instead, which keeps the loads in bounds without branches; the kernels
+ * check the length before relying on any word. Frames too short for an Ethernet header,
+ * and lanes past count up to the next whole vector, are zeroed so they never match.
+ */
+static void prefilter_gather(prefilter_words_t* words, const uint8_t* const* frames, const uint32_t* lengths, size_t count) {
+    size_t lanes = (count + 15) & ~(size_t)15;
+    for (size_t i = 0; i < lanes; i++) {
+        uint32_t length = i < count ? lengths[i] : 0;
+        if (length < ETHERNET_HEADER_LEN) {
+            words->length[i] = words->ethertype[i] = words->version_ihl[i] = words->fragment[i] =
+                words->protocol[i] = words->port4[i] = words->port6[i] = 0;
+            continue;
+        }
+        const uint8_t* frame = frames[i];
+        uint32_t last = length - 2;
+        uint32_t shift = (prefilter_word(frame + 12) == ETHERTYPE_VLAN && length >= ETHERNET_HEADER_LEN + sizeof(vlan_header_t)) ? 4 : 0;
+        uint32_t rest = length - shift;
+        words->length[i] = rest > UINT16_MAX ? UINT16_MAX : (uint16_t)rest;
+#define GATHER(field, offset) words->field[i] = prefilter_word(frame + ((offset) + shift <= last ? (offset) + shift : last))
+        GATHER(ethertype, 12);
+        GATHER(version_ihl, 14);
+        GATHER(fragment, 20);
+        GATHER(protocol, 22);
+        GATHER(port4, 36);
+        GATHER(port6, 56);
+#undef GATHER
+    }
+}
+
+/* Resolves the frames flagged for the scalar path and drops bits past count */
+static uint64_t prefilter_finish(uint64_t hits, uint64_t slow, const uint8_t* const* frames, const uint32_t* lengths, size_t count) {
+    while (slow != 0) {
+        unsigned i = (unsigned)__builtin_ctzll(slow);
+        slow &= slow - 1;
+        if (frame_is_ptp(frames[i], lengths[i])) {
+            hits |= 1ULL << i;
+        }
+    }
+    return count < 64 ? hits & ((1ULL << count) - 1) : hits;
+}
+
+/*
+ * Classifies frames one at a time. This is the reference the vector kernels must match.
+ */
+static uint64_t prefilter_batch_scalar(const uint8_t* const* frames, const uint32_t* lengths, size_t count) {
+    uint64_t hits = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (frame_is_ptp(frames[i], lengths[i])) {
+            hits |= 1ULL << i;
+        }
+    }
+    return hits;
+}
+
+#ifdef PTP_PREFILTER_X86
+
+/*
+ * Classifies 8 frames per iteration with SSE4.1/4.2 compares.
+ */
+__attribute__((target("sse4.2")))
+static uint64_t prefilter_batch_sse42(const uint8_t* const* frames, const uint32_t* lengths, size_t count) {
+    prefilter_words_t words;
+    prefilter_gather(&words, frames, lengths, count);
+
+    const __m128i udp = _mm_set1_epi16(17);
+    const __m128i event_port = _mm_set1_epi16(PTP_EVENT_PORT);
+    const __m128i general_port = _mm_set1_epi16(PTP_GENERAL_PORT);
+    const __m128i five = _mm_set1_epi16(5);
+
+    uint64_t hits = 0;
+    uint64_t slow = 0;
+    for (size_t i = 0; i < count; i += 8) {
+#define LOAD(field) _mm_load_si128((const __m128i*)&words.field[i])
+#define AT_LEAST(vector, bytes) _mm_cmpeq_epi16(_mm_max_epu16(vector, _mm_set1_epi16(bytes)), vector)
+        __m128i length = LOAD(length);
+        __m128i ethertype = LOAD(ethertype);
+
+        // PTP directly over Ethernet
+        __m128i hit = _mm_cmpeq_epi16(ethertype, _mm_set1_epi16((short)ETHERTYPE_PTP));
+
+        // IPv4: first fragment of a UDP datagram; the port is at a fixed offset only without options
+        __m128i ihl = _mm_and_si128(_mm_srli_epi16(LOAD(version_ihl), 8), _mm_set1_epi16(0x0F));
+        __m128i first_fragment = _mm_cmpeq_epi16(_mm_and_si128(LOAD(fragment), _mm_set1_epi16(0x1FFF)), _mm_setzero_si128());
+        __m128i udp4 = _mm_cmpeq_epi16(_mm_and_si128(LOAD(protocol), _mm_set1_epi16(0xFF)), udp);
+        __m128i ip4_udp = _mm_and_si128(_mm_cmpeq_epi16(ethertype, _mm_set1_epi16((short)ETHERTYPE_IPV4)), _mm_and_si128(first_fragment, udp4));
+        __m128i port4 = LOAD(port4);
+        __m128i ptp4 = _mm_or_si128(_mm_cmpeq_epi16(port4, event_port), _mm_cmpeq_epi16(port4, general_port));
+        hit = _mm_or_si128(hit, _mm_and_si128(_mm_and_si128(ip4_udp, _mm_cmpeq_epi16(ihl, five)), _mm_and_si128(ptp4, AT_LEAST(length, 42))));
+        __m128i options = _mm_and_si128(ip4_udp, _mm_cmpgt_epi16(ihl, five));
+
+        // IPv6 with UDP as the next header
+        __m128i ip6_udp = _mm_and_si128(_mm_cmpeq_epi16(ethertype, _mm_set1_epi16((short)ETHERTYPE_IPV6)),
+                                        _mm_cmpeq_epi16(_mm_srli_epi16(LOAD(fragment), 8), udp));
+        __m128i port6 = LOAD(port6);
+        __m128i ptp6 = _mm_or_si128(_mm_cmpeq_epi16(port6, event_port), _mm_cmpeq_epi16(port6, general_port));
+        hit = _mm_or_si128(hit, _mm_and_si128(_mm_and_si128(ip6_udp, ptp6), AT_LEAST(length, 62)));
+#undef AT_LEAST
+#undef LOAD
+
+        // Low byte of the mask: hits, high byte: frames for the scalar path
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(hit, options));
+        hits |= (uint64_t)(mask & 0xFF) << i;
+        slow |= (uint64_t)(mask >> 8) << i;
+    }
+    return prefilter_finish(hits, slow, frames, lengths, count);
+}
+
+/*
+ * Classifies 16 frames per iteration with AVX2; same rules as prefilter_batch_sse42().
+ */
+__attribute__((target("avx2")))
+static uint64_t prefilter_batch_avx2(const uint8_t* const* frames, const uint32_t* lengths, size_t count) {
+    prefilter_words_t words;
+    prefilter_gather(&words, frames, lengths, count);
+
+    const __m256i udp = _mm256_set1_epi16(17);
+    const __m256i event_port = _mm256_set1_epi16(PTP_EVENT_PORT);
+    const __m256i general_port = _mm256_set1_epi16(PTP_GENERAL_PORT);
+    const __m256i five = _mm256_set1_epi16(5);
+
+    uint64_t hits = 0;
+    uint64_t slow = 0;
+    for (size_t i = 0; i < count; i += 16) {
+#define LOAD(field) _mm256_load_si256((const __m256i*)&words.field[i])
+#define AT_LEAST(vector, bytes) _mm256_cmpeq_epi16(_mm256_max_epu16(vector, _mm256_set1_epi16(bytes)), vector)
+        __m256i length = LOAD(length);
+        __m256i ethertype = LOAD(ethertype);
+
+        __m256i hit = _mm256_cmpeq_epi16(ethertype, _mm256_set1_epi16((short)ETHERTYPE_PTP));
+
+        __m256i ihl = _mm256_and_si256(_mm256_srli_epi16(LOAD(version_ihl), 8), _mm256_set1_epi16(0x0F));
+        __m256i first_fragment = _mm256_cmpeq_epi16(_mm256_and_si256(LOAD(fragment), _mm256_set1_epi16(0x1FFF)), _mm256_setzero_si256());
+        __m256i udp4 = _mm256_cmpeq_epi16(_mm256_and_si256(LOAD(protocol), _mm256_set1_epi16(0xFF)), udp);
+        __m256i ip4_udp = _mm256_and_si256(_mm256_cmpeq_epi16(ethertype, _mm256_set1_epi16((short)ETHERTYPE_IPV4)), _mm256_and_si256(first_fragment, udp4));
+        __m256i port4 = LOAD(port4);
+        __m256i ptp4 = _mm256_or_si256(_mm256_cmpeq_epi16(port4, event_port), _mm256_cmpeq_epi16(port4, general_port));
+        hit = _mm256_or_si256(hit, _mm256_and_si256(_mm256_and_si256(ip4_udp, _mm256_cmpeq_epi16(ihl, five)), _mm256_and_si256(ptp4, AT_LEAST(length, 42))));
+        __m256i options = _mm256_and_si256(ip4_udp, _mm256_cmpgt_epi16(ihl, five));
+
+        __m256i ip6_udp = _mm256_and_si256(_mm256_cmpeq_epi16(ethertype, _mm256_set1_epi16((short)ETHERTYPE_IPV6)),
+                                           _mm256_cmpeq_epi16(_mm256_srli_epi16(LOAD(fragment), 8), udp));
+        __m256i port6 = LOAD(port6);
+        __m256i ptp6 = _mm256_or_si256(_mm256_cmpeq_epi16(port6, event_port), _mm256_cmpeq_epi16(port6, general_port));
+        hit = _mm256_or_si256(hit, _mm256_and_si256(_mm256_and_si256(ip6_udp, ptp6), AT_LEAST(length, 62)));
+#undef AT_LEAST
+#undef LOAD
+
+        // Packing interleaves the 128-bit halves; restore lane order before taking the mask
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(hit, options), 0xD8);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(packed);
+        hits |= (uint64_t)(mask & 0xFFFF) << i;
+        slow |= (uint64_t)(mask >> 16) << i;
+    }
+    return prefilter_finish(hits, slow, frames, lengths, count);
+}
+
+#endif // PTP_PREFILTER_X86
+
+/*
+ * Picks the widest implementation the CPU supports.
+ * @return The implementation ptp_prefilter_batch() uses.
+ */
+ptp_prefilter_impl_t ptp_prefilter_best(void) {
+#ifdef PTP_PREFILTER_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return PTP_PREFILTER_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return PTP_PREFILTER_SSE42;
+    }
+#endif
+    return PTP_PREFILTER_SCALAR;
+}
+
+/*
+ * Names an implementation for diagnostics.
+ */
+const char* ptp_prefilter_name(ptp_prefilter_impl_t impl) {
+    switch (impl) {
+        case PTP_PREFILTER_AVX2: return "AVX2";
+        case PTP_PREFILTER_SSE42: return "SSE4.2";
+        default: return "scalar";
+    }
+}
+
+/*
+ * Classifies a batch of frames with a given implementation. Implementations the CPU
+ * does not support fall back to the scalar one.
+ * @param impl The implementation.
+ * @param frames The start of each Ethernet frame.
+ * @param lengths Number of bytes available at each frame.
+ * @param count Number of frames, at most PTP_PREFILTER_BATCH.
+ * @return Bit i set if frame i carries PTP, as frame_is_ptp() would decide.
+ */
+uint64_t ptp_prefilter_batch_with(ptp_prefilter_impl_t impl, const uint8_t* const* frames, const uint32_t* lengths, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (count > PTP_PREFILTER_BATCH) {
+        count = PTP_PREFILTER_BATCH;
+    }
+#ifdef PTP_PREFILTER_X86
+    if (impl == PTP_PREFILTER_AVX2 && __builtin_cpu_supports("avx2")) {
+        return prefilter_batch_avx2(frames, lengths, count);
+    }
+    if (impl >= PTP_PREFILTER_SSE42 && __builtin_cpu_supports("sse4.2")) {
+        return prefilter_batch_sse42(frames, lengths, count);
+    }
+#else
+    (void)impl;
+#endif
+    return prefilter_batch_scalar(frames, lengths, count);
+}
+
+/*
+ * Classifies a batch of frames with the best implementation for this CPU.
+ * @param frames The start of each Ethernet frame.
+ * @param lengths Number of bytes available at each frame.
+ * @param count Number of frames, at most PTP_PREFILTER_BATCH.
+ * @return Bit i set if frame i carries PTP.
+ */
+uint64_t ptp_prefilter_batch(const uint8_t* const* frames, const uint32_t* lengths, size_t count) {
+    return ptp_prefilter_batch_with(ptp_prefilter_best(), frames, lengths, count);
+}
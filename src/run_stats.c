@@ -0,0 +1,153 @@
+#include "../include/run_stats.h"
+#include "../include/ethernet.h"
+#include "../include/ptp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Allocates zeroed counter blocks, one per thread, each on its own cache lines.
+ * @param count Number of blocks.
+ * @return The blocks, or NULL on memory allocation failure. Free with run_stats_destroy().
+ */
+run_stats_t* run_stats_create(size_t count) {
+    // sizeof(run_stats_t) is a multiple of its alignment, as aligned_alloc requires
+    run_stats_t* stats = (run_stats_t*)aligned_alloc(RUN_STATS_CACHE_LINE, count * sizeof(run_stats_t));
+    if (stats == NULL) {
+        perror("Failed to allocate memory for run statistics");
+        return NULL;
+    }
+    memset(stats, 0, count * sizeof(run_stats_t));
+    return stats;
+}
+
+/*
+ * Frees counter blocks allocated by run_stats_create().
+ * @param stats The blocks, or NULL.
+ */
+void run_stats_destroy(run_stats_t* stats) {
+    free(stats);
+}
+
+/*
+ * Adds the counters of src to dst.
+ * @param dst The block receiving the counts.
+ * @param src The block to add; left unchanged.
+ */
+void run_stats_add(run_stats_t* dst, const run_stats_t* src) {
+    dst->packets += src->packets;
+    dst->bytes += src->bytes;
+    dst->vlan_tagged += src->vlan_tagged;
+    for (int i = 0; i < RUN_STATS_ETHERTYPE_COUNT; i++) {
+        dst->ethertypes[i] += src->ethertypes[i];
+    }
+    for (int i = 0; i < PTP_MESSAGE_TYPE_COUNT; i++) {
+        dst->ptp_messages[i] += src->ptp_messages[i];
+    }
+    for (int i = 0; i < RUN_STATS_DOMAIN_COUNT; i++) {
+        dst->domains[i] += src->domains[i];
+    }
+    for (int i = 0; i < RUN_STATS_MALFORMED_COUNT; i++) {
+        dst->malformed[i] += src->malformed[i];
+    }
+}
+
+/*
+ * Counts a frame by its EtherType after any VLAN tag.
+ * @param stats The thread's counters.
+ * @param ethertype The EtherType.
+ */
+void run_stats_count_ethertype(run_stats_t* stats, uint16_t ethertype) {
+    run_stats_ethertype_t slot;
+    switch (ethertype) {
+        case ETHERTYPE_IPV4: slot = RUN_STATS_ETHERTYPE_IPV4; break;
+        case ETHERTYPE_IPV6: slot = RUN_STATS_ETHERTYPE_IPV6; break;
+        case ETHERTYPE_PTP:  slot = RUN_STATS_ETHERTYPE_PTP; break;
+        case ETHERTYPE_ARP:  slot = RUN_STATS_ETHERTYPE_ARP; break;
+        case ETHERTYPE_LLDP: slot = RUN_STATS_ETHERTYPE_LLDP; break;
+        default:             slot = RUN_STATS_ETHERTYPE_OTHER; break;
+    }
+    stats->ethertypes[slot]++;
+}
+
+/*
+ * @return The name of an EtherType slot.
+ */
+const char* run_stats_ethertype_name(run_stats_ethertype_t ethertype) {
+    static const char* const names[] = {
+        [RUN_STATS_ETHERTYPE_IPV4] = "IPv4",
+        [RUN_STATS_ETHERTYPE_IPV6] = "IPv6",
+        [RUN_STATS_ETHERTYPE_PTP] = "PTP",
+        [RUN_STATS_ETHERTYPE_ARP] = "ARP",
+        [RUN_STATS_ETHERTYPE_LLDP] = "LLDP",
+        [RUN_STATS_ETHERTYPE_OTHER] = "other",
+    };
+    return (unsigned)ethertype < RUN_STATS_ETHERTYPE_COUNT ? names[ethertype] : "unknown";
+}
+
+/*
+ * @return A short description of a malformed record reason.
+ */
+const char* run_stats_malformed_name(run_stats_malformed_t reason) {
+    static const char* const names[] = {
+        [RUN_STATS_BAD_RECORD] = "invalid record",
+        [RUN_STATS_SHORT_ETHERNET] = "truncated Ethernet header",
+        [RUN_STATS_SHORT_VLAN] = "truncated VLAN tag",
+        [RUN_STATS_BAD_IPV4] = "truncated or invalid IPv4 header",
+        [RUN_STATS_SHORT_IPV6] = "truncated IPv6 header",
+        [RUN_STATS_SHORT_UDP] = "truncated UDP header",
+        [RUN_STATS_SHORT_PTP_HEADER] = "truncated PTP common header",
+        [RUN_STATS_SHORT_PTP_MESSAGE] = "truncated PTP message",
+    };
+    return (unsigned)reason < RUN_STATS_MALFORMED_COUNT ? names[reason] : "unknown";
+}
+
+/*
+ * Prints the counters of the run, summed over every decoding thread: records and bytes
+ * decoded, frames by EtherType, PTP messages by domain and records that were malformed.
+ * @param stats The summed counters.
+ */
+void run_stats_print(const run_stats_t* stats) {
+    printf("Run summary: %llu packets decoded, %llu bytes\n", (unsigned long long)stats->packets, (unsigned long long)stats->bytes);
+    for (int i = 0; i < RUN_STATS_ETHERTYPE_COUNT; i++) {
+        if (stats->ethertypes[i] != 0) {
+            printf("    EtherType %-12s %llu\n", run_stats_ethertype_name((run_stats_ethertype_t)i), (unsigned long long)stats->ethertypes[i]);
+        }
+    }
+    if (stats->vlan_tagged != 0) {
+        printf("    VLAN-tagged            %llu\n", (unsigned long long)stats->vlan_tagged);
+    }
+    for (int domain = 0; domain < RUN_STATS_DOMAIN_COUNT; domain++) {
+        if (stats->domains[domain] != 0) {
+            printf("    PTP domain %-11d %llu\n", domain, (unsigned long long)stats->domains[domain]);
+        }
+    }
+    uint64_t malformed = 0;
+    for (int i = 0; i < RUN_STATS_MALFORMED_COUNT; i++) {
+        malformed += stats->malformed[i];
+    }
+    printf("Malformed records: %llu\n", (unsigned long long)malformed);
+    for (int i = 0; i < RUN_STATS_MALFORMED_COUNT; i++) {
+        if (stats->malformed[i] != 0) {
+            printf("    %-32s %llu\n", run_stats_malformed_name((run_stats_malformed_t)i), (unsigned long long)stats->malformed[i]);
+        }
+    }
+}
+
+/*
+ * Prints the number of PTP messages seen, in total and by message type.
+ * @param stats The summed counters.
+ */
+void run_stats_print_ptp_messages(const run_stats_t* stats) {
+    uint64_t total = 0;
+    for (int type = 0; type < PTP_MESSAGE_TYPE_COUNT; type++) {
+        total += stats->ptp_messages[type];
+    }
+    printf("Total PTP packets: %llu\n", (unsigned long long)total);
+    for (int type = 0; type < PTP_MESSAGE_TYPE_COUNT; type++) {
+        if (stats->ptp_messages[type] != 0) {
+            printf("    %-22s %llu\n", ptp_message_type_name((ptp_message_type_t)type),
+                   (unsigned long long)stats->ptp_messages[type]);
+        }
+    }
+}
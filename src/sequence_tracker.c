@@ -0,0 +1,246 @@
+#include "../include/sequence_tracker.h"
+#include "../include/ptp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOURCE_TABLE_INITIAL_SIZE 64
+
+/*
+ * Initializes an empty tracker.
+ * @param tracker The tracker.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int sequence_tracker_init(sequence_tracker_t* tracker) {
+    memset(tracker, 0, sizeof(*tracker));
+    if (hash_table_init(&tracker->source_index, SOURCE_TABLE_INITIAL_SIZE) != 0) {
+        fprintf(stderr, "Failed to initialize sequence tracker.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Frees the memory allocated by a tracker.
+ * @param tracker The tracker.
+ */
+void sequence_tracker_free(sequence_tracker_t* tracker) {
+    hash_table_free(&tracker->source_index);
+    free(tracker->sources);
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+// A (port identity, messageType) looked up in the source index
+typedef struct {
+    const sequence_tracker_t* tracker;
+    uint64_t clock_id;
+    uint16_t port_number;
+    uint8_t message_type;
+} source_lookup_t;
+
+static int source_matches(const void* context, uint64_t value) {
+    const source_lookup_t* lookup = (const source_lookup_t*)context;
+    const sequence_source_t* source = &lookup->tracker->sources[value];
+    return source->clock_id == lookup->clock_id && source->port_number == lookup->port_number &&
+           source->message_type == lookup->message_type;
+}
+
+/*
+ * Finds the state of a source, adding an empty one if the source is new.
+ * The source index is keyed by a mix of the port identity and message type.
+ * @return The source, or NULL on memory allocation failure.
+ */
+static sequence_source_t* get_source(sequence_tracker_t* tracker, uint64_t clock_id, uint16_t port_number, uint8_t message_type) {
+    uint64_t key = (clock_id * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)port_number << 8) ^ message_type;
+    source_lookup_t lookup = { tracker, clock_id, port_number, message_type };
+    hash_key_match_t match = { source_matches, &lookup };
+    uint64_t* slot = hash_table_find_match(&tracker->source_index, key, &match);
+    if (slot != NULL) {
+        return &tracker->sources[*slot];
+    }
+
+    if (tracker->source_count == tracker->source_capacity) {
+        size_t grown_capacity = tracker->source_capacity ? tracker->source_capacity * 2 : SOURCE_TABLE_INITIAL_SIZE;
+        sequence_source_t* grown = (sequence_source_t*)realloc(tracker->sources, grown_capacity * sizeof(sequence_source_t));
+        if (grown == NULL) {
+            perror("Failed to allocate memory for sequence sources");
+            return NULL;
+        }
+        tracker->sources = grown;
+        tracker->source_capacity = grown_capacity;
+    }
+    if (hash_table_add(&tracker->source_index, key, tracker->source_count) == NULL) {
+        return NULL;
+    }
+    sequence_source_t* source = &tracker->sources[tracker->source_count++];
+    memset(source, 0, sizeof(*source));
+    source->clock_id = clock_id;
+    source->port_number = port_number;
+    source->message_type = message_type;
+    return source;
+}
+
+/*
+ * Classifies a sequenceId against a source's window and slides the window forward.
+ * Distances are taken in 16-bit wraparound order, so 0 follows 65535.
+ * @param source The source.
+ * @param sequence_id The sequenceId.
+ * @param counts Counts to update.
+ * @return What the sequenceId says about the stream.
+ */
+static sequence_event_t classify(sequence_source_t* source, uint16_t sequence_id, sequence_counts_t* counts) {
+    counts->received++;
+    int distance = (int16_t)(uint16_t)(sequence_id - source->highest);
+    if (source->depth == 0 || distance > SEQUENCE_RESYNC_GAP || distance < -SEQUENCE_RESYNC_GAP) {
+        sequence_event_t event = source->depth == 0 ? SEQUENCE_IN_ORDER : SEQUENCE_RESYNC;
+        if (event == SEQUENCE_RESYNC) {
+            counts->resyncs++;
+        }
+        source->highest = sequence_id;
+        source->window = 1;
+        source->depth = 1;
+        return event;
+    }
+    if (distance > 0) {
+        source->window = distance < SEQUENCE_WINDOW ? (source->window << distance) | 1 : 1;
+        source->depth = source->depth + distance < SEQUENCE_WINDOW ? (uint8_t)(source->depth + distance) : SEQUENCE_WINDOW;
+        source->highest = sequence_id;
+        if (distance == 1) {
+            return SEQUENCE_IN_ORDER;
+        }
+        counts->gaps++;
+        counts->missing += distance - 1;
+        return SEQUENCE_GAP;
+    }
+    // Behind the highest: only sequenceIds since the first message or resync are known
+    if (-distance >= source->depth) {
+        counts->late++;
+        return SEQUENCE_LATE;
+    }
+    uint64_t bit = 1ULL << -distance;
+    if (source->window & bit) {
+        counts->duplicates++;
+        return SEQUENCE_DUPLICATE;
+    }
+    source->window |= bit;
+    counts->reordered++;
+    counts->missing--;
+    return SEQUENCE_REORDERED;
+}
+
+/*
+ * Records the sequenceId of one message.
+ * @param tracker The tracker.
+ * @param clock_id clockIdentity of the sourcePortIdentity.
+ * @param port_number portNumber of the sourcePortIdentity.
+ * @param message_type The messageType.
+ * @param sequence_id The sequenceId.
+ * @param source_out Set to the source's state, or NULL on failure.
+ * @param event_out Set to what the sequenceId says about the stream.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int sequence_tracker_record(sequence_tracker_t* tracker, uint64_t clock_id, uint16_t port_number, uint8_t message_type,
+                            uint16_t sequence_id, const sequence_source_t** source_out, sequence_event_t* event_out) {
+    sequence_source_t* source = get_source(tracker, clock_id, port_number, message_type);
+    *source_out = source;
+    if (source == NULL) {
+        return -1;
+    }
+    if (tracker->defer_partial && source->pending_count < SEQUENCE_WINDOW) {
+        // The window still reaches the previous chunk: classify for the window only
+        sequence_counts_t ignored = {0};
+        source->pending[source->pending_count++] = sequence_id;
+        classify(source, sequence_id, &ignored);
+        *event_out = SEQUENCE_DEFERRED;
+        return 0;
+    }
+    *event_out = classify(source, sequence_id, &source->counts);
+    return 0;
+}
+
+/*
+ * Merges the sources of a later chunk's tracker into dst. The sequenceIds a source kept
+ * back are classified against dst's window; once SEQUENCE_WINDOW of them have been, dst's
+ * window matches the one the chunk continued from, so the chunk's counts and final window
+ * are taken over. Exact unless a source's sequenceIds run backwards across the boundary.
+ * @param dst The tracker receiving the sources.
+ * @param src The chunk tracker to merge from; left unchanged.
+ * @return 0 on success, -1 on memory allocation failure.
+ */
+int sequence_tracker_merge(sequence_tracker_t* dst, const sequence_tracker_t* src) {
+    for (size_t i = 0; i < src->source_count; i++) {
+        const sequence_source_t* part = &src->sources[i];
+        sequence_source_t* source = get_source(dst, part->clock_id, part->port_number, part->message_type);
+        if (source == NULL) {
+            return -1;
+        }
+        for (uint32_t n = 0; n < part->pending_count; n++) {
+            classify(source, part->pending[n], &source->counts);
+        }
+        if (part->counts.received == 0) {
+            continue;
+        }
+        source->highest = part->highest;
+        source->window = part->window;
+        source->depth = part->depth;
+        source->counts.received += part->counts.received;
+        source->counts.gaps += part->counts.gaps;
+        source->counts.missing += part->counts.missing;
+        source->counts.duplicates += part->counts.duplicates;
+        source->counts.reordered += part->counts.reordered;
+        source->counts.late += part->counts.late;
+        source->counts.resyncs += part->counts.resyncs;
+    }
+    return 0;
+}
+
+/*
+ * @return A short name for a sequence event, e.g. "gap".
+ */
+const char* sequence_event_name(sequence_event_t event) {
+    static const char* const names[] = {
+        [SEQUENCE_IN_ORDER] = "in order",
+        [SEQUENCE_GAP] = "gap",
+        [SEQUENCE_DUPLICATE] = "duplicate",
+        [SEQUENCE_REORDERED] = "reordered",
+        [SEQUENCE_LATE] = "late",
+        [SEQUENCE_RESYNC] = "resync",
+        [SEQUENCE_DEFERRED] = "deferred",
+    };
+    return (unsigned)event < sizeof(names) / sizeof(names[0]) ? names[event] : "unknown";
+}
+
+/*
+ * Prints the sequenceId anomalies summed over every source, then the counts of each
+ * source that had any.
+ * @param tracker The tracker.
+ */
+void sequence_tracker_print(const sequence_tracker_t* tracker) {
+    sequence_counts_t totals = {0};
+    for (size_t i = 0; i < tracker->source_count; i++) {
+        const sequence_counts_t* counts = &tracker->sources[i].counts;
+        totals.received += counts->received;
+        totals.gaps += counts->gaps;
+        totals.missing += counts->missing;
+        totals.duplicates += counts->duplicates;
+        totals.reordered += counts->reordered;
+        totals.late += counts->late;
+        totals.resyncs += counts->resyncs;
+    }
+    printf("Sequence IDs: %zu sources, %llu gaps (%lld missing), %llu duplicates, %llu reordered, %llu late, %llu resyncs\n",
+           tracker->source_count, (unsigned long long)totals.gaps, (long long)totals.missing,
+           (unsigned long long)totals.duplicates, (unsigned long long)totals.reordered,
+           (unsigned long long)totals.late, (unsigned long long)totals.resyncs);
+    for (size_t i = 0; i < tracker->source_count; i++) {
+        const sequence_source_t* source = &tracker->sources[i];
+        const sequence_counts_t* counts = &source->counts;
+        if (counts->gaps == 0 && counts->duplicates == 0 && counts->reordered == 0 && counts->late == 0 && counts->resyncs == 0) {
+            continue;
+        }
+        printf("    %-22s 0x%016llx:%u: %llu received, %llu gaps (%lld missing), %llu duplicates, %llu reordered, %llu late, %llu resyncs\n",
+               ptp_message_type_name((ptp_message_type_t)source->message_type), (unsigned long long)source->clock_id,
+               source->port_number, (unsigned long long)counts->received, (unsigned long long)counts->gaps,
+               (long long)counts->missing, (unsigned long long)counts->duplicates, (unsigned long long)counts->reordered,
+               (unsigned long long)counts->late, (unsigned long long)counts->resyncs);
+    }
+}
@@ -0,0 +1,85 @@
+#include "../include/slab.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Objects start after the slab header, padded so they keep the slab's alignment
+#define SLAB_HEADER_SIZE ((sizeof(slab_t) + SLAB_ALIGNMENT - 1) & ~(size_t)(SLAB_ALIGNMENT - 1))
+
+/*
+ * Initializes an empty allocator. No memory is allocated until the first object is.
+ * @param slab The allocator.
+ * @param object_size Size of each object in bytes.
+ * @param objects_per_slab Number of objects carved from each slab.
+ */
+void slab_init(slab_allocator_t* slab, size_t object_size, size_t objects_per_slab) {
+    memset(slab, 0, sizeof(*slab));
+    if (object_size < sizeof(void*)) {
+        object_size = sizeof(void*);
+    }
+    slab->object_size = (object_size + SLAB_OBJECT_ALIGNMENT - 1) & ~(size_t)(SLAB_OBJECT_ALIGNMENT - 1);
+    slab->objects_per_slab = objects_per_slab ? objects_per_slab : 1;
+}
+
+/*
+ * Allocates an object. Its contents are undefined.
+ * @param slab The allocator.
+ * @return The object, or NULL on memory allocation failure.
+ */
+void* slab_alloc(slab_allocator_t* slab) {
+    void* object = slab->free_list;
+    if (object != NULL) {
+        memcpy(&slab->free_list, object, sizeof(void*));
+        slab->live++;
+        return object;
+    }
+
+    if (slab->bump == slab->bump_end) {
+        size_t bytes = SLAB_HEADER_SIZE + slab->object_size * slab->objects_per_slab;
+        bytes = (bytes + SLAB_ALIGNMENT - 1) & ~(size_t)(SLAB_ALIGNMENT - 1);
+        slab_t* block = (slab_t*)aligned_alloc(SLAB_ALIGNMENT, bytes);
+        if (block == NULL) {
+            perror("Failed to allocate memory for slab");
+            return NULL;
+        }
+        block->next = slab->slabs;
+        slab->slabs = block;
+        slab->bump = (char*)block + SLAB_HEADER_SIZE;
+        slab->bump_end = slab->bump + slab->object_size * slab->objects_per_slab;
+    }
+    object = slab->bump;
+    slab->bump += slab->object_size;
+    slab->live++;
+    return object;
+}
+
+/*
+ * Returns an object to the allocator for reuse.
+ * @param slab The allocator the object came from.
+ * @param object The object, or NULL.
+ */
+void slab_release(slab_allocator_t* slab, void* object) {
+    if (object == NULL) {
+        return;
+    }
+    memcpy(object, &slab->free_list, sizeof(void*));
+    slab->free_list = object;
+    slab->live--;
+}
+
+/*
+ * Frees every slab at once, invalidating all objects. The allocator can be reused.
+ * @param slab The allocator.
+ */
+void slab_free_all(slab_allocator_t* slab) {
+    slab_t* block = slab->slabs;
+    while (block != NULL) {
+        slab_t* next = block->next;
+        free(block);
+        block = next;
+    }
+    slab->slabs = NULL;
+    slab->bump = slab->bump_end = NULL;
+    slab->free_list = NULL;
+    slab->live = 0;
+}
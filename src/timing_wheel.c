@@ -0,0 +1,184 @@
+#include "../include/timing_wheel.h"
+#include <string.h>
+
+#define SLOT_MASK ((int64_t)TIMING_WHEEL_SLOTS - 1)
+
+/*
+ * Initializes an empty wheel. Its clock starts at the first advance or schedule.
+ * @param wheel The wheel.
+ */
+void timing_wheel_init(timing_wheel_t* wheel) {
+    memset(wheel, 0, sizeof(*wheel));
+}
+
+/*
+ * Links a node into the slot its expiry tick maps to, given the current tick.
+ * @param min_tick Earliest tick the node may be placed at: the current tick while
+ *        cascading (that tick's slot is fired next), the following tick otherwise.
+ */
+static void wheel_place(timing_wheel_t* wheel, timer_node_t* node, int64_t min_tick) {
+    int64_t tick = node->expires_tick > min_tick ? node->expires_tick : min_tick;
+    int64_t delta = tick - wheel->now_tick;
+    int level = 0;
+
+    while (level < TIMING_WHEEL_LEVELS - 1 && delta >= ((int64_t)1 << (TIMING_WHEEL_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    int64_t top_span = (int64_t)1 << (TIMING_WHEEL_SLOT_BITS * TIMING_WHEEL_LEVELS);
+    if (delta >= top_span) {
+        // Beyond the wheel's range: park in the furthest slot and re-place when it cascades
+        tick = wheel->now_tick + top_span - 1;
+    }
+
+    int slot = (int)((tick >> (TIMING_WHEEL_SLOT_BITS * level)) & SLOT_MASK);
+    timer_node_t** head = &wheel->slots[level][slot];
+    node->level = (uint8_t)level;
+    node->slot = (uint8_t)slot;
+    node->next = *head;
+    node->pprev = head;
+    if (*head != NULL) {
+        (*head)->pprev = &node->next;
+    }
+    *head = node;
+    wheel->occupied[level] |= 1ull << slot;
+}
+
+/*
+ * Unlinks a scheduled node from its slot.
+ */
+static void wheel_unlink(timing_wheel_t* wheel, timer_node_t* node) {
+    *node->pprev = node->next;
+    if (node->next != NULL) {
+        node->next->pprev = node->pprev;
+    }
+    if (wheel->slots[node->level][node->slot] == NULL) {
+        wheel->occupied[node->level] &= ~(1ull << node->slot);
+    }
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+/*
+ * Schedules (or reschedules) a timer to expire once the wheel advances past deadline_ns.
+ * @param wheel The wheel.
+ * @param node The timer.
+ * @param deadline_ns Capture time at which the timer expires.
+ */
+void timing_wheel_schedule(timing_wheel_t* wheel, timer_node_t* node, int64_t deadline_ns) {
+    if (node->pprev != NULL) {
+        wheel_unlink(wheel, node);
+    } else {
+        wheel->count++;
+    }
+    node->expires_tick = deadline_ns >> TIMING_WHEEL_TICK_SHIFT;
+    if (!wheel->started) {
+        wheel->now_tick = node->expires_tick - 1;
+        wheel->started = 1;
+    }
+    wheel_place(wheel, node, wheel->now_tick + 1);
+}
+
+/*
+ * Cancels a timer. Cancelling a timer that is not scheduled does nothing.
+ * @param wheel The wheel.
+ * @param node The timer.
+ */
+void timing_wheel_cancel(timing_wheel_t* wheel, timer_node_t* node) {
+    if (node->pprev == NULL) {
+        return;
+    }
+    wheel_unlink(wheel, node);
+    wheel->count--;
+}
+
+/*
+ * Moves the timers of the current slot of a level down to the levels below, after
+ * cascading the level above if this level just wrapped.
+ */
+static void wheel_cascade(timing_wheel_t* wheel, int level) {
+    if (level >= TIMING_WHEEL_LEVELS) {
+        return;
+    }
+    int slot = (int)((wheel->now_tick >> (TIMING_WHEEL_SLOT_BITS * level)) & SLOT_MASK);
+    if (slot == 0) {
+        wheel_cascade(wheel, level + 1);
+    }
+
+    // Detach first: timers parked beyond the wheel's range can land back in this slot
+    timer_node_t* node = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~(1ull << slot);
+    while (node != NULL) {
+        timer_node_t* next = node->next;
+        wheel_place(wheel, node, wheel->now_tick);
+        node = next;
+    }
+}
+
+/*
+ * Finds the next tick after the current one at which a slot of some level comes up
+ * with timers in it. Every tick before it can be skipped.
+ */
+static int64_t wheel_next_event(const timing_wheel_t* wheel) {
+    int64_t next = INT64_MAX;
+    for (int level = 0; level < TIMING_WHEEL_LEVELS; level++) {
+        uint64_t occupied = wheel->occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
+        int shift = TIMING_WHEEL_SLOT_BITS * level;
+        int index = (int)((wheel->now_tick >> shift) & SLOT_MASK);
+        int64_t rotation = (wheel->now_tick >> (shift + TIMING_WHEEL_SLOT_BITS)) << (shift + TIMING_WHEEL_SLOT_BITS);
+        uint64_t ahead = index == TIMING_WHEEL_SLOTS - 1 ? 0 : occupied & (~0ull << (index + 1));
+
+        int64_t candidate;
+        if (ahead != 0) {
+            candidate = rotation + ((int64_t)__builtin_ctzll(ahead) << shift);
+        } else {
+            // Only slots at or behind the current index: they come up in the next rotation
+            candidate = rotation + ((int64_t)1 << (shift + TIMING_WHEEL_SLOT_BITS)) + ((int64_t)__builtin_ctzll(occupied) << shift);
+        }
+        if (candidate < next) {
+            next = candidate;
+        }
+    }
+    return next;
+}
+
+/*
+ * Advances the wheel's clock to now_ns, expiring every timer whose deadline has passed.
+ * Capture time that goes backwards leaves the clock where it is.
+ * @param wheel The wheel.
+ * @param now_ns Current capture time.
+ * @param expire Called for each expired timer.
+ * @param user Passed to expire.
+ */
+void timing_wheel_advance(timing_wheel_t* wheel, int64_t now_ns, timing_wheel_expire_fn expire, void* user) {
+    int64_t target = now_ns >> TIMING_WHEEL_TICK_SHIFT;
+    if (!wheel->started) {
+        wheel->now_tick = target;
+        wheel->started = 1;
+        return;
+    }
+
+    while (wheel->now_tick < target) {
+        int64_t next = wheel->count != 0 ? wheel_next_event(wheel) : INT64_MAX;
+        if (next > target) {
+            wheel->now_tick = target;
+            break;
+        }
+        wheel->now_tick = next;
+        if ((next & SLOT_MASK) == 0) {
+            wheel_cascade(wheel, 1);
+        }
+
+        // Pop one at a time: an expiry callback may cancel other timers of this slot
+        int slot = (int)(next & SLOT_MASK);
+        timer_node_t* node;
+        while ((node = wheel->slots[0][slot]) != NULL) {
+            wheel_unlink(wheel, node);
+            wheel->count--;
+            expire(node, user);
+        }
+    }
+}
@@ -33,8 +33,58 @@ uint64_t bytes_to_uint48(const uint8_t* bytes, int swap_bytes) {
     return result;
 }
 
+// Reads a 16-bit big-endian (network byte order) field, independent of alignment and capture byte order
+uint16_t read_be16(const uint8_t* bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+// Reads a 32-bit big-endian (network byte order) field, independent of alignment and capture byte order
+uint32_t read_be32(const uint8_t* bytes) {
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+uint64_t read_be64(const uint8_t* bytes) {
+    return ((uint64_t)read_be32(bytes) << 32) | read_be32(bytes + 4);
+}
+
 int is_little_endian() {
     volatile uint32_t i = 0x01234567;
     // return 1 if the first byte (lowest address) is the LSB
     return (*(volatile uint8_t*)(&i) == 0x67);
-}
\ No newline at end of file
+}
+// Parses "SECONDS[.FRACTION]" (seconds since the epoch, up to nanosecond precision) into nanoseconds.
+// Returns 0 on success, -1 if the text is not a valid timestamp.
+int parse_timestamp_ns(const char* text, int64_t* ts_ns) {
+    const char* p = text;
+    int64_t seconds = 0;
+    int64_t fraction = 0;
+    int digits = 0;
+
+    if (*p < '0' || *p > '9') {
+        return -1;
+    }
+    while (*p >= '0' && *p <= '9') {
+        if (seconds > (INT64_MAX / NSEC_PER_SEC - 9) / 10) {
+            return -1; // Out of range for int64 nanoseconds
+        }
+        seconds = seconds * 10 + (*p++ - '0');
+    }
+    if (*p == '.') {
+        p++;
+        while (*p >= '0' && *p <= '9') {
+            if (digits < 9) {
+                fraction = fraction * 10 + (*p - '0');
+                digits++;
+            }
+            p++;
+        }
+    }
+    if (*p != '\0') {
+        return -1;
+    }
+    for (; digits < 9; digits++) {
+        fraction *= 10;
+    }
+    *ts_ns = seconds * NSEC_PER_SEC + fraction;
+    return 0;
+}
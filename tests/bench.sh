@@ -0,0 +1,84 @@
+#!/bin/sh
+# Throughput benchmark: generates synthetic gPTP captures once, then times every reader and
+# decoder mode of the parser on them and reports packets/s, ns/packet and MB/s.
+# Run through `make bench`, which builds an optimized parser and passes the settings below.
+
+set -e
+
+PARSER=${PARSER:-bin/pcap_parser}
+GENERATOR=${GENERATOR:-bin/generate_capture}
+BENCH_DIR=${BENCH_DIR:-obj/bench}
+BENCH_PACKETS=${BENCH_PACKETS:-1000000}
+BENCH_THREADS=${BENCH_THREADS:-4}
+BENCH_REPEAT=${BENCH_REPEAT:-3}
+
+# A mix of every exchange and transport, with some VLAN tags, loss and reordering
+MIX="--transport l2=2,ipv4=1,ipv6=1 --mix sync=8,pdelay=2,delay=1,announce=1,signaling=1 --vlan 10 --loss 0.1 --reorder 0.1 --seed 1"
+
+mkdir -p "$BENCH_DIR"
+
+# Generates a capture unless one was already made with the same options; prints its record count
+generate() {
+    file=$BENCH_DIR/$1
+    shift
+    stamp="$BENCH_PACKETS $MIX $*"
+    if [ ! -f "$file" ] || [ "$(cat "$file.options" 2>/dev/null)" != "$stamp" ]; then
+        rm -f "$file.options"
+        "$GENERATOR" -o "$file" --packets "$BENCH_PACKETS" $MIX "$@" 2>"$file.log" || { cat "$file.log" >&2; exit 1; }
+        echo "$stamp" > "$file.options"
+    fi
+    sed -n 's/^Wrote \([0-9]*\) packets.*/\1/p' "$file.log"
+}
+
+now_ns() {
+    date +%s%N
+}
+
+# Runs one mode BENCH_REPEAT times and prints a result line for the fastest run
+run() {
+    label=$1
+    file=$2
+    packets=$3
+    shift 3
+    best=0
+    i=0
+    while [ "$i" -lt "$BENCH_REPEAT" ]; do
+        start=$(now_ns)
+        if [ "$1" = "-" ]; then
+            # Through a pipe: stdin redirected from a regular file would be mapped like the file
+            cat "$file" | "$PARSER" "$@" > /dev/null 2>&1
+        else
+            "$PARSER" "$file" "$@" > /dev/null 2>&1
+        fi
+        elapsed=$(($(now_ns) - start))
+        if [ "$best" -eq 0 ] || [ "$elapsed" -lt "$best" ]; then
+            best=$elapsed
+        fi
+        i=$((i + 1))
+    done
+    bytes=$(wc -c < "$file")
+    awk -v label="$label" -v name="$(basename "$file")" -v ns="$best" -v packets="$packets" -v bytes="$bytes" 'BEGIN {
+        printf "%-24s %-14s %8.3f %12.0f %10.1f %9.1f\n", label, name, ns / 1e9, packets / (ns / 1e9), ns / packets, bytes / (ns / 1e3)
+    }'
+}
+
+echo "Generating captures in $BENCH_DIR ($BENCH_PACKETS packets each)..."
+pcap_packets=$(generate mixed.pcap)
+pcapng_packets=$(generate mixed.pcapng --format pcapng --nanosecond)
+swapped_packets=$(generate swapped.pcap --byte-order big)
+pcap=$BENCH_DIR/mixed.pcap
+
+echo "Best of $BENCH_REPEAT runs; per-packet output goes to /dev/null"
+printf "%-24s %-14s %8s %12s %10s %9s\n" "mode" "capture" "seconds" "packets/s" "ns/packet" "MB/s"
+run "mmap --quiet"           "$pcap" "$pcap_packets" --quiet
+run "stdio --quiet"          "$pcap" "$pcap_packets" --quiet --no-mmap
+run "stdin pipe --quiet"     "$pcap" "$pcap_packets" - --quiet
+run "-j $BENCH_THREADS --quiet"     "$pcap" "$pcap_packets" --quiet -j "$BENCH_THREADS"
+run "--chunks $BENCH_THREADS --quiet" "$pcap" "$pcap_packets" --quiet --chunks "$BENCH_THREADS"
+run "--filter-ptp --quiet"   "$pcap" "$pcap_packets" --quiet --filter-ptp
+run "--summary"              "$pcap" "$pcap_packets" --summary
+run "verbose"                "$pcap" "$pcap_packets"
+run "-j $BENCH_THREADS verbose"     "$pcap" "$pcap_packets" -j "$BENCH_THREADS"
+run "pcapng mmap --quiet"    "$BENCH_DIR/mixed.pcapng" "$pcapng_packets" --quiet
+run "pcapng stdio --quiet"   "$BENCH_DIR/mixed.pcapng" "$pcapng_packets" --quiet --no-mmap
+run "swapped mmap --quiet"   "$BENCH_DIR/swapped.pcap" "$swapped_packets" --quiet
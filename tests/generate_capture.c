@@ -0,0 +1,902 @@
+// Synthetic gPTP capture generator for benchmarks and decoder tests.
+//
+// Simulates a set of gPTP ports exchanging Sync/Follow_Up, Pdelay, Delay_Req/Delay_Resp,
+// Announce and Signaling messages over Ethernet, UDP/IPv4 or UDP/IPv6, interleaved with
+// background traffic, and streams the frames to a classic pcap or pcapng file in either
+// byte order. Messages carry their IEEE 1588 / 802.1AS on-wire lengths, consistent
+// sequenceIds and timestamps derived from capture time, so every stage of the decoder sees
+// realistic input. Each clock starts every exchange at the interval its logMessageInterval
+// announces; background frames fill the time between exchanges at --rate. Loss drops PTP
+// messages after their sequenceId is taken; reordering swaps a record with its successor.
+// Ports can be grouped into multi-port clocks (bridges) that run every exchange on all their
+// ports at once, with the same sequenceIds. Memory use does not depend on the capture size.
+//
+// Build: make generator        Usage: bin/generate_capture --help
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_MAX_FRAME 1518
+#define GEN_MAX_PORTS 256
+#define GEN_MAX_PORTS_PER_CLOCK 16
+#define GEN_MIN_FRAME 60                    // Ethernet minimum without FCS
+#define GEN_WRITE_BUFFER (1 << 20)
+#define GEN_BASE_TIME_NS 1700000000000000000LL
+#define GEN_PATH_DELAY_NS 800               // One-way delay between neighbouring ports
+#define GEN_PTP_HEADER_LENGTH 34
+#define GEN_MESSAGE_GAP_NS 20000            // Most time between the messages of one exchange
+#define GEN_MAX_LOG_INTERVAL 8              // Most messages per second of one exchange: 2^8
+
+#define PCAP_MAGIC_USEC 0xA1B2C3D4u
+#define PCAP_MAGIC_NSEC 0xA1B23C4Du
+#define PCAPNG_SHB_TYPE 0x0A0D0D0Au
+#define PCAPNG_IDB_TYPE 0x00000001u
+#define PCAPNG_EPB_TYPE 0x00000006u
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4Du
+
+/* Exchanges a port can start; each emits one or more PTP messages */
+typedef enum {
+    EXCHANGE_SYNC = 0,      // Sync + Follow_Up
+    EXCHANGE_PDELAY,        // Pdelay_Req + Pdelay_Resp + Pdelay_Resp_Follow_Up
+    EXCHANGE_DELAY,         // Delay_Req + Delay_Resp
+    EXCHANGE_ANNOUNCE,
+    EXCHANGE_SIGNALING,
+    EXCHANGE_COUNT
+} exchange_t;
+
+typedef enum {
+    TRANSPORT_L2 = 0,
+    TRANSPORT_IPV4,
+    TRANSPORT_IPV6,
+    TRANSPORT_COUNT
+} transport_t;
+
+static const char* const exchange_names[EXCHANGE_COUNT] = { "sync", "pdelay", "delay", "announce", "signaling" };
+static const char* const transport_names[TRANSPORT_COUNT] = { "l2", "ipv4", "ipv6" };
+
+typedef struct {
+    const char* output_path;
+    int pcapng;
+    int big_endian;
+    int nanosecond;
+    uint64_t packets;
+    uint64_t size_bytes;            // Stop once the file reaches this size instead, 0 if unused
+    unsigned exchange_weights[EXCHANGE_COUNT];
+    unsigned transport_weights[TRANSPORT_COUNT];
+    double vlan_percent;
+    double background_percent;
+    double loss_percent;
+    double reorder_percent;
+    unsigned ports;
+    unsigned ports_per_clock;       // Ports sharing one clock identity, numbered from 1
+    uint64_t rate;                  // Mean background frames per second of capture time
+    uint64_t seed;
+} gen_options_t;
+
+/* Per-port sequenceIds, one counter per exchange as in IEEE 1588 */
+typedef struct {
+    uint16_t sequence[EXCHANGE_COUNT];
+    int64_t offset_ns;              // Port clock minus capture clock
+    int64_t next_ns[EXCHANGE_COUNT];    // When the clock next starts each exchange; kept on its first port
+} gen_port_t;
+
+typedef struct {
+    uint8_t data[GEN_MAX_FRAME];
+    uint32_t length;
+    int64_t ts_ns;
+} gen_frame_t;
+
+typedef struct {
+    const gen_options_t* options;
+    FILE* file;
+    gen_port_t ports[GEN_MAX_PORTS];
+    int8_t log_interval[EXCHANGE_COUNT];    // logMessageInterval of each exchange, from its weight
+    int64_t now_ns;
+    uint64_t rng;
+    uint64_t packets;               // Records written
+    uint64_t frames;                // Records written or held back for reordering
+    uint64_t ptp_packets;
+    uint64_t bytes;                 // File bytes written
+    gen_frame_t held;               // Record waiting to be written after its successor
+    int holding;
+    uint8_t filler[GEN_MAX_FRAME];  // Payload bytes for background frames
+} generator_t;
+
+/* Random numbers (splitmix64) */
+static uint64_t next_random(generator_t* gen) {
+    uint64_t z = (gen->rng += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t random_below(generator_t* gen, uint64_t bound) {
+    return bound ? next_random(gen) % bound : 0;
+}
+
+static int random_chance(generator_t* gen, double percent) {
+    return percent > 0.0 && (double)random_below(gen, 1000000) < percent * 10000.0;
+}
+
+static int random_weighted(generator_t* gen, const unsigned* weights, int count) {
+    uint64_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += weights[i];
+    }
+    uint64_t pick = random_below(gen, total);
+    for (int i = 0; i < count; i++) {
+        if (pick < weights[i]) {
+            return i;
+        }
+        pick -= weights[i];
+    }
+    return 0;
+}
+
+/* Network byte order writers for frame contents */
+static void put_be16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v; }
+static void put_be32(uint8_t* p, uint32_t v) { put_be16(p, (uint16_t)(v >> 16)); put_be16(p + 2, (uint16_t)v); }
+static void put_be64(uint8_t* p, uint64_t v) { put_be32(p, (uint32_t)(v >> 32)); put_be32(p + 4, (uint32_t)v); }
+
+/* PTP timestamp: 48-bit seconds, 32-bit nanoseconds */
+static void put_timestamp(uint8_t* p, int64_t ns) {
+    uint64_t seconds = (uint64_t)(ns / 1000000000LL);
+    put_be16(p, (uint16_t)(seconds >> 32));
+    put_be32(p + 2, (uint32_t)seconds);
+    put_be32(p + 6, (uint32_t)(ns % 1000000000LL));
+}
+
+static uint64_t clock_id(unsigned clock) {
+    return 0x001B19FFFE000000ULL | clock;  // EUI-64 built from a MAC with FF-FE inserted
+}
+
+static void put_port_identity(const generator_t* gen, uint8_t* p, unsigned port) {
+    unsigned ports_per_clock = gen->options->ports_per_clock;
+    put_be64(p, clock_id(port / ports_per_clock));
+    put_be16(p + 8, (uint16_t)(port % ports_per_clock + 1));
+}
+
+static void put_port_mac(uint8_t* p, unsigned port) {
+    static const uint8_t prefix[3] = { 0x00, 0x1B, 0x19 };
+    memcpy(p, prefix, 3);
+    p[3] = 0x00;
+    p[4] = (uint8_t)(port >> 8);
+    p[5] = (uint8_t)port;
+}
+
+/* Writers for the file's own headers, in the chosen byte order */
+static int write_bytes(generator_t* gen, const void* data, size_t length) {
+    if (fwrite(data, 1, length, gen->file) != length) {
+        perror("Error writing capture");
+        return -1;
+    }
+    gen->bytes += length;
+    return 0;
+}
+
+static int write_u16(generator_t* gen, uint16_t v) {
+    uint8_t b[2];
+    if (gen->options->big_endian) {
+        put_be16(b, v);
+    } else {
+        b[0] = (uint8_t)v; b[1] = (uint8_t)(v >> 8);
+    }
+    return write_bytes(gen, b, sizeof(b));
+}
+
+static int write_u32(generator_t* gen, uint32_t v) {
+    uint8_t b[4];
+    if (gen->options->big_endian) {
+        put_be32(b, v);
+    } else {
+        for (int i = 0; i < 4; i++) {
+            b[i] = (uint8_t)(v >> (8 * i));
+        }
+    }
+    return write_bytes(gen, b, sizeof(b));
+}
+
+/*
+ * Writes the pcap global header, or the pcapng Section Header and Interface Description Blocks.
+ * @return 0 on success, -1 on write error.
+ */
+static int write_file_header(generator_t* gen) {
+    const gen_options_t* opt = gen->options;
+    if (!opt->pcapng) {
+        return write_u32(gen, opt->nanosecond ? PCAP_MAGIC_NSEC : PCAP_MAGIC_USEC) | write_u16(gen, 2) | write_u16(gen, 4) |
+               write_u32(gen, 0) | write_u32(gen, 0) | write_u32(gen, 65535) | write_u32(gen, 1);
+    }
+    int result = write_u32(gen, PCAPNG_SHB_TYPE) | write_u32(gen, 28) | write_u32(gen, PCAPNG_BYTE_ORDER_MAGIC) |
+                 write_u16(gen, 1) | write_u16(gen, 0) | write_u32(gen, 0xFFFFFFFFu) | write_u32(gen, 0xFFFFFFFFu) | write_u32(gen, 28);
+    // Interface 0: Ethernet, with if_tsresol = 10^-9 for nanosecond timestamps
+    uint32_t idb_length = opt->nanosecond ? 32 : 20;
+    result |= write_u32(gen, PCAPNG_IDB_TYPE) | write_u32(gen, idb_length) | write_u16(gen, 1) | write_u16(gen, 0) | write_u32(gen, 65535);
+    if (opt->nanosecond) {
+        static const uint8_t tsresol_value[4] = { 9, 0, 0, 0 };
+        result |= write_u16(gen, 9) | write_u16(gen, 1) | write_bytes(gen, tsresol_value, sizeof(tsresol_value));
+        result |= write_u16(gen, 0) | write_u16(gen, 0);
+    }
+    return result | write_u32(gen, idb_length);
+}
+
+/*
+ * Writes one record: a pcap record header or a pcapng Enhanced Packet Block around the frame.
+ * @return 0 on success, -1 on write error.
+ */
+static int write_record(generator_t* gen, const gen_frame_t* frame) {
+    const gen_options_t* opt = gen->options;
+    uint64_t seconds = (uint64_t)(frame->ts_ns / 1000000000LL);
+    uint64_t fraction = (uint64_t)(frame->ts_ns % 1000000000LL);
+    if (!opt->nanosecond) {
+        fraction /= 1000;
+    }
+    int result;
+    if (!opt->pcapng) {
+        result = write_u32(gen, (uint32_t)seconds) | write_u32(gen, (uint32_t)fraction) |
+                 write_u32(gen, frame->length) | write_u32(gen, frame->length) |
+                 write_bytes(gen, frame->data, frame->length);
+    } else {
+        static const uint8_t padding[4] = { 0 };
+        uint32_t padded = (frame->length + 3u) & ~3u;
+        uint64_t timestamp = seconds * (opt->nanosecond ? 1000000000ULL : 1000000ULL) + fraction;
+        result = write_u32(gen, PCAPNG_EPB_TYPE) | write_u32(gen, 32 + padded) | write_u32(gen, 0) |
+                 write_u32(gen, (uint32_t)(timestamp >> 32)) | write_u32(gen, (uint32_t)timestamp) |
+                 write_u32(gen, frame->length) | write_u32(gen, frame->length) |
+                 write_bytes(gen, frame->data, frame->length) | write_bytes(gen, padding, padded - frame->length) |
+                 write_u32(gen, 32 + padded);
+    }
+    gen->packets++;
+    return result;
+}
+
+/*
+ * Emits a frame, possibly holding it back so that it is written after the next one.
+ * @return 0 on success, -1 on write error.
+ */
+static int emit_frame(generator_t* gen, const gen_frame_t* frame) {
+    gen->frames++;
+    if (gen->holding) {
+        gen->holding = 0;
+        return write_record(gen, frame) | write_record(gen, &gen->held);
+    }
+    if (random_chance(gen, gen->options->reorder_percent)) {
+        gen->held = *frame;
+        gen->holding = 1;
+        return 0;
+    }
+    return write_record(gen, frame);
+}
+
+/*
+ * @return Whether the capture is complete. A record held back for reordering counts
+ * towards --packets, so the file ends with exactly that many records.
+ */
+static int done(const generator_t* gen) {
+    const gen_options_t* opt = gen->options;
+    return opt->size_bytes ? gen->bytes >= opt->size_bytes : gen->frames >= opt->packets;
+}
+
+static int64_t interval_ns(int8_t log_interval) {
+    return log_interval >= 0 ? 1000000000LL << log_interval : 1000000000LL >> -log_interval;
+}
+
+/*
+ * Writes the Ethernet header and an optional VLAN tag.
+ * @return Offset of the EtherType's payload.
+ */
+static uint32_t build_ethernet(generator_t* gen, uint8_t* p, const uint8_t dst[6], const uint8_t src[6], uint16_t ethertype) {
+    memcpy(p, dst, 6);
+    memcpy(p + 6, src, 6);
+    uint32_t offset = 12;
+    if (random_chance(gen, gen->options->vlan_percent)) {
+        put_be16(p + offset, 0x8100);
+        put_be16(p + offset + 2, (uint16_t)(3 << 13 | 10));    // PCP 3, VID 10
+        offset += 4;
+    }
+    put_be16(p + offset, ethertype);
+    return offset + 2;
+}
+
+static uint16_t checksum_finish(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+static uint32_t checksum_add(uint32_t sum, const uint8_t* p, uint32_t length) {
+    for (uint32_t i = 0; i + 1 < length; i += 2) {
+        sum += (uint32_t)p[i] << 8 | p[i + 1];
+    }
+    if (length & 1) {
+        sum += (uint32_t)p[length - 1] << 8;
+    }
+    return sum;
+}
+
+static void build_ipv4(uint8_t* p, uint32_t payload_length, uint8_t protocol, const uint8_t src[4], const uint8_t dst[4]) {
+    memset(p, 0, 20);
+    p[0] = 0x45;
+    put_be16(p + 2, (uint16_t)(20 + payload_length));
+    p[8] = protocol == 17 ? 1 : 64;     // PTP multicast stays on the link
+    p[9] = protocol;
+    memcpy(p + 12, src, 4);
+    memcpy(p + 16, dst, 4);
+    put_be16(p + 10, checksum_finish(checksum_add(0, p, 20)));
+}
+
+static void build_ipv6(uint8_t* p, uint32_t payload_length, uint8_t next_header, const uint8_t src[16], const uint8_t dst[16]) {
+    memset(p, 0, 40);
+    p[0] = 0x60;
+    put_be16(p + 4, (uint16_t)payload_length);
+    p[6] = next_header;
+    p[7] = 1;
+    memcpy(p + 8, src, 16);
+    memcpy(p + 24, dst, 16);
+}
+
+/*
+ * Wraps a payload already at p + 8 in a UDP header. IPv6 requires the checksum; IPv4 leaves it 0.
+ */
+static void build_udp(uint8_t* p, uint32_t payload_length, uint16_t src_port, uint16_t dst_port, const uint8_t* ipv6_header) {
+    put_be16(p, src_port);
+    put_be16(p + 2, dst_port);
+    put_be16(p + 4, (uint16_t)(8 + payload_length));
+    put_be16(p + 6, 0);
+    if (ipv6_header != NULL) {
+        uint32_t sum = checksum_add(0, ipv6_header + 8, 32) + 17 + 8 + payload_length;
+        uint16_t checksum = checksum_finish(checksum_add(sum, p, 8 + payload_length));
+        put_be16(p + 6, checksum ? checksum : 0xFFFF);
+    }
+}
+
+static void pad_frame(gen_frame_t* frame) {
+    if (frame->length < GEN_MIN_FRAME) {
+        memset(frame->data + frame->length, 0, GEN_MIN_FRAME - frame->length);
+        frame->length = GEN_MIN_FRAME;
+    }
+}
+
+/*
+ * Frames a PTP message for the chosen transport and emits it, unless it is lost.
+ * @param message The message, message_length bytes.
+ * @param port The sending port.
+ * @param peer_delay Whether the message belongs to the peer delay mechanism.
+ * @return 0 on success, -1 on write error.
+ */
+static int send_ptp(generator_t* gen, const uint8_t* message, uint32_t message_length, unsigned port, int peer_delay) {
+    if (done(gen)) {
+        return 0;
+    }
+    gen->now_ns += 1 + (int64_t)random_below(gen, GEN_MESSAGE_GAP_NS);
+    if (random_chance(gen, gen->options->loss_percent)) {
+        return 0;
+    }
+    static const uint8_t gptp_mac[6] = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E };
+    static const uint8_t ptp_ipv4_mac[6] = { 0x01, 0x00, 0x5E, 0x00, 0x01, 0x81 };
+    static const uint8_t pdelay_ipv4_mac[6] = { 0x01, 0x00, 0x5E, 0x00, 0x00, 0x6B };
+    static const uint8_t ptp_ipv6_mac[6] = { 0x33, 0x33, 0x00, 0x00, 0x01, 0x81 };
+    static const uint8_t pdelay_ipv6_mac[6] = { 0x33, 0x33, 0x00, 0x00, 0x00, 0x6B };
+    static const uint8_t ptp_ipv4[4] = { 224, 0, 1, 129 };
+    static const uint8_t pdelay_ipv4[4] = { 224, 0, 0, 107 };
+    static const uint8_t ptp_ipv6[16] = { 0xFF, 0x0E, [14] = 0x01, [15] = 0x81 };
+    static const uint8_t pdelay_ipv6[16] = { 0xFF, 0x02, [15] = 0x6B };
+
+    gen_frame_t frame;
+    frame.ts_ns = gen->now_ns;
+    uint8_t src_mac[6];
+    put_port_mac(src_mac, port);
+    // Event messages (types 0-3) go to port 319, general messages to 320
+    uint16_t udp_port = (message[0] & 0x0F) < 8 ? 319 : 320;
+    uint8_t* p = frame.data;
+    uint32_t offset;
+
+    switch ((transport_t)random_weighted(gen, gen->options->transport_weights, TRANSPORT_COUNT)) {
+        case TRANSPORT_IPV4: {
+            uint8_t src_ip[4] = { 192, 168, (uint8_t)(port >> 8), (uint8_t)(10 + port) };
+            offset = build_ethernet(gen, p, peer_delay ? pdelay_ipv4_mac : ptp_ipv4_mac, src_mac, 0x0800);
+            memcpy(p + offset + 28, message, message_length);
+            build_udp(p + offset + 20, message_length, udp_port, udp_port, NULL);
+            build_ipv4(p + offset, 8 + message_length, 17, src_ip, peer_delay ? pdelay_ipv4 : ptp_ipv4);
+            frame.length = offset + 28 + message_length;
+            break;
+        }
+        case TRANSPORT_IPV6: {
+            uint8_t src_ip[16] = { 0xFE, 0x80, [8] = 0x02, [9] = 0x1B, [10] = 0x19, [11] = 0xFF, [12] = 0xFE,
+                                   [14] = (uint8_t)(port >> 8), [15] = (uint8_t)port };
+            offset = build_ethernet(gen, p, peer_delay ? pdelay_ipv6_mac : ptp_ipv6_mac, src_mac, 0x86DD);
+            build_ipv6(p + offset, 8 + message_length, 17, src_ip, peer_delay ? pdelay_ipv6 : ptp_ipv6);
+            memcpy(p + offset + 48, message, message_length);
+            build_udp(p + offset + 40, message_length, udp_port, udp_port, p + offset);
+            frame.length = offset + 48 + message_length;
+            break;
+        }
+        default:
+            offset = build_ethernet(gen, p, gptp_mac, src_mac, 0x88F7);
+            memcpy(p + offset, message, message_length);
+            frame.length = offset + message_length;
+            break;
+    }
+    pad_frame(&frame);
+    gen->ptp_packets++;
+    return emit_frame(gen, &frame);
+}
+
+/* controlField: deprecated in IEEE 1588-2008 but still set for version 1 compatibility */
+static uint8_t control_field(uint8_t message_type) {
+    switch (message_type) {
+        case 0x0: return 0;     // Sync
+        case 0x1: return 1;     // Delay_Req
+        case 0x8: return 2;     // Follow_Up
+        case 0x9: return 3;     // Delay_Resp
+        default:  return 5;
+    }
+}
+
+/*
+ * Fills in a PTP common header.
+ * @return Pointer to the message body.
+ */
+static uint8_t* build_ptp_header(const generator_t* gen, uint8_t* m, uint8_t message_type, uint16_t length, unsigned port, uint16_t sequence_id,
+                                 int8_t log_interval, int two_step, int64_t correction_ns) {
+    memset(m, 0, length);
+    m[0] = (uint8_t)(0x10 | message_type);     // transportSpecific 1: 802.1AS
+    m[1] = 0x02;                                // versionPTP 2
+    put_be16(m + 2, length);
+    m[6] = two_step ? 0x02 : 0x00;              // twoStepFlag
+    m[7] = 0x08;                                // ptpTimescale
+    put_be64(m + 8, (uint64_t)(correction_ns << 16));
+    put_port_identity(gen, m + 20, port);
+    put_be16(m + 30, sequence_id);
+    m[32] = control_field(message_type);
+    m[33] = (uint8_t)log_interval;
+    return m + GEN_PTP_HEADER_LENGTH;
+}
+
+/*
+ * Emits the messages of one exchange started by a clock. Each step of the exchange is sent
+ * from every port of the clock before the next step, as a bridge forwarding in lockstep.
+ * @param first_port The clock's first port.
+ * @return 0 on success, -1 on write error.
+ */
+static int run_exchange(generator_t* gen, exchange_t exchange, unsigned first_port) {
+    const gen_options_t* opt = gen->options;
+    unsigned count = opt->ports_per_clock;
+    uint8_t m[128];
+    uint16_t sequence_ids[GEN_MAX_PORTS_PER_CLOCK];
+    int64_t sent_ns[GEN_MAX_PORTS_PER_CLOCK];
+    int8_t log_interval = gen->log_interval[exchange];
+    int result = 0;
+    for (unsigned i = 0; i < count; i++) {
+        sequence_ids[i] = gen->ports[first_port + i].sequence[exchange]++;
+    }
+
+    switch (exchange) {
+        case EXCHANGE_SYNC:
+            for (unsigned i = 0; i < count; i++) {
+                build_ptp_header(gen, m, 0x0, 44, first_port + i, sequence_ids[i], log_interval, 1, 0);
+                result |= send_ptp(gen, m, 44, first_port + i, 0);
+                sent_ns[i] = gen->now_ns;
+            }
+            for (unsigned i = 0; i < count; i++) {
+                unsigned port = first_port + i;
+                uint8_t* body = build_ptp_header(gen, m, 0x8, 76, port, sequence_ids[i], log_interval, 0, (int64_t)random_below(gen, 1000));
+                put_timestamp(body, sent_ns[i] + gen->ports[port].offset_ns - GEN_PATH_DELAY_NS);
+                // 802.1AS Follow_Up information TLV
+                put_be16(body + 10, 0x0003);
+                put_be16(body + 12, 28);
+                body[14] = 0x00; body[15] = 0x80; body[16] = 0xC2;
+                body[19] = 0x01;
+                result |= send_ptp(gen, m, 76, port, 0);
+            }
+            return result;
+        case EXCHANGE_PDELAY:
+            // Each port's link partner is the port with the same number on the next clock
+            for (unsigned i = 0; i < count; i++) {
+                build_ptp_header(gen, m, 0x2, 54, first_port + i, sequence_ids[i], log_interval, 0, 0);
+                result |= send_ptp(gen, m, 54, first_port + i, 1);
+                sent_ns[i] = gen->now_ns;
+            }
+            for (unsigned i = 0; i < count; i++) {
+                unsigned port = first_port + i;
+                unsigned peer = (port + count) % opt->ports;
+                uint8_t* body = build_ptp_header(gen, m, 0x3, 54, peer, sequence_ids[i], 0x7F, 1, 0);
+                put_timestamp(body, sent_ns[i] + GEN_PATH_DELAY_NS + gen->ports[peer].offset_ns);
+                put_port_identity(gen, body + 10, port);
+                result |= send_ptp(gen, m, 54, peer, 1);
+                sent_ns[i] = gen->now_ns;
+            }
+            for (unsigned i = 0; i < count; i++) {
+                unsigned port = first_port + i;
+                unsigned peer = (port + count) % opt->ports;
+                uint8_t* body = build_ptp_header(gen, m, 0xA, 54, peer, sequence_ids[i], 0x7F, 0, 0);
+                put_timestamp(body, sent_ns[i] - GEN_PATH_DELAY_NS + gen->ports[peer].offset_ns);
+                put_port_identity(gen, body + 10, port);
+                result |= send_ptp(gen, m, 54, peer, 1);
+            }
+            return result;
+        case EXCHANGE_DELAY:
+            for (unsigned i = 0; i < count; i++) {
+                unsigned port = first_port + i;
+                uint8_t* body = build_ptp_header(gen, m, 0x1, 44, port, sequence_ids[i], 0x7F, 0, 0);
+                put_timestamp(body, gen->now_ns + gen->ports[port].offset_ns);
+                result |= send_ptp(gen, m, 44, port, 0);
+                sent_ns[i] = gen->now_ns;
+            }
+            for (unsigned i = 0; i < count; i++) {
+                unsigned port = first_port + i;
+                unsigned peer = (port + count) % opt->ports;
+                uint8_t* body = build_ptp_header(gen, m, 0x9, 54, peer, sequence_ids[i], log_interval, 0, 0);
+                put_timestamp(body, sent_ns[i] + GEN_PATH_DELAY_NS + gen->ports[peer].offset_ns);
+                put_port_identity(gen, body + 10, port);
+                result |= send_ptp(gen, m, 54, peer, 0);
+            }
+            return result;
+        case EXCHANGE_ANNOUNCE:
+            for (unsigned i = 0; i < count; i++) {
+                unsigned port = first_port + i;
+                uint8_t* body = build_ptp_header(gen, m, 0xB, 76, port, sequence_ids[i], log_interval, 0, 0);
+                put_be16(body + 10, 37);            // currentUtcOffset
+                body[13] = 246;                     // grandmasterPriority1
+                body[14] = 248;                     // clockClass, clockAccuracy, offsetScaledLogVariance
+                body[15] = 0xFE;
+                put_be16(body + 16, 0x4100);
+                body[18] = 248;                     // grandmasterPriority2
+                put_be64(body + 19, clock_id(0));
+                put_be16(body + 27, (uint16_t)(port / count));  // stepsRemoved
+                body[29] = 0xA0;                    // timeSource: internal oscillator
+                put_be16(body + 30, 0x0008);        // Path trace TLV with the grandmaster
+                put_be16(body + 32, 8);
+                put_be64(body + 34, clock_id(0));
+                result |= send_ptp(gen, m, 76, port, 0);
+            }
+            return result;
+        case EXCHANGE_SIGNALING:
+            for (unsigned i = 0; i < count; i++) {
+                uint8_t* body = build_ptp_header(gen, m, 0xC, 60, first_port + i, sequence_ids[i], 0x7F, 0, 0);
+                memset(body, 0xFF, 10);             // targetPortIdentity: all ports
+                put_be16(body + 10, 0x0003);        // 802.1AS message interval request TLV
+                put_be16(body + 12, 12);
+                body[14] = 0x00; body[15] = 0x80; body[16] = 0xC2;
+                body[19] = 0x02;
+                body[20] = (uint8_t)gen->log_interval[EXCHANGE_PDELAY];
+                body[21] = (uint8_t)gen->log_interval[EXCHANGE_SYNC];
+                body[22] = (uint8_t)gen->log_interval[EXCHANGE_ANNOUNCE];
+                result |= send_ptp(gen, m, 60, first_port + i, 0);
+            }
+            return result;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Emits one non-PTP frame: UDP or TCP over IPv4, UDP over IPv6, ARP or LLDP.
+ * @return 0 on success, -1 on write error.
+ */
+static int send_background(generator_t* gen) {
+    static const uint8_t broadcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    static const uint8_t lldp_mac[6] = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E };
+    if (done(gen)) {
+        return 0;
+    }
+    uint64_t mean_ns = 1000000000ULL / gen->options->rate;
+    gen->now_ns += (int64_t)random_below(gen, 2 * mean_ns + 1);
+
+    gen_frame_t frame;
+    frame.ts_ns = gen->now_ns;
+    uint8_t* p = frame.data;
+    uint8_t src_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, (uint8_t)random_below(gen, 256) };
+    uint8_t dst_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x01, (uint8_t)random_below(gen, 256) };
+    uint8_t src_ip[4] = { 10, 0, 0, src_mac[5] };
+    uint8_t dst_ip[4] = { 10, 0, 1, dst_mac[5] };
+    uint64_t kind = random_below(gen, 100);
+    uint32_t offset;
+
+    if (kind < 45) {
+        // UDP over IPv4 on ports clear of 319/320
+        uint32_t payload = 18 + (uint32_t)random_below(gen, 1400);
+        offset = build_ethernet(gen, p, dst_mac, src_mac, 0x0800);
+        memcpy(p + offset + 28, gen->filler, payload);
+        build_udp(p + offset + 20, payload, (uint16_t)(1024 + random_below(gen, 60000)), 5004, NULL);
+        build_ipv4(p + offset, 8 + payload, 17, src_ip, dst_ip);
+        frame.length = offset + 28 + payload;
+    } else if (kind < 80) {
+        // TCP over IPv4: a 20-byte header and a segment of data
+        uint32_t payload = (uint32_t)random_below(gen, 1441);
+        offset = build_ethernet(gen, p, dst_mac, src_mac, 0x0800);
+        memset(p + offset + 20, 0, 20);
+        put_be16(p + offset + 20, (uint16_t)(1024 + random_below(gen, 60000)));
+        put_be16(p + offset + 22, 443);
+        p[offset + 32] = 0x50;
+        p[offset + 33] = 0x18;
+        memcpy(p + offset + 40, gen->filler, payload);
+        build_ipv4(p + offset, 20 + payload, 6, src_ip, dst_ip);
+        frame.length = offset + 40 + payload;
+    } else if (kind < 90) {
+        uint8_t src6[16] = { 0xFD, 0x00, [15] = src_mac[5] };
+        uint8_t dst6[16] = { 0xFD, 0x00, [14] = 1, [15] = dst_mac[5] };
+        uint32_t payload = 18 + (uint32_t)random_below(gen, 1380);
+        offset = build_ethernet(gen, p, dst_mac, src_mac, 0x86DD);
+        build_ipv6(p + offset, 8 + payload, 17, src6, dst6);
+        memcpy(p + offset + 48, gen->filler, payload);
+        build_udp(p + offset + 40, payload, 5353, 5353, p + offset);
+        frame.length = offset + 48 + payload;
+    } else if (kind < 97) {
+        // ARP request
+        offset = build_ethernet(gen, p, broadcast, src_mac, 0x0806);
+        put_be16(p + offset, 1);
+        put_be16(p + offset + 2, 0x0800);
+        p[offset + 4] = 6;
+        p[offset + 5] = 4;
+        put_be16(p + offset + 6, 1);
+        memcpy(p + offset + 8, src_mac, 6);
+        memcpy(p + offset + 14, src_ip, 4);
+        memset(p + offset + 18, 0, 6);
+        memcpy(p + offset + 24, dst_ip, 4);
+        frame.length = offset + 28;
+    } else {
+        // LLDP: chassis ID, port ID, TTL and end TLVs
+        static const uint8_t lldp[] = { 0x02, 0x07, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+                                        0x04, 0x03, 0x07, 0x70, 0x31, 0x06, 0x02, 0x00, 0x78, 0x00, 0x00 };
+        offset = build_ethernet(gen, p, lldp_mac, src_mac, 0x88CC);
+        memcpy(p + offset, lldp, sizeof(lldp));
+        frame.length = offset + (uint32_t)sizeof(lldp);
+    }
+    pad_frame(&frame);
+    return emit_frame(gen, &frame);
+}
+
+/*
+ * Generates the capture described by the options.
+ * @return 0 on success, -1 on write error.
+ */
+static int generate(generator_t* gen) {
+    const gen_options_t* opt = gen->options;
+    gen->rng = opt->seed;
+    gen->now_ns = GEN_BASE_TIME_NS;
+    // An exchange of weight W runs 2^floor(log2 W) times a second and says so in its messages
+    for (int e = 0; e < EXCHANGE_COUNT; e++) {
+        int log_rate = 0;
+        while (log_rate < GEN_MAX_LOG_INTERVAL && opt->exchange_weights[e] >> (log_rate + 1) != 0) {
+            log_rate++;
+        }
+        gen->log_interval[e] = (int8_t)-log_rate;
+    }
+    for (size_t i = 0; i < sizeof(gen->filler); i++) {
+        gen->filler[i] = (uint8_t)next_random(gen);
+    }
+    for (unsigned i = 0; i < opt->ports; i++) {
+        gen->ports[i].offset_ns = (int64_t)random_below(gen, 20001) - 10000;
+        for (int e = 0; e < EXCHANGE_COUNT; e++) {
+            gen->ports[i].sequence[e] = (uint16_t)next_random(gen);
+            // Clocks start each exchange at a random phase of its interval; weight 0 never runs
+            gen->ports[i].next_ns[e] = opt->exchange_weights[e] == 0 ? INT64_MAX :
+                                       GEN_BASE_TIME_NS + (int64_t)random_below(gen, (uint64_t)interval_ns(gen->log_interval[e]));
+        }
+        // Ports of one clock share its time and start their sequenceIds together
+        if (i % opt->ports_per_clock != 0) {
+            gen->ports[i] = gen->ports[i - 1];
+        }
+    }
+
+    if (write_file_header(gen) != 0) {
+        return -1;
+    }
+    while (!done(gen)) {
+        int result;
+        if (random_chance(gen, opt->background_percent)) {
+            result = send_background(gen);
+        } else {
+            // The exchange due first starts then, or as soon as the frames before it are sent
+            unsigned first_port = 0;
+            exchange_t exchange = EXCHANGE_SYNC;
+            for (unsigned port = 0; port < opt->ports; port += opt->ports_per_clock) {
+                for (int e = 0; e < EXCHANGE_COUNT; e++) {
+                    if (gen->ports[port].next_ns[e] < gen->ports[first_port].next_ns[exchange]) {
+                        first_port = port;
+                        exchange = (exchange_t)e;
+                    }
+                }
+            }
+            int64_t* next_ns = &gen->ports[first_port].next_ns[exchange];
+            if (gen->now_ns < *next_ns) {
+                gen->now_ns = *next_ns;
+            }
+            // Intervals vary by up to 1/128 of nominal, well inside the decoder's tolerance
+            int64_t nominal_ns = interval_ns(gen->log_interval[exchange]);
+            *next_ns = gen->now_ns + nominal_ns - nominal_ns / 128 + (int64_t)random_below(gen, (uint64_t)nominal_ns / 64 + 1);
+            result = run_exchange(gen, exchange, first_port);
+        }
+        if (result != 0) {
+            return -1;
+        }
+    }
+    if (gen->holding) {
+        gen->holding = 0;
+        return write_record(gen, &gen->held);
+    }
+    return 0;
+}
+
+/*
+ * Parses "name=weight,..." into weights indexed like names. Unnamed entries become 0.
+ * @return 0 on success, -1 on an unknown name or a bad weight.
+ */
+static int parse_weights(const char* spec, const char* const* names, int count, unsigned* weights) {
+    memset(weights, 0, count * sizeof(*weights));
+    unsigned total = 0;
+    while (*spec != '\0') {
+        const char* equals = strchr(spec, '=');
+        if (equals == NULL) {
+            return -1;
+        }
+        int index = -1;
+        for (int i = 0; i < count; i++) {
+            if (strlen(names[i]) == (size_t)(equals - spec) && strncmp(spec, names[i], equals - spec) == 0) {
+                index = i;
+            }
+        }
+        char* end;
+        unsigned long weight = strtoul(equals + 1, &end, 10);
+        if (index < 0 || end == equals + 1 || (*end != ',' && *end != '\0') || weight > 1000000) {
+            return -1;
+        }
+        weights[index] = (unsigned)weight;
+        total += (unsigned)weight;
+        spec = *end == ',' ? end + 1 : end;
+    }
+    return total > 0 ? 0 : -1;
+}
+
+/*
+ * Parses a byte count with an optional K, M or G suffix (powers of 1024).
+ * @return The count, or 0 if it is invalid.
+ */
+static uint64_t parse_size(const char* text) {
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+    switch (*end) {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default: break;
+    }
+    return *end == '\0' ? value : 0;
+}
+
+static double parse_percent(const char* text, int* error) {
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || *end != '\0' || value < 0.0 || value > 100.0) {
+        *error = 1;
+    }
+    return value;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s -o FILE|- [options]\n"
+            "  --format pcap|pcapng       Container format (default pcap)\n"
+            "  --packets N                Records to write (default 1000000)\n"
+            "  --size BYTES[K|M|G]        Write until the file reaches this size instead\n"
+            "  --mix NAME=W,...           Exchange rates: sync, pdelay, delay, announce, signaling; each\n"
+            "                             clock runs an exchange 2^floor(log2 W) times a second\n"
+            "                             (default sync=8,pdelay=2,announce=1)\n"
+            "  --transport NAME=W,...     PTP transport weights: l2, ipv4, ipv6 (default l2=1)\n"
+            "  --vlan PCT                 Frames carrying an 802.1Q tag (default 0)\n"
+            "  --background PCT           Frames that are not PTP (default 50)\n"
+            "  --loss PCT                 PTP messages dropped (default 0)\n"
+            "  --reorder PCT              Records swapped with their successor (default 0)\n"
+            "  --byte-order little|big    Byte order of the file headers (default little)\n"
+            "  --nanosecond               Nanosecond timestamps\n"
+            "  --ports N                  gPTP ports exchanging messages (default 4, at most %d)\n"
+            "  --ports-per-clock N        Ports of each clock, sending in lockstep (default 1, at most %d)\n"
+            "  --rate N                   Mean background frames per second of capture time (default 100000)\n"
+            "  --seed N                   Random seed (default 1)\n",
+            program, GEN_MAX_PORTS, GEN_MAX_PORTS_PER_CLOCK);
+}
+
+int main(int argc, char* argv[]) {
+    gen_options_t opt = {0};
+    opt.packets = 1000000;
+    opt.exchange_weights[EXCHANGE_SYNC] = 8;
+    opt.exchange_weights[EXCHANGE_PDELAY] = 2;
+    opt.exchange_weights[EXCHANGE_ANNOUNCE] = 1;
+    opt.transport_weights[TRANSPORT_L2] = 1;
+    opt.background_percent = 50.0;
+    opt.ports = 4;
+    opt.ports_per_clock = 1;
+    opt.rate = 100000;
+    opt.seed = 1;
+
+    int error = 0;
+    for (int i = 1; i < argc && !error; i++) {
+        const char* option = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--nanosecond") == 0) {
+            opt.nanosecond = 1;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (value == NULL) {
+            error = 1;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            opt.output_path = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0) {
+            opt.pcapng = strcmp(value, "pcapng") == 0;
+            error = !opt.pcapng && strcmp(value, "pcap") != 0;
+            i++;
+        } else if (strcmp(argv[i], "--packets") == 0) {
+            opt.packets = strtoull(argv[++i], NULL, 10);
+            error = opt.packets == 0;
+        } else if (strcmp(argv[i], "--size") == 0) {
+            opt.size_bytes = parse_size(argv[++i]);
+            error = opt.size_bytes == 0;
+        } else if (strcmp(argv[i], "--mix") == 0) {
+            error = parse_weights(argv[++i], exchange_names, EXCHANGE_COUNT, opt.exchange_weights) != 0;
+        } else if (strcmp(argv[i], "--transport") == 0) {
+            error = parse_weights(argv[++i], transport_names, TRANSPORT_COUNT, opt.transport_weights) != 0;
+        } else if (strcmp(argv[i], "--vlan") == 0) {
+            opt.vlan_percent = parse_percent(argv[++i], &error);
+        } else if (strcmp(argv[i], "--background") == 0) {
+            opt.background_percent = parse_percent(argv[++i], &error);
+        } else if (strcmp(argv[i], "--loss") == 0) {
+            opt.loss_percent = parse_percent(argv[++i], &error);
+        } else if (strcmp(argv[i], "--reorder") == 0) {
+            opt.reorder_percent = parse_percent(argv[++i], &error);
+        } else if (strcmp(argv[i], "--byte-order") == 0) {
+            opt.big_endian = strcmp(value, "big") == 0;
+            error = !opt.big_endian && strcmp(value, "little") != 0;
+            i++;
+        } else if (strcmp(argv[i], "--ports") == 0) {
+            opt.ports = (unsigned)strtoul(argv[++i], NULL, 10);
+            error = opt.ports == 0 || opt.ports > GEN_MAX_PORTS;
+        } else if (strcmp(argv[i], "--ports-per-clock") == 0) {
+            opt.ports_per_clock = (unsigned)strtoul(argv[++i], NULL, 10);
+            error = opt.ports_per_clock == 0 || opt.ports_per_clock > GEN_MAX_PORTS_PER_CLOCK;
+        } else if (strcmp(argv[i], "--rate") == 0) {
+            opt.rate = strtoull(argv[++i], NULL, 10);
+            error = opt.rate == 0 || opt.rate > 1000000000ULL;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            opt.seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            error = 1;
+        }
+        if (error) {
+            fprintf(stderr, "Invalid option or value: %s\n", option);
+        }
+    }
+    if (!error && opt.ports % opt.ports_per_clock != 0) {
+        fprintf(stderr, "--ports must be a multiple of --ports-per-clock\n");
+        error = 1;
+    }
+    if (error || opt.output_path == NULL) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    static generator_t gen;
+    gen.options = &opt;
+    int to_stdout = strcmp(opt.output_path, "-") == 0;
+    gen.file = to_stdout ? stdout : fopen(opt.output_path, "wb");
+    if (gen.file == NULL) {
+        perror("Error opening file for writing");
+        return 1;
+    }
+    setvbuf(gen.file, NULL, _IOFBF, GEN_WRITE_BUFFER);
+
+    int result = generate(&gen);
+    if ((to_stdout ? fflush(gen.file) : fclose(gen.file)) != 0 && result == 0) {
+        perror("Error writing capture");
+        result = -1;
+    }
+    if (result != 0) {
+        return 1;
+    }
+    fprintf(stderr, "Wrote %llu packets (%llu PTP), %llu bytes to %s\n", (unsigned long long)gen.packets,
+            (unsigned long long)gen.ptp_packets, (unsigned long long)gen.bytes, opt.output_path);
+    return 0;
+}
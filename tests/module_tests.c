@@ -0,0 +1,1305 @@
+// Tests of individual modules on inputs with known results.
+//
+// Unlike parser_tests, these call a module's functions directly instead of decoding a
+// capture. Run through `make test`, which links the parser's objects without main.o.
+//
+// Usage: module_tests
+
+#include "../include/packet_filter.h"
+#include "../include/ethernet.h"
+#include "../include/ip.h"
+#include "../include/ptp.h"
+#include "../include/ptp_prefilter.h"
+#include "../include/hash_table.h"
+#include "../include/timing_wheel.h"
+#include "../include/ptp_offset.h"
+#include "../include/hdr_histogram.h"
+#include "../include/histogram_set.h"
+#include "../include/sequence_tracker.h"
+#include "../include/allan_deviation.h"
+#include "../include/bmca_tracker.h"
+#include "../include/interval_analyzer.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+        unsigned long long actual_value = (unsigned long long)(actual); \
+        unsigned long long expected_value = (unsigned long long)(expected); \
+        if (actual_value != expected_value) { \
+            fprintf(stderr, "%s:%d: %s is %llu, expected %llu\n", __FILE__, __LINE__, #actual, actual_value, expected_value); \
+            failures++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, relative) do { \
+        double actual_value = (actual); \
+        double expected_value = (expected); \
+        if (!(fabs(actual_value - expected_value) <= (relative) * fabs(expected_value))) { \
+            fprintf(stderr, "%s:%d: %s is %g, expected %g\n", __FILE__, __LINE__, #actual, actual_value, expected_value); \
+            failures++; \
+        } \
+    } while (0)
+
+static void put16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+/* PTP frame of the filter tests; addresses are fixed, see build_ptp_frame() */
+typedef struct {
+    int vlan;                       // VLAN ID, or -1 for an untagged frame
+    int ip_version;                 // 4 or 6 for UDP transport, 0 for layer 2
+    uint8_t domain;
+    uint8_t message_type;
+    uint64_t clock_id;
+} test_ptp_frame_t;
+
+/*
+ * Builds a 44-byte PTP message from 00:1b:19:00:00:01 to 01:1b:19:00:00:00, and over UDP
+ * from 192.168.0.10 to 224.0.1.129 or from fe80::1 to ff0e::181. The VLAN tag carries
+ * priority 3, which "vlan ID" must mask off.
+ * @return Length of the frame.
+ */
+static uint32_t build_ptp_frame(uint8_t* frame, const test_ptp_frame_t* spec) {
+    static const uint8_t dst_mac[6] = { 0x01, 0x1B, 0x19, 0x00, 0x00, 0x00 };
+    static const uint8_t src_mac[6] = { 0x00, 0x1B, 0x19, 0x00, 0x00, 0x01 };
+    static const uint8_t src_ipv4[4] = { 192, 168, 0, 10 };
+    static const uint8_t dst_ipv4[4] = { 224, 0, 1, 129 };
+    static const uint8_t src_ipv6[16] = { 0xFE, 0x80, [15] = 0x01 };
+    static const uint8_t dst_ipv6[16] = { 0xFF, 0x0E, [14] = 0x01, [15] = 0x81 };
+    memset(frame, 0, 128);
+    memcpy(frame, dst_mac, 6);
+    memcpy(frame + 6, src_mac, 6);
+    uint32_t offset = 12;
+    if (spec->vlan >= 0) {
+        put16(frame + offset, ETHERTYPE_VLAN);
+        put16(frame + offset + 2, (uint16_t)(0x6000 | spec->vlan));
+        offset += 4;
+    }
+    uint8_t* ptp;
+    if (spec->ip_version == 4) {
+        put16(frame + offset, ETHERTYPE_IPV4);
+        uint8_t* ip = frame + offset + 2;
+        ip[0] = 0x45;
+        put16(ip + 2, 20 + 8 + 44);
+        ip[8] = 1;
+        ip[9] = 17;
+        memcpy(ip + 12, src_ipv4, 4);
+        memcpy(ip + 16, dst_ipv4, 4);
+        put16(ip + 20, PTP_EVENT_PORT);
+        put16(ip + 22, PTP_EVENT_PORT);
+        put16(ip + 24, 8 + 44);
+        ptp = ip + 28;
+    } else if (spec->ip_version == 6) {
+        put16(frame + offset, ETHERTYPE_IPV6);
+        uint8_t* ip = frame + offset + 2;
+        ip[0] = 0x60;
+        put16(ip + 4, 8 + 44);
+        ip[6] = 17;
+        ip[7] = 1;
+        memcpy(ip + 8, src_ipv6, 16);
+        memcpy(ip + 24, dst_ipv6, 16);
+        put16(ip + 40, PTP_EVENT_PORT);
+        put16(ip + 42, PTP_EVENT_PORT);
+        put16(ip + 44, 8 + 44);
+        ptp = ip + 48;
+    } else {
+        put16(frame + offset, ETHERTYPE_PTP);
+        ptp = frame + offset + 2;
+    }
+    ptp[0] = (uint8_t)((spec->ip_version == 0 ? 0x10 : 0x00) | spec->message_type);
+    ptp[1] = 2;
+    put16(ptp + 2, 44);
+    ptp[4] = spec->domain;
+    for (int i = 0; i < 8; i++) {
+        ptp[20 + i] = (uint8_t)(spec->clock_id >> (56 - 8 * i));
+    }
+    put16(ptp + 28, 1);
+    return (uint32_t)(ptp + 44 - frame);
+}
+
+/*
+ * Compiles an expression and runs it against a frame.
+ * @return The verdict, or -1 if the expression did not compile.
+ */
+static int filter_verdict(const char* expression, const uint8_t* frame, uint32_t length) {
+    packet_filter_t filter;
+    if (packet_filter_compile(&filter, expression) != 0) {
+        fprintf(stderr, "%s:%d: filter did not compile: %s\n", __FILE__, __LINE__, expression);
+        failures++;
+        return -1;
+    }
+    int verdict = packet_filter_match(&filter, frame, length);
+    packet_filter_free(&filter);
+    return verdict;
+}
+
+/*
+ * "and" binds tighter than "or", "not" binds tightest, and parentheses nest: each
+ * expression over a = vlan, b = domain 5 and c = msgtype sync gives its truth table on
+ * the eight frames that set every combination of the three.
+ */
+static void test_filter_precedence(void) {
+    static const struct {
+        const char* expression;
+        uint8_t truth;              // Bit a | b << 1 | c << 2 is the verdict for that combination
+    } cases[] = {
+        { "vlan or domain 5 and msgtype sync", 0xEA },             // a or (b and c)
+        { "vlan and domain 5 or msgtype sync", 0xF8 },             // (a and b) or c
+        { "(vlan or domain 5) and msgtype sync", 0xE0 },
+        { "not vlan and not (domain 5 or msgtype sync)", 0x01 },
+        { "not (vlan and (domain 5 or not msgtype sync))", 0x75 },
+        { "vlan || domain 5 && ! msgtype sync", 0xAE },            // a or (b and not c)
+        { "((vlan) or ((domain 5) and (msgtype sync)))", 0xEA },
+        { "not not vlan", 0xAA },
+    };
+    uint8_t frame[128];
+    for (int combination = 0; combination < 8; combination++) {
+        test_ptp_frame_t spec = {
+            .vlan = combination & 1 ? 10 : -1,
+            .ip_version = 4,
+            .domain = combination & 2 ? 5 : 0,
+            .message_type = combination & 4 ? PTP_MESSAGE_SYNC : PTP_MESSAGE_DELAY_REQ,
+            .clock_id = 0x001B19FFFE000001ULL,
+        };
+        uint32_t length = build_ptp_frame(frame, &spec);
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            int verdict = filter_verdict(cases[i].expression, frame, length);
+            if (verdict != ((cases[i].truth >> combination) & 1)) {
+                fprintf(stderr, "%s:%d: \"%s\" gives %d for a=%d b=%d c=%d\n", __FILE__, __LINE__, cases[i].expression,
+                        verdict, combination & 1, (combination >> 1) & 1, (combination >> 2) & 1);
+                failures++;
+            }
+        }
+    }
+}
+
+/*
+ * Every primitive accepts the frames it describes and no others, over layer 2, IPv4 and
+ * IPv6 transport, tagged or not.
+ */
+static void test_filter_primitives(void) {
+    static const struct {
+        const char* expression;
+        uint8_t matches;            // Bit per frame below
+    } cases[] = {
+        { "ptp", 0x3F },
+        { "gptp", 0x03 },
+        { "mac 00:1b:19:00:00:01", 0x3F },
+        { "src 00-1B-19-00-00-01", 0x3F },
+        { "dst mac 00:1b:19:00:00:01", 0x00 },
+        { "dst ether 01:1b:19:00:00:00", 0x3F },
+        { "ip", 0x0C },
+        { "ip6", 0x30 },
+        { "src ip 192.168.0.10", 0x0C },
+        { "dst 192.168.0.10", 0x00 },
+        { "host 224.0.1.129", 0x0C },
+        { "src ip6 fe80::1", 0x30 },
+        { "dst host ff0e::181", 0x30 },
+        { "ip6 ff0e::182", 0x00 },
+        { "vlan", 0x2A },
+        { "vlan 10", 0x02 },
+        { "vlan 20", 0x08 },
+        { "vlan 2", 0x00 },
+        { "domain 0", 0x15 },
+        { "domain 24", 0x2A },
+        { "msgtype sync", 0x03 },
+        { "msgtype Follow_Up", 0x0C },
+        { "msgtype 11", 0x30 },
+        { "msgtype announce", 0x30 },
+        { "clock 001b19fffe000001", 0x33 },
+        { "clock 00:1b:19:ff:fe:00:00:02", 0x0C },
+        { "clock 00-1b-19-ff-fe-00-00-03", 0x00 },
+    };
+    static const test_ptp_frame_t frames[] = {
+        { -1, 0, 0, PTP_MESSAGE_SYNC, 0x001B19FFFE000001ULL },
+        { 10, 0, 24, PTP_MESSAGE_SYNC, 0x001B19FFFE000001ULL },
+        { -1, 4, 0, PTP_MESSAGE_FOLLOW_UP, 0x001B19FFFE000002ULL },
+        { 20, 4, 24, PTP_MESSAGE_FOLLOW_UP, 0x001B19FFFE000002ULL },
+        { -1, 6, 0, PTP_MESSAGE_ANNOUNCE, 0x001B19FFFE000001ULL },
+        { 30, 6, 24, PTP_MESSAGE_ANNOUNCE, 0x001B19FFFE000001ULL },
+    };
+    uint8_t frame[128];
+    for (size_t f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        uint32_t length = build_ptp_frame(frame, &frames[f]);
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            int verdict = filter_verdict(cases[i].expression, frame, length);
+            if (verdict != ((cases[i].matches >> f) & 1)) {
+                fprintf(stderr, "%s:%d: \"%s\" gives %d for frame %zu\n", __FILE__, __LINE__, cases[i].expression, verdict, f);
+                failures++;
+            }
+        }
+    }
+}
+
+/*
+ * On a tagged IPv4 frame cut short at every length, a compare matches only once its layer
+ * is located and the whole field is present, and "not" of a missing field matches.
+ */
+static void test_filter_truncated_frames(void) {
+    static const struct {
+        const char* expression;
+        uint32_t min_length;        // Shortest frame the expression accepts; shorter ones are rejected
+        int negated;                // Accepts exactly the frames shorter than min_length
+    } cases[] = {
+        { "src mac 00:1b:19:00:00:01", 12, 0 },
+        { "vlan 10", 18, 0 },       // The tag is only located in full
+        { "src ip 192.168.0.10", 38, 0 },
+        { "domain 5", 51, 0 },
+        { "clock 001b19fffe000001", 74, 0 },
+        { "not clock 001b19fffe000001", 74, 1 },
+        { "vlan 10 and msgtype sync", 47, 0 },
+    };
+    test_ptp_frame_t spec = { 10, 4, 5, PTP_MESSAGE_SYNC, 0x001B19FFFE000001ULL };
+    uint8_t frame[128];
+    uint32_t full_length = build_ptp_frame(frame, &spec);
+    CHECK_EQ(full_length, 90);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        for (uint32_t length = 0; length <= full_length; length++) {
+            int expected = (length >= cases[i].min_length) != cases[i].negated;
+            int verdict = filter_verdict(cases[i].expression, frame, length);
+            if (verdict != expected) {
+                fprintf(stderr, "%s:%d: \"%s\" gives %d at length %u\n", __FILE__, __LINE__, cases[i].expression, verdict, length);
+                failures++;
+            }
+        }
+    }
+}
+
+/*
+ * Malformed expressions fail to compile: unbalanced parentheses, unknown keywords,
+ * missing operands and bad MAC, IPv6 and other literals.
+ */
+static void test_filter_rejects(void) {
+    static const char* const expressions[] = {
+        "", "(ptp", "ptp)", "((vlan or ptp)", "(vlan or ptp))", ")", "()",
+        "frobnicate", "ptp and", "or ptp", "ptp vlan", "not",
+        "mac 00:1b:19:00:00", "mac 00:1b:19:00:00:0g", "00:1b:19:00:00:01:02", "host 00:1b:19:00:00:01",
+        "ip6 fe80:::1", "ip6 1:2:3:4:5:6:7:8:9", "ip6 192.168.0.1", "ip 192.168.0.256",
+        "vlan 4096 and ptp", "domain 256", "domain", "msgtype bogus", "msgtype 16", "clock 001b19", "clock 001b19fffe00000g",
+    };
+    for (size_t i = 0; i < sizeof(expressions) / sizeof(expressions[0]); i++) {
+        packet_filter_t filter;
+        if (packet_filter_compile(&filter, expressions[i]) == 0) {
+            fprintf(stderr, "%s:%d: \"%s\" compiled\n", __FILE__, __LINE__, expressions[i]);
+            failures++;
+            packet_filter_free(&filter);
+        } else {
+            CHECK(filter.insns == NULL);
+        }
+    }
+}
+
+/* Frames of the prefilter tests: transport, IPv4 options and fragments, destination port */
+typedef enum {
+    FRAME_L2_PTP = 0,
+    FRAME_IPV4_EVENT,
+    FRAME_IPV4_OPTIONS_GENERAL,     // IHL 6, so the UDP header moves by four bytes
+    FRAME_IPV4_OPTIONS_OTHER,
+    FRAME_IPV4_FRAGMENT,            // Port 319 in a fragment other than the first
+    FRAME_IPV4_TCP,                 // TCP to port 319
+    FRAME_IPV4_OTHER,
+    FRAME_IPV6_EVENT,
+    FRAME_IPV6_GENERAL,
+    FRAME_IPV6_TCP,
+    FRAME_IPV6_OTHER,
+    FRAME_ARP,
+    FRAME_KIND_COUNT
+} test_frame_kind_t;
+
+static const int frame_kind_is_ptp[FRAME_KIND_COUNT] = { 1, 1, 1, 0, 0, 0, 0, 1, 1, 0, 0, 0 };
+
+/*
+ * Builds a frame of the given kind, optionally VLAN tagged, with a 44-byte payload.
+ * @return Length of the frame.
+ */
+static uint32_t build_test_frame(uint8_t* frame, test_frame_kind_t kind, int vlan) {
+    memset(frame, 0xA5, 128);
+    uint32_t offset = 12;
+    if (vlan) {
+        put16(frame + offset, ETHERTYPE_VLAN);
+        put16(frame + offset + 2, 10);
+        offset += 4;
+    }
+    uint16_t port = kind == FRAME_IPV4_OPTIONS_GENERAL || kind == FRAME_IPV6_GENERAL ? PTP_GENERAL_PORT :
+                    kind == FRAME_IPV4_OPTIONS_OTHER || kind == FRAME_IPV4_OTHER || kind == FRAME_IPV6_OTHER ? 5004 : PTP_EVENT_PORT;
+    uint8_t protocol = kind == FRAME_IPV4_TCP || kind == FRAME_IPV6_TCP ? 6 : 17;
+    switch (kind) {
+        case FRAME_L2_PTP:
+            put16(frame + offset, ETHERTYPE_PTP);
+            return offset + 2 + 44;
+        case FRAME_ARP:
+            put16(frame + offset, ETHERTYPE_ARP);
+            return offset + 2 + 28;
+        case FRAME_IPV6_EVENT:
+        case FRAME_IPV6_GENERAL:
+        case FRAME_IPV6_TCP:
+        case FRAME_IPV6_OTHER: {
+            put16(frame + offset, ETHERTYPE_IPV6);
+            uint8_t* ip = frame + offset + 2;
+            ip[0] = 0x60;
+            ip[6] = protocol;
+            put16(ip + 40 + 2, port);
+            return offset + 2 + 40 + 8 + 44;
+        }
+        default: {
+            put16(frame + offset, ETHERTYPE_IPV4);
+            uint8_t* ip = frame + offset + 2;
+            uint32_t header_length = kind == FRAME_IPV4_OPTIONS_GENERAL || kind == FRAME_IPV4_OPTIONS_OTHER ? 24 : 20;
+            ip[0] = (uint8_t)(0x40 | header_length / 4);
+            put16(ip + 6, kind == FRAME_IPV4_FRAGMENT ? 0x0010 : 0x4000);   // Offset 128 bytes, or Don't Fragment
+            ip[9] = protocol;
+            put16(ip + header_length + 2, port);
+            return offset + 2 + header_length + 8 + 44;
+        }
+    }
+}
+
+/*
+ * Every kind of frame, tagged or not, is classified as expected by frame_is_ptp() and by
+ * each prefilter implementation.
+ */
+static void test_prefilter_known_frames(void) {
+    static uint8_t storage[2 * FRAME_KIND_COUNT][128];
+    const uint8_t* frames[2 * FRAME_KIND_COUNT];
+    uint32_t lengths[2 * FRAME_KIND_COUNT];
+    uint64_t expected = 0;
+    for (int i = 0; i < 2 * FRAME_KIND_COUNT; i++) {
+        lengths[i] = build_test_frame(storage[i], (test_frame_kind_t)(i / 2), i % 2);
+        frames[i] = storage[i];
+        CHECK_EQ(frame_is_ptp(frames[i], lengths[i]), frame_kind_is_ptp[i / 2]);
+        expected |= (uint64_t)frame_kind_is_ptp[i / 2] << i;
+    }
+    for (int impl = PTP_PREFILTER_SCALAR; impl <= PTP_PREFILTER_AVX2; impl++) {
+        CHECK_EQ(ptp_prefilter_batch_with((ptp_prefilter_impl_t)impl, frames, lengths, 2 * FRAME_KIND_COUNT), expected);
+    }
+}
+
+/*
+ * The vector kernels agree with frame_is_ptp() on every truncation of every frame kind,
+ * from empty frames through cut-off VLAN tags and IP and UDP headers, in batches of
+ * every size so that partial vectors are covered.
+ */
+static void test_prefilter_truncated_frames(void) {
+    static uint8_t storage[2 * FRAME_KIND_COUNT][128];
+    const uint8_t* frames[PTP_PREFILTER_BATCH];
+    uint32_t lengths[PTP_PREFILTER_BATCH];
+    size_t count = 0;
+    size_t batch_size = 1;
+    for (int i = 0; i < 2 * FRAME_KIND_COUNT; i++) {
+        uint32_t full_length = build_test_frame(storage[i], (test_frame_kind_t)(i / 2), i % 2);
+        for (uint32_t length = 0; length <= full_length; length++) {
+            frames[count] = storage[i];
+            lengths[count] = length;
+            count++;
+            if (count < batch_size && !(i == 2 * FRAME_KIND_COUNT - 1 && length == full_length)) {
+                continue;
+            }
+            uint64_t expected = 0;
+            for (size_t f = 0; f < count; f++) {
+                expected |= (uint64_t)frame_is_ptp(frames[f], lengths[f]) << f;
+            }
+            for (int impl = PTP_PREFILTER_SCALAR; impl <= PTP_PREFILTER_AVX2; impl++) {
+                CHECK_EQ(ptp_prefilter_batch_with((ptp_prefilter_impl_t)impl, frames, lengths, count), expected);
+            }
+            count = 0;
+            batch_size = batch_size % PTP_PREFILTER_BATCH + 1;
+        }
+    }
+}
+
+/*
+ * Entries inserted while the table grows stay reachable during the incremental migration,
+ * and removals from either array take effect: every key is found with its value until it
+ * is removed, and never after.
+ */
+static void test_hash_table_growth(void) {
+    hash_table_t table;
+    if (hash_table_init(&table, 0) != 0) {
+        failures++;
+        return;
+    }
+    const uint64_t count = 5000;
+    int saw_migration = 0;
+    for (uint64_t key = 1; key <= count; key++) {
+        int inserted = 0;
+        uint64_t* value = hash_table_insert(&table, key << 16, &inserted);
+        CHECK(value != NULL && inserted);
+        if (value != NULL) {
+            *value = key * 3;
+        }
+        saw_migration |= table.previous.capacity != 0;
+        // Remove every third key right away, often while it may still sit in the old array
+        if (key % 3 == 0) {
+            uint64_t removed = 0;
+            CHECK_EQ(hash_table_remove(&table, (key / 3) << 16, &removed), 0);
+            CHECK_EQ(removed, key);
+        }
+    }
+    CHECK(saw_migration);
+    CHECK_EQ(hash_table_size(&table), count - count / 3);
+
+    for (uint64_t key = 1; key <= count; key++) {
+        const uint64_t* value = hash_table_find(&table, key << 16);
+        if (key <= count / 3) {
+            CHECK(value == NULL);
+        } else {
+            CHECK(value != NULL && *value == key * 3);
+        }
+    }
+    int inserted = 1;
+    uint64_t* existing = hash_table_insert(&table, count << 16, &inserted);
+    CHECK(existing != NULL && !inserted && *existing == count * 3);
+    CHECK_EQ(hash_table_remove(&table, 1 << 16, NULL), -1);
+
+    size_t cursor = 0;
+    uint64_t key;
+    uint64_t value;
+    size_t visited = 0;
+    while (hash_table_next(&table, &cursor, &key, &value)) {
+        CHECK_EQ(value, (key >> 16) * 3);
+        visited++;
+    }
+    CHECK_EQ(visited, hash_table_size(&table));
+    hash_table_free(&table);
+}
+
+// Entries of the full-key test are told apart by their value's low byte
+static int low_byte_matches(const void* context, uint64_t value) {
+    return (value & 0xFF) == *(const uint8_t*)context;
+}
+
+/*
+ * Entries added under one shared key are found and removed by their full key, also while
+ * the table grows around them.
+ */
+static void test_hash_table_shared_keys(void) {
+    hash_table_t table;
+    if (hash_table_init(&table, 0) != 0) {
+        failures++;
+        return;
+    }
+    for (uint64_t i = 0; i < 200; i++) {
+        CHECK(hash_table_add(&table, 42, (i << 8) | i) != NULL);
+        CHECK(hash_table_add(&table, i + 1000, i) != NULL);
+    }
+    for (uint64_t i = 0; i < 200; i++) {
+        uint8_t low = (uint8_t)i;
+        hash_key_match_t match = { low_byte_matches, &low };
+        const uint64_t* value = hash_table_find_match(&table, 42, &match);
+        CHECK(value != NULL && *value == ((i << 8) | i));
+    }
+
+    uint8_t low = 7;
+    hash_key_match_t match = { low_byte_matches, &low };
+    uint64_t removed = 0;
+    CHECK_EQ(hash_table_remove_match(&table, 42, &match, &removed), 0);
+    CHECK_EQ(removed, (7 << 8) | 7);
+    CHECK(hash_table_find_match(&table, 42, &match) == NULL);
+    CHECK_EQ(hash_table_remove_match(&table, 42, &match, NULL), -1);
+    low = 8;
+    CHECK(hash_table_find_match(&table, 42, &match) != NULL);
+    CHECK_EQ(hash_table_size(&table), 399);
+    hash_table_free(&table);
+}
+
+/* Timer of the timing wheel tests; the node comes first so the callback can cast back */
+typedef struct {
+    timer_node_t node;
+    int64_t deadline_ns;
+    int fired;
+} test_timer_t;
+
+typedef struct {
+    int64_t after_ns;               // Timers must expire after this capture time...
+    int64_t now_ns;                 // ...and no later than this one
+    size_t fired;
+} test_advance_t;
+
+static void test_timer_expired(timer_node_t* node, void* user) {
+    test_timer_t* timer = (test_timer_t*)node;
+    test_advance_t* advance = user;
+    int64_t deadline_tick = timer->deadline_ns >> TIMING_WHEEL_TICK_SHIFT;
+    CHECK(deadline_tick > advance->after_ns >> TIMING_WHEEL_TICK_SHIFT);
+    CHECK(deadline_tick <= advance->now_ns >> TIMING_WHEEL_TICK_SHIFT);
+    CHECK(node->pprev == NULL);
+    timer->fired++;
+    advance->fired++;
+}
+
+/*
+ * Timers on every level of the wheel, including deadlines on slot and level boundaries,
+ * cascade down and expire in the advance that passes their deadline, whether the clock
+ * moves one tick or many at a time.
+ */
+static void test_timing_wheel_cascade(void) {
+    const int64_t tick_ns = (int64_t)1 << TIMING_WHEEL_TICK_SHIFT;
+    const int64_t start_ns = 1700000000LL * 1000000000LL;
+    static test_timer_t timers[400];
+    const size_t count = sizeof(timers) / sizeof(timers[0]);
+    timing_wheel_t wheel;
+    timing_wheel_init(&wheel);
+    timing_wheel_advance(&wheel, start_ns, test_timer_expired, NULL);
+
+    int64_t last_deadline_ns = start_ns;
+    for (size_t i = 0; i < count; i++) {
+        memset(&timers[i], 0, sizeof(timers[i]));
+        int64_t ticks;
+        if (i < 4 * TIMING_WHEEL_LEVELS) {
+            // One tick either side of each level's span
+            int64_t span = (int64_t)1 << (TIMING_WHEEL_SLOT_BITS * (i / 4 + 1));
+            ticks = span + (int64_t)(i % 4) - 2;
+        } else {
+            // Spread over all levels: up to 2^(6 * level) ticks ahead
+            ticks = 1 + (int64_t)((i * 2654435761u) % ((uint64_t)1 << (TIMING_WHEEL_SLOT_BITS * (1 + i % TIMING_WHEEL_LEVELS))));
+        }
+        timers[i].deadline_ns = start_ns + ticks * tick_ns + (int64_t)(i % 7) * (tick_ns / 7);
+        timing_wheel_schedule(&wheel, &timers[i].node, timers[i].deadline_ns);
+        if (timers[i].deadline_ns > last_deadline_ns) {
+            last_deadline_ns = timers[i].deadline_ns;
+        }
+    }
+    CHECK_EQ(wheel.count, count);
+
+    // Single ticks through the first two levels, then strides of growing size
+    test_advance_t advance = { start_ns, start_ns, 0 };
+    int64_t stride = tick_ns;
+    while (advance.now_ns <= last_deadline_ns) {
+        advance.after_ns = advance.now_ns;
+        advance.now_ns += stride;
+        timing_wheel_advance(&wheel, advance.now_ns, test_timer_expired, &advance);
+        if (advance.now_ns - start_ns > (tick_ns << (2 * TIMING_WHEEL_SLOT_BITS))) {
+            stride += stride / 8 + 1;
+        }
+    }
+    CHECK_EQ(advance.fired, count);
+    CHECK_EQ(wheel.count, 0);
+    for (size_t i = 0; i < count; i++) {
+        CHECK_EQ(timers[i].fired, 1);
+    }
+}
+
+/*
+ * Deadlines past the last level's range park in its furthest slot and are placed again
+ * each time it comes up, expiring only once the clock reaches them. A cancelled timer
+ * never expires, and a timer rescheduled from the park expires at its new deadline.
+ */
+static void test_timing_wheel_parking(void) {
+    const int64_t tick_ns = (int64_t)1 << TIMING_WHEEL_TICK_SHIFT;
+    const int64_t range_ns = tick_ns << (TIMING_WHEEL_SLOT_BITS * TIMING_WHEEL_LEVELS);
+    const int64_t start_ns = 1700000000LL * 1000000000LL;
+    timing_wheel_t wheel;
+    timing_wheel_init(&wheel);
+    timing_wheel_advance(&wheel, start_ns, test_timer_expired, NULL);
+
+    test_timer_t far = { .deadline_ns = start_ns + 3 * range_ns + range_ns / 3 };
+    test_timer_t cancelled = { .deadline_ns = start_ns + 2 * range_ns };
+    test_timer_t moved = { .deadline_ns = start_ns + 5 * range_ns };
+    timing_wheel_schedule(&wheel, &far.node, far.deadline_ns);
+    timing_wheel_schedule(&wheel, &cancelled.node, cancelled.deadline_ns);
+    timing_wheel_schedule(&wheel, &moved.node, moved.deadline_ns);
+    CHECK_EQ(far.node.level, TIMING_WHEEL_LEVELS - 1);
+
+    // Up to one tick short of the first deadline, in strides that are not a multiple of a slot
+    test_advance_t advance = { start_ns, start_ns, 0 };
+    int64_t stride = range_ns / 5 + 12345 * tick_ns;
+    while (advance.now_ns + stride < far.deadline_ns - tick_ns) {
+        advance.after_ns = advance.now_ns;
+        advance.now_ns += stride;
+        timing_wheel_advance(&wheel, advance.now_ns, test_timer_expired, &advance);
+        if (advance.now_ns > start_ns + range_ns && cancelled.node.pprev != NULL) {
+            timing_wheel_cancel(&wheel, &cancelled.node);
+            moved.deadline_ns = far.deadline_ns + range_ns / 2;
+            timing_wheel_schedule(&wheel, &moved.node, moved.deadline_ns);
+        }
+    }
+    advance.after_ns = advance.now_ns;
+    advance.now_ns = far.deadline_ns - tick_ns;
+    timing_wheel_advance(&wheel, advance.now_ns, test_timer_expired, &advance);
+    CHECK_EQ(advance.fired, 0);
+    CHECK_EQ(wheel.count, 2);
+
+    advance.after_ns = advance.now_ns;
+    advance.now_ns = far.deadline_ns;
+    timing_wheel_advance(&wheel, advance.now_ns, test_timer_expired, &advance);
+    CHECK_EQ(far.fired, 1);
+
+    advance.after_ns = advance.now_ns;
+    advance.now_ns = start_ns + 10 * range_ns;
+    timing_wheel_advance(&wheel, advance.now_ns, test_timer_expired, &advance);
+    CHECK_EQ(moved.fired, 1);
+    CHECK_EQ(cancelled.fired, 0);
+    CHECK_EQ(wheel.count, 0);
+}
+
+/*
+ * Records one Sync/Follow_Up and one Delay_Req/Delay_Resp between a fixed master and slave.
+ * @return The pair's statistics after the exchange, or NULL if no result was computed.
+ */
+static const ptp_offset_pair_t* record_exchange(ptp_offset_engine_t* engine, int64_t t1_ns, int64_t t2_ns, int64_t sync_correction,
+                                                int64_t t3_ns, int64_t t4_ns, int64_t resp_correction) {
+    const uint64_t master_id = 0x001B19FFFE000001ULL;
+    ptp_delay_sample_t sample = { 0x001B19FFFE000002ULL, t3_ns, t4_ns, resp_correction };
+    const ptp_offset_pair_t* pair = NULL;
+    CHECK_EQ(ptp_offset_record_sync(engine, master_id, t1_ns, t2_ns, sync_correction), 0);
+    CHECK_EQ(ptp_offset_record_delay(engine, master_id, &sample, &pair), 0);
+    return pair;
+}
+
+/*
+ * offsetFromMaster and meanPathDelay come out exactly at 2^-16 ns: correctionFields are
+ * subtracted before halving, halves truncate toward zero for either sign, and results
+ * beyond the int64 range saturate. Hand-picked t1..t4, in scaled nanoseconds below.
+ */
+static void test_offset_fixed_point(void) {
+    const int64_t scale = (int64_t)1 << PTP_SCALED_NS_SHIFT;
+    const int64_t t1_ns = 1700000000LL * 1000000000LL;
+    ptp_offset_engine_t engine;
+    if (ptp_offset_init(&engine) != 0) {
+        failures++;
+        return;
+    }
+
+    // A Delay_Resp before any Sync has nothing to pair with
+    ptp_delay_sample_t early = { 0x001B19FFFE000002ULL, t1_ns, t1_ns + 700, 0 };
+    ptp_offset_pair_t untouched;
+    const ptp_offset_pair_t* pair = &untouched;
+    CHECK_EQ(ptp_offset_record_delay(&engine, 0x001B19FFFE000001ULL, &early, &pair), 0);
+    CHECK(pair == NULL);
+    CHECK_EQ(engine.unmatched, 1);
+
+    // master-to-slave 1500 - 100.5 = 1399.5 ns, slave-to-master 700 - 0.25 = 699.75 ns
+    pair = record_exchange(&engine, t1_ns, t1_ns + 1500, 100 * scale + scale / 2, t1_ns + 1000000, t1_ns + 1000700, scale / 4);
+    if (pair == NULL) {
+        failures++;
+        ptp_offset_free(&engine);
+        return;
+    }
+    CHECK_EQ(pair->last_delay, 1049 * scale + scale * 5 / 8);
+    CHECK_EQ(pair->last_offset, 349 * scale + scale * 7 / 8);
+
+    // A one-unit correction leaves an odd sum and difference: 72089599.5 and 26214399.5
+    pair = record_exchange(&engine, t1_ns, t1_ns + 1500, 1, t1_ns + 2000000, t1_ns + 2000700, 0);
+    CHECK_EQ(pair->last_delay, (1500 * scale - 1 + 700 * scale) / 2);
+    CHECK_EQ(pair->last_delay, 72089599);
+    CHECK_EQ(pair->last_offset, 26214399);
+
+    // The slave runs ahead: a negative offset, truncated toward zero from -13107200.5
+    pair = record_exchange(&engine, t1_ns, t1_ns + 500, 0, t1_ns + 3000000, t1_ns + 3000900, -1);
+    CHECK_EQ(pair->last_delay, 700 * scale);
+    CHECK_EQ(pair->last_offset, (uint64_t)(int64_t)-13107200);
+    CHECK_EQ(pair->min_offset, (uint64_t)(int64_t)-13107200);
+    CHECK_EQ(pair->max_offset, 26214399);
+    CHECK_EQ(pair->samples, 3);
+    CHECK_EQ(ptp_offset_mean(pair, 0), (22929408 + 26214399 - 13107200) / 3);
+    CHECK_EQ(ptp_offset_mean(pair, 1), (68788224 + 72089599 + 45875200) / 3);
+
+    // A Sync 2^62 ns after its origin timestamp overflows int64 once scaled
+    pair = record_exchange(&engine, 0, INT64_C(1) << 62, 0, t1_ns + 4000000, t1_ns + 4000700, 0);
+    CHECK_EQ(pair->last_delay, INT64_MAX);
+    CHECK_EQ(pair->last_offset, INT64_MAX);
+    pair = record_exchange(&engine, INT64_C(1) << 62, 0, 0, t1_ns + 5000000, t1_ns + 5000700, 0);
+    CHECK_EQ(pair->last_delay, (uint64_t)INT64_MIN);
+    CHECK_EQ(pair->last_offset, (uint64_t)INT64_MIN);
+    CHECK_EQ(engine.pair_count, 1);
+
+    char text[32];
+    ptp_scaled_ns_format(-13107200, text, sizeof(text));
+    CHECK(strcmp(text, "-200.000") == 0);
+    ptp_scaled_ns_format(349 * scale + scale * 7 / 8, text, sizeof(text));
+    CHECK(strcmp(text, "349.875") == 0);
+    ptp_offset_free(&engine);
+}
+
+/*
+ * Percentiles report the middle of the bucket the rank falls in, for either sign, and
+ * exact values below the first bucket boundary.
+ */
+static void test_hdr_histogram_midpoint(void) {
+    hdr_histogram_t histogram;
+    hdr_histogram_init(&histogram);
+    // 1000 and 1007 share the bucket [1000, 1007]; so do -1000 and -1007
+    int64_t values[] = { -1007, -1000, 5, 1000, 1000, 1007, 5000 };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        CHECK_EQ(hdr_histogram_record(&histogram, values[i]), 0);
+    }
+    CHECK_EQ(hdr_histogram_percentile(&histogram, 100.0 / 7), (uint64_t)-1004);
+    CHECK_EQ(hdr_histogram_percentile(&histogram, 300.0 / 7), 5);
+    CHECK_EQ(hdr_histogram_percentile(&histogram, 400.0 / 7), 1004);
+    CHECK_EQ(hdr_histogram_percentile(&histogram, 600.0 / 7), 1004);
+    CHECK_EQ(hdr_histogram_percentile(&histogram, 0), (uint64_t)-1004);
+    CHECK_EQ(hdr_histogram_percentile(&histogram, 100), 5000);
+    hdr_histogram_free(&histogram);
+}
+
+/*
+ * A histogram dump has the same bytes on any host: little-endian header fields, and a set
+ * loaded from it holds the saved histogram under the same key.
+ */
+static void test_histogram_dump_layout(void) {
+    static const uint8_t expected[] = {
+        0x50, 0x48, 0x53, 0x54, 0x01, 0x00, 0x00, 0x00,     // "PHST", version 1
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,     // One record
+        0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01,     // id_a
+        0x18, 0x17, 0x16, 0x15, 0x14, 0x13, 0x12, 0x11,     // id_b
+        0x22, 0x21, 0x32, 0x31,                             // port_a, port_b
+        HISTOGRAM_LINK_DELAY, 0x00, 0x00, 0x00,             // metric, reserved
+    };
+    char path[] = "/tmp/module_tests_histXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("Error creating histogram dump");
+        failures++;
+        return;
+    }
+    close(fd);
+
+    histogram_set_t set;
+    if (histogram_set_init(&set) != 0) {
+        failures++;
+        remove(path);
+        return;
+    }
+    histogram_record_header_t key = { 0x0102030405060708ULL, 0x1112131415161718ULL, 0x2122, 0x3132, HISTOGRAM_LINK_DELAY, { 0 } };
+    hdr_histogram_t* histogram = histogram_set_get(&set, &key);
+    CHECK(histogram != NULL);
+    if (histogram != NULL) {
+        CHECK_EQ(hdr_histogram_record(histogram, -5), 0);
+        CHECK_EQ(hdr_histogram_record(histogram, 1000), 0);
+    }
+    CHECK_EQ(histogram_set_save(&set, path), 0);
+    histogram_set_free(&set);
+
+    uint8_t bytes[sizeof(expected)];
+    FILE* file = fopen(path, "rb");
+    CHECK(file != NULL);
+    if (file != NULL) {
+        CHECK_EQ(fread(bytes, 1, sizeof(bytes), file), sizeof(bytes));
+        CHECK(memcmp(bytes, expected, sizeof(expected)) == 0);
+        fclose(file);
+    }
+
+    if (histogram_set_init(&set) != 0) {
+        failures++;
+        remove(path);
+        return;
+    }
+    CHECK_EQ(histogram_set_load(&set, path), 0);
+    CHECK_EQ(set.count, 1);
+    if (set.count == 1) {
+        CHECK(memcmp(&set.entries[0].key, &key, sizeof(key)) == 0);
+        CHECK_EQ(set.entries[0].histogram.total, 2);
+        CHECK_EQ(set.entries[0].histogram.min, (uint64_t)-5);
+        CHECK_EQ(set.entries[0].histogram.max, 1000);
+    }
+    histogram_set_free(&set);
+    remove(path);
+}
+
+/* Records one Sync sequenceId from a fixed source and returns what the tracker made of it */
+static sequence_event_t record_sequence(sequence_tracker_t* tracker, uint16_t sequence_id) {
+    const sequence_source_t* source;
+    sequence_event_t event = SEQUENCE_RESYNC;
+    CHECK_EQ(sequence_tracker_record(tracker, 0x001B19FFFE000001ULL, 1, 0x0, sequence_id, &source, &event), 0);
+    return event;
+}
+
+/*
+ * sequenceIds run on from 65535 to 0 in order; a gap across the wrap is counted once and
+ * closed by the missing sequenceId arriving late, and a second copy of it is a duplicate.
+ */
+static void test_sequence_wraparound(void) {
+    sequence_tracker_t tracker;
+    if (sequence_tracker_init(&tracker) != 0) {
+        failures++;
+        return;
+    }
+    for (uint32_t id = 65530; id <= 65535 + 3; id++) {
+        CHECK_EQ(record_sequence(&tracker, (uint16_t)id), SEQUENCE_IN_ORDER);
+    }
+    const sequence_counts_t* counts = &tracker.sources[0].counts;
+    CHECK_EQ(counts->gaps, 0);
+    CHECK_EQ(counts->missing, 0);
+    sequence_tracker_free(&tracker);
+
+    // A new stream that skips 65535 on the way over
+    if (sequence_tracker_init(&tracker) != 0) {
+        failures++;
+        return;
+    }
+    CHECK_EQ(record_sequence(&tracker, 65533), SEQUENCE_IN_ORDER);
+    CHECK_EQ(record_sequence(&tracker, 65534), SEQUENCE_IN_ORDER);
+    CHECK_EQ(record_sequence(&tracker, 0), SEQUENCE_GAP);
+    counts = &tracker.sources[0].counts;
+    CHECK_EQ(counts->gaps, 1);
+    CHECK_EQ(counts->missing, 1);
+    CHECK_EQ(record_sequence(&tracker, 65535), SEQUENCE_REORDERED);
+    CHECK_EQ(counts->missing, 0);
+    CHECK_EQ(record_sequence(&tracker, 65535), SEQUENCE_DUPLICATE);
+    CHECK_EQ(record_sequence(&tracker, 1), SEQUENCE_IN_ORDER);
+    CHECK_EQ(counts->received, 6);
+    CHECK_EQ(counts->duplicates, 1);
+    CHECK_EQ(counts->reordered, 1);
+    CHECK_EQ(tracker.sources[0].highest, 1);
+    sequence_tracker_free(&tracker);
+}
+
+/*
+ * Behind the highest sequenceId, a message is a duplicate or reordered only while the
+ * window still covers it: SEQUENCE_WINDOW back from the highest, and never before the
+ * source's first message. Further back it is late, whether or not it was received.
+ */
+static void test_sequence_late_vs_duplicate(void) {
+    sequence_tracker_t tracker;
+    if (sequence_tracker_init(&tracker) != 0) {
+        failures++;
+        return;
+    }
+    // Before the window has filled, only sequenceIds since the first message are known
+    CHECK_EQ(record_sequence(&tracker, 1000), SEQUENCE_IN_ORDER);
+    CHECK_EQ(record_sequence(&tracker, 1001), SEQUENCE_IN_ORDER);
+    CHECK_EQ(record_sequence(&tracker, 1000), SEQUENCE_DUPLICATE);
+    CHECK_EQ(record_sequence(&tracker, 999), SEQUENCE_LATE);
+
+    for (uint16_t id = 1002; id < 1100; id++) {
+        CHECK_EQ(record_sequence(&tracker, id), SEQUENCE_IN_ORDER);
+    }
+    // Highest 1099: 1036 is the oldest sequenceId the window covers
+    CHECK_EQ(record_sequence(&tracker, 1099 - (SEQUENCE_WINDOW - 1)), SEQUENCE_DUPLICATE);
+    CHECK_EQ(record_sequence(&tracker, 1099 - SEQUENCE_WINDOW), SEQUENCE_LATE);
+
+    // A gap, then the missing sequenceIds: reordered inside the window, late beyond it
+    CHECK_EQ(record_sequence(&tracker, 1110), SEQUENCE_GAP);
+    CHECK_EQ(record_sequence(&tracker, 1105), SEQUENCE_REORDERED);
+    CHECK_EQ(record_sequence(&tracker, 1105), SEQUENCE_DUPLICATE);
+    for (uint16_t id = 1111; id < 1110 + SEQUENCE_WINDOW; id++) {
+        record_sequence(&tracker, id);
+    }
+    CHECK_EQ(record_sequence(&tracker, 1100), SEQUENCE_LATE);
+
+    const sequence_counts_t* counts = &tracker.sources[0].counts;
+    CHECK_EQ(counts->gaps, 1);
+    CHECK_EQ(counts->missing, 9);
+    CHECK_EQ(counts->duplicates, 3);
+    CHECK_EQ(counts->reordered, 1);
+    CHECK_EQ(counts->late, 3);
+
+    // A jump beyond SEQUENCE_RESYNC_GAP restarts tracking with an empty window
+    CHECK_EQ(record_sequence(&tracker, 1173 + SEQUENCE_RESYNC_GAP + 1), SEQUENCE_RESYNC);
+    CHECK_EQ(record_sequence(&tracker, 1173 + SEQUENCE_RESYNC_GAP), SEQUENCE_LATE);
+    CHECK_EQ(counts->resyncs, 1);
+    sequence_tracker_free(&tracker);
+}
+
+/*
+ * A linear frequency drift d makes every second difference of the phase, and of its block
+ * means, exactly d * tau^2, so ADEV = MDEV = d * tau / sqrt(2) at every octave.
+ */
+static void test_allan_linear_drift(void) {
+    const int64_t tau0_ns = 1000;
+    const uint64_t count = 1 << 12;
+    allan_accumulator_t accumulator;
+    allan_init(&accumulator, 0);
+    // x(t) = d t^2 / 2 with x in ns: d = 2 / tau0^2 per ns gives x[i] = i^2
+    for (uint64_t i = 0; i < count; i++) {
+        CHECK_EQ(allan_add(&accumulator, 1000000000LL + (int64_t)i * tau0_ns, (int64_t)(i * i)), 0);
+    }
+    double drift = 2.0 / ((double)tau0_ns * (double)tau0_ns);
+    for (uint32_t level = 0; level < 10; level++) {
+        allan_point_t point;
+        if (allan_point(&accumulator, level, 1.0, &point) != 0) {
+            failures++;
+            continue;
+        }
+        double tau_ns = (double)(tau0_ns << level);
+        CHECK_NEAR(point.tau_ns, tau_ns, 1e-12);
+        CHECK_EQ(point.terms, (count >> level) - 2);
+        CHECK_NEAR(point.adev, drift * tau_ns / sqrt(2.0), 1e-9);
+        CHECK_NEAR(point.mdev, drift * tau_ns / sqrt(2.0), 1e-9);
+        CHECK_NEAR(point.tdev_ns, tau_ns * point.mdev / sqrt(3.0), 1e-12);
+    }
+    allan_free(&accumulator);
+}
+
+/*
+ * White phase noise of deviation sigma gives ADEV = sqrt(3) sigma / tau and, as block means
+ * average it down, MDEV = sqrt(3) sigma / (tau sqrt(m)): slopes of tau^-1 and tau^-3/2.
+ */
+static void test_allan_white_phase_noise(void) {
+    const int64_t tau0_ns = 125000000;
+    const uint64_t count = 1 << 18;
+    const double sigma = 1000.0;
+    allan_accumulator_t accumulator;
+    allan_init(&accumulator, 0);
+    uint64_t state = 12345;
+    for (uint64_t i = 0; i < count; i++) {
+        // Sum of 12 uniforms: mean 6, variance 1
+        double normal = -6.0;
+        for (int n = 0; n < 12; n++) {
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            normal += (double)(state >> 11) / 9007199254740992.0;
+        }
+        CHECK_EQ(allan_add(&accumulator, (int64_t)i * tau0_ns, (int64_t)llround(normal * sigma)), 0);
+    }
+    for (uint32_t level = 0; level <= 6; level++) {
+        allan_point_t point;
+        if (allan_point(&accumulator, level, 1.0, &point) != 0) {
+            failures++;
+            continue;
+        }
+        double m = (double)(1u << level);
+        double expected_adev = sqrt(3.0) * sigma / point.tau_ns;
+        // Relative error of the estimate grows as terms thin out with each octave
+        double tolerance = 5.0 / sqrt((double)point.terms);
+        CHECK_NEAR(point.adev, expected_adev, tolerance);
+        CHECK_NEAR(point.mdev, expected_adev / sqrt(m), tolerance);
+    }
+    allan_free(&accumulator);
+}
+
+#define BMCA_TEST_SECOND 1000000000LL
+
+/*
+ * Advances a tracker to an Announce and records it. The sender is its own grandmaster,
+ * in domain 0, with the given priority1 and clockClass.
+ */
+static void record_announce(bmca_tracker_t* tracker, int64_t capture_ns, uint64_t sender_id, uint8_t priority1, uint8_t clock_class,
+                            int8_t log_interval) {
+    bmca_announce_t announce = {
+        .capture_ns = capture_ns,
+        .dataset = {
+            .grandmaster_id = sender_id,
+            .sender_id = sender_id,
+            .sender_port = 1,
+            .offset_scaled_log_variance = 0x4E5D,
+            .priority1 = priority1,
+            .clock_class = clock_class,
+            .clock_accuracy = 0x21,
+            .priority2 = 128,
+        },
+        .log_interval = log_interval,
+    };
+    CHECK_EQ(bmca_tracker_advance(tracker, capture_ns), 0);
+    CHECK_EQ(bmca_tracker_record(tracker, &announce), 0);
+}
+
+/* Checks the latest grandmaster change of a tracker */
+static void check_last_change(const bmca_tracker_t* tracker, int64_t time_ns, uint64_t previous_id, uint64_t grandmaster_id,
+                              bmca_change_reason_t reason) {
+    if (tracker->change_count == 0) {
+        fprintf(stderr, "%s:%d: no grandmaster change\n", __FILE__, __LINE__);
+        failures++;
+        return;
+    }
+    const bmca_change_t* change = &tracker->timeline[tracker->change_count - 1];
+    CHECK_EQ(change->time_ns, time_ns);
+    CHECK_EQ(change->previous_id, previous_id);
+    CHECK_EQ(change->grandmaster_id, grandmaster_id);
+    CHECK_EQ(change->reason, reason);
+    CHECK_EQ(tracker->domains[0].grandmaster_id, grandmaster_id);
+}
+
+/*
+ * A foreign master qualifies with its second Announce within 4 intervals, not its first,
+ * and not with a second one after the first timed out. A qualified grandmaster loses its
+ * place when an Announce comes later than 4 of its now shorter intervals.
+ */
+static void test_bmca_qualification(void) {
+    const int64_t s = BMCA_TEST_SECOND;
+    const uint64_t a = 0x001B19FFFE00000AULL;
+    bmca_tracker_t tracker;
+    if (bmca_tracker_init(&tracker) != 0) {
+        failures++;
+        return;
+    }
+    record_announce(&tracker, 0, a, 128, 248, 1);
+    CHECK_EQ(tracker.change_count, 0);
+    // 2 s intervals: the first Announce times out after 6 s, before the second arrives
+    record_announce(&tracker, 7 * s, a, 128, 248, 1);
+    CHECK_EQ(tracker.change_count, 0);
+    CHECK_EQ(tracker.domains[0].best, -1);
+    record_announce(&tracker, 12 * s, a, 128, 248, 1);
+    check_last_change(&tracker, 12 * s, 0, a, BMCA_CHANGE_BETTER);
+
+    // Down to 250 ms intervals: the last two Announces are 2 s, more than 4 intervals, apart
+    record_announce(&tracker, 14 * s, a, 128, 248, -2);
+    check_last_change(&tracker, 14 * s, a, 0, BMCA_CHANGE_TIMEOUT);
+    CHECK_EQ(tracker.domains[0].best, -1);
+    record_announce(&tracker, 14 * s + s / 4, a, 128, 248, -2);
+    check_last_change(&tracker, 14 * s + s / 4, 0, a, BMCA_CHANGE_BETTER);
+    CHECK_EQ(tracker.change_count, 3);
+    CHECK_EQ(tracker.master_count, 1);
+    bmca_tracker_free(&tracker);
+}
+
+/*
+ * A better foreign master takes over once it qualifies, and a worse one never does.
+ */
+static void test_bmca_better_master(void) {
+    const int64_t s = BMCA_TEST_SECOND;
+    const uint64_t a = 0x001B19FFFE00000AULL, b = 0x001B19FFFE00000BULL, c = 0x001B19FFFE00000CULL;
+    bmca_tracker_t tracker;
+    if (bmca_tracker_init(&tracker) != 0) {
+        failures++;
+        return;
+    }
+    for (int64_t t = 0; t <= 4; t++) {
+        record_announce(&tracker, t * s, a, 128, 6, 0);
+        if (t >= 2) {
+            record_announce(&tracker, t * s + s / 2, c, 128, 7, 0);
+        }
+    }
+    CHECK_EQ(tracker.change_count, 1);
+    check_last_change(&tracker, 1 * s, 0, a, BMCA_CHANGE_BETTER);
+
+    // priority1 100 beats A's 128, from B's second Announce on
+    record_announce(&tracker, 5 * s, b, 100, 248, 0);
+    CHECK_EQ(tracker.domains[0].grandmaster_id, a);
+    record_announce(&tracker, 5 * s + s / 4, a, 128, 6, 0);
+    record_announce(&tracker, 6 * s, b, 100, 248, 0);
+    check_last_change(&tracker, 6 * s, a, b, BMCA_CHANGE_BETTER);
+    record_announce(&tracker, 6 * s + s / 4, a, 128, 6, 0);
+    CHECK_EQ(tracker.change_count, 2);
+    CHECK_EQ(tracker.domains[0].changes, 2);
+    bmca_tracker_free(&tracker);
+}
+
+/*
+ * A grandmaster whose clockQuality degrades below another qualified master's hands over
+ * to it, and takes over again once its quality recovers.
+ */
+static void test_bmca_degraded(void) {
+    const int64_t s = BMCA_TEST_SECOND;
+    const uint64_t a = 0x001B19FFFE00000AULL, b = 0x001B19FFFE00000BULL;
+    bmca_tracker_t tracker;
+    if (bmca_tracker_init(&tracker) != 0) {
+        failures++;
+        return;
+    }
+    for (int64_t t = 0; t < 3; t++) {
+        record_announce(&tracker, t * s, a, 128, 6, 0);
+        record_announce(&tracker, t * s + s / 2, b, 128, 7, 0);
+    }
+    check_last_change(&tracker, 1 * s, 0, a, BMCA_CHANGE_BETTER);
+
+    // A loses its time source: clockClass 6 -> 52, worse than B's 7
+    record_announce(&tracker, 3 * s, a, 128, 52, 0);
+    check_last_change(&tracker, 3 * s, a, b, BMCA_CHANGE_DEGRADED);
+    record_announce(&tracker, 3 * s + s / 2, b, 128, 7, 0);
+    // Degrading while still the best keeps the grandmaster
+    record_announce(&tracker, 4 * s, b, 128, 13, 0);
+    CHECK_EQ(tracker.domains[0].grandmaster_id, b);
+    CHECK_EQ(tracker.change_count, 2);
+    record_announce(&tracker, 5 * s, a, 128, 6, 0);
+    check_last_change(&tracker, 5 * s, b, a, BMCA_CHANGE_BETTER);
+    bmca_tracker_free(&tracker);
+}
+
+/*
+ * A grandmaster whose Announces stop is dropped 3 intervals after its last one, dated at
+ * that deadline, in favour of the best remaining master; when none remains, the domain
+ * has no grandmaster.
+ */
+static void test_bmca_timeout(void) {
+    const int64_t s = BMCA_TEST_SECOND;
+    const uint64_t a = 0x001B19FFFE00000AULL, b = 0x001B19FFFE00000BULL;
+    bmca_tracker_t tracker;
+    if (bmca_tracker_init(&tracker) != 0) {
+        failures++;
+        return;
+    }
+    for (int64_t t = 0; t <= 2; t++) {
+        record_announce(&tracker, t * s, a, 128, 6, 0);
+        record_announce(&tracker, t * s + s / 2, b, 128, 7, 0);
+    }
+    record_announce(&tracker, 3 * s + s / 2, b, 128, 7, 0);
+    record_announce(&tracker, 4 * s + s / 2, b, 128, 7, 0);
+    CHECK_EQ(bmca_tracker_advance(&tracker, 5 * s - 1), 0);
+    CHECK_EQ(tracker.domains[0].grandmaster_id, a);
+    record_announce(&tracker, 5 * s + s / 2, b, 128, 7, 0);
+    check_last_change(&tracker, 5 * s, a, b, BMCA_CHANGE_TIMEOUT);
+
+    CHECK_EQ(bmca_tracker_advance(&tracker, 60 * s), 0);
+    check_last_change(&tracker, 8 * s + s / 2, b, 0, BMCA_CHANGE_TIMEOUT);
+    CHECK_EQ(tracker.domains[0].best, -1);
+    CHECK_EQ(tracker.change_count, 3);
+    bmca_tracker_free(&tracker);
+}
+
+/* Records messages of one Sync source at the given capture times */
+static void record_intervals(interval_analyzer_t* analyzer, const int64_t* times_ns, size_t first, size_t last, int8_t log_interval) {
+    for (size_t i = first; i < last; i++) {
+        CHECK_EQ(interval_analyzer_record(analyzer, 0x001B19FFFE000001ULL, 1, PTP_MESSAGE_SYNC, log_interval, times_ns[i]), 0);
+    }
+}
+
+/*
+ * Intervals up to 30% off 2^logMessageInterval pass, for intervals shorter and longer
+ * than a second; 31% early or late does not. A logMessageInterval out of range leaves
+ * the interval unchecked.
+ */
+static void test_interval_tolerance(void) {
+    static const int8_t log_intervals[] = { -3, 0, 2 };
+    for (size_t l = 0; l < sizeof(log_intervals) / sizeof(log_intervals[0]); l++) {
+        int64_t nominal_ns = interval_nominal_ns(log_intervals[l]);
+        // On time, 31% early, 31% late, then exactly 30% early and late
+        const int64_t percent[] = { 100, 69, 131, 70, 130 };
+        int64_t times_ns[6] = { 1700000000LL * 1000000000LL };
+        for (size_t i = 0; i < 5; i++) {
+            times_ns[i + 1] = times_ns[i] + nominal_ns / 100 * percent[i];
+        }
+        interval_analyzer_t analyzer;
+        if (interval_analyzer_init(&analyzer) != 0) {
+            failures++;
+            return;
+        }
+        record_intervals(&analyzer, times_ns, 0, 6, log_intervals[l]);
+        CHECK_EQ(analyzer.source_count, 1);
+        const interval_source_t* source = &analyzer.sources[0];
+        CHECK_EQ(source->messages, 6);
+        CHECK_EQ(source->intervals, 5);
+        CHECK_EQ(source->early, 1);
+        CHECK_EQ(source->late, 1);
+        CHECK_EQ(source->bursts, 0);
+        CHECK_EQ(source->min_ns, nominal_ns / 100 * 69);
+        CHECK_EQ(source->max_ns, nominal_ns / 100 * 131);
+        CHECK_NEAR(interval_mean_ns(source), (double)nominal_ns, 1e-12);
+
+        // 0x7F: logMessageInterval not applicable
+        int64_t late_ns = times_ns[5] + nominal_ns / 100;
+        CHECK_EQ(interval_analyzer_record(&analyzer, 0x001B19FFFE000001ULL, 1, PTP_MESSAGE_SYNC, 0x7F, late_ns), 0);
+        CHECK_EQ(source->messages, 7);
+        CHECK_EQ(source->intervals, 5);
+        CHECK_EQ(source->early, 1);
+        interval_analyzer_free(&analyzer);
+    }
+}
+
+/* Capture times of the burst tests: 1 s Sync intervals, early below 700 ms, late above 1300 ms */
+static const int64_t burst_intervals_ms[] = { 600, 650, 1000, 690, 650, 600, 1000, 1310, 500, 400, 300, 1000, 700, 699, 1000 };
+#define BURST_MESSAGES (sizeof(burst_intervals_ms) / sizeof(burst_intervals_ms[0]) + 1)
+
+static void check_same_source(const interval_source_t* merged, const interval_source_t* single) {
+    CHECK_EQ(merged->messages, single->messages);
+    CHECK_EQ(merged->intervals, single->intervals);
+    CHECK(merged->sum_ns == single->sum_ns && merged->sum_squares == single->sum_squares);
+    CHECK_EQ(merged->min_ns, single->min_ns);
+    CHECK_EQ(merged->max_ns, single->max_ns);
+    CHECK_EQ(merged->early, single->early);
+    CHECK_EQ(merged->late, single->late);
+    CHECK_EQ(merged->bursts, single->bursts);
+    CHECK_EQ(merged->longest_burst, single->longest_burst);
+    CHECK_EQ(merged->run, single->run);
+    CHECK_EQ(merged->last_ns, single->last_ns);
+}
+
+/*
+ * Runs of early intervals count as one burst each, and splitting the messages between
+ * two or three analyzers at any points, then merging them in order, counts every burst
+ * once: a run cut by a split, or spanning a whole middle part, is joined back together.
+ */
+static void test_interval_split_bursts(void) {
+    int64_t times_ns[BURST_MESSAGES] = { 1700000000LL * 1000000000LL };
+    for (size_t i = 1; i < BURST_MESSAGES; i++) {
+        times_ns[i] = times_ns[i - 1] + burst_intervals_ms[i - 1] * 1000000;
+    }
+    interval_analyzer_t single;
+    if (interval_analyzer_init(&single) != 0) {
+        failures++;
+        return;
+    }
+    record_intervals(&single, times_ns, 0, BURST_MESSAGES, 0);
+    const interval_source_t* expected = &single.sources[0];
+    CHECK_EQ(expected->intervals, BURST_MESSAGES - 1);
+    CHECK_EQ(expected->early, 9);
+    CHECK_EQ(expected->late, 1);
+    CHECK_EQ(expected->bursts, 3);
+    CHECK_EQ(expected->longest_burst, 3);
+
+    for (size_t first_split = 1; first_split < BURST_MESSAGES; first_split++) {
+        for (size_t second_split = first_split; second_split < BURST_MESSAGES; second_split++) {
+            interval_analyzer_t parts[3];
+            const size_t bounds[4] = { 0, first_split, second_split, BURST_MESSAGES };
+            int ready = 1;
+            for (int p = 0; p < 3; p++) {
+                if (interval_analyzer_init(&parts[p]) != 0) {
+                    ready = 0;
+                } else {
+                    record_intervals(&parts[p], times_ns, bounds[p], bounds[p + 1], 0);
+                }
+            }
+            // An empty middle part is a two-way split
+            if (!ready || interval_analyzer_merge(&parts[0], &parts[1]) != 0 || interval_analyzer_merge(&parts[0], &parts[2]) != 0) {
+                failures++;
+            } else if (parts[0].source_count != 1) {
+                CHECK_EQ(parts[0].source_count, 1);
+            } else {
+                int before = failures;
+                check_same_source(&parts[0].sources[0], expected);
+                if (failures != before) {
+                    fprintf(stderr, "    split after messages %zu and %zu\n", first_split, second_split);
+                }
+            }
+            for (int p = 0; p < 3; p++) {
+                interval_analyzer_free(&parts[p]);
+            }
+        }
+    }
+    interval_analyzer_free(&single);
+}
+
+typedef struct {
+    const char* name;
+    void (*run)(void);
+} test_case_t;
+
+static const test_case_t tests[] = {
+    { "filter_precedence", test_filter_precedence },
+    { "filter_primitives", test_filter_primitives },
+    { "filter_truncated_frames", test_filter_truncated_frames },
+    { "filter_rejects", test_filter_rejects },
+    { "prefilter_known_frames", test_prefilter_known_frames },
+    { "prefilter_truncated_frames", test_prefilter_truncated_frames },
+    { "hash_table_growth", test_hash_table_growth },
+    { "hash_table_shared_keys", test_hash_table_shared_keys },
+    { "timing_wheel_cascade", test_timing_wheel_cascade },
+    { "timing_wheel_parking", test_timing_wheel_parking },
+    { "offset_fixed_point", test_offset_fixed_point },
+    { "hdr_histogram_midpoint", test_hdr_histogram_midpoint },
+    { "histogram_dump_layout", test_histogram_dump_layout },
+    { "sequence_wraparound", test_sequence_wraparound },
+    { "sequence_late_vs_duplicate", test_sequence_late_vs_duplicate },
+    { "allan_linear_drift", test_allan_linear_drift },
+    { "allan_white_phase_noise", test_allan_white_phase_noise },
+    { "bmca_qualification", test_bmca_qualification },
+    { "bmca_better_master", test_bmca_better_master },
+    { "bmca_degraded", test_bmca_degraded },
+    { "bmca_timeout", test_bmca_timeout },
+    { "interval_tolerance", test_interval_tolerance },
+    { "interval_split_bursts", test_interval_split_bursts },
+};
+
+int main(void) {
+    int failed_tests = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = failures;
+        tests[i].run();
+        fprintf(stderr, "%-28s %s\n", tests[i].name, failures == before ? "ok" : "FAILED");
+        failed_tests += failures != before;
+    }
+    fprintf(stderr, "%d of %zu tests failed\n", failed_tests, sizeof(tests) / sizeof(tests[0]));
+    return failed_tests == 0 ? 0 : 1;
+}
@@ -0,0 +1,656 @@
+// Decoder tests on captures from the synthetic generator.
+//
+// Each test generates a capture with known contents, decodes it through process_pcap_file
+// the way the command line does, and checks the counters and analyzer state it leaves in the
+// file context. Run through `make test`, which builds the generator and links the parser's
+// objects without main.o.
+//
+// Usage: parser_tests GENERATOR SCRATCH_DIR
+
+#include "../include/pcap.h"
+#include "../include/ptp.h"
+#include "../include/output.h"
+#include "../include/packet_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char* generator_path;
+static const char* scratch_dir;
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+        unsigned long long actual_value = (unsigned long long)(actual); \
+        unsigned long long expected_value = (unsigned long long)(expected); \
+        if (actual_value != expected_value) { \
+            fprintf(stderr, "%s:%d: %s is %llu, expected %llu\n", __FILE__, __LINE__, #actual, actual_value, expected_value); \
+            failures++; \
+        } \
+    } while (0)
+
+/* A decoded capture: the context a run leaves behind and the counters summed into it */
+typedef struct {
+    file_context_t ctx;
+    run_stats_t stats;
+    output_t out;
+    FILE* sink;
+} test_run_t;
+
+/*
+ * Writes a capture with the generator.
+ * @param name File name in the scratch directory.
+ * @param options Generator options besides -o.
+ * @param path Receives the capture's path.
+ * @return 0 on success, -1 if the generator failed.
+ */
+static int generate(const char* name, const char* options, char* path, size_t size) {
+    char command[1024];
+    snprintf(path, size, "%s/%s", scratch_dir, name);
+    snprintf(command, sizeof(command), "%s -o %s %s 2>/dev/null", generator_path, path, options);
+    if (system(command) != 0) {
+        fprintf(stderr, "Generator failed: %s\n", command);
+        failures++;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Sets up a run with per-packet output discarded and no time window; tests may change
+ * the settings in run->ctx before run_decode().
+ * @param num_threads Decode worker threads (-j), 0 for none.
+ * @param num_chunks Byte ranges scanned in parallel (--chunks), 0 for none.
+ */
+static void run_init(test_run_t* run, int num_threads, int num_chunks) {
+    memset(run, 0, sizeof(*run));
+    run->ctx.out = &run->out;
+    run->ctx.stats = &run->stats;
+    run->ctx.verbosity = OUTPUT_QUIET;
+    run->ctx.index_stride = PACKET_INDEX_DEFAULT_STRIDE;
+    run->ctx.window_start_ns = INT64_MIN;
+    run->ctx.window_end_ns = INT64_MAX;
+    run->ctx.num_threads = num_threads;
+    run->ctx.num_chunks = num_chunks;
+}
+
+/*
+ * Decodes a capture with the settings of a run set up by run_init().
+ * @return 0 on success, -1 on failure; run_free() must be called after a success.
+ */
+static int run_decode(test_run_t* run, const char* path) {
+    run->sink = fopen("/dev/null", "w");
+    if (run->sink == NULL) {
+        perror("Error opening /dev/null");
+        failures++;
+        return -1;
+    }
+    if (file_context_init_maps(&run->ctx) != 0 || output_init(&run->out, run->sink, OUTPUT_BUFFER_SIZE) != 0) {
+        file_context_free_maps(&run->ctx);
+        fclose(run->sink);
+        failures++;
+        return -1;
+    }
+    if (process_pcap_file(path, &run->ctx) != 0) {
+        fprintf(stderr, "Failed to decode %s\n", path);
+        output_free(&run->out);
+        file_context_free_maps(&run->ctx);
+        fclose(run->sink);
+        failures++;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Decodes a capture with per-packet output discarded.
+ * @param num_threads Decode worker threads (-j), 0 for none.
+ * @param num_chunks Byte ranges scanned in parallel (--chunks), 0 for none.
+ * @return 0 on success, -1 on failure; run_free() must be called after a success.
+ */
+static int run_parser(test_run_t* run, const char* path, int num_threads, int num_chunks) {
+    run_init(run, num_threads, num_chunks);
+    return run_decode(run, path);
+}
+
+static void run_free(test_run_t* run) {
+    output_free(&run->out);
+    file_context_free_maps(&run->ctx);
+    fclose(run->sink);
+}
+
+static uint64_t malformed_total(const run_stats_t* stats) {
+    uint64_t total = 0;
+    for (int i = 0; i < RUN_STATS_MALFORMED_COUNT; i++) {
+        total += stats->malformed[i];
+    }
+    return total;
+}
+
+/*
+ * --packets N writes exactly N records, also when it ends an exchange early or the last
+ * record was held back for reordering.
+ */
+static void test_generator_packet_count(void) {
+    static const char* const formats[] = { "", "--format pcapng --nanosecond" };
+    static const uint64_t counts[] = { 777, 1000, 20000 };
+    char path[512], options[256];
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            snprintf(options, sizeof(options), "--packets %llu --background 0 --mix sync=1,pdelay=1 --reorder 5 --loss 2 --seed 3 %s",
+                     (unsigned long long)counts[c], formats[f]);
+            test_run_t run;
+            if (generate(f == 0 ? "count.pcap" : "count.pcapng", options, path, sizeof(path)) != 0 || run_parser(&run, path, 0, 0) != 0) {
+                continue;
+            }
+            CHECK_EQ(run.stats.packets, counts[c]);
+            run_free(&run);
+        }
+    }
+}
+
+/*
+ * Messages at their on-wire lengths (44-byte Sync and Delay_Req, 54-byte Pdelay and
+ * Delay_Resp, 76-byte Follow_Up and Announce) over every transport decode without a
+ * malformed record, and no exchange is invalid or out of order.
+ */
+static void test_wire_lengths(void) {
+    char path[512];
+    test_run_t run;
+    if (generate("lengths.pcap", "--packets 6000 --background 0 --mix sync=1,pdelay=1,delay=1,announce=1 "
+                 "--transport l2=1,ipv4=1,ipv6=1 --vlan 20 --seed 4", path, sizeof(path)) != 0 ||
+        run_parser(&run, path, 0, 0) != 0) {
+        return;
+    }
+    CHECK_EQ(malformed_total(&run.stats), 0);
+    CHECK_EQ(run.stats.packets, 6000);
+    CHECK(run.stats.ptp_messages[PTP_MESSAGE_SYNC] > 0);
+    CHECK(run.stats.ptp_messages[PTP_MESSAGE_DELAY_REQ] > 0);
+    CHECK(run.stats.ptp_messages[PTP_MESSAGE_PDELAY_REQ] > 0);
+    CHECK(run.stats.ptp_messages[PTP_MESSAGE_ANNOUNCE] > 0);
+    CHECK(run.ctx.cycle_map.completed > 0);
+    CHECK_EQ(run.ctx.cycle_map.invalid, 0);
+    CHECK_EQ(run.ctx.cycle_map.out_of_order, 0);
+    CHECK(run.ctx.links.link_count > 0);
+    CHECK(run.ctx.offsets.pair_count > 0);
+    run_free(&run);
+}
+
+/* Worker threads and parallel chunks report the same cycles and malformed counts as one pass */
+static void test_modes_agree(void) {
+    char path[512];
+    if (generate("modes.pcap", "--packets 30000 --mix sync=4,pdelay=2,delay=1,announce=1 --loss 1 --reorder 1 --seed 5",
+                 path, sizeof(path)) != 0) {
+        return;
+    }
+    test_run_t sequential;
+    if (run_parser(&sequential, path, 0, 0) != 0) {
+        return;
+    }
+    static const int modes[][2] = { { 3, 0 }, { 0, 4 } };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        test_run_t run;
+        if (run_parser(&run, path, modes[i][0], modes[i][1]) != 0) {
+            continue;
+        }
+        CHECK_EQ(run.stats.packets, sequential.stats.packets);
+        CHECK_EQ(malformed_total(&run.stats), malformed_total(&sequential.stats));
+        CHECK_EQ(run.ctx.cycle_map.completed, sequential.ctx.cycle_map.completed);
+        CHECK_EQ(run.ctx.cycle_map.invalid, sequential.ctx.cycle_map.invalid);
+        CHECK_EQ(run.ctx.cycle_map.expired, sequential.ctx.cycle_map.expired);
+        CHECK_EQ(run.ctx.links.link_count, sequential.ctx.links.link_count);
+        run_free(&run);
+    }
+    run_free(&sequential);
+}
+
+/*
+ * Ports of one clock send in lockstep with the same sequenceIds. Their cycles are kept
+ * apart by the full port identity, so none is invalidated by a message of a sibling port,
+ * in every decoder mode.
+ */
+static void test_multi_port_cycles(void) {
+    char path[512];
+    if (generate("ports.pcap", "--packets 20000 --background 0 --ports 4 --ports-per-clock 2 --mix sync=4,pdelay=2,delay=1 --seed 6",
+                 path, sizeof(path)) != 0) {
+        return;
+    }
+    static const int modes[][2] = { { 0, 0 }, { 3, 0 }, { 0, 4 } };
+    uint64_t completed = 0;
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        test_run_t run;
+        if (run_parser(&run, path, modes[i][0], modes[i][1]) != 0) {
+            continue;
+        }
+        CHECK(run.ctx.cycle_map.completed > 0);
+        CHECK_EQ(run.ctx.cycle_map.invalid, 0);
+        CHECK_EQ(run.ctx.cycle_map.out_of_order, 0);
+        if (i == 0) {
+            completed = run.ctx.cycle_map.completed;
+        }
+        CHECK_EQ(run.ctx.cycle_map.completed, completed);
+        run_free(&run);
+    }
+}
+
+/*
+ * Two bridges with two ports each exchange Pdelay messages port to port: every port's
+ * link to its peer port is measured separately, in every decoder mode.
+ */
+static void test_pdelay_links_per_port(void) {
+    char path[512];
+    if (generate("links.pcap", "--packets 8000 --background 0 --ports 4 --ports-per-clock 2 --mix pdelay=1 --seed 7",
+                 path, sizeof(path)) != 0) {
+        return;
+    }
+    static const int modes[][2] = { { 0, 0 }, { 3, 0 }, { 0, 4 } };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        test_run_t run;
+        if (run_parser(&run, path, modes[i][0], modes[i][1]) != 0) {
+            continue;
+        }
+        CHECK_EQ(run.ctx.cycle_map.invalid, 0);
+        CHECK_EQ(run.ctx.links.link_count, 4);
+        for (size_t l = 0; l < run.ctx.links.link_count; l++) {
+            const pdelay_link_t* link = &run.ctx.links.links[l];
+            CHECK(link->samples > 0);
+            CHECK(link->requester_id != link->responder_id);
+            CHECK_EQ(link->responder_port, link->requester_port);
+            for (size_t other = 0; other < l; other++) {
+                CHECK(run.ctx.links.links[other].requester_id != link->requester_id ||
+                      run.ctx.links.links[other].requester_port != link->requester_port);
+            }
+        }
+        run_free(&run);
+    }
+}
+
+/* Path of the sidecar index of a capture */
+static void index_path_of(const char* path, char* index_path, size_t size) {
+    snprintf(index_path, size, "%s%s", path, PACKET_INDEX_SUFFIX);
+}
+
+/*
+ * @return Whether the sidecar index of a capture loads, i.e. matches the capture as it is now.
+ */
+static int index_is_current(const char* path) {
+    struct stat file_stat;
+    char index_path[600];
+    packet_index_t index;
+    if (stat(path, &file_stat) != 0) {
+        return 0;
+    }
+    index_path_of(path, index_path, sizeof(index_path));
+    int64_t mtime_ns = (int64_t)file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec;
+    int current = packet_index_load(&index, index_path, (uint64_t)file_stat.st_size, mtime_ns) == 0;
+    packet_index_free(&index);
+    return current;
+}
+
+/*
+ * Writes the sidecar index of a capture in a full pass (--index).
+ * @param first_ns Receives the capture time of the first record.
+ * @param last_ns Receives the capture time of the last record.
+ * @return Records in the capture, or 0 on failure.
+ */
+static uint64_t write_index(const char* path, int64_t* first_ns, int64_t* last_ns) {
+    char index_path[600];
+    packet_index_t index;
+    test_run_t run;
+    run_init(&run, 0, 0);
+    run.ctx.build_index = 1;
+    if (run_decode(&run, path) != 0) {
+        return 0;
+    }
+    uint64_t packets = run.stats.packets;
+    *last_ns = run.ctx.packet_ts_ns;
+    run_free(&run);
+
+    struct stat file_stat;
+    index_path_of(path, index_path, sizeof(index_path));
+    CHECK(stat(path, &file_stat) == 0);
+    if (packet_index_load(&index, index_path, (uint64_t)file_stat.st_size,
+                          (int64_t)file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec) != 0) {
+        fprintf(stderr, "%s:%d: no index written for %s\n", __FILE__, __LINE__, path);
+        failures++;
+        return 0;
+    }
+    *first_ns = index.entries[0].ts_ns;
+    packet_index_free(&index);
+    return packets;
+}
+
+/*
+ * Decodes the records of a capture inside a time window (--start, --end).
+ * @param build_index Write the sidecar index unless a current one is loaded (--index).
+ * @param use_stdio Read with stdio instead of mapping the file (--no-mmap).
+ * @return Records decoded, or UINT64_MAX on failure.
+ */
+static uint64_t count_window(const char* path, int64_t start_ns, int64_t end_ns, int build_index, int use_stdio) {
+    test_run_t run;
+    run_init(&run, 0, 0);
+    run.ctx.has_window = 1;
+    run.ctx.window_start_ns = start_ns;
+    run.ctx.window_end_ns = end_ns;
+    run.ctx.build_index = build_index;
+    run.ctx.use_stdio = use_stdio;
+    if (run_decode(&run, path) != 0) {
+        return UINT64_MAX;
+    }
+    uint64_t packets = run.stats.packets;
+    run_free(&run);
+    return packets;
+}
+
+/*
+ * A time window holds the same records whether it is found through the sidecar index or
+ * by reading from the first record, mapped or through stdio, on a capture whose
+ * timestamps step back where records were reordered.
+ */
+static void test_index_window(void) {
+    char path[512], index_path[600];
+    if (generate("index.pcap", "--packets 20000 --reorder 5 --seed 8", path, sizeof(path)) != 0) {
+        return;
+    }
+    index_path_of(path, index_path, sizeof(index_path));
+    int64_t first_ns, last_ns;
+    uint64_t total = write_index(path, &first_ns, &last_ns);
+    if (total == 0) {
+        return;
+    }
+    // In the middle, from the first record, to the end, and past the end of the capture
+    const int64_t span_ns = last_ns - first_ns;
+    const int64_t windows[][2] = {
+        { first_ns + span_ns / 10 * 3, first_ns + span_ns / 10 * 6 },
+        { first_ns, first_ns + span_ns / 7 },
+        { first_ns + span_ns / 2, INT64_MAX },
+        { last_ns + 1000000000LL, INT64_MAX },
+    };
+    const size_t count = sizeof(windows) / sizeof(windows[0]);
+    uint64_t expected[sizeof(windows) / sizeof(windows[0])];
+    CHECK_EQ(remove(index_path), 0);
+    for (size_t w = 0; w < count; w++) {
+        expected[w] = count_window(path, windows[w][0], windows[w][1], 0, 0);
+        CHECK_EQ(count_window(path, windows[w][0], windows[w][1], 0, 1), expected[w]);
+        CHECK(w == count - 1 ? expected[w] == 0 : expected[w] > 0 && expected[w] < total);
+    }
+
+    if (write_index(path, &first_ns, &last_ns) != total) {
+        return;
+    }
+    for (size_t w = 0; w < count; w++) {
+        CHECK_EQ(count_window(path, windows[w][0], windows[w][1], 0, 0), expected[w]);
+        CHECK_EQ(count_window(path, windows[w][0], windows[w][1], 0, 1), expected[w]);
+        CHECK_EQ(count_window(path, windows[w][0], windows[w][1], 1, 0), expected[w]);
+    }
+    CHECK(index_is_current(path));
+}
+
+/*
+ * An index that no longer matches its capture, because the capture was modified or the
+ * index file was cut short, is not used to seek: the window is read from the first
+ * record, and --index writes a new index in the same pass.
+ */
+static void test_index_rebuilt(void) {
+    char path[512], index_path[600];
+    if (generate("stale.pcap", "--packets 20000 --reorder 5 --seed 9", path, sizeof(path)) != 0) {
+        return;
+    }
+    index_path_of(path, index_path, sizeof(index_path));
+    int64_t first_ns, last_ns;
+    if (write_index(path, &first_ns, &last_ns) == 0) {
+        return;
+    }
+    const int64_t start_ns = first_ns + (last_ns - first_ns) / 3;
+    const int64_t end_ns = first_ns + (last_ns - first_ns) / 3 * 2;
+    uint64_t expected = count_window(path, start_ns, end_ns, 0, 0);
+    CHECK(expected > 0);
+
+    // The capture is modified after the index was written
+    struct stat file_stat;
+    CHECK(stat(path, &file_stat) == 0);
+    struct timespec times[2] = { file_stat.st_atim, file_stat.st_mtim };
+    times[1].tv_sec += 60;
+    CHECK(utimensat(AT_FDCWD, path, times, 0) == 0);
+    CHECK(!index_is_current(path));
+    CHECK_EQ(count_window(path, start_ns, end_ns, 0, 0), expected);
+    CHECK(!index_is_current(path));
+    CHECK_EQ(count_window(path, start_ns, end_ns, 1, 1), expected);
+    CHECK(index_is_current(path));
+
+    // The index file is cut short
+    CHECK(stat(index_path, &file_stat) == 0);
+    CHECK(truncate(index_path, file_stat.st_size / 2) == 0);
+    CHECK(!index_is_current(path));
+    CHECK_EQ(count_window(path, start_ns, end_ns, 0, 1), expected);
+    CHECK_EQ(count_window(path, start_ns, end_ns, 1, 0), expected);
+    CHECK(index_is_current(path));
+    CHECK_EQ(count_window(path, start_ns, end_ns, 0, 0), expected);
+}
+
+/* A pcapng Interface Description Block's timestamp options */
+typedef struct {
+    uint8_t tsresol;    // if_tsresol, or 0 to leave it out (microseconds)
+    int64_t tsoffset;   // if_tsoffset in seconds, or 0 to leave it out
+} test_interface_t;
+
+/* A pcapng Enhanced Packet Block and the capture time it should decode to */
+typedef struct {
+    uint32_t interface_id;
+    uint64_t timestamp;     // In the interface's units
+    int64_t ts_ns;
+} test_epb_t;
+
+/* Appends a pcapng block in host byte order, its body padded to 32 bits */
+static void write_block(FILE* file, uint32_t type, const void* body, uint32_t length) {
+    static const uint8_t padding[4] = { 0 };
+    uint32_t padded = (length + 3) & ~3u;
+    uint32_t total_length = padded + 12;
+    fwrite(&type, sizeof(type), 1, file);
+    fwrite(&total_length, sizeof(total_length), 1, file);
+    fwrite(body, 1, length, file);
+    fwrite(padding, 1, padded - length, file);
+    fwrite(&total_length, sizeof(total_length), 1, file);
+}
+
+/*
+ * Writes a pcapng capture of one section with the given interfaces and a 60-byte PTP over
+ * Ethernet frame in each packet block.
+ * @param name File name in the scratch directory.
+ * @param path Receives the capture's path.
+ * @return 0 on success, -1 if the file could not be written.
+ */
+static int write_pcapng(const char* name, const test_interface_t* interfaces, size_t interface_count,
+                        const test_epb_t* packets, size_t packet_count, char* path, size_t size) {
+    snprintf(path, size, "%s/%s", scratch_dir, name);
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("Error writing pcapng capture");
+        failures++;
+        return -1;
+    }
+    uint8_t body[128];
+
+    // Byte-order magic, version 1.0, section length unspecified
+    const uint32_t magic = 0x1A2B3C4D;
+    const uint16_t version[2] = { 1, 0 };
+    const int64_t section_length = -1;
+    memcpy(body, &magic, 4);
+    memcpy(body + 4, version, 4);
+    memcpy(body + 8, &section_length, 8);
+    write_block(file, 0x0A0D0D0A, body, 16);
+
+    for (size_t i = 0; i < interface_count; i++) {
+        // Ethernet, no snapshot limit, then the options and opt_endofopt
+        const uint16_t link_type[2] = { 1, 0 };
+        const uint32_t snaplen = 0;
+        uint32_t length = 8;
+        memcpy(body, link_type, 4);
+        memcpy(body + 4, &snaplen, 4);
+        if (interfaces[i].tsresol != 0) {
+            const uint16_t option[2] = { 9, 1 };
+            memcpy(body + length, option, 4);
+            memset(body + length + 4, 0, 4);
+            body[length + 4] = interfaces[i].tsresol;
+            length += 8;
+        }
+        if (interfaces[i].tsoffset != 0) {
+            const uint16_t option[2] = { 14, 8 };
+            memcpy(body + length, option, 4);
+            memcpy(body + length + 4, &interfaces[i].tsoffset, 8);
+            length += 12;
+        }
+        memset(body + length, 0, 4);
+        write_block(file, 0x00000001, body, length + 4);
+    }
+
+    for (size_t i = 0; i < packet_count; i++) {
+        const uint32_t fields[5] = {
+            packets[i].interface_id,
+            (uint32_t)(packets[i].timestamp >> 32),
+            (uint32_t)packets[i].timestamp,
+            60, 60,
+        };
+        memcpy(body, fields, sizeof(fields));
+        uint8_t* frame = body + sizeof(fields);
+        memset(frame, 0, 60);
+        memset(frame, 0xFF, 6);
+        frame[12] = 0x88;
+        frame[13] = 0xF7;
+        frame[15] = 0x02;
+        write_block(file, 0x00000006, body, sizeof(fields) + 60);
+    }
+
+    if (fclose(file) != 0) {
+        perror("Error writing pcapng capture");
+        failures++;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Each packet of a pcapng capture decodes to its expected capture time: a window of that
+ * single nanosecond holds it, mapped and through stdio, and a full pass leaves the last
+ * one's time in the context.
+ */
+static void check_pcapng_times(const char* name, const test_interface_t* interfaces, size_t interface_count,
+                               const test_epb_t* packets, size_t packet_count) {
+    char path[512];
+    if (write_pcapng(name, interfaces, interface_count, packets, packet_count, path, sizeof(path)) != 0) {
+        return;
+    }
+    test_run_t run;
+    if (run_parser(&run, path, 0, 0) != 0) {
+        return;
+    }
+    CHECK_EQ(run.stats.packets, packet_count);
+    CHECK_EQ(run.ctx.packet_ts_ns, packets[packet_count - 1].ts_ns);
+    run_free(&run);
+    for (size_t i = 0; i < packet_count; i++) {
+        CHECK_EQ(count_window(path, packets[i].ts_ns, packets[i].ts_ns, 0, 0), 1);
+        CHECK_EQ(count_window(path, packets[i].ts_ns, packets[i].ts_ns, 0, 1), 1);
+        CHECK_EQ(count_window(path, packets[i].ts_ns + 1, packets[i].ts_ns + 1, 0, 0), 0);
+    }
+}
+
+#define PCAPNG_BASE_SECONDS 1700000000LL
+#define PCAPNG_NS(seconds, ns) ((PCAPNG_BASE_SECONDS + (seconds)) * 1000000000LL + (ns))
+
+/* if_tsresol with the high bit set counts in negative powers of 2, rounded to the nanosecond */
+static void test_pcapng_tsresol_binary(void) {
+    const test_interface_t interfaces[] = { { 0x80 | 20, 0 } };
+    const test_epb_t packets[] = {
+        { 0, ((uint64_t)PCAPNG_BASE_SECONDS << 20) + 1, PCAPNG_NS(0, 954) },
+        { 0, ((uint64_t)PCAPNG_BASE_SECONDS << 20) + (1 << 19), PCAPNG_NS(0, 500000000) },
+        { 0, ((uint64_t)(PCAPNG_BASE_SECONDS + 1) << 20) + 1048575, PCAPNG_NS(1, 999999046) },
+    };
+    check_pcapng_times("tsresol_binary.pcapng", interfaces, 1, packets, 3);
+}
+
+/* if_tsresol of 3 counts milliseconds */
+static void test_pcapng_tsresol_milli(void) {
+    const test_interface_t interfaces[] = { { 3, 0 } };
+    const test_epb_t packets[] = {
+        { 0, (uint64_t)PCAPNG_BASE_SECONDS * 1000 + 123, PCAPNG_NS(0, 123000000) },
+        { 0, (uint64_t)(PCAPNG_BASE_SECONDS + 2) * 1000 + 999, PCAPNG_NS(2, 999000000) },
+    };
+    check_pcapng_times("tsresol_milli.pcapng", interfaces, 1, packets, 2);
+}
+
+/* if_tsoffset adds whole seconds, either way, to timestamps in the interface's units */
+static void test_pcapng_tsoffset(void) {
+    const test_interface_t interfaces[] = {
+        { 0, PCAPNG_BASE_SECONDS },
+        { 6, -1000 },
+    };
+    const test_epb_t packets[] = {
+        { 0, 250000, PCAPNG_NS(0, 250000000) },
+        { 1, (uint64_t)(PCAPNG_BASE_SECONDS + 1001) * 1000000 + 7, PCAPNG_NS(1, 7000) },
+        { 0, 3000001, PCAPNG_NS(3, 1000) },
+    };
+    check_pcapng_times("tsoffset.pcapng", interfaces, 2, packets, 3);
+}
+
+/* Each packet block is converted with the resolution of the interface it names */
+static void test_pcapng_two_interfaces(void) {
+    const test_interface_t interfaces[] = {
+        { 9, 0 },
+        { 0x80 | 10, 0 },
+    };
+    const test_epb_t packets[] = {
+        { 0, (uint64_t)PCAPNG_BASE_SECONDS * 1000000000 + 7, PCAPNG_NS(0, 7) },
+        { 1, ((uint64_t)(PCAPNG_BASE_SECONDS + 1) << 10) + 512, PCAPNG_NS(1, 500000000) },
+        { 0, (uint64_t)(PCAPNG_BASE_SECONDS + 2) * 1000000000 + 999999999, PCAPNG_NS(2, 999999999) },
+        { 1, ((uint64_t)(PCAPNG_BASE_SECONDS + 3) << 10) + 1, PCAPNG_NS(3, 976563) },
+    };
+    check_pcapng_times("two_interfaces.pcapng", interfaces, 2, packets, 4);
+}
+
+typedef struct {
+    const char* name;
+    void (*run)(void);
+} test_case_t;
+
+static const test_case_t tests[] = {
+    { "generator_packet_count", test_generator_packet_count },
+    { "wire_lengths", test_wire_lengths },
+    { "modes_agree", test_modes_agree },
+    { "multi_port_cycles", test_multi_port_cycles },
+    { "pdelay_links_per_port", test_pdelay_links_per_port },
+    { "index_window", test_index_window },
+    { "index_rebuilt", test_index_rebuilt },
+    { "pcapng_tsresol_binary", test_pcapng_tsresol_binary },
+    { "pcapng_tsresol_milli", test_pcapng_tsresol_milli },
+    { "pcapng_tsoffset", test_pcapng_tsoffset },
+    { "pcapng_two_interfaces", test_pcapng_two_interfaces },
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s GENERATOR SCRATCH_DIR\n", argv[0]);
+        return 1;
+    }
+    generator_path = argv[1];
+    scratch_dir = argv[2];
+
+    int failed_tests = 0;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = failures;
+        tests[i].run();
+        fprintf(stderr, "%-28s %s\n", tests[i].name, failures == before ? "ok" : "FAILED");
+        failed_tests += failures != before;
+    }
+    fprintf(stderr, "%d of %zu tests failed\n", failed_tests, sizeof(tests) / sizeof(tests[0]));
+    return failed_tests == 0 ? 0 : 1;
+}